@@ -16,7 +16,13 @@
  */
 #ifndef NATIVE_AUDIO_ANDROID_DEBUG_H_H
 #define NATIVE_AUDIO_ANDROID_DEBUG_H_H
+#ifdef __ANDROID__
 #include <android/log.h>
+#else
+// host builds (audio_effect_benchmark.cpp): log to stdout
+#include <cstdio>
+#define __android_log_print(prio, tag, ...) (printf(__VA_ARGS__), printf("\n"))
+#endif
 
 #if 1
 
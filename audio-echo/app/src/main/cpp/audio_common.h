@@ -34,7 +34,7 @@
  * Sample Buffer Controls...
  */
 #define RECORD_DEVICE_KICKSTART_BUF_COUNT   2
-#define PLAY_KICKSTART_BUFFER_COUNT         3
+#define PLAY_KICKSTART_BUFFER_COUNT         3   // initial depth, adapted at run time
 #define DEVICE_SHADOW_BUFFER_QUEUE_LEN      4
 #define BUF_COUNT                           16
 
@@ -69,6 +69,7 @@ __inline__ uint64_t GetSystemTicks(void) {
  */
 #define ENGINE_SERVICE_MSG_KICKSTART_PLAYER    1
 #define ENGINE_SERVICE_MSG_RETRIEVE_DUMP_BUFS  2
+#define ENGINE_SERVICE_MSG_RECORDED_AUDIO_AVAILABLE 3
 typedef bool (*ENGINE_CALLBACK)(void* pCTX, uint32_t msg, void* pData);
 
 /*
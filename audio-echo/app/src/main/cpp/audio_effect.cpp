@@ -0,0 +1,361 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cassert>
+#include <cinttypes>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define EFFECT_USE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define EFFECT_USE_SSE2 1
+#endif
+
+#include "android_debug.h"
+#include "audio_convert.h"
+#include "audio_effect.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static __inline__ uint64_t GetMonotonicNanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+static __inline__ float DbToLinear(float db) {
+    return powf(10.0f, db / 20.0f);
+}
+
+/*
+ * SIMD building blocks shared by the effects; the int16 <-> float
+ * conversions come from the shared audio-common library
+ */
+
+/*
+ * multiply samples by a gain linearly ramped from g0 to g1
+ */
+static void ApplyGainRamp(float* samples, uint32_t count, float g0, float g1) {
+    if (!count) return;
+    float step = (g1 - g0) / count;
+    uint32_t i = 0;
+#if defined(EFFECT_USE_NEON)
+    float32x4_t g = { g0, g0 + step, g0 + 2 * step, g0 + 3 * step };
+    float32x4_t vStep = vdupq_n_f32(4 * step);
+    for (; i + 4 <= count; i += 4) {
+        vst1q_f32(samples + i, vmulq_f32(vld1q_f32(samples + i), g));
+        g = vaddq_f32(g, vStep);
+    }
+#elif defined(EFFECT_USE_SSE2)
+    __m128 g = _mm_setr_ps(g0, g0 + step, g0 + 2 * step, g0 + 3 * step);
+    __m128 vStep = _mm_set1_ps(4 * step);
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(samples + i, _mm_mul_ps(_mm_loadu_ps(samples + i), g));
+        g = _mm_add_ps(g, vStep);
+    }
+#endif
+    for (; i < count; i++) {
+        samples[i] *= g0 + step * i;
+    }
+}
+
+static float PeakAbs(const float* samples, uint32_t count) {
+    float peak = 0.0f;
+    uint32_t i = 0;
+#if defined(EFFECT_USE_NEON)
+    float32x4_t vPeak = vdupq_n_f32(0.0f);
+    for (; i + 4 <= count; i += 4) {
+        vPeak = vmaxq_f32(vPeak, vabsq_f32(vld1q_f32(samples + i)));
+    }
+    float lanes[4];
+    vst1q_f32(lanes, vPeak);
+    peak = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#elif defined(EFFECT_USE_SSE2)
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 vPeak = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4) {
+        vPeak = _mm_max_ps(vPeak, _mm_and_ps(_mm_loadu_ps(samples + i), absMask));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, vPeak);
+    peak = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#endif
+    for (; i < count; i++) {
+        peak = std::max(peak, fabsf(samples[i]));
+    }
+    return peak;
+}
+
+/*
+ * DelayEffect: echo with feedback
+ *    out     = in + mix * line[n - delay]
+ *    line[n] = in + feedback * line[n - delay]
+ */
+DelayEffect::DelayEffect(uint32_t sampleRate, uint32_t maxDelayMs) :
+        sampleRate_(sampleRate), writeIdx_(0) {
+    lineSize_ = static_cast<uint32_t>(
+            (static_cast<uint64_t>(sampleRate) * maxDelayMs) / 1000) + 1;
+    line_ = new float[lineSize_];
+    memset(line_, 0, sizeof(float) * lineSize_);
+    delayFrames_.store(lineSize_ - 1);
+    feedback_.store(0.0f);
+    mix_.store(0.0f);
+}
+
+DelayEffect::~DelayEffect() {
+    delete [] line_;
+}
+
+void DelayEffect::SetDelay(uint32_t delayMs) {
+    uint32_t frames = static_cast<uint32_t>(
+            (static_cast<uint64_t>(sampleRate_) * delayMs) / 1000);
+    delayFrames_.store(std::min(std::max(frames, 1U), lineSize_ - 1));
+}
+
+void DelayEffect::SetFeedback(float feedback) {
+    feedback_.store(std::min(std::max(feedback, 0.0f), 0.95f));
+}
+
+void DelayEffect::SetMix(float mix) {
+    mix_.store(std::min(std::max(mix, 0.0f), 1.0f));
+}
+
+void DelayEffect::Process(float* samples, uint32_t count) {
+    const uint32_t delay = delayFrames_.load(std::memory_order_relaxed);
+    const float fb  = feedback_.load(std::memory_order_relaxed);
+    const float mix = mix_.load(std::memory_order_relaxed);
+
+    // Walk the block in spans where neither the read nor the write index
+    // wraps and the span is no longer than the delay itself: inside such a
+    // span nothing written is read back, so there is no loop carried
+    // dependency and the loop vectorizes. The read span can still run into
+    // the write span from above (delays over half the line, read index
+    // wrapped), so the two are not restrict: the compiler checks at run time.
+    uint32_t done = 0;
+    while (done < count) {
+        uint32_t readIdx = (writeIdx_ + lineSize_ - delay) % lineSize_;
+        uint32_t span = count - done;
+        span = std::min(span, delay);
+        span = std::min(span, lineSize_ - writeIdx_);
+        span = std::min(span, lineSize_ - readIdx);
+
+        float* __restrict__ in  = samples + done;
+        float* wr = line_ + writeIdx_;
+        const float* rd = line_ + readIdx;
+        for (uint32_t i = 0; i < span; i++) {
+            float delayed = rd[i];
+            wr[i] = in[i] + fb * delayed;
+            in[i] = in[i] + mix * delayed;
+        }
+        writeIdx_ = (writeIdx_ + span) % lineSize_;
+        done += span;
+    }
+}
+
+/*
+ * GainEffect
+ */
+GainEffect::GainEffect() : curGain_(1.0f) {
+    targetGain_.store(1.0f);
+}
+
+void GainEffect::SetGain(float gainDb) {
+    targetGain_.store(DbToLinear(gainDb));
+}
+
+void GainEffect::Process(float* samples, uint32_t count) {
+    float target = targetGain_.load(std::memory_order_relaxed);
+    ApplyGainRamp(samples, count, curGain_, target);
+    curGain_ = target;
+}
+
+/*
+ * BiquadEffect
+ */
+BiquadEffect::BiquadEffect(uint32_t sampleRate) :
+        sampleRate_(sampleRate), appliedVersion_(0),
+        b0_(1.0f), b1_(0.0f), b2_(0.0f), a1_(0.0f), a2_(0.0f),
+        z1_(0.0f), z2_(0.0f) {
+    freq_.store(1000.0f);
+    q_.store(0.707f);
+    gainDb_.store(0.0f);
+    version_.store(0);
+}
+
+void BiquadEffect::SetPeaking(float freqHz, float q, float gainDb) {
+    freq_.store(std::min(std::max(freqHz, 20.0f), sampleRate_ * 0.45f));
+    q_.store(std::max(q, 0.1f));
+    gainDb_.store(gainDb);
+    version_.fetch_add(1, std::memory_order_release);
+}
+
+void BiquadEffect::UpdateCoefficients(void) {
+    float A     = powf(10.0f, gainDb_.load() / 40.0f);
+    float w0    = static_cast<float>(2.0 * M_PI) * freq_.load() / sampleRate_;
+    float alpha = sinf(w0) / (2.0f * q_.load());
+    float cosw0 = cosf(w0);
+    float a0    = 1.0f + alpha / A;
+
+    b0_ = (1.0f + alpha * A) / a0;
+    b1_ = (-2.0f * cosw0) / a0;
+    b2_ = (1.0f - alpha * A) / a0;
+    a1_ = (-2.0f * cosw0) / a0;
+    a2_ = (1.0f - alpha / A) / a0;
+}
+
+void BiquadEffect::Process(float* samples, uint32_t count) {
+    uint32_t version = version_.load(std::memory_order_acquire);
+    if (version != appliedVersion_) {
+        UpdateCoefficients();
+        appliedVersion_ = version;
+    }
+
+    // the recursion is inherently serial; keep the state in registers
+    float z1 = z1_, z2 = z2_;
+    for (uint32_t i = 0; i < count; i++) {
+        float x = samples[i];
+        float y = b0_ * x + z1;
+        z1 = b1_ * x - a1_ * y + z2;
+        z2 = b2_ * x - a2_ * y;
+        samples[i] = y;
+    }
+    z1_ = z1;
+    z2_ = z2;
+}
+
+/*
+ * LimiterEffect
+ */
+LimiterEffect::LimiterEffect(uint32_t sampleRate, uint32_t framesPerBuf) :
+        curGain_(1.0f) {
+    // ~50 ms release time
+    float blocksPerRelease = 0.05f * sampleRate / std::max(framesPerBuf, 1U);
+    release_ = expf(-1.0f / std::max(blocksPerRelease, 1.0f));
+    threshold_.store(DbToLinear(-1.0f));
+}
+
+void LimiterEffect::SetThreshold(float thresholdDb) {
+    threshold_.store(DbToLinear(std::min(thresholdDb, 0.0f)));
+}
+
+void LimiterEffect::Process(float* samples, uint32_t count) {
+    float threshold = threshold_.load(std::memory_order_relaxed);
+    float peak = PeakAbs(samples, count);
+    float target = (peak > threshold) ? threshold / peak : 1.0f;
+
+    if (target < curGain_) {
+        // instant attack: the whole block stays under the threshold
+        ApplyGainRamp(samples, count, target, target);
+        curGain_ = target;
+        return;
+    }
+    // release towards target; every gain in the ramp is <= target
+    float newGain = target + (curGain_ - target) * release_;
+    if (curGain_ < 1.0f || newGain < 1.0f) {
+        ApplyGainRamp(samples, count, curGain_, newGain);
+    }
+    curGain_ = newGain;
+}
+
+/*
+ * EffectChain
+ */
+EffectChain::EffectChain(uint32_t sampleRate, uint32_t framesPerBuf) :
+        maxFrames_(framesPerBuf),
+        delay_(sampleRate, 1000),
+        gain_(),
+        eq_(sampleRate),
+        limiter_(sampleRate, framesPerBuf) {
+    assert(framesPerBuf);
+    scratch_ = new float[maxFrames_];
+    bypass_.store(true);
+
+    effects_[0] = &delay_;
+    effects_[1] = &gain_;
+    effects_[2] = &eq_;
+    effects_[3] = &limiter_;
+    ResetStats();
+}
+
+EffectChain::~EffectChain() {
+    delete [] scratch_;
+}
+
+void EffectChain::Accumulate(uint32_t idx, uint64_t ns, uint32_t frames) {
+    // single writer (the audio thread): relaxed is enough
+    nanoSeconds_[idx].store(nanoSeconds_[idx].load(std::memory_order_relaxed)
+                            + ns, std::memory_order_relaxed);
+    frames_[idx].store(frames_[idx].load(std::memory_order_relaxed)
+                       + frames, std::memory_order_relaxed);
+}
+
+void EffectChain::Process(int16_t* pcm, uint32_t frames) {
+    if (bypass_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    while (frames) {
+        uint32_t count = std::min(frames, maxFrames_);
+        uint64_t chainStart = GetMonotonicNanos();
+        uint64_t start = chainStart;
+
+        convertI16ToFloat(pcm, scratch_, count);
+        for (uint32_t idx = 0; idx < EFFECT_COUNT; idx++) {
+            effects_[idx]->Process(scratch_, count);
+            uint64_t now = GetMonotonicNanos();
+            Accumulate(idx, now - start, count);
+            start = now;
+        }
+        convertFloatToI16(scratch_, pcm, count);
+        Accumulate(EFFECT_COUNT, GetMonotonicNanos() - chainStart, count);
+
+        pcm += count;
+        frames -= count;
+    }
+}
+
+void EffectChain::GetStats(EffectStats* stats, uint32_t count) {
+    count = std::min(count, static_cast<uint32_t>(EFFECT_COUNT + 1));
+    for (uint32_t idx = 0; idx < count; idx++) {
+        stats[idx].name_ = (idx < EFFECT_COUNT) ? effects_[idx]->Name() : "chain";
+        stats[idx].nanoSeconds_ = nanoSeconds_[idx].load();
+        stats[idx].frames_ = frames_[idx].load();
+    }
+}
+
+void EffectChain::ResetStats(void) {
+    for (uint32_t idx = 0; idx <= EFFECT_COUNT; idx++) {
+        nanoSeconds_[idx].store(0);
+        frames_[idx].store(0);
+    }
+}
+
+void EffectChain::LogStats(void) {
+    EffectStats stats[EFFECT_COUNT + 1];
+    GetStats(stats, EFFECT_COUNT + 1);
+    for (uint32_t idx = 0; idx <= EFFECT_COUNT; idx++) {
+        if (!stats[idx].frames_) continue;
+        LOGI("EffectChain %-8s: %.2f ns/frame over %" PRIu64 " frames",
+             stats[idx].name_,
+             static_cast<double>(stats[idx].nanoSeconds_) / stats[idx].frames_,
+             stats[idx].frames_);
+    }
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NATIVE_AUDIO_AUDIO_EFFECT_H
+#define NATIVE_AUDIO_AUDIO_EFFECT_H
+#include <sys/types.h>
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Block based effect chain running on the recorded mono audio, in place:
+ *     int16 --> [delay] --> [gain] --> [eq] --> [limiter] --> int16
+ * All memory is allocated when the chain is created; Process() never
+ * allocates or locks, so it is safe to call from the OpenSL callbacks.
+ * Parameters could be changed from any thread: they are plain atomics
+ * picked up by the audio thread at the start of the next block.
+ * A new chain is bypassed, and its effects are neutral (no echo, unity
+ * gain, flat eq) until configured.
+ */
+class AudioEffect {
+public:
+    virtual ~AudioEffect() {}
+    virtual void Process(float* samples, uint32_t count) = 0;
+    virtual const char* Name(void) const = 0;
+};
+
+class DelayEffect : public AudioEffect {
+public:
+    DelayEffect(uint32_t sampleRate, uint32_t maxDelayMs);
+    ~DelayEffect();
+    void SetDelay(uint32_t delayMs);
+    void SetFeedback(float feedback);   // 0.0f .. 0.95f
+    void SetMix(float mix);             // 0.0f(dry) .. 1.0f(wet)
+    void Process(float* samples, uint32_t count) override;
+    const char* Name(void) const override { return "delay"; }
+private:
+    uint32_t  sampleRate_;
+    float    *line_;
+    uint32_t  lineSize_;
+    uint32_t  writeIdx_;
+    std::atomic<uint32_t> delayFrames_;
+    std::atomic<float>    feedback_;
+    std::atomic<float>    mix_;
+};
+
+class GainEffect : public AudioEffect {
+public:
+    GainEffect();
+    void SetGain(float gainDb);
+    void Process(float* samples, uint32_t count) override;
+    const char* Name(void) const override { return "gain"; }
+private:
+    std::atomic<float> targetGain_;
+    float              curGain_;       // ramped towards target_ per block
+};
+
+/*
+ * Peaking EQ biquad (RBJ audio-eq-cookbook), transposed direct form II
+ */
+class BiquadEffect : public AudioEffect {
+public:
+    explicit BiquadEffect(uint32_t sampleRate);
+    void SetPeaking(float freqHz, float q, float gainDb);
+    void Process(float* samples, uint32_t count) override;
+    const char* Name(void) const override { return "biquad"; }
+private:
+    void UpdateCoefficients(void);
+
+    uint32_t sampleRate_;
+    std::atomic<float>    freq_;
+    std::atomic<float>    q_;
+    std::atomic<float>    gainDb_;
+    std::atomic<uint32_t> version_;     // bumped by SetPeaking()
+    uint32_t              appliedVersion_;
+    float b0_, b1_, b2_, a1_, a2_;
+    float z1_, z2_;
+};
+
+/*
+ * Block peak limiter: gain reduction is computed from the block peak
+ * and linearly ramped across the block, with a one pole release.
+ */
+class LimiterEffect : public AudioEffect {
+public:
+    LimiterEffect(uint32_t sampleRate, uint32_t framesPerBuf);
+    void SetThreshold(float thresholdDb);
+    void Process(float* samples, uint32_t count) override;
+    const char* Name(void) const override { return "limiter"; }
+private:
+    std::atomic<float> threshold_;
+    float              release_;       // per block release coefficient
+    float              curGain_;
+};
+
+#define EFFECT_COUNT 4
+struct EffectStats {
+    const char *name_;
+    uint64_t    nanoSeconds_;         // accumulated processing time
+    uint64_t    frames_;              // accumulated frames processed
+};
+
+class EffectChain {
+public:
+    EffectChain(uint32_t sampleRate, uint32_t framesPerBuf);
+    ~EffectChain();
+
+    // in place processing of one int16 PCM buffer
+    void Process(int16_t* pcm, uint32_t frames);
+    void SetBypass(bool bypass) { bypass_.store(bypass); }
+
+    DelayEffect*   Delay(void)   { return &delay_; }
+    GainEffect*    Gain(void)    { return &gain_; }
+    BiquadEffect*  Equalizer(void) { return &eq_; }
+    LimiterEffect* Limiter(void) { return &limiter_; }
+
+    // stats[0..EFFECT_COUNT-1] per effect, stats[EFFECT_COUNT] whole chain
+    void GetStats(EffectStats* stats, uint32_t count);
+    void ResetStats(void);
+    void LogStats(void);
+private:
+    void Accumulate(uint32_t idx, uint64_t ns, uint32_t frames);
+
+    uint32_t   maxFrames_;
+    float     *scratch_;              // int16 <--> float staging, owner
+    std::atomic<bool> bypass_;
+
+    DelayEffect    delay_;
+    GainEffect     gain_;
+    BiquadEffect   eq_;
+    LimiterEffect  limiter_;
+    AudioEffect   *effects_[EFFECT_COUNT];
+
+    std::atomic<uint64_t> nanoSeconds_[EFFECT_COUNT + 1];
+    std::atomic<uint64_t> frames_[EFFECT_COUNT + 1];
+};
+
+#endif //NATIVE_AUDIO_AUDIO_EFFECT_H
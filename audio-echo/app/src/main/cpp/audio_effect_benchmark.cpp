@@ -0,0 +1,124 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Cost of the echo effect chain: ns/frame of every effect run on its own,
+ * and of the whole chain (int16 conversions included) as the recorder
+ * callback runs it, at a few callback sizes. No Android dependency, runs
+ * on the host:
+ *   gcc -std=c99 -O2 -c ../../../../../common/audio/audio_convert.c
+ *   g++ -std=c++11 -O2 -DAUDIO_EFFECT_HOST_BENCHMARK -I../../../../../common/audio \
+ *       audio_effect.cpp audio_effect_benchmark.cpp audio_convert.o
+ */
+
+#ifdef AUDIO_EFFECT_HOST_BENCHMARK
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <vector>
+
+#include "audio_effect.h"
+
+static const uint32_t kSampleRate = 48000;
+static const uint32_t kFrames = kSampleRate * 20;    // 20 s of audio per run
+
+static uint64_t NowNanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+// loud enough for the limiter to work
+static void FillTone(int16_t* pcm, float* samples, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        float v = 0.9f * sinf(2.0f * 3.14159265f * 440.0f * i / kSampleRate);
+        samples[i] = v;
+        pcm[i] = static_cast<int16_t>(v * 32767.0f);
+    }
+}
+
+static void Configure(EffectChain* chain) {
+    chain->Delay()->SetDelay(250);
+    chain->Delay()->SetFeedback(0.3f);
+    chain->Delay()->SetMix(0.5f);
+    chain->Gain()->SetGain(6.0f);
+    chain->Equalizer()->SetPeaking(1000.0f, 0.707f, 3.0f);
+    chain->Limiter()->SetThreshold(-1.0f);
+    chain->SetBypass(false);
+}
+
+static double TimeEffect(AudioEffect* effect, const float* input,
+                         float* block, uint32_t framesPerBuf) {
+    uint64_t ns = 0;
+    for (uint32_t done = 0; done < kFrames; done += framesPerBuf) {
+        std::copy(input, input + framesPerBuf, block);
+        uint64_t start = NowNanos();
+        effect->Process(block, framesPerBuf);
+        ns += NowNanos() - start;
+    }
+    return static_cast<double>(ns) / kFrames;
+}
+
+static void Run(uint32_t framesPerBuf) {
+    std::vector<int16_t> pcm(framesPerBuf), block(framesPerBuf);
+    std::vector<float> input(framesPerBuf), samples(framesPerBuf);
+    FillTone(pcm.data(), input.data(), framesPerBuf);
+
+    // every node on its own, configured as in Configure()
+    EffectChain nodes(kSampleRate, framesPerBuf);
+    Configure(&nodes);
+    AudioEffect* effects[EFFECT_COUNT] = {nodes.Delay(), nodes.Gain(),
+                                          nodes.Equalizer(), nodes.Limiter()};
+    for (uint32_t idx = 0; idx < EFFECT_COUNT; idx++) {
+        printf("  %-8s %6.2f ns/frame\n", effects[idx]->Name(),
+               TimeEffect(effects[idx], input.data(), samples.data(),
+                          framesPerBuf));
+    }
+
+    // the chain, as the recorder callback runs it
+    EffectChain chain(kSampleRate, framesPerBuf);
+    Configure(&chain);
+    uint64_t ns = 0;
+    for (uint32_t done = 0; done < kFrames; done += framesPerBuf) {
+        std::copy(pcm.begin(), pcm.end(), block.begin());
+        uint64_t start = NowNanos();
+        chain.Process(block.data(), framesPerBuf);
+        ns += NowNanos() - start;
+    }
+    printf("  %-8s %6.2f ns/frame\n", "chain", static_cast<double>(ns) / kFrames);
+
+    // and what the chain's own per node stats report for the same run
+    EffectStats stats[EFFECT_COUNT + 1];
+    chain.GetStats(stats, EFFECT_COUNT + 1);
+    printf("  stats   ");
+    for (uint32_t idx = 0; idx <= EFFECT_COUNT; idx++) {
+        printf(" %s %.2f", stats[idx].name_,
+               static_cast<double>(stats[idx].nanoSeconds_) / stats[idx].frames_);
+    }
+    printf(" ns/frame\n");
+}
+
+int main() {
+    const uint32_t bufSizes[] = {96, 192, 240, 480};
+    for (uint32_t framesPerBuf : bufSizes) {
+        printf("%u frames per buffer, %u Hz\n", framesPerBuf, kSampleRate);
+        Run(framesPerBuf);
+    }
+    return 0;
+}
+#endif  // AUDIO_EFFECT_HOST_BENCHMARK
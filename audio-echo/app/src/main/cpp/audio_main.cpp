@@ -14,13 +14,16 @@
  * limitations under the License.
  */
 #include <cassert>
+#include <cstdio>
 #include <cstring>
+#include <algorithm>
 #include <jni.h>
 
 #include <sys/types.h>
 #include <SLES/OpenSLES.h>
 
 #include "audio_common.h"
+#include "audio_effect.h"
 #include "audio_recorder.h"
 #include "audio_player.h"
 
@@ -37,10 +40,13 @@ struct EchoAudioEngine {
     AudioPlayer    *player_;
     AudioQueue     *freeBufQueue_;    //Owner of the queue
     AudioQueue     *recBufQueue_;     //Owner of the queue
+    EffectChain    *effects_;         //Owner of the effect chain
 
     sample_buf  *bufs_;
     uint32_t     bufCount_;
     uint32_t     frameCount_;
+
+    JitterStats  playStats_;          // snapshot from the last echo session
 };
 static EchoAudioEngine engine;
 
@@ -64,6 +70,11 @@ JNIEXPORT void JNICALL
         Java_com_google_sample_echo_MainActivity_startPlay(JNIEnv *env, jclass type);
 JNIEXPORT void JNICALL
         Java_com_google_sample_echo_MainActivity_stopPlay(JNIEnv *env, jclass type);
+JNIEXPORT jstring JNICALL
+        Java_com_google_sample_echo_MainActivity_getPlaybackStats(JNIEnv *env, jclass type);
+JNIEXPORT void JNICALL
+        Java_com_google_sample_echo_MainActivity_configureEcho(JNIEnv *env, jclass type,
+                                                               jint, jfloat, jfloat);
 }
 
 JNIEXPORT void JNICALL
@@ -105,6 +116,13 @@ Java_com_google_sample_echo_MainActivity_createSLEngine(
     for(uint32_t i=0; i<engine.bufCount_; i++) {
         engine.freeBufQueue_->push(&engine.bufs_[i]);
     }
+
+    // all effect memory is allocated here, audio callbacks never allocate;
+    // the chain starts bypassed until the app turns the echo on
+    assert(engine.sampleChannels_ == 1 &&
+           engine.bitsPerSample_ == SL_PCMSAMPLEFORMAT_FIXED_16);
+    engine.effects_ = new EffectChain(static_cast<uint32_t>(sampleRate),
+                                      engine.fastPathFramesPerBuf_);
 }
 
 JNIEXPORT jboolean JNICALL
@@ -168,6 +186,7 @@ JNIEXPORT void JNICALL
 Java_com_google_sample_echo_MainActivity_startPlay(JNIEnv *env, jclass type) {
 
     engine.frameCount_  = 0;
+    engine.effects_->ResetStats();
     /*
      * start player: make it into waitForData state
      */
@@ -182,6 +201,8 @@ JNIEXPORT void JNICALL
 Java_com_google_sample_echo_MainActivity_stopPlay(JNIEnv *env, jclass type) {
     engine.recorder_->Stop();
     engine.player_ ->Stop();
+    engine.effects_->LogStats();
+    engine.player_->GetJitterStats(&engine.playStats_);
 
     delete engine.recorder_;
     delete engine.player_;
@@ -189,8 +210,45 @@ Java_com_google_sample_echo_MainActivity_stopPlay(JNIEnv *env, jclass type) {
     engine.player_ = NULL;
 }
 
+JNIEXPORT jstring JNICALL
+Java_com_google_sample_echo_MainActivity_getPlaybackStats(JNIEnv *env, jclass type) {
+    JitterStats stats = engine.playStats_;
+    if (engine.player_) {
+        engine.player_->GetJitterStats(&stats);
+    }
+    char msg[256];
+    snprintf(msg, sizeof(msg),
+             "kickstartBuffers    = %u\n"
+             "callbackJitter      = %.2f ms\n"
+             "steadyLatency       = %.2f ms\n"
+             "underruns           = %u (%.2f per min)\n",
+             stats.kickstartDepth_, stats.jitterMs_, stats.latencyMs_,
+             stats.underruns_, stats.underrunsPerMinute_);
+    LOGI("%s", msg);
+    return env->NewStringUTF(msg);
+}
+
+/*
+ * Echo on the recorded audio: a mix of 0 turns the whole effect chain
+ * back into bypass. Safe to call while playing.
+ */
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_configureEcho(JNIEnv *env, jclass type,
+                                                       jint delayMs, jfloat feedback,
+                                                       jfloat mix) {
+    if (!engine.effects_) {
+        return;
+    }
+    engine.effects_->Delay()->SetDelay(static_cast<uint32_t>(std::max(delayMs, 0)));
+    engine.effects_->Delay()->SetFeedback(feedback);
+    engine.effects_->Delay()->SetMix(mix);
+    engine.effects_->SetBypass(mix <= 0.0f);
+}
+
 JNIEXPORT void JNICALL
 Java_com_google_sample_echo_MainActivity_deleteSLEngine(JNIEnv *env, jclass type) {
+    delete engine.effects_;
+    engine.effects_ = nullptr;
     delete engine.recBufQueue_;
     delete engine.freeBufQueue_;
     releaseSampleBufs(engine.bufs_, engine.bufCount_);
@@ -229,6 +287,12 @@ bool EngineService(void* ctx, uint32_t msg, void* data ) {
         case ENGINE_SERVICE_MSG_RETRIEVE_DUMP_BUFS:
             *(static_cast<uint32_t*>(data)) = dbgEngineGetBufCount();
             break;
+        case ENGINE_SERVICE_MSG_RECORDED_AUDIO_AVAILABLE: {
+            sample_buf *buf = static_cast<sample_buf*>(data);
+            engine.effects_->Process(reinterpret_cast<int16_t*>(buf->buf_),
+                                     buf->size_ / sizeof(int16_t));
+            break;
+        }
         default:
             assert(false);
             return false;
@@ -13,6 +13,7 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <algorithm>
 #include <cstdlib>
 #include "audio_player.h"
 
@@ -30,6 +31,22 @@
 void bqPlayerCallback(SLAndroidSimpleBufferQueueItf bq, void *ctx) {
     (static_cast<AudioPlayer *>(ctx))->ProcessSLCallback(bq);
 }
+/*
+ * A recorded buffer is quiet enough to be skipped when all of its 16 bit
+ * samples stay below SHRINK_QUIET_PEAK (about -42 dBFS)
+ */
+#define SHRINK_QUIET_PEAK  256
+static bool IsQuietBuf(const sample_buf *buf) {
+    const int16_t *samples = reinterpret_cast<const int16_t *>(buf->buf_);
+    uint32_t count = buf->size_ / sizeof(int16_t);
+    for (uint32_t idx = 0; idx < count; idx++) {
+        if (samples[idx] >= SHRINK_QUIET_PEAK || samples[idx] <= -SHRINK_QUIET_PEAK) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void AudioPlayer::ProcessSLCallback(SLAndroidSimpleBufferQueueItf bq) {
 #ifdef ENABLE_LOG
     logFile_->logTime();
@@ -52,15 +69,31 @@ void AudioPlayer::ProcessSLCallback(SLAndroidSimpleBufferQueueItf bq) {
         return;
     }
     devShadowQueue_->pop();
+    jitterBuf_->OnCallback(GetSystemTicks(),
+                           playQueue_->size() + devShadowQueue_->size());
 
     if( buf != &silentBuf_) {
         buf->size_ = 0;
         freeQueue_->push(buf);
 
+        if (jitterBuf_->ShrinkPending() && playQueue_->size() > 1 &&
+            playQueue_->front(&buf) && IsQuietBuf(buf)) {
+            // jitter is low enough: skip one buffer of near silence to cut
+            // the latency; the shrink waits for a pause, recorded sound is kept
+            playQueue_->pop();
+            buf->size_ = 0;
+            freeQueue_->push(buf);
+            jitterBuf_->OnShrink();
+        }
+
         if (!playQueue_->front(&buf)) {
 #ifdef ENABLE_LOG
           logFile->log("%s", "====Warning: running out of the Audio buffers")
 #endif
+          // underrun: keep the device busy with silence and refill deeper
+          jitterBuf_->OnUnderrun();
+          (*bq)->Enqueue(bq, silentBuf_.buf_, silentBuf_.size_);
+          devShadowQueue_->push(&silentBuf_);
           return;
         }
 
@@ -70,21 +103,23 @@ void AudioPlayer::ProcessSLCallback(SLAndroidSimpleBufferQueueItf bq) {
       return;
     }
 
-    if (playQueue_->size() < PLAY_KICKSTART_BUFFER_COUNT) {
+    uint32_t depth = jitterBuf_->KickstartDepth();
+    if (playQueue_->size() < depth) {
         (*bq)->Enqueue(bq, buf->buf_, buf->size_);
         devShadowQueue_->push(&silentBuf_);
         return;
     }
 
-    assert(PLAY_KICKSTART_BUFFER_COUNT <=
-           (DEVICE_SHADOW_BUFFER_QUEUE_LEN - devShadowQueue_->size()));
-    for (int32_t idx = 0; idx < PLAY_KICKSTART_BUFFER_COUNT; idx++) {
+    // hand over as many as device queue takes, the rest stays in playQueue_
+    uint32_t kickCount = std::min(depth,
+                         DEVICE_SHADOW_BUFFER_QUEUE_LEN - devShadowQueue_->size());
+    for (uint32_t idx = 0; idx < kickCount; idx++) {
         playQueue_->front(&buf);
         playQueue_->pop();
         devShadowQueue_->push(buf);
         (*bq)->Enqueue(bq, buf->buf_, buf->size_);
     }
-
+    jitterBuf_->OnKickstart();
 }
 
 AudioPlayer::AudioPlayer(SampleFormat *sampleFormat, SLEngineItf slEngine) :
@@ -155,6 +190,10 @@ AudioPlayer::AudioPlayer(SampleFormat *sampleFormat, SLEngineItf slEngine) :
     memset(silentBuf_.buf_, 0, silentBuf_.cap_);
     silentBuf_.size_ = silentBuf_.cap_;
 
+    jitterBuf_ = new AdaptiveJitterBuffer(sampleInfo_.sampleRate_ / 1000,
+                                          sampleInfo_.framesPerBuf_,
+                                          PLAY_KICKSTART_BUFFER_COUNT);
+
 #ifdef  ENABLE_LOG
     std::string name = "play";
     logFile_ = new AndroidLog(name);
@@ -190,6 +229,7 @@ AudioPlayer::~AudioPlayer() {
     }
 
     delete [] silentBuf_.buf_;
+    delete jitterBuf_;
 }
 
 void AudioPlayer::SetBufQueue(AudioQueue *playQ, AudioQueue *freeQ) {
@@ -210,6 +250,7 @@ SLresult AudioPlayer::Start(void) {
     result = (*playItf_)->SetPlayState(playItf_, SL_PLAYSTATE_STOPPED);
     SLASSERT(result);
 
+    jitterBuf_->Reset();
     result = (*playBufferQueueItf_)->Enqueue(playBufferQueueItf_,
                                              silentBuf_.buf_,
                                              silentBuf_.size_);
@@ -251,4 +292,8 @@ void AudioPlayer::RegisterCallback(ENGINE_CALLBACK cb, void *ctx) {
 
 uint32_t  AudioPlayer::dbgGetDevBufCount(void) {
     return (devShadowQueue_->size());
-}
\ No newline at end of file
+}
+
+void AudioPlayer::GetJitterStats(JitterStats *stats) {
+    jitterBuf_->GetStats(stats);
+}
@@ -20,6 +20,7 @@
 #include "audio_common.h"
 #include "buf_manager.h"
 #include "debug_utils.h"
+#include "jitter_buffer.h"
 
 class AudioPlayer {
     // buffer queue player interfaces
@@ -36,6 +37,7 @@ class AudioPlayer {
     ENGINE_CALLBACK callback_;
     void           *ctx_;
     sample_buf   silentBuf_;
+    AdaptiveJitterBuffer *jitterBuf_;  // owner
 #ifdef  ENABLE_LOG
     AndroidLog  *logFile_;
 #endif
@@ -49,6 +51,7 @@ public:
     void        ProcessSLCallback(SLAndroidSimpleBufferQueueItf bq);
     uint32_t    dbgGetDevBufCount(void);
     void        RegisterCallback(ENGINE_CALLBACK cb, void *ctx);
+    void        GetJitterStats(JitterStats *stats);
 };
 
 #endif //NATIVE_AUDIO_AUDIO_PLAYER_H
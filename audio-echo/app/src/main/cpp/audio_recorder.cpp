@@ -34,6 +34,10 @@ void AudioRecorder::ProcessSLCallback(SLAndroidSimpleBufferQueueItf bq) {
     devShadowQueue_->front(&dataBuf);
     devShadowQueue_->pop();
     dataBuf->size_ = dataBuf->cap_;           //device only calls us when it is really full
+    if (callback_) {
+        // let engine process the recorded audio in place before playing it
+        callback_(ctx_, ENGINE_SERVICE_MSG_RECORDED_AUDIO_AVAILABLE, dataBuf);
+    }
     recQueue_->push(dataBuf);
 
     sample_buf* freeBuf;
@@ -19,6 +19,8 @@
 #include <SLES/OpenSLES.h>
 #include <atomic>
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
 #include <memory>
 #include <limits>
 
@@ -159,13 +161,15 @@ struct sample_buf {
 
 using AudioQueue = ProducerConsumerQueue<sample_buf*>;
 
+/*
+ * All sample buffers live in one contiguous slab; each buffer starts on its
+ * own cache line so neighbouring buffers never share one.
+ */
 __inline__ void releaseSampleBufs(sample_buf* bufs, uint32_t& count) {
     if(!bufs || !count) {
         return;
     }
-    for(uint32_t i=0; i<count; i++) {
-        if(bufs[i].buf_) delete [] bufs[i].buf_;
-    }
+    free(bufs[0].buf_);     // owner of the whole slab
     delete [] bufs;
 }
 __inline__ sample_buf *allocateSampleBufs(uint32_t count, uint32_t sizeInByte){
@@ -176,22 +180,20 @@ __inline__ sample_buf *allocateSampleBufs(uint32_t count, uint32_t sizeInByte){
     assert(bufs);
     memset(bufs, 0, sizeof(sample_buf) * count);
 
-    uint32_t allocSize = (sizeInByte + 3) & ~3;   // padding to 4 bytes aligned
-    uint32_t i ;
-    for(i =0; i < count; i++) {
-        bufs[i].buf_ = new uint8_t [allocSize];
-        if(bufs[i].buf_ == nullptr) {
-            LOGW("====Requesting %d buffers, allocated %d in %s",count, i,  __FUNCTION__);
-            break;
-        }
+    // padding each buffer to the cache line
+    uint32_t stride = (sizeInByte + CACHE_ALIGN - 1) & ~(CACHE_ALIGN - 1);
+    void *slab = nullptr;
+    if (posix_memalign(&slab, CACHE_ALIGN,
+                       static_cast<size_t>(stride) * count) || !slab) {
+        LOGW("====Requesting %d buffers failed in %s", count, __FUNCTION__);
+        delete [] bufs;
+        return nullptr;
+    }
+    for(uint32_t i = 0; i < count; i++) {
+        bufs[i].buf_ = static_cast<uint8_t*>(slab) + static_cast<size_t>(stride) * i;
         bufs[i].cap_ = sizeInByte;
         bufs[i].size_ = 0;        //0 data in it
     }
-    if(i < 2) {
-        releaseSampleBufs(bufs, i);
-        bufs = nullptr;
-    }
-    count = i;
     return bufs;
 }
 
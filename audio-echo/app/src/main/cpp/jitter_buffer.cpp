@@ -0,0 +1,123 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <cmath>
+#include "jitter_buffer.h"
+
+// smoothing factor of the jitter and latency moving averages
+#define JITTER_EWMA_WEIGHT  (1.0f / 16)
+
+AdaptiveJitterBuffer::AdaptiveJitterBuffer(uint32_t sampleRate,
+                                           uint32_t framesPerBuf,
+                                           uint32_t initialDepth) {
+    periodUs_ = 1000000.0f * framesPerBuf / std::max(sampleRate, 1U);
+    windowCallbacks_ = std::max(static_cast<uint32_t>(1000000.0f / periodUs_), 1U);
+    initialDepth_ = std::min(std::max(initialDepth,
+                                      static_cast<uint32_t>(PLAY_MIN_KICKSTART_BUFFER_COUNT)),
+                             static_cast<uint32_t>(PLAY_MAX_KICKSTART_BUFFER_COUNT));
+    Reset();
+}
+
+void AdaptiveJitterBuffer::Reset(void) {
+    lastCallbackUs_ = 0;
+    callbacksInWindow_ = 0;
+    minQueuedInWindow_ = UINT32_MAX;
+    underrunInWindow_ = false;
+    refilling_ = true;
+    shrinkPending_ = false;
+
+    depth_.store(initialDepth_);
+    jitterUs_.store(0.0f);
+    latencyUs_.store(0.0f);
+    underruns_.store(0);
+    callbacks_.store(0);
+}
+
+void AdaptiveJitterBuffer::OnCallback(uint64_t nowUs, uint32_t queuedBufs) {
+    if (lastCallbackUs_) {
+        float deviation = fabsf(static_cast<float>(nowUs - lastCallbackUs_) - periodUs_);
+        float jitter = jitterUs_.load(std::memory_order_relaxed);
+        jitterUs_.store(jitter + (deviation - jitter) * JITTER_EWMA_WEIGHT,
+                        std::memory_order_relaxed);
+    }
+    lastCallbackUs_ = nowUs;
+    callbacks_.store(callbacks_.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+    if (refilling_) {
+        // latency is only meaningful while audio is flowing
+        return;
+    }
+
+    float latency = latencyUs_.load(std::memory_order_relaxed);
+    latencyUs_.store(latency + (queuedBufs * periodUs_ - latency) * JITTER_EWMA_WEIGHT,
+                     std::memory_order_relaxed);
+    minQueuedInWindow_ = std::min(minQueuedInWindow_, queuedBufs);
+
+    if (++callbacksInWindow_ < windowCallbacks_) {
+        return;
+    }
+
+    // end of window: see whether we could afford less buffering
+    uint32_t depth = depth_.load(std::memory_order_relaxed);
+    uint32_t jitterBufs = static_cast<uint32_t>(
+            ceilf(2.0f * jitterUs_.load(std::memory_order_relaxed) / periodUs_));
+    uint32_t needed = std::max(jitterBufs + 1,
+                               static_cast<uint32_t>(PLAY_MIN_KICKSTART_BUFFER_COUNT));
+    if (!underrunInWindow_ && minQueuedInWindow_ > 1 && depth > needed) {
+        depth_.store(depth - 1, std::memory_order_relaxed);
+        shrinkPending_ = true;
+    }
+    callbacksInWindow_ = 0;
+    minQueuedInWindow_ = UINT32_MAX;
+    underrunInWindow_ = false;
+}
+
+void AdaptiveJitterBuffer::OnUnderrun(void) {
+    underruns_.store(underruns_.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+    underrunInWindow_ = true;
+    shrinkPending_ = false;
+    if (refilling_) {
+        // still draining from the same underrun: grow only once per refill
+        return;
+    }
+    refilling_ = true;
+    uint32_t depth = depth_.load(std::memory_order_relaxed);
+    if (depth < PLAY_MAX_KICKSTART_BUFFER_COUNT) {
+        depth_.store(depth + 1, std::memory_order_relaxed);
+    }
+}
+
+void AdaptiveJitterBuffer::OnKickstart(void) {
+    refilling_ = false;
+    callbacksInWindow_ = 0;
+    minQueuedInWindow_ = UINT32_MAX;
+}
+
+void AdaptiveJitterBuffer::OnShrink(void) {
+    shrinkPending_ = false;
+}
+
+void AdaptiveJitterBuffer::GetStats(JitterStats* stats) const {
+    stats->kickstartDepth_ = depth_.load();
+    stats->jitterMs_ = jitterUs_.load() / 1000.0f;
+    stats->latencyMs_ = latencyUs_.load() / 1000.0f;
+    stats->underruns_ = underruns_.load();
+    stats->callbacks_ = callbacks_.load();
+
+    float minutes = stats->callbacks_ * periodUs_ / 60000000.0f;
+    stats->underrunsPerMinute_ = (minutes > 0.0f) ? stats->underruns_ / minutes : 0.0f;
+}
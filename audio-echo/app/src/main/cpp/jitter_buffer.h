@@ -0,0 +1,81 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NATIVE_AUDIO_JITTER_BUFFER_H
+#define NATIVE_AUDIO_JITTER_BUFFER_H
+#include <sys/types.h>
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Kickstart depth limits: how many recorded buffers the player waits for
+ * before (re)starting playback.
+ */
+#define PLAY_MIN_KICKSTART_BUFFER_COUNT     1
+#define PLAY_MAX_KICKSTART_BUFFER_COUNT     8
+
+struct JitterStats {
+    uint32_t kickstartDepth_;     // current depth in buffers
+    float    jitterMs_;           // smoothed player callback arrival jitter
+    float    latencyMs_;          // smoothed audio queued in front of the player
+    uint32_t underruns_;
+    float    underrunsPerMinute_;
+    uint64_t callbacks_;
+};
+
+/*
+ * AdaptiveJitterBuffer: decides how deep the player buffering should be.
+ * It watches the arrival jitter of the player callbacks and the underruns:
+ *   - every underrun grows the kickstart depth by one buffer (once per refill)
+ *   - after a window of ~1 second without underruns, with at least one spare
+ *     buffer queued all the time and low enough jitter, the depth shrinks by
+ *     one buffer and the player is asked to skip one queued buffer; the
+ *     request stays pending until the player finds a quiet buffer to skip,
+ *     so no recorded sound is dropped.
+ * All methods except GetStats() are called from the player callback only.
+ */
+class AdaptiveJitterBuffer {
+public:
+    AdaptiveJitterBuffer(uint32_t sampleRate, uint32_t framesPerBuf,
+                         uint32_t initialDepth);
+    void     Reset(void);
+    void     OnCallback(uint64_t nowUs, uint32_t queuedBufs);
+    void     OnUnderrun(void);
+    void     OnKickstart(void);
+    bool     ShrinkPending(void) const { return shrinkPending_; }
+    void     OnShrink(void);
+    uint32_t KickstartDepth(void) const { return depth_.load(std::memory_order_relaxed); }
+    void     GetStats(JitterStats* stats) const;
+private:
+    float    periodUs_;
+    uint32_t windowCallbacks_;
+    uint32_t initialDepth_;
+
+    uint64_t lastCallbackUs_;
+    uint32_t callbacksInWindow_;
+    uint32_t minQueuedInWindow_;
+    bool     underrunInWindow_;
+    bool     refilling_;
+    bool     shrinkPending_;
+
+    std::atomic<uint32_t> depth_;
+    std::atomic<float>    jitterUs_;
+    std::atomic<float>    latencyUs_;
+    std::atomic<uint32_t> underruns_;
+    std::atomic<uint64_t> callbacks_;
+};
+
+#endif //NATIVE_AUDIO_JITTER_BUFFER_H
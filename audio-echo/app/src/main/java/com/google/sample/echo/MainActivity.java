@@ -110,6 +110,7 @@ public class MainActivity extends Activity
         } else {
             stopPlay();  //this must include stopRecording()
             updateNativeAudioUI();
+            statusView.append(getPlaybackStats());
             deleteAudioRecorder();
             deleteSLBufferQueueAudioPlayer();
         }
@@ -220,4 +221,10 @@ public class MainActivity extends Activity
     public static native void deleteAudioRecorder();
     public static native void startPlay();
     public static native void stopPlay();
+    public static native String getPlaybackStats();
+    /*
+     * The echo effect is off until configured: mix 0.0f(off) .. 1.0f,
+     * feedback 0.0f .. 0.95f
+     */
+    public static native void configureEcho(int delayMs, float feedback, float mix);
 }
@@ -22,6 +22,17 @@
 #include "camera_engine.h"
 #include "utils/native_debug.h"
 
+/*
+ * Number of recent full resolution frames kept for zero shutter lag capture;
+ * 0 goes back to stopping the preview and sending a still capture request.
+ */
+static const uint32_t kZslFrameCount = 4;
+
+/*
+ * Preview frames between two logs of the luma analysis stage
+ */
+static const uint64_t kLumaLogInterval = 90;
+
 /**
  * constructor and destructor for main application class
  * @param app native_app_glue environment
@@ -34,6 +45,8 @@ CameraEngine::CameraEngine(android_app* app)
       cameraReady_(false),
       yuvReader_(nullptr),
       jpgReader_(nullptr),
+      pipeline_(nullptr),
+      lumaStage_(-1),
       camera_(nullptr) {
   memset(&savedNativeWinRes_, 0, sizeof(savedNativeWinRes_));
 }
@@ -89,7 +102,17 @@ void CameraEngine::CreateCamera(void) {
 
   yuvReader_ = new ImageReader(&view, AIMAGE_FORMAT_YUV_420_888);
   yuvReader_->SetPresentRotation(imageRotation);
-  jpgReader_ = new ImageReader(&capture, AIMAGE_FORMAT_JPEG);
+
+  // the preview is drawn by DrawFrame(); analysis stages share the same
+  // AImage, which goes back to the reader once everybody is done with it
+  pipeline_ = new FramePipeline([this](void* image) {
+    yuvReader_->DeleteImage(static_cast<AImage*>(image));
+  });
+  lumaStage_ = pipeline_->AddStage(
+      "luma", DropPolicy::LATEST_ONLY, 1,
+      [this](const PipelineFrame& frame) { AnalyzeLuma(frame); });
+  pipeline_->Start();
+  jpgReader_ = new ImageReader(&capture, AIMAGE_FORMAT_JPEG, kZslFrameCount);
   jpgReader_->SetPresentRotation(imageRotation);
   jpgReader_->RegisterCallback(this, [this](void* ctx, const char* str) -> void {
     reinterpret_cast<CameraEngine* >(ctx)->OnPhotoTaken(str);
@@ -97,7 +120,8 @@ void CameraEngine::CreateCamera(void) {
 
   // now we could create session
   camera_->CreateSession(yuvReader_->GetNativeWindow(),
-                         jpgReader_->GetNativeWindow(), imageRotation);
+                         jpgReader_->GetNativeWindow(), imageRotation,
+                         kZslFrameCount > 0);
 }
 
 void CameraEngine::DeleteCamera(void) {
@@ -106,6 +130,11 @@ void CameraEngine::DeleteCamera(void) {
     delete camera_;
     camera_ = nullptr;
   }
+  if (pipeline_) {
+    // hands the frames still in flight back to yuvReader_
+    delete pipeline_;
+    pipeline_ = nullptr;
+  }
   if (yuvReader_) {
     delete yuvReader_;
     yuvReader_ = nullptr;
@@ -159,14 +188,65 @@ void CameraEngine::DrawFrame(void) {
     return;
   }
 
+  YuvImage yuv;
+  if (!ImageReader::GetYuvImage(image, &yuv)) {
+    yuvReader_->DeleteImage(image);
+    return;
+  }
+  int64_t timestamp = 0;
+  AImage_getTimestamp(image, &timestamp);
+  // this thread owns the window, so the preview stays here; the image is
+  // released when both the preview and the analysis stages are done
+  FrameRef frame = pipeline_->Publish(image, yuv, timestamp);
+  if (!frame) {
+    return;
+  }
+
   ANativeWindow_acquire(app_->window);
   ANativeWindow_Buffer buf;
   if (ANativeWindow_lock(app_->window, &buf, nullptr) < 0) {
-    yuvReader_->DeleteImage(image);
+    ANativeWindow_release(app_->window);
     return;
   }
 
-  yuvReader_->DisplayImage(&buf, image);
+  yuvReader_->DisplayImage(&buf, frame->yuv);
   ANativeWindow_unlockAndPost(app_->window);
   ANativeWindow_release(app_->window);
 }
+
+/**
+ * Analysis stage of the frame pipeline: luma histogram of the preview,
+ * on every 4th pixel of every 4th row, as an exposure meter would. Runs on
+ * its own thread and reads the frame in place.
+ */
+void CameraEngine::AnalyzeLuma(const PipelineFrame& frame) {
+  uint32_t histogram[256] = {0};
+  uint32_t count = 0;
+  for (int32_t row = 0; row < frame.yuv.height; row += 4) {
+    const uint8_t* y =
+        frame.yuv.y + (frame.yuv.top + row) * frame.yuv.yStride +
+        frame.yuv.left;
+    for (int32_t col = 0; col < frame.yuv.width; col += 4) {
+      histogram[y[col]]++;
+    }
+    count += (frame.yuv.width + 3) / 4;
+  }
+  if (!count || frame.sequence % kLumaLogInterval) return;
+
+  uint64_t sum = 0;
+  uint32_t dark = 0, clipped = 0;
+  for (int32_t i = 0; i < 256; i++) {
+    sum += static_cast<uint64_t>(i) * histogram[i];
+    if (i < 16) dark += histogram[i];
+    if (i >= 250) clipped += histogram[i];
+  }
+  FrameStageStats stats;
+  pipeline_->GetStageStats(lumaStage_, &stats);
+  LOGI("luma: mean %.1f, %.1f%% dark, %.1f%% clipped (%llu frames, %llu "
+       "dropped, %.2f ms avg)",
+       static_cast<float>(sum) / count, 100.0f * dark / count,
+       100.0f * clipped / count,
+       static_cast<unsigned long long>(stats.framesProcessed),
+       static_cast<unsigned long long>(stats.framesDropped),
+       stats.avgProcessUs / 1000.0f);
+}
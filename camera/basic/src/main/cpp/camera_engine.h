@@ -24,6 +24,7 @@
 #include <thread>
 
 #include "camera_manager.h"
+#include "frame_pipeline.h"
 
 /**
  * basic CameraAppEngine
@@ -60,6 +61,7 @@ class CameraEngine {
  private:
   void OnPhotoTaken(const char* fileName);
   int  GetDisplayRotation(void);
+  void AnalyzeLuma(const PipelineFrame& frame);
 
   struct android_app* app_;
   ImageFormat savedNativeWinRes_;
@@ -69,6 +71,8 @@ class CameraEngine {
   NDKCamera* camera_;
   ImageReader* yuvReader_;
   ImageReader* jpgReader_;
+  FramePipeline* pipeline_;  // preview frames to the analysis stages
+  int32_t lumaStage_;
 };
 
 /**
@@ -234,7 +234,5 @@ void NDKCamera::OnCaptureSequenceEnd(ACameraCaptureSession* session,
     return;
 
   // resume preview
-  CALL_SESSION(setRepeatingRequest(captureSession_, nullptr, 1,
-                                   &requests_[PREVIEW_REQUEST_IDX].request_,
-                                   nullptr));
+  SetRepeatingRequest(nullptr);
 }
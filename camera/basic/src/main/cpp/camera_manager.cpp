@@ -17,6 +17,7 @@
 #include <queue>
 #include <unistd.h>
 #include <cinttypes>
+#include <ctime>
 #include <camera/NdkCameraManager.h>
 #include "camera_manager.h"
 #include "utils/native_debug.h"
@@ -38,7 +39,10 @@ NDKCamera::NDKCamera()
       captureSessionState_(CaptureSessionState::MAX_STATE),
       cameraFacing_(ACAMERA_LENS_FACING_BACK),
       cameraOrientation_(0),
-      exposureTime_(static_cast<int64_t>(0)) {
+      exposureTime_(static_cast<int64_t>(0)),
+      zslMode_(false),
+      zslRequest_(nullptr),
+      realtimeTimestamps_(false) {
   valid_ = false;
   requests_.resize(CAPTURE_REQUEST_COUNT);
   memset(requests_.data(), 0, requests_.size() * sizeof(requests_[0]));
@@ -86,6 +90,12 @@ NDKCamera::NDKCamera()
   sensitivityRange_.max_ = val.data.i32[1];
 
   sensitivity_ = sensitivityRange_.value(2);
+
+  status = ACameraMetadata_getConstEntry(
+      metadataObj, ACAMERA_SENSOR_INFO_TIMESTAMP_SOURCE, &val);
+  realtimeTimestamps_ =
+      (status == ACAMERA_OK &&
+       val.data.u8[0] == ACAMERA_SENSOR_INFO_TIMESTAMP_SOURCE_REALTIME);
   valid_ = true;
 }
 
@@ -215,7 +225,8 @@ bool NDKCamera::MatchCaptureSizeRequest(ANativeWindow* display,
 }
 
 void NDKCamera::CreateSession(ANativeWindow* previewWindow,
-                              ANativeWindow* jpgWindow, int32_t imageRotation) {
+                              ANativeWindow* jpgWindow, int32_t imageRotation,
+                              bool zslMode) {
   // Create output from this app's ANativeWindow, and add into output container
   requests_[PREVIEW_REQUEST_IDX].outputNativeWindow_ = previewWindow;
   requests_[PREVIEW_REQUEST_IDX].template_ = TEMPLATE_PREVIEW;
@@ -242,6 +253,23 @@ void NDKCamera::CreateSession(ANativeWindow* previewWindow,
   ACaptureRequest_setEntry_i32(requests_[JPG_CAPTURE_REQUEST_IDX].request_,
                                ACAMERA_JPEG_ORIENTATION, 1, &imageRotation);
 
+  /*
+   * Zero shutter lag: a second repeating request, alternating with the
+   * preview one, encodes frames into the jpg reader which keeps the last
+   * few; TakePhoto() is not needed then. Preview frames stay out of the
+   * jpeg encoder, and the ZSL frames keep the auto exposure of the
+   * template below instead of the preview's manual settings.
+   */
+  zslMode_ = zslMode;
+  if (zslMode_) {
+    CALL_DEV(createCaptureRequest(cameras_[activeCameraId_].device_,
+                                  TEMPLATE_ZERO_SHUTTER_LAG, &zslRequest_));
+    CALL_REQUEST(addTarget(zslRequest_,
+                           requests_[JPG_CAPTURE_REQUEST_IDX].target_));
+    ACaptureRequest_setEntry_i32(zslRequest_, ACAMERA_JPEG_ORIENTATION, 1,
+                                 &imageRotation);
+  }
+
   /*
    * Only preview request is in manual mode, JPG is always in Auto mode
    * JPG capture mode could also be switch into manual mode and control
@@ -266,6 +294,12 @@ NDKCamera::~NDKCamera() {
   ACameraCaptureSession_close(captureSession_);
 
 #if 1
+  if (zslRequest_) {
+    CALL_REQUEST(removeTarget(zslRequest_,
+                              requests_[JPG_CAPTURE_REQUEST_IDX].target_));
+    ACaptureRequest_free(zslRequest_);
+    zslRequest_ = nullptr;
+  }
   for (auto& req : requests_) {
     CALL_REQUEST(removeTarget(req.request_, req.target_));
     ACaptureRequest_free(req.request_);
@@ -378,9 +412,7 @@ bool NDKCamera::GetSensorOrientation(int32_t* facing, int32_t* angle) {
  */
 void NDKCamera::StartPreview(bool start) {
   if (start) {
-    CALL_SESSION(setRepeatingRequest(captureSession_, nullptr, 1,
-                                     &requests_[PREVIEW_REQUEST_IDX].request_,
-                                     nullptr));
+    SetRepeatingRequest(nullptr);
   } else if (!start && captureSessionState_ == CaptureSessionState::ACTIVE) {
     ACameraCaptureSession_stopRepeating(captureSession_);
   } else {
@@ -389,6 +421,18 @@ void NDKCamera::StartPreview(bool start) {
   }
 }
 
+/**
+ * Repeat the preview request, and in ZSL mode the jpg one with it: the
+ * camera alternates between the requests of the list
+ */
+void NDKCamera::SetRepeatingRequest(int* sequenceId) {
+  ACaptureRequest* repeating[] = {requests_[PREVIEW_REQUEST_IDX].request_,
+                                  zslRequest_};
+  CALL_SESSION(setRepeatingRequest(captureSession_, nullptr,
+                                   zslRequest_ ? 2 : 1, repeating,
+                                   sequenceId));
+}
+
 /**
  * Capture one jpg photo into
  *     /sdcard/DCIM/Camera
@@ -405,6 +449,16 @@ bool NDKCamera::TakePhoto(void) {
   return true;
 }
 
+/**
+ * Current time in the time base of the sensor timestamps, to match a
+ * shutter press against the frames' AImage_getTimestamp()
+ */
+int64_t NDKCamera::SensorTimestampNow(void) {
+  struct timespec ts;
+  clock_gettime(realtimeTimestamps_ ? CLOCK_BOOTTIME : CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
 void NDKCamera::UpdateCameraRequestParameter(int32_t code, int64_t val) {
   ACaptureRequest* request = requests_[PREVIEW_REQUEST_IDX].request_;
   switch (code) {
@@ -427,9 +481,7 @@ void NDKCamera::UpdateCameraRequestParameter(int32_t code, int64_t val) {
 
   uint8_t aeModeOff = ACAMERA_CONTROL_AE_MODE_OFF;
   CALL_REQUEST(setEntry_u8(request, ACAMERA_CONTROL_AE_MODE, 1, &aeModeOff));
-  CALL_SESSION(
-      setRepeatingRequest(captureSession_, nullptr, 1, &request,
-                          &requests_[PREVIEW_REQUEST_IDX].sessionSequenceId_));
+  SetRepeatingRequest(&requests_[PREVIEW_REQUEST_IDX].sessionSequenceId_);
 }
 
 /**
@@ -83,10 +83,18 @@ class NDKCamera {
   RangeValue<int32_t> sensitivityRange_;
   volatile bool valid_;
 
+  // zero shutter lag: the jpg target is fed by its own auto exposure
+  // request, repeated along with the (manual) preview request
+  bool zslMode_;
+  ACaptureRequest* zslRequest_;
+  // sensor timestamps are in CLOCK_BOOTTIME (REALTIME source) time base
+  bool realtimeTimestamps_;
+
   ACameraManager_AvailabilityCallbacks* GetManagerListener();
   ACameraDevice_stateCallbacks* GetDeviceListener();
   ACameraCaptureSession_stateCallbacks* GetSessionListener();
   ACameraCaptureSession_captureCallbacks* GetCaptureCallback();
+  void SetRepeatingRequest(int* sequenceId);
 
  public:
   NDKCamera();
@@ -95,7 +103,7 @@ class NDKCamera {
   bool MatchCaptureSizeRequest(ANativeWindow* display, ImageFormat* view,
                                ImageFormat* capture);
   void CreateSession(ANativeWindow* previewWindow, ANativeWindow* jpgWindow,
-                     int32_t imageRotation);
+                     int32_t imageRotation, bool zslMode = false);
   bool GetSensorOrientation(int32_t* facing, int32_t* angle);
   void OnCameraStatusChanged(const char* id, bool available);
   void OnDeviceState(ACameraDevice* dev);
@@ -107,6 +115,7 @@ class NDKCamera {
                        ACameraCaptureFailure* failure);
   void StartPreview(bool start);
   bool TakePhoto(void);
+  int64_t SensorTimestampNow(void);
   bool GetExposureRange(int64_t* min, int64_t* max, int64_t* curVal);
   bool GetSensitivityRange(int64_t* min, int64_t* max, int64_t* curVal);
 
@@ -83,6 +83,13 @@ void CameraEngine::EnableUI(void) {
  */
 void CameraEngine::OnTakePhoto() {
   if (camera_) {
+    // zero shutter lag: save the frame captured at the shutter press
+    if (jpgReader_ && jpgReader_->IsZsl()) {
+      if (!jpgReader_->SaveZslFrame(camera_->SensorTimestampNow())) {
+        LOGW("No frame captured yet, photo not taken");
+      }
+      return;
+    }
     camera_->TakePhoto();
   }
 }
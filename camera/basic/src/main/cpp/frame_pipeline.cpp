@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <ctime>
+#include "frame_pipeline.h"
+
+static uint64_t NowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+FramePipeline::FramePipeline(Releaser release)
+    : release_(release), sequence_(0), running_(false) {}
+
+FramePipeline::~FramePipeline() { Stop(); }
+
+int32_t FramePipeline::AddStage(const char* name, DropPolicy policy,
+                                uint32_t queueSize, StageFunc func) {
+  assert(!running_);
+  std::unique_ptr<Stage> stage(new Stage);
+  stage->name = name;
+  stage->policy = policy;
+  stage->queueSize =
+      (policy == DropPolicy::LATEST_ONLY) ? 1 : std::max(queueSize, 1U);
+  stage->func = func;
+  stage->stopping = false;
+  memset(&stage->stats, 0, sizeof(stage->stats));
+  stage->totalProcessUs = 0.0;
+  stages_.push_back(std::move(stage));
+  return static_cast<int32_t>(stages_.size() - 1);
+}
+
+void FramePipeline::Start(void) {
+  if (running_) return;
+  running_ = true;
+  for (auto& stage : stages_) {
+    stage->stopping = false;
+    stage->thread = std::thread(&FramePipeline::StageThread, this, stage.get());
+  }
+}
+
+void FramePipeline::Stop(void) {
+  if (!running_) return;
+  running_ = false;
+  for (auto& stage : stages_) {
+    std::lock_guard<std::mutex> guard(stage->lock);
+    stage->stopping = true;
+    stage->frameReady.notify_all();
+    stage->slotFree.notify_all();
+  }
+  for (auto& stage : stages_) {
+    stage->thread.join();
+  }
+}
+
+FrameRef FramePipeline::Publish(void* image, const YuvImage& yuv,
+                                int64_t timestampNs) {
+  if (!running_) {
+    release_(image);
+    return nullptr;
+  }
+
+  Releaser release = release_;
+  FrameRef frame(
+      new PipelineFrame{image, yuv, timestampNs, sequence_++, NowNs()},
+      [release](const PipelineFrame* frame) {
+        release(frame->image);
+        delete frame;
+      });
+
+  // frames pushed out of the queues are only released after the stage locks
+  // are dropped: releasing an AImage may block
+  std::vector<FrameRef> dropped;
+  for (auto& stage : stages_) {
+    Offer(stage.get(), frame, &dropped);
+  }
+  return frame;
+}
+
+void FramePipeline::Offer(Stage* stage, const FrameRef& frame,
+                          std::vector<FrameRef>* dropped) {
+  {
+    std::unique_lock<std::mutex> guard(stage->lock);
+    stage->stats.framesIn++;
+    switch (stage->policy) {
+      case DropPolicy::BLOCK:
+        if (stage->queue.size() >= stage->queueSize) {
+          stage->stats.blockedPublishes++;
+          stage->slotFree.wait(guard, [stage] {
+            return stage->stopping || stage->queue.size() < stage->queueSize;
+          });
+        }
+        if (stage->stopping) return;
+        break;
+      case DropPolicy::DROP_OLDEST:
+      case DropPolicy::LATEST_ONLY:
+        while (stage->queue.size() >= stage->queueSize) {
+          dropped->push_back(std::move(stage->queue.front()));
+          stage->queue.pop_front();
+          stage->stats.framesDropped++;
+        }
+        break;
+    }
+    stage->queue.push_back(frame);
+    stage->stats.queueDepth = static_cast<uint32_t>(stage->queue.size());
+    stage->stats.maxQueueDepth =
+        std::max(stage->stats.maxQueueDepth, stage->stats.queueDepth);
+  }
+  stage->frameReady.notify_one();
+}
+
+void FramePipeline::StageThread(Stage* stage) {
+  std::unique_lock<std::mutex> guard(stage->lock);
+  for (;;) {
+    stage->frameReady.wait(
+        guard, [stage] { return stage->stopping || !stage->queue.empty(); });
+    if (stage->queue.empty()) {
+      break;  // stopping, and everything queued has been processed
+    }
+    FrameRef frame = std::move(stage->queue.front());
+    stage->queue.pop_front();
+    stage->stats.queueDepth = static_cast<uint32_t>(stage->queue.size());
+    guard.unlock();
+    stage->slotFree.notify_one();
+
+    uint64_t start = NowNs();
+    stage->func(*frame);
+    uint64_t end = NowNs();
+    float processUs = (end - start) / 1000.0f;
+    float latencyUs = (end - frame->publishNs) / 1000.0f;
+    frame.reset();  // may be the last reference
+
+    guard.lock();
+    FrameStageStats& stats = stage->stats;
+    stats.framesProcessed++;
+    stage->totalProcessUs += processUs;
+    stats.lastProcessUs = processUs;
+    stats.maxProcessUs = std::max(stats.maxProcessUs, processUs);
+    stats.lastLatencyUs = latencyUs;
+    stats.maxLatencyUs = std::max(stats.maxLatencyUs, latencyUs);
+  }
+}
+
+uint32_t FramePipeline::StageCount(void) const {
+  return static_cast<uint32_t>(stages_.size());
+}
+
+const char* FramePipeline::StageName(int32_t stage) const {
+  if (stage < 0 || stage >= static_cast<int32_t>(stages_.size())) {
+    return nullptr;
+  }
+  return stages_[stage]->name.c_str();
+}
+
+bool FramePipeline::GetStageStats(int32_t stage, FrameStageStats* stats) {
+  if (stage < 0 || stage >= static_cast<int32_t>(stages_.size())) {
+    return false;
+  }
+  Stage* s = stages_[stage].get();
+  std::lock_guard<std::mutex> guard(s->lock);
+  *stats = s->stats;
+  stats->avgProcessUs =
+      s->stats.framesProcessed
+          ? static_cast<float>(s->totalProcessUs / s->stats.framesProcessed)
+          : 0.0f;
+  return true;
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CAMERA_FRAME_PIPELINE_H
+#define CAMERA_FRAME_PIPELINE_H
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "yuv_converter.h"
+
+/*
+ * PipelineFrame:
+ *   One captured frame as seen by the stages: the image it came from (an
+ *   AImage* in the camera sample) and a view of its planes. Stages only read
+ *   it; nothing is copied.
+ */
+struct PipelineFrame {
+  void* image;
+  YuvImage yuv;
+  int64_t timestampNs;  // sensor timestamp
+  uint64_t sequence;    // publish order, from 0
+  uint64_t publishNs;   // CLOCK_MONOTONIC at Publish()
+};
+
+/*
+ * FrameRef:
+ *   Ref-counted handle of a PipelineFrame. The image goes back to its owner
+ *   when the last handle is gone: the publisher's and every stage's.
+ */
+typedef std::shared_ptr<const PipelineFrame> FrameRef;
+
+/*
+ * What a stage does with a new frame when its queue is full
+ *   DROP_OLDEST: drop the oldest queued frame
+ *   BLOCK:       make Publish() wait, no frame is ever dropped
+ *   LATEST_ONLY: keep only the newest frame, queue size is 1
+ */
+enum class DropPolicy : int32_t { DROP_OLDEST = 0, BLOCK, LATEST_ONLY };
+
+/*
+ * FrameStageStats:
+ *   snapshot of one stage, times in micro seconds
+ */
+struct FrameStageStats {
+  uint64_t framesIn;         // offered by Publish()
+  uint64_t framesProcessed;
+  uint64_t framesDropped;    // by the drop policy
+  uint32_t queueDepth;
+  uint32_t maxQueueDepth;
+  uint64_t blockedPublishes;  // BLOCK only: Publish() had to wait
+  float lastProcessUs;       // time spent in the stage function
+  float avgProcessUs;
+  float maxProcessUs;
+  float lastLatencyUs;       // Publish() to the end of the stage function
+  float maxLatencyUs;
+};
+
+/*
+ * FramePipeline:
+ *   Fans each published frame out to several consumer stages. Every stage
+ *   runs on its own thread with its own bounded queue and drop policy, so a
+ *   slow analysis stage does not hold back the others. The frame is shared,
+ *   not copied: its image is released once the publisher and all stages
+ *   are done with it.
+ *   Stages are added before Start(); Stop() lets the stages finish what is
+ *   queued. Publish() is meant to be called from a single (camera) thread.
+ */
+class FramePipeline {
+ public:
+  typedef std::function<void(void* image)> Releaser;
+  typedef std::function<void(const PipelineFrame& frame)> StageFunc;
+
+  explicit FramePipeline(Releaser release);
+  ~FramePipeline();
+
+  /**
+   * @return index of the stage, for GetStageStats()
+   */
+  int32_t AddStage(const char* name, DropPolicy policy, uint32_t queueSize,
+                   StageFunc func);
+  void Start(void);
+  void Stop(void);
+
+  /**
+   * Hand a frame to every stage. The pipeline owns image from now on.
+   * @return a handle the publisher may keep to use the frame itself
+   *         (display it, for example); nullptr once stopped, image is
+   *         released then.
+   */
+  FrameRef Publish(void* image, const YuvImage& yuv, int64_t timestampNs);
+
+  uint32_t StageCount(void) const;
+  const char* StageName(int32_t stage) const;
+  bool GetStageStats(int32_t stage, FrameStageStats* stats);
+
+ private:
+  struct Stage {
+    std::string name;
+    DropPolicy policy;
+    uint32_t queueSize;
+    StageFunc func;
+
+    std::deque<FrameRef> queue;
+    std::mutex lock;
+    std::condition_variable frameReady;
+    std::condition_variable slotFree;
+    std::thread thread;
+    bool stopping;
+
+    FrameStageStats stats;
+    double totalProcessUs;
+  };
+
+  void StageThread(Stage* stage);
+  void Offer(Stage* stage, const FrameRef& frame,
+             std::vector<FrameRef>* dropped);
+
+  Releaser release_;
+  std::vector<std::unique_ptr<Stage>> stages_;
+  uint64_t sequence_;
+  bool running_;
+};
+
+#endif  // CAMERA_FRAME_PIPELINE_H
@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs a synthetic source through a display-like LATEST_ONLY stage, a slow
+ * DROP_OLDEST analysis stage and a BLOCK recording stage; checks that no
+ * frame is released while a stage still uses it, that every frame is
+ * released once and that the policies drop what they should, then prints
+ * the stage statistics. No Android dependency, runs on the host:
+ *   g++ -std=c++11 -O2 -pthread -DFRAME_PIPELINE_HOST_CHECK \
+ *       frame_pipeline.cpp frame_pipeline_check.cpp
+ */
+#ifdef FRAME_PIPELINE_HOST_CHECK
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include "frame_pipeline.h"
+
+/*
+ * SyntheticFrameSource:
+ *   Stands in for an AImageReader on Linux: a fixed number of YUV_420_888
+ *   buffers (semi-planar chroma, like most camera HALs) handed out until all
+ *   of them are in use. Released buffers are poisoned, so a stage reading a
+ *   frame after its release sees it.
+ */
+class SyntheticFrameSource {
+ public:
+  SyntheticFrameSource(int32_t width, int32_t height, uint32_t bufferCount);
+
+  /**
+   * Fill the next free buffer with a pattern derived from sequence.
+   * @return the buffer (PipelineFrame::image), nullptr if none is free
+   */
+  void* Acquire(uint64_t sequence, YuvImage* yuv);
+  void Release(void* image);
+
+  /**
+   * @return true if the pattern of frame sequence is intact
+   */
+  static bool Verify(const YuvImage& yuv, uint64_t sequence);
+
+  uint64_t Acquired(void);
+  uint64_t Released(void);
+  uint64_t Starved(void);  // Acquire() calls with every buffer in use
+
+ private:
+  struct Buffer {
+    std::vector<uint8_t> data;
+    bool inUse;
+  };
+  int32_t width_;
+  int32_t height_;
+  std::vector<Buffer> buffers_;
+  std::mutex lock_;
+  uint64_t acquired_;
+  uint64_t released_;
+  uint64_t starved_;
+};
+
+/*
+ * SyntheticFrameSource: Y plane followed by interleaved U/V (NV12)
+ */
+static const uint8_t kPoison = 0xDD;
+
+SyntheticFrameSource::SyntheticFrameSource(int32_t width, int32_t height,
+                                           uint32_t bufferCount)
+    : width_(width & ~1),
+      height_(height & ~1),
+      buffers_(bufferCount),
+      acquired_(0),
+      released_(0),
+      starved_(0) {
+  for (auto& buffer : buffers_) {
+    buffer.data.assign(width_ * height_ * 3 / 2, kPoison);
+    buffer.inUse = false;
+  }
+}
+
+void* SyntheticFrameSource::Acquire(uint64_t sequence, YuvImage* yuv) {
+  Buffer* buffer = nullptr;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    for (auto& b : buffers_) {
+      if (!b.inUse) {
+        buffer = &b;
+        break;
+      }
+    }
+    if (!buffer) {
+      starved_++;
+      return nullptr;
+    }
+    buffer->inUse = true;
+    acquired_++;
+  }
+
+  // the buffer is ours: fill it like a sensor would, outside of the lock
+  uint8_t* y = buffer->data.data();
+  uint8_t* uv = y + width_ * height_;
+  for (int32_t row = 0; row < height_; row++) {
+    for (int32_t col = 0; col < width_; col++) {
+      y[row * width_ + col] = static_cast<uint8_t>(row + col + sequence);
+    }
+  }
+  for (int32_t row = 0; row < height_ / 2; row++) {
+    for (int32_t col = 0; col < width_ / 2; col++) {
+      uv[row * width_ + col * 2] = static_cast<uint8_t>(128 + sequence);
+      uv[row * width_ + col * 2 + 1] = static_cast<uint8_t>(128 - sequence);
+    }
+  }
+
+  yuv->y = y;
+  yuv->u = uv;
+  yuv->v = uv + 1;
+  yuv->yStride = width_;
+  yuv->uvStride = width_;
+  yuv->uvPixelStride = 2;
+  yuv->left = 0;
+  yuv->top = 0;
+  yuv->width = width_;
+  yuv->height = height_;
+  return buffer;
+}
+
+void SyntheticFrameSource::Release(void* image) {
+  Buffer* buffer = static_cast<Buffer*>(image);
+  std::fill(buffer->data.begin(), buffer->data.end(), kPoison);
+  std::lock_guard<std::mutex> guard(lock_);
+  assert(buffer->inUse);
+  buffer->inUse = false;
+  released_++;
+}
+
+bool SyntheticFrameSource::Verify(const YuvImage& yuv, uint64_t sequence) {
+  for (int32_t row = 0; row < yuv.height; row += 15) {
+    for (int32_t col = 0; col < yuv.width; col += 17) {
+      if (yuv.y[row * yuv.yStride + col] !=
+          static_cast<uint8_t>(row + col + sequence)) {
+        return false;
+      }
+    }
+  }
+  return yuv.u[0] == static_cast<uint8_t>(128 + sequence) &&
+         yuv.v[0] == static_cast<uint8_t>(128 - sequence);
+}
+
+uint64_t SyntheticFrameSource::Acquired(void) {
+  std::lock_guard<std::mutex> guard(lock_);
+  return acquired_;
+}
+
+uint64_t SyntheticFrameSource::Released(void) {
+  std::lock_guard<std::mutex> guard(lock_);
+  return released_;
+}
+
+uint64_t SyntheticFrameSource::Starved(void) {
+  std::lock_guard<std::mutex> guard(lock_);
+  return starved_;
+}
+
+/*
+ * Self check
+ */
+#define CHECK(cond)                                                     \
+  do {                                                                  \
+    if (!(cond)) {                                                      \
+      used += snprintf(report + used, reportSize - used,                \
+                       "FAILED line %d: %s\n", __LINE__, #cond);        \
+      return false;                                                     \
+    }                                                                   \
+  } while (0)
+
+static bool RunFramePipelineSelfCheck(char* report, size_t reportSize) {
+  const int kFrames = 150;
+  const int kStages = 3;
+  size_t used = 0;
+  if (!report || reportSize < 256) return false;
+  report[0] = 0;
+
+  SyntheticFrameSource source(640, 480, 8);
+  std::atomic<uint32_t> corruptFrames(0);
+  FramePipeline pipeline([&source](void* image) { source.Release(image); });
+
+  // a stage doing func plus some work, checking at its very end that the
+  // frame was not released under its feet
+  auto checked = [&corruptFrames](std::chrono::microseconds work,
+                                  FramePipeline::StageFunc func) {
+    return [&corruptFrames, work, func](const PipelineFrame& frame) {
+      if (func) func(frame);
+      std::this_thread::sleep_for(work);
+      if (!SyntheticFrameSource::Verify(frame.yuv, frame.sequence)) {
+        corruptFrames++;
+      }
+    };
+  };
+  uint32_t histogram[256];
+  int32_t display = pipeline.AddStage(
+      "display", DropPolicy::LATEST_ONLY, 1,
+      checked(std::chrono::microseconds(1000), nullptr));
+  int32_t analysis = pipeline.AddStage(
+      "histogram", DropPolicy::DROP_OLDEST, 2,
+      checked(std::chrono::microseconds(15000),
+              [&histogram](const PipelineFrame& frame) {
+                memset(histogram, 0, sizeof(histogram));
+                for (int32_t row = 0; row < frame.yuv.height; row++) {
+                  const uint8_t* y = frame.yuv.y + row * frame.yuv.yStride;
+                  for (int32_t col = 0; col < frame.yuv.width; col++) {
+                    histogram[y[col]]++;
+                  }
+                }
+              }));
+  int32_t recorder = pipeline.AddStage(
+      "recorder", DropPolicy::BLOCK, 3,
+      checked(std::chrono::microseconds(3000), nullptr));
+  pipeline.Start();
+
+  uint64_t published = 0;
+  for (int i = 0; i < kFrames; i++) {
+    YuvImage yuv;
+    void* image = source.Acquire(published, &yuv);
+    if (image) {
+      FrameRef frame = pipeline.Publish(image, yuv, i * 4000000LL);
+      published++;
+      // the publisher's own use of the frame, like the preview
+      CHECK(frame && SyntheticFrameSource::Verify(frame->yuv, frame->sequence));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(4));
+  }
+  pipeline.Stop();
+
+  // a released buffer is poisoned: a stage finishing on it would have seen
+  // a corrupt frame; and no buffer may stay acquired
+  CHECK(corruptFrames == 0);
+  CHECK(source.Acquired() == published && source.Released() == published);
+
+  FrameStageStats stats[kStages];
+  for (int32_t i = 0; i < kStages; i++) {
+    CHECK(pipeline.GetStageStats(i, &stats[i]));
+    CHECK(stats[i].framesIn == published);
+    CHECK(stats[i].framesProcessed + stats[i].framesDropped == published);
+    CHECK(stats[i].queueDepth == 0);
+  }
+  CHECK(stats[display].maxQueueDepth == 1);
+  CHECK(stats[analysis].maxQueueDepth <= 2 && stats[analysis].framesDropped);
+  CHECK(stats[recorder].framesDropped == 0);
+
+  used += snprintf(report + used, reportSize - used,
+                   "frame pipeline checks passed: %llu frames, %llu starved\n",
+                   static_cast<unsigned long long>(published),
+                   static_cast<unsigned long long>(source.Starved()));
+  for (int32_t i = 0; i < kStages; i++) {
+    used += snprintf(
+        report + used, reportSize - used,
+        "%-10s %4llu done %4llu dropped %3llu blocked, process %6.0f us avg "
+        "%6.0f us max, latency %6.0f us max\n",
+        pipeline.StageName(i),
+        static_cast<unsigned long long>(stats[i].framesProcessed),
+        static_cast<unsigned long long>(stats[i].framesDropped),
+        static_cast<unsigned long long>(stats[i].blockedPublishes),
+        stats[i].avgProcessUs, stats[i].maxProcessUs, stats[i].maxLatencyUs);
+    if (used >= reportSize) break;
+  }
+  return true;
+}
+
+int main() {
+  char report[1024];
+  bool ok = RunFramePipelineSelfCheck(report, sizeof(report));
+  fputs(report, stdout);
+  return ok ? 0 : 1;
+}
+#endif  // FRAME_PIPELINE_HOST_CHECK
@@ -15,11 +15,9 @@
  */
 #include <string>
 #include <functional>
-#include <thread>
-#include <cstdlib>
-#include <dirent.h>
 #include <ctime>
 #include "image_reader.h"
+#include "yuv_converter.h"
 #include "utils/native_debug.h"
 
 /*
@@ -37,6 +35,15 @@ static const char *kFileName = "capture";
  */
 #define MAX_BUF_COUNT 4
 
+/**
+ * WRITER_THREAD_COUNT / WRITER_QUEUE_SIZE:
+ *   JPEG files are saved by a small pool of writers. Images are copied out
+ *   of the reader before being queued, so the queue may be as deep as the
+ *   reader itself without holding any of the reader's buffers.
+ */
+#define WRITER_THREAD_COUNT 2
+#define WRITER_QUEUE_SIZE MAX_BUF_COUNT
+
 /**
  * ImageReader listener: called by AImageReader for every frame captured
  * We pass the event to ImageReader class, so it could do some housekeeping
@@ -54,13 +61,32 @@ void OnImageCallback(void *ctx, AImageReader *reader) {
 /**
  * Constructor
  */
-ImageReader::ImageReader(ImageFormat *res, enum AIMAGE_FORMATS format)
-    : reader_(nullptr), presentRotation_(0) {
+ImageReader::ImageReader(ImageFormat *res, enum AIMAGE_FORMATS format,
+                         uint32_t zslFrames)
+    : reader_(nullptr),
+      presentRotation_(0),
+      writer_(nullptr),
+      fileIndex_(0),
+      zsl_(nullptr) {
   callback_ = nullptr;
   callbackCtx_ = nullptr;
 
+  int32_t maxImages = MAX_BUF_COUNT;
+  if (format == AIMAGE_FORMAT_JPEG) {
+    writer_ = new ImageWriterPool(kDirName, WRITER_THREAD_COUNT,
+                                  WRITER_QUEUE_SIZE);
+    if (zslFrames) {
+      // the ring holds its frames as AImages: the reader needs room for
+      // them plus the one being acquired
+      zsl_ = new ZslRing(zslFrames, [](void *frame) {
+        AImage_delete(static_cast<AImage *>(frame));
+      });
+      maxImages = zslFrames + 1;
+    }
+  }
+
   media_status_t status = AImageReader_new(res->width, res->height, format,
-                                           MAX_BUF_COUNT, &reader_);
+                                           maxImages, &reader_);
   ASSERT(reader_ && status == AMEDIA_OK, "Failed to create AImageReader");
 
   AImageReader_ImageListener listener{
@@ -71,6 +97,31 @@ ImageReader::ImageReader(ImageFormat *res, enum AIMAGE_FORMATS format)
 
 ImageReader::~ImageReader() {
   ASSERT(reader_, "NULL Pointer to %s", __FUNCTION__);
+  if (writer_) {
+    ImageWriterStats stats;
+    writer_->GetStats(&stats);
+    LOGI("jpeg writer: %llu files, max queue %u, %u blocked, write %.1f ms avg "
+         "%.1f ms max, %u errors",
+         static_cast<unsigned long long>(stats.filesWritten),
+         stats.maxQueueDepth, stats.blockedSubmits, stats.avgWriteMs,
+         stats.maxWriteMs, stats.writeErrors);
+    // flushes the files still queued
+    delete writer_;
+    writer_ = nullptr;
+  }
+  if (zsl_) {
+    ZslStats stats;
+    zsl_->GetStats(&stats);
+    LOGI("zsl ring: %llu frames, %llu dropped, %llu shots, max distance "
+         "%.1f ms",
+         static_cast<unsigned long long>(stats.framesPushed),
+         static_cast<unsigned long long>(stats.framesDropped),
+         static_cast<unsigned long long>(stats.lookups),
+         stats.maxDistanceNs / 1000000.0);
+    // AImages must go back before their reader is deleted
+    delete zsl_;
+    zsl_ = nullptr;
+  }
   AImageReader_delete(reader_);
 }
 
@@ -89,12 +140,55 @@ void ImageReader::ImageCallback(AImageReader *reader) {
     media_status_t status = AImageReader_acquireNextImage(reader, &image);
     ASSERT(status == AMEDIA_OK && image, "Image is not available");
 
-    // Create a thread and write out the jpeg files
-    std::thread writeFileHandler(&ImageReader::WriteFile, this, image);
-    writeFileHandler.detach();
+    if (zsl_) {
+      // ZSL: keep the frame around until the shutter asks for it
+      int64_t timestamp = 0;
+      AImage_getTimestamp(image, &timestamp);
+      zsl_->Push(image, timestamp);
+      return;
+    }
+
+    // Hand the jpeg to the writer pool; it keeps a copy, so the image goes
+    // back to the reader right away
+    WriteFile(image);
   }
 }
 
+bool ImageReader::SaveZslFrame(int64_t shutterTimestampNs) {
+  if (!zsl_) return false;
+  int64_t frameTimestamp;
+  AImage *image =
+      static_cast<AImage *>(zsl_->Acquire(shutterTimestampNs, &frameTimestamp));
+  if (!image) return false;
+
+  // pinned: the ring cannot evict it while the writer pool copies it
+  QueueFile(image);
+  zsl_->Release(image);
+
+  ZslStats stats;
+  zsl_->GetStats(&stats);
+  LOGI("zsl shot: frame %.1f ms from shutter, lookup %llu ns",
+       (frameTimestamp - shutterTimestampNs) / 1000000.0,
+       static_cast<unsigned long long>(stats.lastLookupNs));
+  return true;
+}
+
+bool ImageReader::GetZslStats(ZslStats *stats) {
+  if (!zsl_) return false;
+  zsl_->GetStats(stats);
+  return true;
+}
+
+/**
+ * Report the activity of the jpeg writer pool
+ * @return false if this reader does not write files
+ */
+bool ImageReader::GetWriterStats(ImageWriterStats *stats) {
+  if (!writer_) return false;
+  writer_->GetStats(stats);
+  return true;
+}
+
 ANativeWindow *ImageReader::GetNativeWindow(void) {
   if (!reader_) return nullptr;
   ANativeWindow *nativeWindow;
@@ -140,59 +234,6 @@ void ImageReader::DeleteImage(AImage *image) {
   if (image) AImage_delete(image);
 }
 
-/**
- * Helper function for YUV_420 to RGB conversion. Courtesy of Tensorflow
- * ImageClassifier Sample:
- * https://github.com/tensorflow/tensorflow/blob/master/tensorflow/examples/android/jni/yuv2rgb.cc
- * The difference is that here we have to swap UV plane when calling it.
- */
-#ifndef MAX
-#define MAX(a, b)           \
-  ({                        \
-    __typeof__(a) _a = (a); \
-    __typeof__(b) _b = (b); \
-    _a > _b ? _a : _b;      \
-  })
-#define MIN(a, b)           \
-  ({                        \
-    __typeof__(a) _a = (a); \
-    __typeof__(b) _b = (b); \
-    _a < _b ? _a : _b;      \
-  })
-#endif
-
-// This value is 2 ^ 18 - 1, and is used to clamp the RGB values before their
-// ranges
-// are normalized to eight bits.
-static const int kMaxChannelValue = 262143;
-
-static inline uint32_t YUV2RGB(int nY, int nU, int nV) {
-  nY -= 16;
-  nU -= 128;
-  nV -= 128;
-  if (nY < 0) nY = 0;
-
-  // This is the floating point equivalent. We do the conversion in integer
-  // because some Android devices do not have floating point in hardware.
-  // nR = (int)(1.164 * nY + 1.596 * nV);
-  // nG = (int)(1.164 * nY - 0.813 * nV - 0.391 * nU);
-  // nB = (int)(1.164 * nY + 2.018 * nU);
-
-  int nR = (int)(1192 * nY + 1634 * nV);
-  int nG = (int)(1192 * nY - 833 * nV - 400 * nU);
-  int nB = (int)(1192 * nY + 2066 * nU);
-
-  nR = MIN(kMaxChannelValue, MAX(0, nR));
-  nG = MIN(kMaxChannelValue, MAX(0, nG));
-  nB = MIN(kMaxChannelValue, MAX(0, nB));
-
-  nR = (nR >> 10) & 0xff;
-  nG = (nG >> 10) & 0xff;
-  nB = (nB >> 10) & 0xff;
-
-  return 0xff000000 | (nR << 16) | (nG << 8) | nB;
-}
-
 /**
  * Convert yuv image inside AImage into ANativeWindow_Buffer
  * ANativeWindow_Buffer format is guaranteed to be
@@ -204,211 +245,89 @@ static inline uint32_t YUV2RGB(int nY, int nU, int nV) {
  *            it will be deleted via {@link AImage_delete}
  */
 bool ImageReader::DisplayImage(ANativeWindow_Buffer *buf, AImage *image) {
+  YuvImage src;
+  bool status = GetYuvImage(image, &src) && DisplayImage(buf, src);
+  AImage_delete(image);
+  return status;
+}
+
+/**
+ * Same as above, for a YuvImage whose AImage stays with the caller (a frame
+ * shared through a FramePipeline)
+ */
+bool ImageReader::DisplayImage(ANativeWindow_Buffer *buf,
+                               const YuvImage &src) {
   ASSERT(buf->format == WINDOW_FORMAT_RGBX_8888 ||
              buf->format == WINDOW_FORMAT_RGBA_8888,
          "Not supported buffer format");
+  ASSERT(presentRotation_ == 0 || presentRotation_ == 90 ||
+             presentRotation_ == 180 || presentRotation_ == 270,
+         "NOT recognized display rotation: %d", presentRotation_);
 
+  RgbaImage dst = {static_cast<uint32_t *>(buf->bits), buf->stride,
+                   buf->width, buf->height};
+  ConvertYuvToRgba(src, dst, presentRotation_);
+  return true;
+}
+
+/**
+ * Describe the planes and crop rectangle of a YUV_420_888 AImage, without
+ * copying them
+ * @return false if image is not YUV_420_888
+ */
+bool ImageReader::GetYuvImage(AImage *image, YuvImage *yuv) {
   int32_t srcFormat = -1;
   AImage_getFormat(image, &srcFormat);
   ASSERT(AIMAGE_FORMAT_YUV_420_888 == srcFormat, "Failed to get format");
   int32_t srcPlanes = 0;
   AImage_getNumberOfPlanes(image, &srcPlanes);
   ASSERT(srcPlanes == 3, "Is not 3 planes");
-
-  switch (presentRotation_) {
-    case 0:
-      PresentImage(buf, image);
-      break;
-    case 90:
-      PresentImage90(buf, image);
-      break;
-    case 180:
-      PresentImage180(buf, image);
-      break;
-    case 270:
-      PresentImage270(buf, image);
-      break;
-    default:
-      ASSERT(0, "NOT recognized display rotation: %d", presentRotation_);
-  }
-
-  AImage_delete(image);
-
-  return true;
-}
-
-/*
- * PresentImage()
- *   Converting yuv to RGB
- *   No rotation: (x,y) --> (x, y)
- *   Refer to:
- * https://mathbits.com/MathBits/TISection/Geometry/Transformations2.htm
- */
-void ImageReader::PresentImage(ANativeWindow_Buffer *buf, AImage *image) {  
-  AImageCropRect srcRect;
-  AImage_getCropRect(image, &srcRect);
-
-  int32_t yStride, uvStride;
-  uint8_t *yPixel, *uPixel, *vPixel;
-  int32_t yLen, uLen, vLen;
-  AImage_getPlaneRowStride(image, 0, &yStride);
-  AImage_getPlaneRowStride(image, 1, &uvStride);
-  AImage_getPlaneData(image, 0, &yPixel, &yLen);
-  AImage_getPlaneData(image, 1, &vPixel, &vLen);
-  AImage_getPlaneData(image, 2, &uPixel, &uLen);
-  int32_t uvPixelStride;
-  AImage_getPlanePixelStride(image, 1, &uvPixelStride);
-
-  int32_t height = MIN(buf->height, (srcRect.bottom - srcRect.top));
-  int32_t width = MIN(buf->width, (srcRect.right - srcRect.left));
-
-  uint32_t *out = static_cast<uint32_t *>(buf->bits);
-  for (int32_t y = 0; y < height; y++) {
-    const uint8_t *pY = yPixel + yStride * (y + srcRect.top) + srcRect.left;
-
-    int32_t uv_row_start = uvStride * ((y + srcRect.top) >> 1);
-    const uint8_t *pU = uPixel + uv_row_start + (srcRect.left >> 1);
-    const uint8_t *pV = vPixel + uv_row_start + (srcRect.left >> 1);
-
-    for (int32_t x = 0; x < width; x++) {
-      const int32_t uv_offset = (x >> 1) * uvPixelStride;
-      out[x] = YUV2RGB(pY[x], pU[uv_offset], pV[uv_offset]);
-    }
-    out += buf->stride;
+  if (srcFormat != AIMAGE_FORMAT_YUV_420_888 || srcPlanes != 3) {
+    return false;
   }
-}
 
-/*
- * PresentImage90()
- *   Converting YUV to RGB
- *   Rotation image anti-clockwise 90 degree -- (x, y) --> (-y, x)
- */
-void ImageReader::PresentImage90(ANativeWindow_Buffer *buf, AImage *image) {
   AImageCropRect srcRect;
   AImage_getCropRect(image, &srcRect);
 
-  int32_t yStride, uvStride;
+  // plane 1 / 2 are handed over as V / U: see YUV2RGB() in yuv_converter.cpp
   uint8_t *yPixel, *uPixel, *vPixel;
   int32_t yLen, uLen, vLen;
-  AImage_getPlaneRowStride(image, 0, &yStride);
-  AImage_getPlaneRowStride(image, 1, &uvStride);
+  AImage_getPlaneRowStride(image, 0, &yuv->yStride);
+  AImage_getPlaneRowStride(image, 1, &yuv->uvStride);
+  AImage_getPlanePixelStride(image, 1, &yuv->uvPixelStride);
   AImage_getPlaneData(image, 0, &yPixel, &yLen);
   AImage_getPlaneData(image, 1, &vPixel, &vLen);
   AImage_getPlaneData(image, 2, &uPixel, &uLen);
-  int32_t uvPixelStride;
-  AImage_getPlanePixelStride(image, 1, &uvPixelStride);
-
-  int32_t height = MIN(buf->width, (srcRect.bottom - srcRect.top));
-  int32_t width = MIN(buf->height, (srcRect.right - srcRect.left));
-
-  uint32_t *out = static_cast<uint32_t *>(buf->bits);
-  out += height - 1;
-  for (int32_t y = 0; y < height; y++) {
-    const uint8_t *pY = yPixel + yStride * (y + srcRect.top) + srcRect.left;
-
-    int32_t uv_row_start = uvStride * ((y + srcRect.top) >> 1);
-    const uint8_t *pU = uPixel + uv_row_start + (srcRect.left >> 1);
-    const uint8_t *pV = vPixel + uv_row_start + (srcRect.left >> 1);
-
-    for (int32_t x = 0; x < width; x++) {
-      const int32_t uv_offset = (x >> 1) * uvPixelStride;
-      // [x, y]--> [-y, x]
-      out[x * buf->stride] = YUV2RGB(pY[x], pU[uv_offset], pV[uv_offset]);
-    }
-    out -= 1;  // move to the next column
-  }
+  yuv->y = yPixel;
+  yuv->u = uPixel;
+  yuv->v = vPixel;
+  yuv->left = srcRect.left;
+  yuv->top = srcRect.top;
+  yuv->width = srcRect.right - srcRect.left;
+  yuv->height = srcRect.bottom - srcRect.top;
+  return true;
 }
 
-/*
- * PresentImage180()
- *   Converting yuv to RGB
- *   Rotate image 180 degree: (x, y) --> (-x, -y)
- */
-void ImageReader::PresentImage180(ANativeWindow_Buffer *buf, AImage *image) {
-  AImageCropRect srcRect;
-  AImage_getCropRect(image, &srcRect);
-
-  int32_t yStride, uvStride;
-  uint8_t *yPixel, *uPixel, *vPixel;
-  int32_t yLen, uLen, vLen;
-  AImage_getPlaneRowStride(image, 0, &yStride);
-  AImage_getPlaneRowStride(image, 1, &uvStride);
-  AImage_getPlaneData(image, 0, &yPixel, &yLen);
-  AImage_getPlaneData(image, 1, &vPixel, &vLen);
-  AImage_getPlaneData(image, 2, &uPixel, &uLen);
-  int32_t uvPixelStride;
-  AImage_getPlanePixelStride(image, 1, &uvPixelStride);
-
-  int32_t height = MIN(buf->height, (srcRect.bottom - srcRect.top));
-  int32_t width = MIN(buf->width, (srcRect.right - srcRect.left));
-
-  uint32_t *out = static_cast<uint32_t *>(buf->bits);
-  out += (height - 1) * buf->stride;
-  for (int32_t y = 0; y < height; y++) {
-    const uint8_t *pY = yPixel + yStride * (y + srcRect.top) + srcRect.left;
-
-    int32_t uv_row_start = uvStride * ((y + srcRect.top) >> 1);
-    const uint8_t *pU = uPixel + uv_row_start + (srcRect.left >> 1);
-    const uint8_t *pV = vPixel + uv_row_start + (srcRect.left >> 1);
-
-    for (int32_t x = 0; x < width; x++) {
-      const int32_t uv_offset = (x >> 1) * uvPixelStride;
-      // mirror image since we are using front camera
-      out[width - 1 - x] = YUV2RGB(pY[x], pU[uv_offset], pV[uv_offset]);
-      // out[x] = YUV2RGB(pY[x], pU[uv_offset], pV[uv_offset]);
-    }
-    out -= buf->stride;
-  }
+void ImageReader::SetPresentRotation(int32_t angle) {
+  presentRotation_ = angle;
 }
 
-/*
- * PresentImage270()
- *   Converting image from YUV to RGB
- *   Rotate Image counter-clockwise 270 degree: (x, y) --> (y, x)
+/**
+ * Queue a jpeg file to be written to kDirName directory. Blocks while the
+ * writer pool is full, which holds the reader back instead of dropping
+ * captures.
+ * @param image point capture jpg image, deleted before returning
  */
-void ImageReader::PresentImage270(ANativeWindow_Buffer *buf, AImage *image) {
-  AImageCropRect srcRect;
-  AImage_getCropRect(image, &srcRect);
-
-  int32_t yStride, uvStride;
-  uint8_t *yPixel, *uPixel, *vPixel;
-  int32_t yLen, uLen, vLen;
-  AImage_getPlaneRowStride(image, 0, &yStride);
-  AImage_getPlaneRowStride(image, 1, &uvStride);
-  AImage_getPlaneData(image, 0, &yPixel, &yLen);
-  AImage_getPlaneData(image, 1, &vPixel, &vLen);
-  AImage_getPlaneData(image, 2, &uPixel, &uLen);
-  int32_t uvPixelStride;
-  AImage_getPlanePixelStride(image, 1, &uvPixelStride);
-
-  int32_t height = MIN(buf->width, (srcRect.bottom - srcRect.top));
-  int32_t width = MIN(buf->height, (srcRect.right - srcRect.left));
-
-  uint32_t *out = static_cast<uint32_t *>(buf->bits);
-  for (int32_t y = 0; y < height; y++) {
-    const uint8_t *pY = yPixel + yStride * (y + srcRect.top) + srcRect.left;
-
-    int32_t uv_row_start = uvStride * ((y + srcRect.top) >> 1);
-    const uint8_t *pU = uPixel + uv_row_start + (srcRect.left >> 1);
-    const uint8_t *pV = vPixel + uv_row_start + (srcRect.left >> 1);
-
-    for (int32_t x = 0; x < width; x++) {
-      const int32_t uv_offset = (x >> 1) * uvPixelStride;
-      out[(width - 1 - x) * buf->stride] =
-          YUV2RGB(pY[x], pU[uv_offset], pV[uv_offset]);
-    }
-    out += 1;  // move to the next column
-  }
-}
-void ImageReader::SetPresentRotation(int32_t angle) {
-  presentRotation_ = angle;
+void ImageReader::WriteFile(AImage* image) {
+  QueueFile(image);
+  AImage_delete(image);
 }
 
 /**
- * Write out jpeg files to kDirName directory
+ * Copy a jpeg image into the writer pool; the image stays with the caller
  * @param image point capture jpg image
  */
-void ImageReader::WriteFile(AImage* image) {
+void ImageReader::QueueFile(AImage* image) {
 
   int planeCount;
   media_status_t status = AImage_getNumberOfPlanes(image, &planeCount);
@@ -418,15 +337,6 @@ void ImageReader::WriteFile(AImage* image) {
   int len = 0;
   AImage_getPlaneData(image, 0, &data, &len);
 
-  DIR *dir = opendir(kDirName);
-  if (dir) {
-    closedir(dir);
-  } else {
-    std::string cmd = "mkdir -p ";
-    cmd += kDirName;
-    system(cmd.c_str());
-  }
-
   struct timespec ts {
       0, 0
   };
@@ -434,24 +344,20 @@ void ImageReader::WriteFile(AImage* image) {
   struct tm localTime;
   localtime_r(&ts.tv_sec, &localTime);
 
-  std::string fileName = kDirName;
+  // burst captures land within the same second: keep them apart with
+  // the running index
   std::string dash("-");
-  fileName += kFileName + std::to_string(localTime.tm_mon) +
-              std::to_string(localTime.tm_mday) + dash +
-              std::to_string(localTime.tm_hour) +
-              std::to_string(localTime.tm_min) +
-              std::to_string(localTime.tm_sec) + ".jpg";
-  FILE *file = fopen(fileName.c_str(), "wb");
-  if (file && data && len) {
-    fwrite(data, 1, len, file);
-    fclose(file);
-
-    if (callback_) {
-      callback_(callbackCtx_, fileName.c_str());
-    }
-  } else {
-    if (file)
-      fclose(file);
+  std::string fileName = kFileName + std::to_string(localTime.tm_mon) +
+                         std::to_string(localTime.tm_mday) + dash +
+                         std::to_string(localTime.tm_hour) +
+                         std::to_string(localTime.tm_min) +
+                         std::to_string(localTime.tm_sec) + dash +
+                         std::to_string(fileIndex_++) + ".jpg";
+  if (data && len) {
+    writer_->Submit(data, len, fileName, [this](const char *path) {
+      if (callback_) {
+        callback_(callbackCtx_, path);
+      }
+    });
   }
-  AImage_delete(image);
-}
\ No newline at end of file
+}
@@ -18,6 +18,9 @@
 #define CAMERA_IMAGE_READER_H
 #include <media/NdkImageReader.h>
 #include <functional>
+#include "image_writer.h"
+#include "yuv_converter.h"
+#include "zsl_ring.h"
 /*
  * ImageFormat:
  *     A Data Structure to communicate resolution between camera and ImageReader
@@ -34,8 +37,11 @@ class ImageReader {
  public:
   /**
    * Ctor and Dtor()
+   * zslFrames: for JPEG readers fed by the repeating request, keep that many
+   * recent frames in a ZslRing instead of saving every one of them.
    */
-  explicit ImageReader(ImageFormat* res, enum AIMAGE_FORMATS format);
+  explicit ImageReader(ImageFormat* res, enum AIMAGE_FORMATS format,
+                       uint32_t zslFrames = 0);
 
   ~ImageReader();
 
@@ -81,6 +87,13 @@ class ImageReader {
    *   @return true on success, false on failure
    */
   bool DisplayImage(ANativeWindow_Buffer* buf, AImage* image);
+  bool DisplayImage(ANativeWindow_Buffer* buf, const YuvImage& src);
+
+  /**
+   * Fill yuv with the planes of a YUV_420_888 image: pointers into the
+   * AImage, valid until it is deleted.
+   */
+  static bool GetYuvImage(AImage* image, YuvImage* yuv);
   /**
    * Configure the rotation angle necessary to apply to
    * Camera image when presenting: all rotations should be accumulated:
@@ -96,6 +109,22 @@ class ImageReader {
    * @param callback is the actual callback function
    */
   void RegisterCallback(void* ctx, std::function<void(void* ctx, const char* fileName)>);
+
+  /**
+   * Queue depth and write latency of the jpeg writer pool
+   * @return false for readers not writing files (YUV)
+   */
+  bool GetWriterStats(ImageWriterStats* stats);
+
+  /**
+   * Zero shutter lag: save the kept frame nearest to the shutter time
+   * @param shutterTimestampNs shutter press, in sensor timestamp time base
+   * @return false if there is no frame to save (not in ZSL mode, or no frame
+   *         arrived yet)
+   */
+  bool SaveZslFrame(int64_t shutterTimestampNs);
+  bool IsZsl(void) const { return zsl_ != nullptr; }
+  bool GetZslStats(ZslStats* stats);
  private:
   int32_t presentRotation_;
   AImageReader* reader_;
@@ -103,12 +132,12 @@ class ImageReader {
   std::function<void(void *ctx, const char* fileName)> callback_;
   void *callbackCtx_;
 
-  void PresentImage(ANativeWindow_Buffer* buf, AImage* image);
-  void PresentImage90(ANativeWindow_Buffer* buf, AImage* image);
-  void PresentImage180(ANativeWindow_Buffer* buf, AImage* image);
-  void PresentImage270(ANativeWindow_Buffer* buf, AImage* image);
+  ImageWriterPool* writer_;
+  uint32_t fileIndex_;
+  ZslRing* zsl_;
 
   void WriteFile(AImage* image);
+  void QueueFile(AImage* image);
 };
 
 #endif  // CAMERA_IMAGE_READER_H
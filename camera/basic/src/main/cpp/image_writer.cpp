@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "image_writer.h"
+#include "utils/native_debug.h"
+
+static double NowMs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/*
+ * mkdir -p, without going through system()
+ */
+static void MakeDirectories(const std::string& dir) {
+  for (size_t pos = dir.find('/', 1); pos != std::string::npos;
+       pos = dir.find('/', pos + 1)) {
+    std::string path = dir.substr(0, pos);
+    if (mkdir(path.c_str(), 0775) && errno != EEXIST) {
+      LOGW("Failed to create %s: %s", path.c_str(), strerror(errno));
+      return;
+    }
+  }
+}
+
+ImageWriterPool::ImageWriterPool(const char* dir, uint32_t threadCount,
+                                 uint32_t queueSize)
+    : dir_(dir),
+      jobs_(queueSize),
+      copying_(0),
+      stopping_(false),
+      totalWriteMs_(0.0) {
+  ASSERT(threadCount && queueSize, "Empty ImageWriterPool");
+  memset(&stats_, 0, sizeof(stats_));
+  MakeDirectories(dir_);
+
+  for (auto& job : jobs_) {
+    freeJobs_.push_back(&job);
+  }
+  for (uint32_t i = 0; i < threadCount; i++) {
+    threads_.emplace_back(&ImageWriterPool::WriterThread, this);
+  }
+}
+
+ImageWriterPool::~ImageWriterPool() {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    stopping_ = true;
+  }
+  jobReady_.notify_all();
+  slotFree_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+bool ImageWriterPool::Submit(const uint8_t* data, size_t len,
+                             const std::string& fileName,
+                             std::function<void(const char*)> done) {
+  Job* job;
+  {
+    std::unique_lock<std::mutex> guard(lock_);
+    if (freeJobs_.empty()) {
+      stats_.blockedSubmits++;
+      slotFree_.wait(guard, [this] { return stopping_ || !freeJobs_.empty(); });
+    }
+    if (stopping_) return false;
+    job = freeJobs_.back();
+    freeJobs_.pop_back();
+    copying_++;
+    stats_.queueDepth++;
+    stats_.maxQueueDepth = std::max(stats_.maxQueueDepth, stats_.queueDepth);
+  }
+
+  // the slot is ours: copy without holding the lock. The buffer only ever
+  // grows, so after the first few captures this does not allocate.
+  if (job->data.size() < len) {
+    job->data.resize(len);
+  }
+  memcpy(job->data.data(), data, len);
+  job->len = len;
+  job->path = dir_ + fileName;
+  job->done = std::move(done);
+
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    pendingJobs_.push_back(job);
+    copying_--;
+  }
+  jobReady_.notify_one();
+  return true;
+}
+
+/*
+ * One open(), as few write()s as the kernel allows, no stdio buffering
+ */
+bool ImageWriterPool::WriteJob(const Job* job) {
+  int fd = open(job->path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                0644);
+  if (fd < 0) {
+    LOGE("Failed to open %s: %s", job->path.c_str(), strerror(errno));
+    return false;
+  }
+  const uint8_t* data = job->data.data();
+  size_t left = job->len;
+  while (left) {
+    ssize_t written = write(fd, data, left);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      LOGE("Failed to write %s: %s", job->path.c_str(), strerror(errno));
+      break;
+    }
+    data += written;
+    left -= written;
+  }
+  return close(fd) == 0 && !left;
+}
+
+void ImageWriterPool::WriterThread(void) {
+  std::unique_lock<std::mutex> guard(lock_);
+  for (;;) {
+    // when stopping, wait for the Submit() calls still copying their data
+    jobReady_.wait(guard, [this] {
+      return (stopping_ && !copying_) || !pendingJobs_.empty();
+    });
+    if (pendingJobs_.empty()) {
+      break;  // stopping, and everything queued has been written
+    }
+    Job* job = pendingJobs_.front();
+    pendingJobs_.pop_front();
+    guard.unlock();
+
+    double start = NowMs();
+    bool ok = WriteJob(job);
+    float writeMs = static_cast<float>(NowMs() - start);
+    if (ok && job->done) {
+      job->done(job->path.c_str());
+    }
+    job->done = nullptr;
+
+    guard.lock();
+    if (ok) {
+      stats_.filesWritten++;
+      stats_.bytesWritten += job->len;
+    } else {
+      stats_.writeErrors++;
+    }
+    totalWriteMs_ += writeMs;
+    stats_.lastWriteMs = writeMs;
+    stats_.maxWriteMs = std::max(stats_.maxWriteMs, writeMs);
+    stats_.queueDepth--;
+    freeJobs_.push_back(job);
+    slotFree_.notify_one();
+  }
+}
+
+void ImageWriterPool::GetStats(ImageWriterStats* stats) {
+  std::lock_guard<std::mutex> guard(lock_);
+  *stats = stats_;
+  uint64_t count = stats_.filesWritten + stats_.writeErrors;
+  stats->avgWriteMs =
+      count ? static_cast<float>(totalWriteMs_ / count) : 0.0f;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CAMERA_IMAGE_WRITER_H
+#define CAMERA_IMAGE_WRITER_H
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * ImageWriterStats:
+ *   snapshot of the writer pool activity
+ */
+struct ImageWriterStats {
+  uint32_t queueDepth;      // files waiting or being written right now
+  uint32_t maxQueueDepth;
+  uint32_t blockedSubmits;  // Submit() calls that had to wait for a slot
+  uint32_t writeErrors;
+  uint64_t filesWritten;
+  uint64_t bytesWritten;
+  float lastWriteMs;        // open() to close() of a single file
+  float avgWriteMs;
+  float maxWriteMs;
+};
+
+/*
+ * ImageWriterPool:
+ *   A fixed set of writer threads saving encoded images into one directory.
+ *   The queue is bounded to a fixed number of slots whose buffers are
+ *   reused: Submit() copies the data into a free slot, so the caller may
+ *   release its AImage right away, and blocks while every slot is busy.
+ *   That pushes back on the producer instead of piling up threads.
+ */
+class ImageWriterPool {
+ public:
+  /**
+   * Create the directory (once, like mkdir -p) and start the writers.
+   * @param dir directory the files are written to, with trailing '/'
+   * @param threadCount number of writer threads
+   * @param queueSize number of slots: files queued or being written
+   */
+  ImageWriterPool(const char* dir, uint32_t threadCount, uint32_t queueSize);
+
+  /**
+   * Write out everything still queued and stop the writers.
+   */
+  ~ImageWriterPool();
+
+  /**
+   * Queue data to be written to dir + fileName. done(fullPath) is called
+   * from the writer thread once the file is complete.
+   * @return false if the pool is shutting down
+   */
+  bool Submit(const uint8_t* data, size_t len, const std::string& fileName,
+              std::function<void(const char* fullPath)> done);
+
+  void GetStats(ImageWriterStats* stats);
+
+ private:
+  struct Job {
+    std::vector<uint8_t> data;
+    size_t len;
+    std::string path;
+    std::function<void(const char*)> done;
+  };
+
+  void WriterThread(void);
+  bool WriteJob(const Job* job);
+
+  std::string dir_;
+  std::vector<Job> jobs_;
+  std::vector<Job*> freeJobs_;
+  std::deque<Job*> pendingJobs_;
+  std::vector<std::thread> threads_;
+  std::mutex lock_;
+  std::condition_variable jobReady_;
+  std::condition_variable slotFree_;
+  uint32_t copying_;  // slots taken by Submit() but not queued yet
+  bool stopping_;
+
+  ImageWriterStats stats_;
+  double totalWriteMs_;
+};
+
+#endif  // CAMERA_IMAGE_WRITER_H
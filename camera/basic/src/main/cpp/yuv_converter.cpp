@@ -0,0 +1,460 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define YUV_USE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define YUV_USE_SSE2 1
+#endif
+
+#include "yuv_converter.h"
+
+/*
+ * YUV_TILE:
+ *   edge of the square tiles used by the 90/270 degree conversions;
+ *   32 x 32 RGBA pixels = 4KB, comfortably inside L1.
+ * YUV_CHUNK:
+ *   pixels per call of the row kernel; also the width of the 180 degree
+ *   tiles, which only need to reverse rows and so are YUV_CHUNK_ROWS high.
+ */
+#define YUV_TILE 32
+#define YUV_CHUNK 256
+#define YUV_CHUNK_ROWS 8
+
+/**
+ * Helper function for YUV_420 to RGB conversion. Courtesy of Tensorflow
+ * ImageClassifier Sample:
+ * https://github.com/tensorflow/tensorflow/blob/master/tensorflow/examples/android/jni/yuv2rgb.cc
+ * The difference is that here we have to swap UV plane when calling it.
+ */
+// This value is 2 ^ 18 - 1, and is used to clamp the RGB values before their
+// ranges
+// are normalized to eight bits.
+static const int kMaxChannelValue = 262143;
+
+static inline uint32_t YUV2RGB(int nY, int nU, int nV) {
+  nY -= 16;
+  nU -= 128;
+  nV -= 128;
+  if (nY < 0) nY = 0;
+
+  // This is the floating point equivalent. We do the conversion in integer
+  // because some Android devices do not have floating point in hardware.
+  // nR = (int)(1.164 * nY + 1.596 * nV);
+  // nG = (int)(1.164 * nY - 0.813 * nV - 0.391 * nU);
+  // nB = (int)(1.164 * nY + 2.018 * nU);
+
+  int nR = (int)(1192 * nY + 1634 * nV);
+  int nG = (int)(1192 * nY - 833 * nV - 400 * nU);
+  int nB = (int)(1192 * nY + 2066 * nU);
+
+  nR = std::min(kMaxChannelValue, std::max(0, nR));
+  nG = std::min(kMaxChannelValue, std::max(0, nG));
+  nB = std::min(kMaxChannelValue, std::max(0, nB));
+
+  nR = (nR >> 10) & 0xff;
+  nG = (nG >> 10) & 0xff;
+  nB = (nB >> 10) & 0xff;
+
+  return 0xff000000 | (nR << 16) | (nG << 8) | nB;
+}
+
+/*
+ * Row kernel: convert n pixels of one or two luma rows sharing the same
+ * chroma row. u/v are contiguous (already gathered) chroma samples, one per
+ * 2 pixels. The chroma part of every 2x2 block is computed once. y1/out1
+ * may be nullptr for a single row.
+ * The SIMD versions produce exactly the same pixels as YUV2RGB().
+ */
+#if defined(YUV_USE_NEON)
+static inline uint8x16_t PackChannel(const int32x4_t* y, const int32x4_t* c) {
+  uint16x8_t lo = vcombine_u16(vqshrun_n_s32(vaddq_s32(y[0], c[0]), 10),
+                               vqshrun_n_s32(vaddq_s32(y[1], c[1]), 10));
+  uint16x8_t hi = vcombine_u16(vqshrun_n_s32(vaddq_s32(y[2], c[2]), 10),
+                               vqshrun_n_s32(vaddq_s32(y[3], c[3]), 10));
+  return vcombine_u8(vqmovn_u16(lo), vqmovn_u16(hi));
+}
+
+static inline void ConvertRow16(const uint8_t* y, const int32x4_t* r,
+                                const int32x4_t* g, const int32x4_t* b,
+                                uint32_t* out) {
+  uint8x16_t yv = vqsubq_u8(vld1q_u8(y), vdupq_n_u8(16));
+  uint16x8_t yLo = vmovl_u8(vget_low_u8(yv));
+  uint16x8_t yHi = vmovl_u8(vget_high_u8(yv));
+  int32x4_t ys[4] = {
+      vreinterpretq_s32_u32(vmull_n_u16(vget_low_u16(yLo), 1192)),
+      vreinterpretq_s32_u32(vmull_n_u16(vget_high_u16(yLo), 1192)),
+      vreinterpretq_s32_u32(vmull_n_u16(vget_low_u16(yHi), 1192)),
+      vreinterpretq_s32_u32(vmull_n_u16(vget_high_u16(yHi), 1192)),
+  };
+  // memory order of 0xAARRGGBB on little endian: B, G, R, A
+  uint8x16x4_t px;
+  px.val[0] = PackChannel(ys, b);
+  px.val[1] = PackChannel(ys, g);
+  px.val[2] = PackChannel(ys, r);
+  px.val[3] = vdupq_n_u8(0xff);
+  vst4q_u8(reinterpret_cast<uint8_t*>(out), px);
+}
+
+static inline void DuplicateChroma(int32x4_t lo, int32x4_t hi, int32x4_t* c) {
+  int32x4x2_t l = vzipq_s32(lo, lo);
+  int32x4x2_t h = vzipq_s32(hi, hi);
+  c[0] = l.val[0];
+  c[1] = l.val[1];
+  c[2] = h.val[0];
+  c[3] = h.val[1];
+}
+#elif defined(YUV_USE_SSE2)
+static inline __m128i PackChannel(const __m128i* y, const __m128i* c) {
+  __m128i lo = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(y[0], c[0]), 10),
+                               _mm_srai_epi32(_mm_add_epi32(y[1], c[1]), 10));
+  __m128i hi = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(y[2], c[2]), 10),
+                               _mm_srai_epi32(_mm_add_epi32(y[3], c[3]), 10));
+  return _mm_packus_epi16(lo, hi);
+}
+
+static inline void ConvertRow16(const uint8_t* y, const __m128i* r,
+                                const __m128i* g, const __m128i* b,
+                                uint32_t* out) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i kY = _mm_set1_epi32(1192);  // 16 bit pairs (1192, 0)
+  __m128i yv = _mm_subs_epu8(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(y)), _mm_set1_epi8(16));
+  __m128i yLo = _mm_unpacklo_epi8(yv, zero);
+  __m128i yHi = _mm_unpackhi_epi8(yv, zero);
+  __m128i ys[4] = {
+      _mm_madd_epi16(_mm_unpacklo_epi16(yLo, zero), kY),
+      _mm_madd_epi16(_mm_unpackhi_epi16(yLo, zero), kY),
+      _mm_madd_epi16(_mm_unpacklo_epi16(yHi, zero), kY),
+      _mm_madd_epi16(_mm_unpackhi_epi16(yHi, zero), kY),
+  };
+  __m128i B = PackChannel(ys, b);
+  __m128i G = PackChannel(ys, g);
+  __m128i R = PackChannel(ys, r);
+  __m128i A = _mm_set1_epi8(static_cast<char>(0xff));
+  // memory order of 0xAARRGGBB on little endian: B, G, R, A
+  __m128i bgLo = _mm_unpacklo_epi8(B, G), bgHi = _mm_unpackhi_epi8(B, G);
+  __m128i raLo = _mm_unpacklo_epi8(R, A), raHi = _mm_unpackhi_epi8(R, A);
+  __m128i* dst = reinterpret_cast<__m128i*>(out);
+  _mm_storeu_si128(dst, _mm_unpacklo_epi16(bgLo, raLo));
+  _mm_storeu_si128(dst + 1, _mm_unpackhi_epi16(bgLo, raLo));
+  _mm_storeu_si128(dst + 2, _mm_unpacklo_epi16(bgHi, raHi));
+  _mm_storeu_si128(dst + 3, _mm_unpackhi_epi16(bgHi, raHi));
+}
+
+static inline void DuplicateChroma(__m128i lo, __m128i hi, __m128i* c) {
+  c[0] = _mm_unpacklo_epi32(lo, lo);
+  c[1] = _mm_unpackhi_epi32(lo, lo);
+  c[2] = _mm_unpacklo_epi32(hi, hi);
+  c[3] = _mm_unpackhi_epi32(hi, hi);
+}
+#endif
+
+static void ConvertRows(const uint8_t* y0, const uint8_t* y1,
+                        const uint8_t* u, const uint8_t* v, uint32_t* out0,
+                        uint32_t* out1, int32_t n) {
+  int32_t x = 0;
+#if defined(YUV_USE_NEON)
+  for (; x + 16 <= n; x += 16) {
+    int16x8_t U = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(u + x / 2))),
+                            vdupq_n_s16(128));
+    int16x8_t V = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(v + x / 2))),
+                            vdupq_n_s16(128));
+    int32x4_t r[4], g[4], b[4];
+    DuplicateChroma(vmull_n_s16(vget_low_s16(V), 1634),
+                    vmull_n_s16(vget_high_s16(V), 1634), r);
+    DuplicateChroma(
+        vmlal_n_s16(vmull_n_s16(vget_low_s16(V), -833), vget_low_s16(U), -400),
+        vmlal_n_s16(vmull_n_s16(vget_high_s16(V), -833), vget_high_s16(U), -400),
+        g);
+    DuplicateChroma(vmull_n_s16(vget_low_s16(U), 2066),
+                    vmull_n_s16(vget_high_s16(U), 2066), b);
+    ConvertRow16(y0 + x, r, g, b, out0 + x);
+    if (y1) ConvertRow16(y1 + x, r, g, b, out1 + x);
+  }
+#elif defined(YUV_USE_SSE2)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i kR = _mm_setr_epi16(1634, 0, 1634, 0, 1634, 0, 1634, 0);
+  const __m128i kG =
+      _mm_setr_epi16(-833, -400, -833, -400, -833, -400, -833, -400);
+  const __m128i kB = _mm_setr_epi16(0, 2066, 0, 2066, 0, 2066, 0, 2066);
+  for (; x + 16 <= n; x += 16) {
+    __m128i U = _mm_sub_epi16(
+        _mm_unpacklo_epi8(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(u + x / 2)), zero),
+        _mm_set1_epi16(128));
+    __m128i V = _mm_sub_epi16(
+        _mm_unpacklo_epi8(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(v + x / 2)), zero),
+        _mm_set1_epi16(128));
+    // (V, U) pairs: one madd per channel gives the 32 bit chroma terms
+    __m128i vuLo = _mm_unpacklo_epi16(V, U), vuHi = _mm_unpackhi_epi16(V, U);
+    __m128i r[4], g[4], b[4];
+    DuplicateChroma(_mm_madd_epi16(vuLo, kR), _mm_madd_epi16(vuHi, kR), r);
+    DuplicateChroma(_mm_madd_epi16(vuLo, kG), _mm_madd_epi16(vuHi, kG), g);
+    DuplicateChroma(_mm_madd_epi16(vuLo, kB), _mm_madd_epi16(vuHi, kB), b);
+    ConvertRow16(y0 + x, r, g, b, out0 + x);
+    if (y1) ConvertRow16(y1 + x, r, g, b, out1 + x);
+  }
+#endif
+  for (; x < n; x++) {
+    out0[x] = YUV2RGB(y0[x], u[x >> 1], v[x >> 1]);
+    if (y1) out1[x] = YUV2RGB(y1[x], u[x >> 1], v[x >> 1]);
+  }
+}
+
+/*
+ * Copy the chroma samples of n pixels starting at (x0, row) into u/v,
+ * dropping the pixel stride. x0 must be even.
+ */
+static void GatherChroma(const YuvImage& src, int32_t x0, int32_t row,
+                         int32_t n, uint8_t* u, uint8_t* v) {
+  int32_t count = (n + 1) >> 1;
+  int32_t offset = src.uvStride * ((row + src.top) >> 1) +
+                   ((src.left >> 1) + (x0 >> 1)) * src.uvPixelStride;
+  const uint8_t* pU = src.u + offset;
+  const uint8_t* pV = src.v + offset;
+  if (src.uvPixelStride == 1) {
+    memcpy(u, pU, count);
+    memcpy(v, pV, count);
+    return;
+  }
+  for (int32_t i = 0; i < count; i++) {
+    u[i] = pU[i * src.uvPixelStride];
+    v[i] = pV[i * src.uvPixelStride];
+  }
+}
+
+/*
+ * Convert the source block [x0, x0 + n) x [row0, row1) into out, row by row,
+ * taking two luma rows per chroma row whenever they pair up.
+ */
+static void ConvertBlock(const YuvImage& src, int32_t x0, int32_t n,
+                         int32_t row0, int32_t row1, uint32_t* out,
+                         int32_t outStride) {
+  uint8_t u[YUV_CHUNK / 2], v[YUV_CHUNK / 2];
+  for (int32_t row = row0; row < row1;) {
+    bool pair = !((row + src.top) & 1) && row + 1 < row1;
+    const uint8_t* y0 =
+        src.y + src.yStride * (row + src.top) + src.left + x0;
+    uint32_t* out0 = out + (row - row0) * outStride;
+    for (int32_t x = 0; x < n; x += YUV_CHUNK) {
+      int32_t count = std::min(n - x, YUV_CHUNK);
+      GatherChroma(src, x0 + x, row, count, u, v);
+      ConvertRows(y0 + x, pair ? y0 + src.yStride + x : nullptr, u, v,
+                  out0 + x, pair ? out0 + outStride + x : nullptr, count);
+    }
+    row += pair ? 2 : 1;
+  }
+}
+
+/*
+ * Write the transpose of the 4x4 block at in (rows inStride apart) to out
+ * (rows outStride apart). Negative strides flip the block on the way.
+ */
+static inline void Transpose4x4(const uint32_t* in, int32_t inStride,
+                                uint32_t* out, int32_t outStride) {
+#if defined(YUV_USE_NEON)
+  uint32x4x2_t p = vtrnq_u32(vld1q_u32(in), vld1q_u32(in + inStride));
+  uint32x4x2_t q =
+      vtrnq_u32(vld1q_u32(in + 2 * inStride), vld1q_u32(in + 3 * inStride));
+  vst1q_u32(out, vcombine_u32(vget_low_u32(p.val[0]), vget_low_u32(q.val[0])));
+  vst1q_u32(out + outStride,
+            vcombine_u32(vget_low_u32(p.val[1]), vget_low_u32(q.val[1])));
+  vst1q_u32(out + 2 * outStride,
+            vcombine_u32(vget_high_u32(p.val[0]), vget_high_u32(q.val[0])));
+  vst1q_u32(out + 3 * outStride,
+            vcombine_u32(vget_high_u32(p.val[1]), vget_high_u32(q.val[1])));
+#elif defined(YUV_USE_SSE2)
+  const __m128i* src = reinterpret_cast<const __m128i*>(in);
+  __m128i r0 = _mm_loadu_si128(src);
+  __m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + inStride));
+  __m128i r2 =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * inStride));
+  __m128i r3 =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 3 * inStride));
+  __m128i t0 = _mm_unpacklo_epi32(r0, r1), t1 = _mm_unpacklo_epi32(r2, r3);
+  __m128i t2 = _mm_unpackhi_epi32(r0, r1), t3 = _mm_unpackhi_epi32(r2, r3);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi64(t0, t1));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out + outStride),
+                   _mm_unpackhi_epi64(t0, t1));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * outStride),
+                   _mm_unpacklo_epi64(t2, t3));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 3 * outStride),
+                   _mm_unpackhi_epi64(t2, t3));
+#else
+  for (int32_t i = 0; i < 4; i++) {
+    for (int32_t j = 0; j < 4; j++) {
+      out[i * outStride + j] = in[j * inStride + i];
+    }
+  }
+#endif
+}
+
+/*
+ * Store a converted tile (tw x th pixels at source position tx, ty) into
+ * dst with the requested rotation. width/height are the source dimensions
+ * being converted.
+ *   90: (x, y) --> (height - 1 - y, x)
+ *  180: (x, y) --> (width - 1 - x, height - 1 - y)
+ *  270: (x, y) --> (y, width - 1 - x)
+ */
+static void StoreTile(const uint32_t* tile, int32_t tileStride, int32_t tx,
+                      int32_t ty, int32_t tw, int32_t th, int32_t width,
+                      int32_t height, const RgbaImage& dst, int32_t rotation) {
+  int32_t stride = dst.stride;
+  int32_t tw4 = tw & ~3, th4 = th & ~3;
+  if (rotation == 90) {
+    // source column x becomes destination row x, read bottom up
+    for (int32_t j = 0; j < th4; j += 4) {
+      for (int32_t i = 0; i < tw4; i += 4) {
+        Transpose4x4(tile + (j + 3) * tileStride + i, -tileStride,
+                     dst.bits + (tx + i) * stride + height - 4 - ty - j,
+                     stride);
+      }
+    }
+    for (int32_t j = 0; j < th; j++) {
+      for (int32_t i = (j < th4) ? tw4 : 0; i < tw; i++) {
+        dst.bits[(tx + i) * stride + height - 1 - ty - j] =
+            tile[j * tileStride + i];
+      }
+    }
+  } else if (rotation == 270) {
+    // source column x becomes destination row width - 1 - x
+    for (int32_t j = 0; j < th4; j += 4) {
+      for (int32_t i = 0; i < tw4; i += 4) {
+        Transpose4x4(tile + j * tileStride + i, tileStride,
+                     dst.bits + (width - 1 - tx - i) * stride + ty + j,
+                     -stride);
+      }
+    }
+    for (int32_t j = 0; j < th; j++) {
+      for (int32_t i = (j < th4) ? tw4 : 0; i < tw; i++) {
+        dst.bits[(width - 1 - tx - i) * stride + ty + j] =
+            tile[j * tileStride + i];
+      }
+    }
+  } else {
+    // 180: every row lands reversed on its mirrored row
+    for (int32_t j = 0; j < th; j++) {
+      const uint32_t* in = tile + j * tileStride;
+      uint32_t* out = dst.bits + (height - 1 - ty - j) * stride + width - tx;
+      int32_t i = 0;
+#if defined(YUV_USE_NEON)
+      for (; i + 4 <= tw; i += 4) {
+        uint32x4_t p = vrev64q_u32(vld1q_u32(in + i));
+        vst1q_u32(out - i - 4, vcombine_u32(vget_high_u32(p), vget_low_u32(p)));
+      }
+#elif defined(YUV_USE_SSE2)
+      for (; i + 4 <= tw; i += 4) {
+        __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out - i - 4),
+                         _mm_shuffle_epi32(p, _MM_SHUFFLE(0, 1, 2, 3)));
+      }
+#endif
+      for (; i < tw; i++) {
+        out[-i - 1] = in[i];
+      }
+    }
+  }
+}
+
+void ConvertYuvToRgba(const YuvImage& src, const RgbaImage& dst,
+                      int32_t rotation) {
+  bool swap = (rotation == 90 || rotation == 270);
+  int32_t height = std::min(swap ? dst.width : dst.height, src.height);
+  int32_t width = std::min(swap ? dst.height : dst.width, src.width);
+  if (width <= 0 || height <= 0) return;
+
+  if (rotation == 0) {
+    ConvertBlock(src, 0, width, 0, height, dst.bits, dst.stride);
+    return;
+  }
+
+  static_assert(YUV_CHUNK * YUV_CHUNK_ROWS >= YUV_TILE * YUV_TILE,
+                "tile buffer too small");
+  uint32_t tile[YUV_CHUNK * YUV_CHUNK_ROWS];
+  int32_t tileW = (rotation == 180) ? YUV_CHUNK : YUV_TILE;
+  int32_t tileH = (rotation == 180) ? YUV_CHUNK_ROWS : YUV_TILE;
+  for (int32_t ty = 0; ty < height; ty += tileH) {
+    int32_t th = std::min(height - ty, tileH);
+    for (int32_t tx = 0; tx < width; tx += tileW) {
+      int32_t tw = std::min(width - tx, tileW);
+      ConvertBlock(src, tx, tw, ty, ty + th, tile, tileW);
+      StoreTile(tile, tileW, tx, ty, tw, th, width, height, dst, rotation);
+    }
+  }
+}
+
+/*
+ * The per pixel conversions formerly in ImageReader::PresentImage*()
+ */
+void ConvertYuvToRgbaReference(const YuvImage& src, const RgbaImage& dst,
+                               int32_t rotation) {
+  bool swap = (rotation == 90 || rotation == 270);
+  int32_t height = std::min(swap ? dst.width : dst.height, src.height);
+  int32_t width = std::min(swap ? dst.height : dst.width, src.width);
+
+  uint32_t* out = dst.bits;
+  if (rotation == 90) {
+    out += height - 1;
+  } else if (rotation == 180) {
+    out += (height - 1) * dst.stride;
+  }
+  for (int32_t y = 0; y < height; y++) {
+    const uint8_t* pY = src.y + src.yStride * (y + src.top) + src.left;
+
+    int32_t uv_row_start = src.uvStride * ((y + src.top) >> 1);
+    const uint8_t* pU = src.u + uv_row_start + (src.left >> 1) * src.uvPixelStride;
+    const uint8_t* pV = src.v + uv_row_start + (src.left >> 1) * src.uvPixelStride;
+
+    for (int32_t x = 0; x < width; x++) {
+      const int32_t uv_offset = (x >> 1) * src.uvPixelStride;
+      uint32_t rgb = YUV2RGB(pY[x], pU[uv_offset], pV[uv_offset]);
+      switch (rotation) {
+        case 90:
+          out[x * dst.stride] = rgb;
+          break;
+        case 180:
+          out[width - 1 - x] = rgb;
+          break;
+        case 270:
+          out[(width - 1 - x) * dst.stride] = rgb;
+          break;
+        default:
+          out[x] = rgb;
+      }
+    }
+    switch (rotation) {
+      case 90:
+        out -= 1;  // move to the next column
+        break;
+      case 180:
+        out -= dst.stride;
+        break;
+      case 270:
+        out += 1;  // move to the next column
+        break;
+      default:
+        out += dst.stride;
+    }
+  }
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CAMERA_YUV_CONVERTER_H
+#define CAMERA_YUV_CONVERTER_H
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * YuvImage:
+ *   The 3 planes of a YUV_420_888 image plus its crop rectangle. Chroma
+ *   planes may be planar (uvPixelStride 1) or semi-planar (uvPixelStride 2).
+ */
+struct YuvImage {
+  const uint8_t* y;
+  const uint8_t* u;
+  const uint8_t* v;
+  int32_t yStride;
+  int32_t uvStride;
+  int32_t uvPixelStride;
+
+  int32_t left;  // crop rectangle
+  int32_t top;
+  int32_t width;
+  int32_t height;
+};
+
+/*
+ * RgbaImage:
+ *   Destination of the conversion, 32 bits per pixel, stride in pixels.
+ *   Usually the bits of an ANativeWindow_Buffer.
+ */
+struct RgbaImage {
+  uint32_t* bits;
+  int32_t stride;
+  int32_t width;
+  int32_t height;
+};
+
+/**
+ * Convert src into dst, rotating it by 0, 90, 180 or 270 degree on the way
+ * (same mapping as the original per pixel ImageReader::PresentImage*()).
+ * The part of the image not fitting into dst is cropped.
+ *
+ * The conversion runs on 2x2 pixel blocks sharing one chroma sample with
+ * NEON / SSE2 where available. Rotated output is produced in small tiles
+ * that stay in L1, so the source is read and the destination is written
+ * row by row instead of striding down the columns.
+ */
+void ConvertYuvToRgba(const YuvImage& src, const RgbaImage& dst,
+                      int32_t rotation);
+
+/**
+ * The original scalar, one pixel at a time conversion; kept as the
+ * reference for ConvertYuvToRgba().
+ */
+void ConvertYuvToRgbaReference(const YuvImage& src, const RgbaImage& dst,
+                               int32_t rotation);
+
+#endif  // CAMERA_YUV_CONVERTER_H
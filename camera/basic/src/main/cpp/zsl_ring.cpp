@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include "zsl_ring.h"
+
+static uint64_t NowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+ZslRing::ZslRing(uint32_t capacity, Releaser release)
+    : capacity_(std::max(capacity, 1U)), release_(release) {
+  slots_.reserve(capacity_);
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+ZslRing::~ZslRing() {
+  for (auto& slot : slots_) {
+    assert(!slot.pins);
+    release_(slot.frame);
+  }
+}
+
+bool ZslRing::Push(void* frame, int64_t timestampNs) {
+  void* evicted = nullptr;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    stats_.framesPushed++;
+    if (slots_.size() == capacity_) {
+      auto victim = std::find_if(slots_.begin(), slots_.end(),
+                                 [](const Slot& s) { return !s.pins; });
+      if (victim == slots_.end()) {
+        stats_.framesDropped++;
+        evicted = frame;
+        frame = nullptr;
+      } else {
+        stats_.framesEvicted++;
+        evicted = victim->frame;
+        slots_.erase(victim);
+      }
+    }
+    if (frame) {
+      // frames normally arrive in order: this is the end of the vector
+      auto pos = std::upper_bound(
+          slots_.begin(), slots_.end(), timestampNs,
+          [](int64_t ts, const Slot& s) { return ts < s.timestampNs; });
+      slots_.insert(pos, Slot{frame, timestampNs, 0});
+    }
+  }
+  // hand frames back outside of the lock: AImage_delete() may block
+  if (evicted) {
+    release_(evicted);
+  }
+  return frame != nullptr;
+}
+
+void* ZslRing::Acquire(int64_t timestampNs, int64_t* frameTimestampNs) {
+  uint64_t start = NowNs();
+  std::lock_guard<std::mutex> guard(lock_);
+  stats_.lookups++;
+  if (slots_.empty()) {
+    stats_.lookupMisses++;
+    return nullptr;
+  }
+
+  auto it = std::lower_bound(
+      slots_.begin(), slots_.end(), timestampNs,
+      [](const Slot& s, int64_t ts) { return s.timestampNs < ts; });
+  if (it == slots_.end() ||
+      (it != slots_.begin() &&
+       timestampNs - (it - 1)->timestampNs < it->timestampNs - timestampNs)) {
+    --it;
+  }
+  it->pins++;
+  if (frameTimestampNs) *frameTimestampNs = it->timestampNs;
+
+  int64_t distance = std::abs(it->timestampNs - timestampNs);
+  stats_.lastDistanceNs = distance;
+  stats_.maxDistanceNs = std::max(stats_.maxDistanceNs, distance);
+  stats_.lastLookupNs = NowNs() - start;
+  stats_.maxLookupNs = std::max(stats_.maxLookupNs, stats_.lastLookupNs);
+  return it->frame;
+}
+
+void ZslRing::Release(void* frame) {
+  std::lock_guard<std::mutex> guard(lock_);
+  auto it = std::find_if(slots_.begin(), slots_.end(),
+                         [frame](const Slot& s) { return s.frame == frame; });
+  assert(it != slots_.end() && it->pins);
+  if (it != slots_.end() && it->pins) {
+    it->pins--;
+  }
+}
+
+void ZslRing::Clear(void) {
+  std::vector<void*> frames;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    for (auto it = slots_.begin(); it != slots_.end();) {
+      if (it->pins) {
+        ++it;
+      } else {
+        frames.push_back(it->frame);
+        it = slots_.erase(it);
+      }
+    }
+  }
+  for (auto frame : frames) {
+    release_(frame);
+  }
+}
+
+uint32_t ZslRing::Size(void) {
+  std::lock_guard<std::mutex> guard(lock_);
+  return static_cast<uint32_t>(slots_.size());
+}
+
+void ZslRing::GetStats(ZslStats* stats) {
+  std::lock_guard<std::mutex> guard(lock_);
+  *stats = stats_;
+}
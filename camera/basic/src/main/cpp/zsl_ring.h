@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CAMERA_ZSL_RING_H
+#define CAMERA_ZSL_RING_H
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/*
+ * ZslStats:
+ *   counters of a ZslRing, plus how far (in sensor time) the selected frames
+ *   were from the requested shutter time and how long the lookups took
+ */
+struct ZslStats {
+  uint64_t framesPushed;
+  uint64_t framesEvicted;   // pushed out by newer frames
+  uint64_t framesDropped;   // refused: every slot was pinned
+  uint64_t lookups;
+  uint64_t lookupMisses;    // ring was empty
+  int64_t lastDistanceNs;
+  int64_t maxDistanceNs;
+  uint64_t lastLookupNs;
+  uint64_t maxLookupNs;
+};
+
+/*
+ * ZslRing:
+ *   Keeps the last N frames of a stream for zero shutter lag capture.
+ *   - Push() adds the newest frame, evicting the oldest frame not pinned.
+ *   - Acquire() pins the frame nearest to a timestamp, so it is not evicted
+ *     while the caller uses it; Release() unpins it. A frame may be pinned
+ *     several times (ref-counted).
+ *   Frames are opaque (AImage* in the camera sample); the ring owns them
+ *   from Push() on and hands them to the release function once they leave.
+ *   All methods are thread safe. No Android dependency, see
+ *   zsl_ring_check.cpp.
+ */
+class ZslRing {
+ public:
+  typedef std::function<void(void* frame)> Releaser;
+
+  ZslRing(uint32_t capacity, Releaser release);
+  ~ZslRing();
+
+  /**
+   * Take ownership of frame. If every slot is pinned the frame is released
+   * right away (counted as dropped).
+   * @return true if the frame was kept
+   */
+  bool Push(void* frame, int64_t timestampNs);
+
+  /**
+   * Pin the frame whose timestamp is the nearest to timestampNs.
+   * @param frameTimestampNs optional, receives the timestamp of the frame
+   * @return the frame, nullptr if the ring is empty
+   */
+  void* Acquire(int64_t timestampNs, int64_t* frameTimestampNs);
+
+  /**
+   * Unpin a frame returned by Acquire()
+   */
+  void Release(void* frame);
+
+  /**
+   * Release all frames not pinned
+   */
+  void Clear(void);
+
+  uint32_t Size(void);
+  void GetStats(ZslStats* stats);
+
+ private:
+  struct Slot {
+    void* frame;
+    int64_t timestampNs;
+    uint32_t pins;
+  };
+
+  uint32_t capacity_;
+  Releaser release_;
+  std::vector<Slot> slots_;  // oldest first, sorted by timestamp
+  std::mutex lock_;
+  ZslStats stats_;
+};
+
+#endif  // CAMERA_ZSL_RING_H
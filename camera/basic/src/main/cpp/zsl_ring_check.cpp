@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Exercises eviction, pinning and lookup of a ZslRing and measures Push()
+ * and Acquire() latency. No Android dependency, runs on the host:
+ *   g++ -std=c++11 -O2 -pthread -DZSL_RING_HOST_CHECK \
+ *       zsl_ring.cpp zsl_ring_check.cpp
+ */
+#ifdef ZSL_RING_HOST_CHECK
+#include <cstdio>
+#include <ctime>
+#include <vector>
+
+#include "zsl_ring.h"
+
+static uint64_t NowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Self check: frames are small integers, released ones are recorded
+ */
+#define CHECK(cond)                                                     \
+  do {                                                                  \
+    if (!(cond)) {                                                      \
+      used += snprintf(report + used, reportSize - used,                \
+                       "FAILED line %d: %s\n", __LINE__, #cond);        \
+      return false;                                                     \
+    }                                                                   \
+  } while (0)
+
+static inline void* Frame(uintptr_t id) {
+  return reinterpret_cast<void*>(id + 1);
+}
+
+static bool RunZslRingSelfCheck(char* report, size_t reportSize) {
+  const int64_t kFrameNs = 33333333;  // 30 fps
+  size_t used = 0;
+  if (!report || reportSize < 128) return false;
+  report[0] = 0;
+
+  std::vector<bool> released(64, false);
+  auto release = [&released](void* frame) {
+    released[reinterpret_cast<uintptr_t>(frame) - 1] = true;
+  };
+  {
+    ZslRing ring(4, release);
+    int64_t ts;
+    CHECK(ring.Acquire(0, &ts) == nullptr);
+
+    // eviction: the two oldest frames go
+    for (uintptr_t i = 0; i < 6; i++) {
+      CHECK(ring.Push(Frame(i), i * kFrameNs));
+    }
+    CHECK(ring.Size() == 4);
+    CHECK(released[0] && released[1] && !released[2]);
+
+    // lookup: nearest frame, clamped at both ends
+    CHECK(ring.Acquire(2.9 * kFrameNs, &ts) == Frame(3) && ts == 3 * kFrameNs);
+    CHECK(ring.Acquire(-kFrameNs, &ts) == Frame(2));
+    CHECK(ring.Acquire(100 * kFrameNs, &ts) == Frame(5));
+    ring.Release(Frame(5));
+
+    // pinning: frames 2 and 3 survive newer frames
+    for (uintptr_t i = 6; i < 9; i++) {
+      CHECK(ring.Push(Frame(i), i * kFrameNs));
+    }
+    CHECK(!released[2] && !released[3]);
+    CHECK(released[4] && released[5] && released[6]);
+
+    // everything pinned: a new frame is dropped, not kept
+    CHECK(ring.Acquire(7 * kFrameNs, nullptr) == Frame(7));
+    CHECK(ring.Acquire(8 * kFrameNs, nullptr) == Frame(8));
+    CHECK(!ring.Push(Frame(9), 9 * kFrameNs) && released[9]);
+
+    // unpinned frames are evictable again, oldest first
+    ring.Release(Frame(2));
+    ring.Release(Frame(3));
+    ring.Release(Frame(7));
+    ring.Release(Frame(8));
+    CHECK(ring.Push(Frame(10), 10 * kFrameNs) && released[2] && !released[3]);
+
+    ZslStats stats;
+    ring.GetStats(&stats);
+    CHECK(stats.framesPushed == 11 && stats.framesDropped == 1);
+    CHECK(stats.framesEvicted == 6 && stats.lookupMisses == 1);
+  }
+  CHECK(released[3] && released[7] && released[8] && released[10]);
+  used += snprintf(report + used, reportSize - used, "zsl ring checks passed\n");
+
+  // latency with a realistic ring: push a frame, look one up every 10
+  const int kIterations = 100000;
+  ZslRing ring(8, [](void*) {});
+  uint64_t pushNs = 0, acquireNs = 0;
+  for (int i = 0; i < kIterations; i++) {
+    uint64_t t0 = NowNs();
+    ring.Push(Frame(i), i * kFrameNs);
+    uint64_t t1 = NowNs();
+    pushNs += t1 - t0;
+    if (i % 10 == 0) {
+      void* frame = ring.Acquire(i * kFrameNs - kFrameNs * 5 / 2, nullptr);
+      acquireNs += NowNs() - t1;
+      ring.Release(frame);
+    }
+  }
+  ZslStats stats;
+  ring.GetStats(&stats);
+  used += snprintf(report + used, reportSize - used,
+                   "push %.0f ns, acquire %.0f ns (max %llu ns), "
+                   "max frame distance %.1f ms\n",
+                   static_cast<double>(pushNs) / kIterations,
+                   static_cast<double>(acquireNs) / (kIterations / 10),
+                   static_cast<unsigned long long>(stats.maxLookupNs),
+                   stats.maxDistanceNs / 1000000.0);
+  return true;
+}
+
+int main() {
+  char report[512];
+  bool ok = RunZslRingSelfCheck(report, sizeof(report));
+  fputs(report, stdout);
+  return ok ? 0 : 1;
+}
+#endif  // ZSL_RING_HOST_CHECK
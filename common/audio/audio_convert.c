@@ -0,0 +1,751 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "audio_convert.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define CONVERT_USE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#include <immintrin.h>
+#define CONVERT_USE_SSE2 1
+#if defined(__GNUC__)
+// built for the target attribute below and only used after a cpuid check
+#define CONVERT_USE_AVX2 1
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+#define I16_SCALE     32768.0f
+#define I24_SCALE     8388608.0f
+#define I32_SCALE     2147483648.0f
+
+/*
+ * Plain C kernels: the reference for the SIMD versions and the tail loops
+ */
+static void i16ToFloat_c(const int16_t *src, float *dst, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        dst[i] = src[i] * (1.0f / I16_SCALE);
+    }
+}
+
+static __inline__ int32_t roundClamp(float v, float lo, float hi) {
+    v = v < lo ? lo : (v > hi ? hi : v);
+    return (int32_t)(v + (v >= 0.0f ? 0.5f : -0.5f));
+}
+
+static void floatToI16_c(const float *src, int16_t *dst, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        dst[i] = (int16_t)roundClamp(src[i] * I16_SCALE, -32768.0f, 32767.0f);
+    }
+}
+
+static void i24ToFloat_c(const uint8_t *src, float *dst, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++, src += 3) {
+        int32_t v = (int32_t)((uint32_t)src[0] << 8 | (uint32_t)src[1] << 16 |
+                              (uint32_t)src[2] << 24);
+        dst[i] = v * (1.0f / I32_SCALE);
+    }
+}
+
+static void floatToI24_c(const float *src, uint8_t *dst, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++, dst += 3) {
+        int32_t v = roundClamp(src[i] * I24_SCALE, -8388608.0f, 8388607.0f);
+        dst[0] = (uint8_t)v;
+        dst[1] = (uint8_t)(v >> 8);
+        dst[2] = (uint8_t)(v >> 16);
+    }
+}
+
+static __inline__ uint32_t xorshift32(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// uniform in [0, 1) from the top 24 bits
+#define RNG_TO_UNIT(x)  ((float)((x) >> 8) * (1.0f / 16777216.0f))
+
+static void floatToI16Dither_c(const float *src, int16_t *dst, uint32_t count,
+                               AudioDitherState *state) {
+    uint32_t *rng = &state->rng[0];
+    for (uint32_t i = 0; i < count; i++) {
+        float tpdf = RNG_TO_UNIT(xorshift32(rng)) - RNG_TO_UNIT(xorshift32(rng));
+        dst[i] = (int16_t)roundClamp(src[i] * I16_SCALE + tpdf, -32768.0f, 32767.0f);
+    }
+}
+
+static void interleaveStereo_c(const float *left, const float *right, float *dst,
+                               uint32_t frames) {
+    for (uint32_t i = 0; i < frames; i++) {
+        dst[2 * i] = left[i];
+        dst[2 * i + 1] = right[i];
+    }
+}
+
+static void deinterleaveStereo_c(const float *src, float *left, float *right,
+                                 uint32_t frames) {
+    for (uint32_t i = 0; i < frames; i++) {
+        left[i] = src[2 * i];
+        right[i] = src[2 * i + 1];
+    }
+}
+
+static void upmixMonoToStereo_c(const float *src, float *dst, uint32_t frames) {
+    for (uint32_t i = 0; i < frames; i++) {
+        dst[2 * i] = dst[2 * i + 1] = src[i];
+    }
+}
+
+static void downmixStereoToMono_c(const float *src, float *dst, uint32_t frames) {
+    for (uint32_t i = 0; i < frames; i++) {
+        dst[i] = (src[2 * i] + src[2 * i + 1]) * 0.5f;
+    }
+}
+
+// sample first + i is scaled by g0 + step * (first + i)
+static void gainRampI16_c(int16_t *samples, uint32_t count, float g0, float step,
+                          uint32_t first) {
+    for (uint32_t i = 0; i < count; i++) {
+        float g = g0 + step * (float)(first + i);
+        samples[i] = (int16_t)roundClamp(samples[i] * g, -32768.0f, 32767.0f);
+    }
+}
+
+static void mixI16Saturate_c(int16_t *dst, const int16_t *src, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        int32_t v = dst[i] + src[i];
+        dst[i] = (int16_t)(v < -32768 ? -32768 : (v > 32767 ? 32767 : v));
+    }
+}
+
+static void upsampleI16Hold_c(const int16_t *src, int16_t *dst, uint32_t frames,
+                              uint32_t factor) {
+    for (uint32_t i = 0; i < frames; i++) {
+        for (uint32_t dup = 0; dup < factor; dup++) {
+            *dst++ = src[i];
+        }
+    }
+}
+
+// frames are output frames; dst may be src
+static void decimateI16_c(const int16_t *src, int16_t *dst, uint32_t frames,
+                          uint32_t factor) {
+    for (uint32_t i = 0; i < frames; i++) {
+        dst[i] = src[i * factor];
+    }
+}
+
+/*
+ * SIMD kernels: each handles the largest multiple of its vector width and
+ * returns how many samples (frames for the stereo kernels) it processed.
+ */
+#if defined(CONVERT_USE_NEON)
+
+// round half away from zero, like roundClamp()
+static __inline__ int32x4_t roundClampNeon(float32x4_t v, float32x4_t lo, float32x4_t hi) {
+    v = vminq_f32(vmaxq_f32(v, lo), hi);
+    uint32x4_t half = vorrq_u32(vandq_u32(vreinterpretq_u32_f32(v), vdupq_n_u32(0x80000000)),
+                                vreinterpretq_u32_f32(vdupq_n_f32(0.5f)));
+    return vcvtq_s32_f32(vaddq_f32(v, vreinterpretq_f32_u32(half)));
+}
+
+static uint32_t i16ToFloat_simd(const int16_t *src, float *dst, uint32_t count) {
+    float32x4_t scale = vdupq_n_f32(1.0f / I16_SCALE);
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t s = vld1q_s16(src + i);
+        vst1q_f32(dst + i, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(s))), scale));
+        vst1q_f32(dst + i + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(s))), scale));
+    }
+    return i;
+}
+
+static uint32_t floatToI16_simd(const float *src, int16_t *dst, uint32_t count) {
+    float32x4_t scale = vdupq_n_f32(I16_SCALE);
+    float32x4_t lo = vdupq_n_f32(-32768.0f), hi = vdupq_n_f32(32767.0f);
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        int32x4_t a = roundClampNeon(vmulq_f32(vld1q_f32(src + i), scale), lo, hi);
+        int32x4_t b = roundClampNeon(vmulq_f32(vld1q_f32(src + i + 4), scale), lo, hi);
+        vst1q_s16(dst + i, vcombine_s16(vmovn_s32(a), vmovn_s32(b)));
+    }
+    return i;
+}
+
+static uint32_t i24ToFloat_simd(const uint8_t *src, float *dst, uint32_t count) {
+    float32x4_t scale = vdupq_n_f32(1.0f / I32_SCALE);
+    uint32_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        // de-interleave the 3 bytes of 16 samples into 3 planes
+        uint8x16x3_t b = vld3q_u8(src + 3 * i);
+        // (b2 << 24 | b1 << 16 | b0 << 8) as int32: low and high 16 bit halves
+        uint16x8_t loA = vshll_n_u8(vget_low_u8(b.val[0]), 8);
+        uint16x8_t hiA = vorrq_u16(vshll_n_u8(vget_low_u8(b.val[2]), 8),
+                                   vmovl_u8(vget_low_u8(b.val[1])));
+        uint16x8_t loB = vshll_n_u8(vget_high_u8(b.val[0]), 8);
+        uint16x8_t hiB = vorrq_u16(vshll_n_u8(vget_high_u8(b.val[2]), 8),
+                                   vmovl_u8(vget_high_u8(b.val[1])));
+        uint16x8x2_t a = vzipq_u16(loA, hiA);
+        uint16x8x2_t c = vzipq_u16(loB, hiB);
+        vst1q_f32(dst + i,
+                  vmulq_f32(vcvtq_f32_s32(vreinterpretq_s32_u16(a.val[0])), scale));
+        vst1q_f32(dst + i + 4,
+                  vmulq_f32(vcvtq_f32_s32(vreinterpretq_s32_u16(a.val[1])), scale));
+        vst1q_f32(dst + i + 8,
+                  vmulq_f32(vcvtq_f32_s32(vreinterpretq_s32_u16(c.val[0])), scale));
+        vst1q_f32(dst + i + 12,
+                  vmulq_f32(vcvtq_f32_s32(vreinterpretq_s32_u16(c.val[1])), scale));
+    }
+    return i;
+}
+
+static __inline__ uint8x16_t narrowByte(int32x4_t a, int32x4_t b, int32x4_t c, int32x4_t d,
+                                        int shift) {
+    // byte number 'shift / 8' of the four vectors
+    uint16x8_t ab = vcombine_u16(vmovn_u32(vreinterpretq_u32_s32(vshlq_s32(a, vdupq_n_s32(-shift)))),
+                                 vmovn_u32(vreinterpretq_u32_s32(vshlq_s32(b, vdupq_n_s32(-shift)))));
+    uint16x8_t cd = vcombine_u16(vmovn_u32(vreinterpretq_u32_s32(vshlq_s32(c, vdupq_n_s32(-shift)))),
+                                 vmovn_u32(vreinterpretq_u32_s32(vshlq_s32(d, vdupq_n_s32(-shift)))));
+    return vcombine_u8(vmovn_u16(ab), vmovn_u16(cd));
+}
+
+static uint32_t floatToI24_simd(const float *src, uint8_t *dst, uint32_t count) {
+    float32x4_t scale = vdupq_n_f32(I24_SCALE);
+    float32x4_t lo = vdupq_n_f32(-8388608.0f), hi = vdupq_n_f32(8388607.0f);
+    uint32_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        int32x4_t a = roundClampNeon(vmulq_f32(vld1q_f32(src + i), scale), lo, hi);
+        int32x4_t b = roundClampNeon(vmulq_f32(vld1q_f32(src + i + 4), scale), lo, hi);
+        int32x4_t c = roundClampNeon(vmulq_f32(vld1q_f32(src + i + 8), scale), lo, hi);
+        int32x4_t d = roundClampNeon(vmulq_f32(vld1q_f32(src + i + 12), scale), lo, hi);
+        uint8x16x3_t out;
+        out.val[0] = narrowByte(a, b, c, d, 0);
+        out.val[1] = narrowByte(a, b, c, d, 8);
+        out.val[2] = narrowByte(a, b, c, d, 16);
+        vst3q_u8(dst + 3 * i, out);
+    }
+    return i;
+}
+
+static __inline__ float32x4_t rngToUnitNeon(uint32x4_t *state) {
+    uint32x4_t x = *state;
+    x = veorq_u32(x, vshlq_n_u32(x, 13));
+    x = veorq_u32(x, vshrq_n_u32(x, 17));
+    x = veorq_u32(x, vshlq_n_u32(x, 5));
+    *state = x;
+    return vmulq_f32(vcvtq_f32_u32(vshrq_n_u32(x, 8)), vdupq_n_f32(1.0f / 16777216.0f));
+}
+
+static uint32_t floatToI16Dither_simd(const float *src, int16_t *dst, uint32_t count,
+                                      AudioDitherState *state) {
+    float32x4_t scale = vdupq_n_f32(I16_SCALE);
+    float32x4_t lo = vdupq_n_f32(-32768.0f), hi = vdupq_n_f32(32767.0f);
+    uint32x4_t rng = vld1q_u32(state->rng);
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t tpdf = vsubq_f32(rngToUnitNeon(&rng), rngToUnitNeon(&rng));
+        float32x4_t v = vaddq_f32(vmulq_f32(vld1q_f32(src + i), scale), tpdf);
+        vst1_s16(dst + i, vmovn_s32(roundClampNeon(v, lo, hi)));
+    }
+    vst1q_u32(state->rng, rng);
+    return i;
+}
+
+static uint32_t interleaveStereo_simd(const float *left, const float *right, float *dst,
+                                      uint32_t frames) {
+    uint32_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        float32x4x2_t lr = { { vld1q_f32(left + i), vld1q_f32(right + i) } };
+        vst2q_f32(dst + 2 * i, lr);
+    }
+    return i;
+}
+
+static uint32_t deinterleaveStereo_simd(const float *src, float *left, float *right,
+                                        uint32_t frames) {
+    uint32_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        float32x4x2_t lr = vld2q_f32(src + 2 * i);
+        vst1q_f32(left + i, lr.val[0]);
+        vst1q_f32(right + i, lr.val[1]);
+    }
+    return i;
+}
+
+static uint32_t upmixMonoToStereo_simd(const float *src, float *dst, uint32_t frames) {
+    uint32_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        float32x4_t m = vld1q_f32(src + i);
+        float32x4x2_t lr = { { m, m } };
+        vst2q_f32(dst + 2 * i, lr);
+    }
+    return i;
+}
+
+static uint32_t downmixStereoToMono_simd(const float *src, float *dst, uint32_t frames) {
+    float32x4_t half = vdupq_n_f32(0.5f);
+    uint32_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        float32x4x2_t lr = vld2q_f32(src + 2 * i);
+        vst1q_f32(dst + i, vmulq_f32(vaddq_f32(lr.val[0], lr.val[1]), half));
+    }
+    return i;
+}
+
+static uint32_t gainRampI16_simd(int16_t *samples, uint32_t count, float g0, float step) {
+    float32x4_t vG0 = vdupq_n_f32(g0), vStep = vdupq_n_f32(step);
+    float32x4_t lo = vdupq_n_f32(-32768.0f), hi = vdupq_n_f32(32767.0f);
+    const uint32_t lanes[4] = {0, 1, 2, 3};
+    uint32x4_t idx = vld1q_u32(lanes);
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        // same arithmetic as gainRampI16_c: g0 + step * index
+        float32x4_t ga = vaddq_f32(vG0, vmulq_f32(vStep, vcvtq_f32_u32(idx)));
+        idx = vaddq_u32(idx, vdupq_n_u32(4));
+        float32x4_t gb = vaddq_f32(vG0, vmulq_f32(vStep, vcvtq_f32_u32(idx)));
+        idx = vaddq_u32(idx, vdupq_n_u32(4));
+        int16x8_t s = vld1q_s16(samples + i);
+        int32x4_t a = roundClampNeon(
+                vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(s))), ga), lo, hi);
+        int32x4_t b = roundClampNeon(
+                vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(s))), gb), lo, hi);
+        vst1q_s16(samples + i, vcombine_s16(vmovn_s32(a), vmovn_s32(b)));
+    }
+    return i;
+}
+
+static uint32_t mixI16Saturate_simd(int16_t *dst, const int16_t *src, uint32_t count) {
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        vst1q_s16(dst + i, vqaddq_s16(vld1q_s16(dst + i), vld1q_s16(src + i)));
+    }
+    return i;
+}
+
+static uint32_t upsampleI16Hold_simd(const int16_t *src, int16_t *dst, uint32_t frames,
+                                     uint32_t factor) {
+    if (factor != 2) {
+        return 0;
+    }
+    uint32_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        int16x8_t s = vld1q_s16(src + i);
+        int16x8x2_t pair = { { s, s } };
+        vst2q_s16(dst + 2 * i, pair);
+    }
+    return i;
+}
+
+static uint32_t decimateI16_simd(const int16_t *src, int16_t *dst, uint32_t frames,
+                                 uint32_t factor) {
+    if (factor != 2) {
+        return 0;
+    }
+    uint32_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        // both vectors are loaded before the store: safe in place
+        int16x8x2_t pair = vld2q_s16(src + 2 * i);
+        vst1q_s16(dst + i, pair.val[0]);
+    }
+    return i;
+}
+
+#elif defined(CONVERT_USE_SSE2)
+
+static __inline__ __m128i roundClampSse(__m128 v, __m128 lo, __m128 hi) {
+    v = _mm_min_ps(_mm_max_ps(v, lo), hi);
+    __m128 half = _mm_or_ps(_mm_and_ps(v, _mm_castsi128_ps(_mm_set1_epi32(0x80000000))),
+                            _mm_set1_ps(0.5f));
+    return _mm_cvttps_epi32(_mm_add_ps(v, half));
+}
+
+static uint32_t i16ToFloat_simd(const int16_t *src, float *dst, uint32_t count) {
+    __m128 scale = _mm_set1_ps(1.0f / I16_SCALE);
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        // sign extend by unpacking into the high half and shifting back
+        __m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+        __m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(a), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(b), scale));
+    }
+    return i;
+}
+
+static uint32_t floatToI16_simd(const float *src, int16_t *dst, uint32_t count) {
+    __m128 scale = _mm_set1_ps(I16_SCALE);
+    __m128 lo = _mm_set1_ps(-32768.0f), hi = _mm_set1_ps(32767.0f);
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = roundClampSse(_mm_mul_ps(_mm_loadu_ps(src + i), scale), lo, hi);
+        __m128i b = roundClampSse(_mm_mul_ps(_mm_loadu_ps(src + i + 4), scale), lo, hi);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(a, b));
+    }
+    return i;
+}
+
+#if defined(__SSSE3__)
+static uint32_t i24ToFloat_simd(const uint8_t *src, float *dst, uint32_t count) {
+    // bytes of 4 packed samples into the top 3 bytes of 4 int32 lanes
+    const __m128i shuf = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5,
+                                       -1, 6, 7, 8, -1, 9, 10, 11);
+    __m128 scale = _mm_set1_ps(1.0f / I32_SCALE);
+    uint32_t i = 0;
+    // each 16 byte load covers 4 samples plus 4 bytes that must exist
+    for (; i + 6 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + 3 * i));
+        __m128i v = _mm_shuffle_epi8(s, shuf);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+    }
+    return i;
+}
+
+static uint32_t floatToI24_simd(const float *src, uint8_t *dst, uint32_t count) {
+    const __m128i shuf = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9,
+                                       10, 12, 13, 14, -1, -1, -1, -1);
+    __m128 scale = _mm_set1_ps(I24_SCALE);
+    __m128 lo = _mm_set1_ps(-8388608.0f), hi = _mm_set1_ps(8388607.0f);
+    uint32_t i = 0;
+    // the 16 byte store spills 4 bytes into the next sample, rewritten later
+    for (; i + 6 <= count; i += 4) {
+        __m128i v = roundClampSse(_mm_mul_ps(_mm_loadu_ps(src + i), scale), lo, hi);
+        _mm_storeu_si128((__m128i *)(dst + 3 * i), _mm_shuffle_epi8(v, shuf));
+    }
+    return i;
+}
+#else
+static uint32_t i24ToFloat_simd(const uint8_t *src, float *dst, uint32_t count) {
+    return 0;
+}
+
+static uint32_t floatToI24_simd(const float *src, uint8_t *dst, uint32_t count) {
+    return 0;
+}
+#endif
+
+static __inline__ __m128 rngToUnitSse(__m128i *state) {
+    __m128i x = *state;
+    x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+    x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+    *state = x;
+    return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(x, 8)), _mm_set1_ps(1.0f / 16777216.0f));
+}
+
+static uint32_t floatToI16Dither_simd(const float *src, int16_t *dst, uint32_t count,
+                                      AudioDitherState *state) {
+    __m128 scale = _mm_set1_ps(I16_SCALE);
+    __m128 lo = _mm_set1_ps(-32768.0f), hi = _mm_set1_ps(32767.0f);
+    __m128i rng = _mm_loadu_si128((const __m128i *)state->rng);
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 tpdf = _mm_sub_ps(rngToUnitSse(&rng), rngToUnitSse(&rng));
+        __m128 v = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(src + i), scale), tpdf);
+        __m128i s = roundClampSse(v, lo, hi);
+        _mm_storel_epi64((__m128i *)(dst + i), _mm_packs_epi32(s, s));
+    }
+    _mm_storeu_si128((__m128i *)state->rng, rng);
+    return i;
+}
+
+static uint32_t interleaveStereo_simd(const float *left, const float *right, float *dst,
+                                      uint32_t frames) {
+    uint32_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        __m128 l = _mm_loadu_ps(left + i), r = _mm_loadu_ps(right + i);
+        _mm_storeu_ps(dst + 2 * i, _mm_unpacklo_ps(l, r));
+        _mm_storeu_ps(dst + 2 * i + 4, _mm_unpackhi_ps(l, r));
+    }
+    return i;
+}
+
+static uint32_t deinterleaveStereo_simd(const float *src, float *left, float *right,
+                                        uint32_t frames) {
+    uint32_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        __m128 a = _mm_loadu_ps(src + 2 * i), b = _mm_loadu_ps(src + 2 * i + 4);
+        _mm_storeu_ps(left + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(right + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+    return i;
+}
+
+static uint32_t upmixMonoToStereo_simd(const float *src, float *dst, uint32_t frames) {
+    uint32_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        __m128 m = _mm_loadu_ps(src + i);
+        _mm_storeu_ps(dst + 2 * i, _mm_unpacklo_ps(m, m));
+        _mm_storeu_ps(dst + 2 * i + 4, _mm_unpackhi_ps(m, m));
+    }
+    return i;
+}
+
+static uint32_t downmixStereoToMono_simd(const float *src, float *dst, uint32_t frames) {
+    __m128 half = _mm_set1_ps(0.5f);
+    uint32_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        __m128 a = _mm_loadu_ps(src + 2 * i), b = _mm_loadu_ps(src + 2 * i + 4);
+        __m128 sum = _mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+                                _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        _mm_storeu_ps(dst + i, _mm_mul_ps(sum, half));
+    }
+    return i;
+}
+
+static uint32_t gainRampI16_simd(int16_t *samples, uint32_t count, float g0, float step) {
+    __m128 vG0 = _mm_set1_ps(g0), vStep = _mm_set1_ps(step);
+    __m128 lo = _mm_set1_ps(-32768.0f), hi = _mm_set1_ps(32767.0f);
+    __m128i idx = _mm_setr_epi32(0, 1, 2, 3), four = _mm_set1_epi32(4);
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        // same arithmetic as gainRampI16_c: g0 + step * index
+        __m128 ga = _mm_add_ps(vG0, _mm_mul_ps(vStep, _mm_cvtepi32_ps(idx)));
+        idx = _mm_add_epi32(idx, four);
+        __m128 gb = _mm_add_ps(vG0, _mm_mul_ps(vStep, _mm_cvtepi32_ps(idx)));
+        idx = _mm_add_epi32(idx, four);
+        __m128i s = _mm_loadu_si128((const __m128i *)(samples + i));
+        __m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+        __m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+        a = roundClampSse(_mm_mul_ps(_mm_cvtepi32_ps(a), ga), lo, hi);
+        b = roundClampSse(_mm_mul_ps(_mm_cvtepi32_ps(b), gb), lo, hi);
+        _mm_storeu_si128((__m128i *)(samples + i), _mm_packs_epi32(a, b));
+    }
+    return i;
+}
+
+static uint32_t mixI16Saturate_simd(int16_t *dst, const int16_t *src, uint32_t count) {
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_adds_epi16(d, v));
+    }
+    return i;
+}
+
+static uint32_t upsampleI16Hold_simd(const int16_t *src, int16_t *dst, uint32_t frames,
+                                     uint32_t factor) {
+    if (factor != 2) {
+        return 0;
+    }
+    uint32_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + 2 * i), _mm_unpacklo_epi16(s, s));
+        _mm_storeu_si128((__m128i *)(dst + 2 * i + 8), _mm_unpackhi_epi16(s, s));
+    }
+    return i;
+}
+
+static uint32_t decimateI16_simd(const int16_t *src, int16_t *dst, uint32_t frames,
+                                 uint32_t factor) {
+    if (factor != 2) {
+        return 0;
+    }
+    uint32_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        // both vectors are loaded before the store: safe in place
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 2 * i + 8));
+        // keep the even samples, sign extended: packs cannot saturate them
+        a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+        b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(a, b));
+    }
+    return i;
+}
+
+#if defined(CONVERT_USE_AVX2)
+AVX2_TARGET static uint32_t i16ToFloat_avx2(const int16_t *src, float *dst, uint32_t count) {
+    __m256 scale = _mm256_set1_ps(1.0f / I16_SCALE);
+    uint32_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i a = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(src + i)));
+        __m256i b = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(src + i + 8)));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(a), scale));
+        _mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(b), scale));
+    }
+    return i;
+}
+
+AVX2_TARGET static __inline__ __m256i roundClampAvx2(__m256 v, __m256 lo, __m256 hi) {
+    v = _mm256_min_ps(_mm256_max_ps(v, lo), hi);
+    __m256 half = _mm256_or_ps(
+            _mm256_and_ps(v, _mm256_castsi256_ps(_mm256_set1_epi32(0x80000000))),
+            _mm256_set1_ps(0.5f));
+    return _mm256_cvttps_epi32(_mm256_add_ps(v, half));
+}
+
+AVX2_TARGET static uint32_t floatToI16_avx2(const float *src, int16_t *dst, uint32_t count) {
+    __m256 scale = _mm256_set1_ps(I16_SCALE);
+    __m256 lo = _mm256_set1_ps(-32768.0f), hi = _mm256_set1_ps(32767.0f);
+    uint32_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i a = roundClampAvx2(_mm256_mul_ps(_mm256_loadu_ps(src + i), scale), lo, hi);
+        __m256i b = roundClampAvx2(_mm256_mul_ps(_mm256_loadu_ps(src + i + 8), scale), lo, hi);
+        // packs works per 128 bit lane: restore the sample order afterwards
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+        _mm256_storeu_si256((__m256i *)(dst + i), packed);
+    }
+    return i;
+}
+#endif  // CONVERT_USE_AVX2
+
+#else   // no SIMD
+
+static uint32_t i16ToFloat_simd(const int16_t *src, float *dst, uint32_t count) { return 0; }
+static uint32_t floatToI16_simd(const float *src, int16_t *dst, uint32_t count) { return 0; }
+static uint32_t i24ToFloat_simd(const uint8_t *src, float *dst, uint32_t count) { return 0; }
+static uint32_t floatToI24_simd(const float *src, uint8_t *dst, uint32_t count) { return 0; }
+static uint32_t floatToI16Dither_simd(const float *src, int16_t *dst, uint32_t count,
+                                      AudioDitherState *state) { return 0; }
+static uint32_t interleaveStereo_simd(const float *left, const float *right, float *dst,
+                                      uint32_t frames) { return 0; }
+static uint32_t deinterleaveStereo_simd(const float *src, float *left, float *right,
+                                        uint32_t frames) { return 0; }
+static uint32_t upmixMonoToStereo_simd(const float *src, float *dst,
+                                       uint32_t frames) { return 0; }
+static uint32_t downmixStereoToMono_simd(const float *src, float *dst,
+                                         uint32_t frames) { return 0; }
+static uint32_t gainRampI16_simd(int16_t *samples, uint32_t count, float g0,
+                                 float step) { return 0; }
+static uint32_t mixI16Saturate_simd(int16_t *dst, const int16_t *src,
+                                    uint32_t count) { return 0; }
+static uint32_t upsampleI16Hold_simd(const int16_t *src, int16_t *dst, uint32_t frames,
+                                     uint32_t factor) { return 0; }
+static uint32_t decimateI16_simd(const int16_t *src, int16_t *dst, uint32_t frames,
+                                 uint32_t factor) { return 0; }
+#endif
+
+/*
+ * Run time selection of the int16 <-> float kernels
+ */
+typedef uint32_t (*I16ToFloatKernel)(const int16_t *, float *, uint32_t);
+typedef uint32_t (*FloatToI16Kernel)(const float *, int16_t *, uint32_t);
+static I16ToFloatKernel i16ToFloatKernel = i16ToFloat_simd;
+static FloatToI16Kernel floatToI16Kernel = floatToI16_simd;
+static pthread_once_t kernelOnce = PTHREAD_ONCE_INIT;
+
+static void selectKernels(void) {
+#if defined(CONVERT_USE_AVX2)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        i16ToFloatKernel = i16ToFloat_avx2;
+        floatToI16Kernel = floatToI16_avx2;
+    }
+#endif
+}
+
+/*
+ * Public entry points: SIMD body, C tail
+ */
+void convertI16ToFloat(const int16_t *src, float *dst, uint32_t count) {
+    pthread_once(&kernelOnce, selectKernels);
+    uint32_t done = i16ToFloatKernel(src, dst, count);
+    i16ToFloat_c(src + done, dst + done, count - done);
+}
+
+void convertFloatToI16(const float *src, int16_t *dst, uint32_t count) {
+    pthread_once(&kernelOnce, selectKernels);
+    uint32_t done = floatToI16Kernel(src, dst, count);
+    floatToI16_c(src + done, dst + done, count - done);
+}
+
+void convertI24ToFloat(const uint8_t *src, float *dst, uint32_t count) {
+    uint32_t done = i24ToFloat_simd(src, dst, count);
+    i24ToFloat_c(src + 3 * done, dst + done, count - done);
+}
+
+void convertFloatToI24(const float *src, uint8_t *dst, uint32_t count) {
+    uint32_t done = floatToI24_simd(src, dst, count);
+    floatToI24_c(src + done, dst + 3 * done, count - done);
+}
+
+void ditherInit(AudioDitherState *state, uint32_t seed) {
+    for (int i = 0; i < 4; i++) {
+        // xorshift must never be seeded with 0
+        state->rng[i] = (seed + 0x9E3779B9u * (i + 1)) | 1u;
+    }
+}
+
+void convertFloatToI16Dither(const float *src, int16_t *dst, uint32_t count,
+                             AudioDitherState *state) {
+    uint32_t done = floatToI16Dither_simd(src, dst, count, state);
+    floatToI16Dither_c(src + done, dst + done, count - done, state);
+}
+
+void interleaveStereo(const float *left, const float *right, float *dst, uint32_t frames) {
+    uint32_t done = interleaveStereo_simd(left, right, dst, frames);
+    interleaveStereo_c(left + done, right + done, dst + 2 * done, frames - done);
+}
+
+void deinterleaveStereo(const float *src, float *left, float *right, uint32_t frames) {
+    uint32_t done = deinterleaveStereo_simd(src, left, right, frames);
+    deinterleaveStereo_c(src + 2 * done, left + done, right + done, frames - done);
+}
+
+void upmixMonoToStereo(const float *src, float *dst, uint32_t frames) {
+    uint32_t done = upmixMonoToStereo_simd(src, dst, frames);
+    upmixMonoToStereo_c(src + done, dst + 2 * done, frames - done);
+}
+
+void downmixStereoToMono(const float *src, float *dst, uint32_t frames) {
+    uint32_t done = downmixStereoToMono_simd(src, dst, frames);
+    downmixStereoToMono_c(src + 2 * done, dst + done, frames - done);
+}
+
+void applyGainRampI16(int16_t *samples, uint32_t count, float g0, float g1) {
+    if (!count) {
+        return;
+    }
+    float step = (g1 - g0) / count;
+    uint32_t done = gainRampI16_simd(samples, count, g0, step);
+    gainRampI16_c(samples + done, count - done, g0, step, done);
+}
+
+void mixI16Saturate(int16_t *dst, const int16_t *src, uint32_t count) {
+    uint32_t done = mixI16Saturate_simd(dst, src, count);
+    mixI16Saturate_c(dst + done, src + done, count - done);
+}
+
+void upsampleI16Hold(const int16_t *src, int16_t *dst, uint32_t frames, uint32_t factor) {
+    uint32_t done = upsampleI16Hold_simd(src, dst, frames, factor);
+    upsampleI16Hold_c(src + done, dst + factor * done, frames - done, factor);
+}
+
+void decimateI16(const int16_t *src, int16_t *dst, uint32_t frames, uint32_t factor) {
+    if (!factor) {
+        return;
+    }
+    frames /= factor;
+    uint32_t done = decimateI16_simd(src, dst, frames, factor);
+    decimateI16_c(src + factor * done, dst + done, frames - done, factor);
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMMON_AUDIO_CONVERT_H
+#define COMMON_AUDIO_CONVERT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Sample format conversion, channel (de)interleave and up/down mix kernels
+ * shared by the audio samples.
+ *
+ * Float samples are in [-1.0, 1.0). int24 samples are packed 3 byte little
+ * endian, as delivered by SL_PCMSAMPLEFORMAT_FIXED_24. Conversions to integer
+ * formats round to nearest and saturate.
+ *
+ * Every kernel has a NEON version (armeabi-v7a with NEON, arm64-v8a) and an
+ * SSE2/SSSE3 version (x86, x86_64); the int16 <-> float kernels additionally
+ * have AVX2 versions picked at run time on CPUs supporting them. Anything not
+ * covered by a SIMD path falls back to plain C.
+ */
+void convertI16ToFloat(const int16_t *src, float *dst, uint32_t count);
+void convertFloatToI16(const float *src, int16_t *dst, uint32_t count);
+void convertI24ToFloat(const uint8_t *src, float *dst, uint32_t count);
+void convertFloatToI24(const float *src, uint8_t *dst, uint32_t count);
+
+/*
+ * Float to int16 with TPDF (triangular) dither of +/-1 LSB, which turns the
+ * truncation distortion of quiet signals into benign white noise. The state
+ * keeps the random generators between calls; seed it with ditherInit().
+ */
+typedef struct AudioDitherState {
+    uint32_t rng[4];
+} AudioDitherState;
+void ditherInit(AudioDitherState *state, uint32_t seed);
+void convertFloatToI16Dither(const float *src, int16_t *dst, uint32_t count,
+                             AudioDitherState *state);
+
+/*
+ * Stereo layout helpers; frames are L/R pairs for the interleaved buffers.
+ */
+void interleaveStereo(const float *left, const float *right, float *dst, uint32_t frames);
+void deinterleaveStereo(const float *src, float *left, float *right, uint32_t frames);
+void upmixMonoToStereo(const float *src, float *dst, uint32_t frames);
+void downmixStereoToMono(const float *src, float *dst, uint32_t frames);
+
+/*
+ * int16 helpers for samples mixing and resampling in place of floats.
+ * applyGainRampI16() scales sample i by g0 + (g1 - g0) * i / count, so g1
+ * is where the next block carries on: 0 -> 1 fades in, 1 -> 0 fades out.
+ * mixI16Saturate() adds src into dst, saturating.
+ * upsampleI16Hold() repeats every frame factor times into dst, and
+ * decimateI16() keeps every factor-th of frames into dst, which may be src.
+ * Resampling is SIMD for a factor of 2 only, plain C otherwise.
+ */
+void applyGainRampI16(int16_t *samples, uint32_t count, float g0, float g1);
+void mixI16Saturate(int16_t *dst, const int16_t *src, uint32_t count);
+void upsampleI16Hold(const int16_t *src, int16_t *dst, uint32_t frames, uint32_t factor);
+void decimateI16(const int16_t *src, int16_t *dst, uint32_t frames, uint32_t factor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COMMON_AUDIO_CONVERT_H
@@ -0,0 +1,181 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks every kernel against its plain C version and times both, in ns per
+ * sample, over callback sized buffers. Built with the kernels themselves, so
+ * the C versions stay static. Host only: the audio-convert-benchmark target
+ * of CMakeLists.txt, run by ctest, or
+ *   gcc -std=c99 -O2 audio_convert_benchmark.c -lpthread
+ */
+
+#include "audio_convert.c"
+
+#define BENCH_ITERATIONS 2000
+
+static double nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return 1e9 * ts.tv_sec + ts.tv_nsec;
+}
+
+static int failures;
+
+// results of the public, SIMD, entry point against the C version
+static void checkI16(const char *label, const int16_t *c, const int16_t *simd,
+                     uint32_t count, int tolerance) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (abs(c[i] - simd[i]) > tolerance) {
+            printf("%-14s MISMATCH at %u: C %d, SIMD %d\n", label, i, c[i], simd[i]);
+            failures++;
+            return;
+        }
+    }
+}
+
+static void checkFloat(const char *label, const float *c, const float *simd,
+                       uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (c[i] != simd[i]) {
+            printf("%-14s MISMATCH at %u: C %f, SIMD %f\n", label, i, c[i], simd[i]);
+            failures++;
+            return;
+        }
+    }
+}
+
+#define BENCH(label, cCall, simdCall)                                         \
+    do {                                                                      \
+        double t0 = nowNs();                                                  \
+        for (int it = 0; it < BENCH_ITERATIONS; it++) { cCall; }              \
+        double t1 = nowNs();                                                  \
+        for (int it = 0; it < BENCH_ITERATIONS; it++) { simdCall; }           \
+        double t2 = nowNs();                                                  \
+        double samples = (double)BENCH_ITERATIONS * frames;                   \
+        printf("%-14s C %6.3f  SIMD %6.3f ns/sample\n", label,                \
+               (t1 - t0) / samples, (t2 - t1) / samples);                     \
+    } while (0)
+
+static void run(uint32_t frames) {
+    // two channels worth of every format, twice: C and SIMD results
+    float *f32 = (float *)calloc(4 * (size_t)frames, sizeof(float));
+    float *f32c = (float *)calloc(2 * (size_t)frames, sizeof(float));
+    int16_t *i16 = (int16_t *)calloc(2 * (size_t)frames, sizeof(int16_t));
+    int16_t *i16b = (int16_t *)calloc(2 * (size_t)frames, sizeof(int16_t));
+    int16_t *i16c = (int16_t *)calloc(2 * (size_t)frames, sizeof(int16_t));
+    uint8_t *i24 = (uint8_t *)calloc(3 * (size_t)frames, 1);
+    uint8_t *i24c = (uint8_t *)calloc(3 * (size_t)frames, 1);
+    if (!f32 || !f32c || !i16 || !i16b || !i16c || !i24 || !i24c) {
+        printf("out of memory\n");
+        failures++;
+        goto out;
+    }
+    float *f32b = f32 + 2 * (size_t)frames;
+    for (uint32_t i = 0; i < 2 * frames; i++) {
+        f32[i] = ((int32_t)(i * 2654435761u) >> 8) * (1.0f / I24_SCALE);
+        i16[i] = (int16_t)(i * 2654435761u >> 16);
+    }
+    printf("%u frames\n", frames);
+
+    // correctness first, on the same inputs
+    i16ToFloat_c(i16, f32c, frames);
+    convertI16ToFloat(i16, f32b, frames);
+    checkFloat("i16->f32", f32c, f32b, frames);
+    floatToI16_c(f32, i16c, frames);
+    convertFloatToI16(f32, i16b, frames);
+    checkI16("f32->i16", i16c, i16b, frames, 0);
+    floatToI24_c(f32, i24c, frames);
+    convertFloatToI24(f32, i24, frames);
+    if (memcmp(i24c, i24, 3 * (size_t)frames)) {
+        printf("%-14s MISMATCH\n", "f32->i24");
+        failures++;
+    }
+    i24ToFloat_c(i24, f32c, frames);
+    convertI24ToFloat(i24, f32b, frames);
+    checkFloat("i24->f32", f32c, f32b, frames);
+    // the generators run in a different order: TPDF is within +/-1 LSB each
+    AudioDitherState dither, ditherC;
+    ditherInit(&dither, 1);
+    ditherInit(&ditherC, 1);
+    floatToI16Dither_c(f32, i16c, frames, &ditherC);
+    convertFloatToI16Dither(f32, i16b, frames, &dither);
+    checkI16("f32->i16 dith", i16c, i16b, frames, 2);
+    downmixStereoToMono_c(f32, f32c, frames);
+    downmixStereoToMono(f32, f32b, frames);
+    checkFloat("stereo->mono", f32c, f32b, frames);
+    // a contracted multiply-add may round the gain differently
+    memcpy(i16c, i16, frames * sizeof(int16_t));
+    memcpy(i16b, i16, frames * sizeof(int16_t));
+    gainRampI16_c(i16c, frames, 1.0f, -0.5f / frames, 0);
+    applyGainRampI16(i16b, frames, 1.0f, 0.5f);
+    checkI16("i16 gain ramp", i16c, i16b, frames, 1);
+    memcpy(i16c, i16, frames * sizeof(int16_t));
+    memcpy(i16b, i16, frames * sizeof(int16_t));
+    mixI16Saturate_c(i16c, i16 + frames, frames);
+    mixI16Saturate(i16b, i16 + frames, frames);
+    checkI16("i16 mix", i16c, i16b, frames, 0);
+    upsampleI16Hold_c(i16, i16c, frames, 2);
+    upsampleI16Hold(i16, i16b, frames, 2);
+    checkI16("i16 upsample", i16c, i16b, 2 * frames, 0);
+    decimateI16_c(i16, i16c, frames, 2);
+    memcpy(i16b, i16, 2 * frames * sizeof(int16_t));
+    decimateI16(i16b, i16b, 2 * frames, 2);     // in place
+    checkI16("i16 decimate", i16c, i16b, frames, 0);
+
+    BENCH("i16->f32", i16ToFloat_c(i16, f32b, frames), convertI16ToFloat(i16, f32b, frames));
+    BENCH("f32->i16", floatToI16_c(f32, i16, frames), convertFloatToI16(f32, i16, frames));
+    BENCH("f32->i16 dith", floatToI16Dither_c(f32, i16, frames, &dither),
+          convertFloatToI16Dither(f32, i16, frames, &dither));
+    BENCH("i24->f32", i24ToFloat_c(i24, f32b, frames), convertI24ToFloat(i24, f32b, frames));
+    BENCH("f32->i24", floatToI24_c(f32, i24, frames), convertFloatToI24(f32, i24, frames));
+    BENCH("interleave", interleaveStereo_c(f32, f32 + frames, f32b, frames),
+          interleaveStereo(f32, f32 + frames, f32b, frames));
+    BENCH("deinterleave", deinterleaveStereo_c(f32, f32b, f32b + frames, frames),
+          deinterleaveStereo(f32, f32b, f32b + frames, frames));
+    BENCH("mono->stereo", upmixMonoToStereo_c(f32, f32b, frames),
+          upmixMonoToStereo(f32, f32b, frames));
+    BENCH("stereo->mono", downmixStereoToMono_c(f32, f32b, frames),
+          downmixStereoToMono(f32, f32b, frames));
+    // unity ramp: the samples stay in range from one iteration to the next
+    BENCH("i16 gain ramp", gainRampI16_c(i16, frames, 1.0f, 0.0f, 0),
+          applyGainRampI16(i16, frames, 1.0f, 1.0f));
+    BENCH("i16 mix", mixI16Saturate_c(i16b, i16, frames), mixI16Saturate(i16b, i16, frames));
+    BENCH("i16 upsample", upsampleI16Hold_c(i16, i16b, frames, 2),
+          upsampleI16Hold(i16, i16b, frames, 2));
+    BENCH("i16 decimate", decimateI16_c(i16b, i16, frames, 2),
+          decimateI16(i16b, i16, 2 * frames, 2));
+
+out:
+    free(f32);
+    free(f32c);
+    free(i16);
+    free(i16b);
+    free(i16c);
+    free(i24);
+    free(i24c);
+}
+
+int main(int argc, char *argv[]) {
+    // fast path callback sizes, and one odd size for the tails
+    uint32_t sizes[] = {96, 192, 240, 1021};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        run(sizes[i]);
+    }
+    if (failures) {
+        printf("%d kernel(s) differ from their C version\n", failures);
+    }
+    return failures ? 1 : 0;
+}
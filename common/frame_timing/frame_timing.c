@@ -0,0 +1,320 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "frame_timing.h"
+
+#if defined(__ANDROID__)
+#include <android/log.h>
+#define LOG_TAG "FrameTiming"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#else
+#define LOGI(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#endif
+
+/*
+ * Histogram of microseconds: values below SUB_COUNT have a bucket each,
+ * larger ones keep their top SUB_BITS bits, so every power of two range is
+ * split in SUB_COUNT / 2 buckets. Durations are clamped to 2^32 - 1 us,
+ * which is shifted by 32 - SUB_BITS: the last bucket is
+ * (32 - SUB_BITS) * SUB_HALF + SUB_COUNT - 1 = BUCKET_COUNT - 1.
+ */
+#define SUB_BITS        6
+#define SUB_COUNT       (1u << SUB_BITS)
+#define SUB_HALF        (SUB_COUNT / 2)
+#define BUCKET_COUNT    ((34 - SUB_BITS) * SUB_HALF)
+
+#define DEFAULT_DEADLINE_MS   (1000.0 / 60)
+#define MAX_NAME              32
+
+typedef struct PhaseHistogram {
+    atomic_uint         buckets[BUCKET_COUNT];
+    atomic_ullong       sumUs;
+    atomic_uint         maxUs;
+    atomic_uint         missed;
+} PhaseHistogram;
+
+// counters at the start of the current period
+typedef struct PhaseSnapshot {
+    uint32_t            buckets[BUCKET_COUNT];
+    uint64_t            sumUs;
+    uint32_t            missed;
+} PhaseSnapshot;
+
+struct FrameTimer {
+    char                name[MAX_NAME];
+    char               *dumpPath;
+    uint64_t            dumpPeriodNs;
+    atomic_uint         deadlineUs;
+    atomic_ullong       lastFrameNs;    // 0 after a pause
+    atomic_ullong       periodStartNs;
+    PhaseHistogram      phases[FRAME_PHASE_COUNT];
+
+    pthread_mutex_t     lock;           // the dump side: previous
+    PhaseSnapshot       previous[FRAME_PHASE_COUNT];
+};
+
+static const char *phaseNames[FRAME_PHASE_COUNT] = {
+    "update", "render", "swap", "frame",
+};
+
+static __inline__ uint32_t bucketOf(uint32_t us) {
+    if (us < SUB_COUNT) {
+        return us;
+    }
+    uint32_t shift = (31 - (uint32_t)__builtin_clz(us)) - (SUB_BITS - 1);
+    return shift * SUB_HALF + (us >> shift);
+}
+
+// middle of the values falling in the bucket
+static double bucketValueUs(uint32_t bucket) {
+    if (bucket < SUB_COUNT) {
+        return bucket;
+    }
+    uint32_t shift = bucket / SUB_HALF - 1;
+    uint32_t sub = bucket - shift * SUB_HALF;
+    return ((double)sub + 0.5) * (double)(1u << shift);
+}
+
+uint64_t frameTimerNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+FrameTimer *frameTimerCreate(const FrameTimerConfig *config) {
+    FrameTimer *timer = (FrameTimer *)calloc(1, sizeof(FrameTimer));
+    if (!timer) {
+        return NULL;
+    }
+    snprintf(timer->name, sizeof(timer->name), "%s",
+             (config && config->name) ? config->name : "frames");
+    if (config && config->dumpPath) {
+        timer->dumpPath = strdup(config->dumpPath);
+    }
+    if (config && config->dumpPeriodMs > 0) {
+        timer->dumpPeriodNs = (uint64_t)(config->dumpPeriodMs * 1e6);
+    }
+    for (int p = 0; p < FRAME_PHASE_COUNT; p++) {
+        PhaseHistogram *histogram = &timer->phases[p];
+        for (uint32_t b = 0; b < BUCKET_COUNT; b++) {
+            atomic_init(&histogram->buckets[b], 0);
+        }
+        atomic_init(&histogram->sumUs, 0);
+        atomic_init(&histogram->maxUs, 0);
+        atomic_init(&histogram->missed, 0);
+    }
+    atomic_init(&timer->deadlineUs, 0);
+    atomic_init(&timer->lastFrameNs, 0);
+    atomic_init(&timer->periodStartNs, frameTimerNow());
+    pthread_mutex_init(&timer->lock, NULL);
+    frameTimerSetDeadline(timer, config ? config->deadlineMs : 0);
+    return timer;
+}
+
+void frameTimerDestroy(FrameTimer *timer) {
+    if (!timer) {
+        return;
+    }
+    pthread_mutex_destroy(&timer->lock);
+    free(timer->dumpPath);
+    free(timer);
+}
+
+void frameTimerSetDeadline(FrameTimer *timer, double deadlineMs) {
+    if (!timer) {
+        return;
+    }
+    if (deadlineMs <= 0) {
+        deadlineMs = DEFAULT_DEADLINE_MS;
+    }
+    atomic_store_explicit(&timer->deadlineUs, (uint32_t)(deadlineMs * 1000),
+                          memory_order_relaxed);
+}
+
+void frameTimerRecord(FrameTimer *timer, FramePhase phase, uint64_t durationNs) {
+    if (!timer || (unsigned)phase >= FRAME_PHASE_COUNT) {
+        return;
+    }
+    uint64_t us64 = durationNs / 1000;
+    uint32_t us = us64 > UINT32_MAX ? UINT32_MAX : (uint32_t)us64;
+    PhaseHistogram *histogram = &timer->phases[phase];
+
+    atomic_fetch_add_explicit(&histogram->buckets[bucketOf(us)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sumUs, us, memory_order_relaxed);
+    uint32_t max = atomic_load_explicit(&histogram->maxUs, memory_order_relaxed);
+    while (us > max &&
+           !atomic_compare_exchange_weak_explicit(&histogram->maxUs, &max, us,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+    }
+
+    uint64_t deadline = atomic_load_explicit(&timer->deadlineUs, memory_order_relaxed);
+    if (phase == FRAME_PHASE_FRAME) {
+        deadline += deadline / 2;
+    }
+    if (us > deadline) {
+        atomic_fetch_add_explicit(&histogram->missed, 1, memory_order_relaxed);
+    }
+}
+
+void frameTimerFrame(FrameTimer *timer) {
+    if (!timer) {
+        return;
+    }
+    uint64_t now = frameTimerNow();
+    uint64_t last = atomic_exchange_explicit(&timer->lastFrameNs, now, memory_order_relaxed);
+    if (last) {
+        frameTimerRecord(timer, FRAME_PHASE_FRAME, now - last);
+    }
+    if (timer->dumpPeriodNs &&
+        now - atomic_load_explicit(&timer->periodStartNs, memory_order_relaxed) >=
+            timer->dumpPeriodNs) {
+        frameTimerDump(timer);
+    }
+}
+
+void frameTimerPause(FrameTimer *timer) {
+    if (timer) {
+        atomic_store_explicit(&timer->lastFrameNs, 0, memory_order_relaxed);
+    }
+}
+
+/*
+ * Reduce the counts recorded since the previous snapshot into stats, and
+ * with commit, make the current counts the new previous snapshot. Called
+ * with the lock held.
+ */
+static void collectLocked(FrameTimer *timer, FramePhaseStats stats[FRAME_PHASE_COUNT],
+                          int commit) {
+    static const double percentiles[3] = {0.50, 0.95, 0.99};
+    uint32_t counts[BUCKET_COUNT];
+
+    for (int p = 0; p < FRAME_PHASE_COUNT; p++) {
+        PhaseHistogram *histogram = &timer->phases[p];
+        PhaseSnapshot *previous = &timer->previous[p];
+        FramePhaseStats *out = &stats[p];
+        uint64_t total = 0;
+
+        for (uint32_t b = 0; b < BUCKET_COUNT; b++) {
+            uint32_t now = atomic_load_explicit(&histogram->buckets[b], memory_order_relaxed);
+            counts[b] = now - previous->buckets[b];
+            total += counts[b];
+            if (commit) {
+                previous->buckets[b] = now;
+            }
+        }
+        uint64_t sum = atomic_load_explicit(&histogram->sumUs, memory_order_relaxed);
+        uint32_t missed = atomic_load_explicit(&histogram->missed, memory_order_relaxed);
+        uint32_t max = commit ? atomic_exchange_explicit(&histogram->maxUs, 0,
+                                                         memory_order_relaxed)
+                              : atomic_load_explicit(&histogram->maxUs, memory_order_relaxed);
+
+        memset(out, 0, sizeof(*out));
+        out->count = total;
+        out->missed = missed - previous->missed;
+        out->maxMs = max / 1000.0;
+        if (total) {
+            out->meanMs = (sum - previous->sumUs) / 1000.0 / total;
+            double *values[3] = {&out->p50Ms, &out->p95Ms, &out->p99Ms};
+            uint64_t seen = 0;
+            uint32_t b = 0;
+            for (int i = 0; i < 3; i++) {
+                uint64_t rank = (uint64_t)(percentiles[i] * total + 0.999999);
+                if (rank < 1) rank = 1;
+                while (seen + counts[b] < rank) {
+                    seen += counts[b++];
+                }
+                *values[i] = bucketValueUs(b) / 1000.0;
+            }
+        }
+        if (commit) {
+            previous->sumUs = sum;
+            previous->missed = missed;
+        }
+    }
+}
+
+void frameTimerPeek(FrameTimer *timer, FramePhaseStats stats[FRAME_PHASE_COUNT],
+                    double *fps) {
+    if (!timer || !stats) {
+        return;
+    }
+    pthread_mutex_lock(&timer->lock);
+    collectLocked(timer, stats, 0);
+    pthread_mutex_unlock(&timer->lock);
+    if (fps) {
+        uint64_t period = frameTimerNow() -
+                          atomic_load_explicit(&timer->periodStartNs, memory_order_relaxed);
+        *fps = period ? stats[FRAME_PHASE_FRAME].count * 1e9 / period : 0;
+    }
+}
+
+void frameTimerDump(FrameTimer *timer) {
+    FramePhaseStats stats[FRAME_PHASE_COUNT];
+    char lines[FRAME_PHASE_COUNT + 1][160];
+    int lineCount = 0;
+
+    if (!timer) {
+        return;
+    }
+    pthread_mutex_lock(&timer->lock);
+    uint64_t now = frameTimerNow();
+    uint64_t start = atomic_exchange_explicit(&timer->periodStartNs, now, memory_order_relaxed);
+    collectLocked(timer, stats, 1);
+    pthread_mutex_unlock(&timer->lock);
+
+    double seconds = (now - start) / 1e9;
+    double deadline = atomic_load_explicit(&timer->deadlineUs, memory_order_relaxed) / 1000.0;
+    snprintf(lines[lineCount++], sizeof(lines[0]),
+             "%s: %.1f fps over %.1f s, deadline %.1f ms", timer->name,
+             seconds > 0 ? stats[FRAME_PHASE_FRAME].count / seconds : 0.0, seconds, deadline);
+    for (int p = 0; p < FRAME_PHASE_COUNT; p++) {
+        const FramePhaseStats *s = &stats[p];
+        if (!s->count) {
+            continue;
+        }
+        snprintf(lines[lineCount++], sizeof(lines[0]),
+                 "%s: %-6s n %5llu  mean %6.2f  p50 %6.2f  p95 %6.2f  p99 %6.2f  "
+                 "max %6.2f ms  missed %llu (%.1f%%)",
+                 timer->name, phaseNames[p], (unsigned long long)s->count, s->meanMs,
+                 s->p50Ms, s->p95Ms, s->p99Ms, s->maxMs, (unsigned long long)s->missed,
+                 100.0 * s->missed / s->count);
+    }
+
+    if (!timer->dumpPath) {
+        for (int i = 0; i < lineCount; i++) {
+            LOGI("%s", lines[i]);
+        }
+        return;
+    }
+    FILE *file = fopen(timer->dumpPath, "a");
+    if (!file) {
+        LOGI("%s: unable to open %s", timer->name, timer->dumpPath);
+        return;
+    }
+    for (int i = 0; i < lineCount; i++) {
+        fprintf(file, "%.3f %s\n", now / 1e9, lines[i]);
+    }
+    fclose(file);
+}
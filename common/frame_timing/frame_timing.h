@@ -0,0 +1,121 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMMON_FRAME_TIMING_H
+#define COMMON_FRAME_TIMING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Frame time instrumentation shared by the plasma and teapot samples.
+ *
+ * Each phase of a frame has a log-linear (HDR style) histogram of its
+ * durations with about 3% resolution from 1 us to over an hour. Recording
+ * is a few relaxed atomic increments, with no lock and no allocation, so
+ * it can be called from any thread. Once per dump period the histograms
+ * of the period are reduced to p50/p95/p99/max and deadline misses, and
+ * written to logcat or appended to a file.
+ */
+typedef enum FramePhase {
+    FRAME_PHASE_UPDATE,     // simulation / animation step
+    FRAME_PHASE_RENDER,     // drawing, CPU side
+    FRAME_PHASE_SWAP,       // eglSwapBuffers / unlockAndPost
+    FRAME_PHASE_FRAME,      // interval between two frameTimerFrame() calls
+    FRAME_PHASE_COUNT,
+} FramePhase;
+
+typedef struct FrameTimerConfig {
+    const char *name;       // prefixes the dumps
+    double deadlineMs;      // frame budget; 0 for 60 fps
+    double dumpPeriodMs;    // 0: no periodic dumps
+    const char *dumpPath;   // NULL: logcat, else appended to this file
+} FrameTimerConfig;
+
+typedef struct FramePhaseStats {
+    uint64_t count;
+    double meanMs;
+    double p50Ms, p95Ms, p99Ms;
+    double maxMs;
+    uint64_t missed;        // see frameTimerRecord()
+} FramePhaseStats;
+
+typedef struct FrameTimer FrameTimer;
+
+FrameTimer *frameTimerCreate(const FrameTimerConfig *config);
+void frameTimerDestroy(FrameTimer *timer);
+
+// CLOCK_MONOTONIC in nanoseconds
+uint64_t frameTimerNow(void);
+
+void frameTimerSetDeadline(FrameTimer *timer, double deadlineMs);
+
+/*
+ * Record a duration of the phase. UPDATE, RENDER and SWAP count a miss
+ * when they alone take longer than the deadline; a FRAME interval counts
+ * one when it is over 1.5 deadlines, that is when a vsync was skipped.
+ */
+void frameTimerRecord(FrameTimer *timer, FramePhase phase, uint64_t durationNs);
+
+/*
+ * Mark the end of a frame: records the FRAME interval since the previous
+ * call, and dumps the statistics when the dump period is over.
+ */
+void frameTimerFrame(FrameTimer *timer);
+
+// forget the last frame, so a pause is not taken for a missed frame
+void frameTimerPause(FrameTimer *timer);
+
+/*
+ * Statistics of the frames recorded since the last dump; frames per second
+ * of the period in fps, if not NULL.
+ */
+void frameTimerPeek(FrameTimer *timer, FramePhaseStats stats[FRAME_PHASE_COUNT],
+                    double *fps);
+
+// write the statistics of the period now, and start a new period
+void frameTimerDump(FrameTimer *timer);
+
+#ifdef __cplusplus
+}
+
+/*
+ * Records the lifetime of a scope as a phase:
+ *   { FramePhaseScope render(timer, FRAME_PHASE_RENDER); ... }
+ */
+class FramePhaseScope {
+ public:
+  FramePhaseScope(FrameTimer *timer, FramePhase phase)
+      : timer_(timer), phase_(phase), start_(frameTimerNow()) {}
+  ~FramePhaseScope() {
+    frameTimerRecord(timer_, phase_, frameTimerNow() - start_);
+  }
+
+ private:
+  FramePhaseScope(const FramePhaseScope &) = delete;
+  FramePhaseScope &operator=(const FramePhaseScope &) = delete;
+
+  FrameTimer *timer_;
+  FramePhase phase_;
+  uint64_t start_;
+};
+#endif
+
+#endif // COMMON_FRAME_TIMING_H
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks the percentiles against sorted samples and times the recording.
+ * Host only: the frame-timing-benchmark target of CMakeLists.txt, run by
+ * ctest, or
+ *   cc -O2 -std=c11 frame_timing.c frame_timing_benchmark.c -lpthread -lm
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "frame_timing.h"
+
+#define SAMPLES      (1 << 20)
+#define THREADS      4
+
+static int compareU64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static uint64_t samples[SAMPLES];
+
+static void *recordAll(void *arg) {
+    FrameTimer *timer = (FrameTimer *)arg;
+    for (uint32_t i = 0; i < SAMPLES; i++) {
+        frameTimerRecord(timer, FRAME_PHASE_RENDER, samples[i]);
+    }
+    return NULL;
+}
+
+int main(void) {
+    // 16.6 ms frames with jitter, 2% of 33 ms ones, a few long stalls
+    uint32_t rng = 1;
+    for (uint32_t i = 0; i < SAMPLES; i++) {
+        rng = rng * 1664525u + 1013904223u;
+        double jitter = ((rng >> 8) / 16777216.0 - 0.5) * 2e6;
+        uint64_t ns = (uint64_t)(16.6e6 + jitter);
+        if (rng % 50 == 0) ns *= 2;
+        if (rng % 10007 == 0) ns = 250000000;
+        samples[i] = ns;
+    }
+
+    FrameTimerConfig config = {.name = "bench"};
+    FrameTimer *timer = frameTimerCreate(&config);
+    double t0 = frameTimerNow();
+    for (uint32_t i = 0; i < SAMPLES; i++) {
+        frameTimerRecord(timer, FRAME_PHASE_FRAME, samples[i]);
+    }
+    double t1 = frameTimerNow();
+
+    pthread_t threads[THREADS];
+    for (int i = 0; i < THREADS; i++) pthread_create(&threads[i], NULL, recordAll, timer);
+    for (int i = 0; i < THREADS; i++) pthread_join(threads[i], NULL);
+    double t2 = frameTimerNow();
+
+    FramePhaseStats stats[FRAME_PHASE_COUNT];
+    frameTimerPeek(timer, stats, NULL);
+    qsort(samples, SAMPLES, sizeof(samples[0]), compareU64);
+    static const double percentiles[3] = {0.50, 0.95, 0.99};
+    double measured[3] = {stats[FRAME_PHASE_FRAME].p50Ms, stats[FRAME_PHASE_FRAME].p95Ms,
+                          stats[FRAME_PHASE_FRAME].p99Ms};
+    double worst = 0;
+    for (int i = 0; i < 3; i++) {
+        double exact = samples[(size_t)(percentiles[i] * SAMPLES) - 1] / 1e6;
+        double error = fabs(measured[i] - exact) / exact;
+        if (error > worst) worst = error;
+        printf("p%-2d exact %7.3f ms  histogram %7.3f ms\n",
+               (int)(percentiles[i] * 100), exact, measured[i]);
+    }
+    printf("max %.3f ms, missed %llu, render n %llu\n", stats[FRAME_PHASE_FRAME].maxMs,
+           (unsigned long long)stats[FRAME_PHASE_FRAME].missed,
+           (unsigned long long)stats[FRAME_PHASE_RENDER].count);
+    printf("record: %.1f ns, %d threads contending %.1f ns\n",
+           (t1 - t0) / SAMPLES, THREADS, (t2 - t1) / SAMPLES / THREADS);
+    frameTimerDump(timer);
+    frameTimerDestroy(timer);
+
+    // the top of the range: a frame spanning a long pause, and the clamp
+    FrameTimer *longTimer = frameTimerCreate(&config);
+    frameTimerRecord(longTimer, FRAME_PHASE_FRAME, (1ull << 31) * 1000);
+    frameTimerRecord(longTimer, FRAME_PHASE_FRAME, UINT64_MAX);
+    FramePhaseStats longStats[FRAME_PHASE_COUNT];
+    frameTimerPeek(longTimer, longStats, NULL);
+    frameTimerDestroy(longTimer);
+    int longOk = longStats[FRAME_PHASE_FRAME].count == 2 &&
+                 longStats[FRAME_PHASE_FRAME].maxMs == UINT32_MAX / 1e3 &&
+                 longStats[FRAME_PHASE_FRAME].p99Ms > (1u << 31) / 1e3;
+    printf("long frames: n %llu, max %.0f ms, p99 %.0f ms%s\n",
+           (unsigned long long)longStats[FRAME_PHASE_FRAME].count,
+           longStats[FRAME_PHASE_FRAME].maxMs, longStats[FRAME_PHASE_FRAME].p99Ms,
+           longOk ? "" : " FAILED");
+
+    return (worst < 0.035 && longOk &&
+            stats[FRAME_PHASE_RENDER].count == (uint64_t)SAMPLES * THREADS) ? 0 : 1;
+}
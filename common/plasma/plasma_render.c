@@ -0,0 +1,396 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "plasma_render.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define PLASMA_USE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PLASMA_USE_SSE2 1
+#endif
+
+/* We're going to perform computations for every pixel of the target
+ * bitmap. floating-point operations are very slow on ARMv5, and not
+ * too bad on ARMv7 with the exception of trigonometric functions.
+ *
+ * For better performance on all platforms, we're going to use fixed-point
+ * arithmetic and all kinds of tricks
+ */
+
+typedef int32_t  Fixed;
+
+#define  FIXED_BITS           16
+#define  FIXED_ONE            (1 << FIXED_BITS)
+#define  FIXED_FROM_FLOAT(x)  ((Fixed)((x)*FIXED_ONE))
+
+#define  ANGLE_BITS           9
+#define  ANGLE_2PI            (1 << ANGLE_BITS)
+#define  ANGLE_PI             (1 << (ANGLE_BITS-1))
+
+/* Color palette used for rendering the plasma */
+#define  PALETTE_BITS         8
+#define  PALETTE_SIZE         (1 << PALETTE_BITS)
+
+#define  YT1_INCR   FIXED_FROM_FLOAT(1/100.)
+#define  YT2_INCR   FIXED_FROM_FLOAT(1/163.)
+#define  XT1_INCR   FIXED_FROM_FLOAT(1/173.)
+#define  XT2_INCR   FIXED_FROM_FLOAT(1/242.)
+
+#define  CACHE_LINE           64
+#define  INDEX_BATCH          16     /* palette indexes per SIMD iteration */
+#define  PLASMA_BAND_ROWS     8      /* rows a thread takes at a time */
+#define  PLASMA_MAX_THREADS   8
+/* below this, waking the workers costs more than it saves */
+#define  PLASMA_MIN_POOL_PIXELS  (64 * 1024)
+
+static Fixed     angle_sin_tab[ANGLE_2PI+1];
+static uint16_t  palette565[PALETTE_SIZE];
+static uint32_t  palette8888[PALETTE_SIZE];
+static pthread_once_t tablesOnce = PTHREAD_ONCE_INIT;
+
+/* sine of a fixed point angle, in radians * ANGLE_PI / M_PI units;
+ * wraps around like the fixed point arithmetic does */
+static __inline__ Fixed fixed_sin(uint32_t f)
+{
+    return angle_sin_tab[(f >> (FIXED_BITS - ANGLE_BITS)) & (ANGLE_2PI-1)];
+}
+
+static void set_palette(int nn, int red, int green, int blue)
+{
+    palette565[nn] = (uint16_t)( ((red   << 8) & 0xf800) |
+                                 ((green << 3) & 0x07e0) |
+                                 ((blue  >> 3) & 0x001f) );
+    palette8888[nn] = (uint32_t)red | (uint32_t)green << 8 |
+                      (uint32_t)blue << 16 | 0xff000000u;
+}
+
+static void init_tables(void)
+{
+    int  nn, mm = 0;
+    for (nn = 0; nn < ANGLE_2PI+1; nn++) {
+        double  radians = nn*M_PI/ANGLE_PI;
+        angle_sin_tab[nn] = FIXED_FROM_FLOAT(sin(radians));
+    }
+
+    /* fun with colors */
+    for (nn = 0; nn < PALETTE_SIZE/4; nn++) {
+        int  jj = (nn-mm)*4*255/PALETTE_SIZE;
+        set_palette(nn, 255, jj, 255-jj);
+    }
+
+    for ( mm = nn; nn < PALETTE_SIZE/2; nn++ ) {
+        int  jj = (nn-mm)*4*255/PALETTE_SIZE;
+        set_palette(nn, 255-jj, 255, jj);
+    }
+
+    for ( mm = nn; nn < PALETTE_SIZE*3/4; nn++ ) {
+        int  jj = (nn-mm)*4*255/PALETTE_SIZE;
+        set_palette(nn, 0, 255-jj, 255);
+    }
+
+    for ( mm = nn; nn < PALETTE_SIZE; nn++ ) {
+        int  jj = (nn-mm)*4*255/PALETTE_SIZE;
+        set_palette(nn, jj, 0, 255);
+    }
+}
+
+/*
+ * A pixel is
+ *     palette(|(row(y) + column(x)) / 4|)
+ * with row(y) the sum of two sines of y and column(x) that of two sines of x.
+ * The palette index is the top 8 bits of the 16 bit fraction, 1.0 being
+ * clamped to the last entry: for v = |sum >> 2| <= 1.0, (v - (v >> 16)) >> 8.
+ */
+static __inline__ uint32_t palette_index(Fixed sum)
+{
+    Fixed  v = sum >> 2;
+    if (v < 0) v = -v;
+    return (uint32_t)(v - (v >> FIXED_BITS)) >> (FIXED_BITS - PALETTE_BITS);
+}
+
+/* count is a multiple of INDEX_BATCH */
+static void palette_indexes(Fixed row, const Fixed *column, uint8_t *idx, uint32_t count)
+{
+    uint32_t  i = 0;
+#if defined(PLASMA_USE_NEON)
+    int32x4_t  vrow = vdupq_n_s32(row);
+    for (; i < count; i += INDEX_BATCH) {
+        int32x4_t  v[4];
+        for (int k = 0; k < 4; k++) {
+            int32x4_t  s = vabsq_s32(vshrq_n_s32(vaddq_s32(vrow, vld1q_s32(column + i + 4*k)), 2));
+            s = vsubq_s32(s, vshrq_n_s32(s, FIXED_BITS));
+            v[k] = vshrq_n_s32(s, FIXED_BITS - PALETTE_BITS);
+        }
+        uint16x8_t  lo = vcombine_u16(vqmovun_s32(v[0]), vqmovun_s32(v[1]));
+        uint16x8_t  hi = vcombine_u16(vqmovun_s32(v[2]), vqmovun_s32(v[3]));
+        vst1q_u8(idx + i, vcombine_u8(vmovn_u16(lo), vmovn_u16(hi)));
+    }
+#elif defined(PLASMA_USE_SSE2)
+    __m128i  vrow = _mm_set1_epi32(row);
+    for (; i < count; i += INDEX_BATCH) {
+        __m128i  v[4];
+        for (int k = 0; k < 4; k++) {
+            __m128i  s = _mm_srai_epi32(_mm_add_epi32(vrow,
+                             _mm_loadu_si128((const __m128i *)(column + i + 4*k))), 2);
+            __m128i  sign = _mm_srai_epi32(s, 31);
+            s = _mm_sub_epi32(_mm_xor_si128(s, sign), sign);
+            s = _mm_sub_epi32(s, _mm_srli_epi32(s, FIXED_BITS));
+            v[k] = _mm_srli_epi32(s, FIXED_BITS - PALETTE_BITS);
+        }
+        __m128i  lo = _mm_packs_epi32(v[0], v[1]);
+        __m128i  hi = _mm_packs_epi32(v[2], v[3]);
+        _mm_storeu_si128((__m128i *)(idx + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; i < count; i++) {
+        idx[i] = (uint8_t)palette_index(row + column[i]);
+    }
+}
+
+static __inline__ void store_line(uint8_t *dst, const uint8_t *src)
+{
+#if defined(PLASMA_USE_NEON)
+    vst1q_u8(dst,      vld1q_u8(src));
+    vst1q_u8(dst + 16, vld1q_u8(src + 16));
+    vst1q_u8(dst + 32, vld1q_u8(src + 32));
+    vst1q_u8(dst + 48, vld1q_u8(src + 48));
+#elif defined(PLASMA_USE_SSE2)
+    const __m128i  *s = (const __m128i *)src;
+    _mm_storeu_si128((__m128i *)dst,        _mm_load_si128(s));
+    _mm_storeu_si128((__m128i *)(dst + 16), _mm_load_si128(s + 1));
+    _mm_storeu_si128((__m128i *)(dst + 32), _mm_load_si128(s + 2));
+    _mm_storeu_si128((__m128i *)(dst + 48), _mm_load_si128(s + 3));
+#else
+    memcpy(dst, src, CACHE_LINE);
+#endif
+}
+
+/*
+ * Render one row, a cache line of pixels at a time: the first chunk runs up
+ * to the first cache line boundary, the following ones fill whole lines.
+ * column holds width values plus INDEX_BATCH of padding.
+ */
+static void render_row(const PlasmaSurface *surface, uint32_t y, Fixed row,
+                       const Fixed *column)
+{
+    uint8_t   *line = (uint8_t *)surface->pixels + (size_t)y * surface->stride;
+    uint32_t   bpp = (surface->format == PLASMA_FORMAT_RGB_565) ? 2 : 4;
+    uint32_t   perLine = CACHE_LINE / bpp;
+    uint32_t   misalign = (uint32_t)((uintptr_t)line & (CACHE_LINE - 1));
+    uint32_t   chunk = (misalign % bpp) ? perLine : (CACHE_LINE - misalign) / bpp;
+    uint8_t    block[CACHE_LINE] __attribute__((aligned(CACHE_LINE)));
+    uint8_t    idx[CACHE_LINE / 2 + INDEX_BATCH];
+    uint32_t   x = 0, i;
+
+    while (x < surface->width) {
+        uint32_t  n = surface->width - x;
+        if (n > chunk) n = chunk;
+        palette_indexes(row, column + x, idx, (n + INDEX_BATCH - 1) & ~(INDEX_BATCH - 1));
+
+        if (bpp == 2) {
+            uint16_t  *pixel = (uint16_t *)block;
+            for (i = 0; i < n; i++) pixel[i] = palette565[idx[i]];
+        } else {
+            uint32_t  *pixel = (uint32_t *)block;
+            for (i = 0; i < n; i++) pixel[i] = palette8888[idx[i]];
+        }
+        if (n == perLine) {
+            store_line(line + x * bpp, block);
+        } else {
+            memcpy(line + x * bpp, block, n * bpp);
+        }
+        x += n;
+        chunk = perLine;
+    }
+}
+
+struct PlasmaRenderer {
+    pthread_t        *workers;
+    uint32_t          workerCount;
+    pthread_mutex_t   lock;
+    pthread_cond_t    start;
+    pthread_cond_t    done;
+    uint32_t          frame;        /* bumped for every frame handed out */
+    uint32_t          busy;         /* workers still on the current frame */
+    int               exit;
+
+    /* the frame being rendered, set under lock before bumping frame */
+    PlasmaSurface     surface;
+    Fixed             yt;
+    Fixed            *column;
+    uint32_t          columnSize;
+    atomic_uint       nextRow;
+};
+
+static void render_bands(PlasmaRenderer *renderer)
+{
+    const PlasmaSurface  *surface = &renderer->surface;
+    for (;;) {
+        uint32_t  y = atomic_fetch_add(&renderer->nextRow, PLASMA_BAND_ROWS);
+        if (y >= surface->height) {
+            return;
+        }
+        uint32_t  end = y + PLASMA_BAND_ROWS;
+        if (end > surface->height) end = surface->height;
+        for (; y < end; y++) {
+            /* the row term of the original: two sines stepping from the
+             * same time dependent start */
+            uint32_t  yt = (uint32_t)renderer->yt;
+            Fixed  row = fixed_sin(yt + y * (uint32_t)YT1_INCR) +
+                         fixed_sin(yt + y * (uint32_t)YT2_INCR);
+            render_row(surface, y, row, renderer->column);
+        }
+    }
+}
+
+static void *worker_loop(void *arg)
+{
+    PlasmaRenderer  *renderer = (PlasmaRenderer *)arg;
+    uint32_t         seen = 0;
+
+    pthread_mutex_lock(&renderer->lock);
+    for (;;) {
+        while (!renderer->exit && renderer->frame == seen) {
+            pthread_cond_wait(&renderer->start, &renderer->lock);
+        }
+        if (renderer->exit) {
+            break;
+        }
+        seen = renderer->frame;
+        pthread_mutex_unlock(&renderer->lock);
+
+        render_bands(renderer);
+
+        pthread_mutex_lock(&renderer->lock);
+        if (--renderer->busy == 0) {
+            pthread_cond_signal(&renderer->done);
+        }
+    }
+    pthread_mutex_unlock(&renderer->lock);
+    return NULL;
+}
+
+PlasmaRenderer *plasmaCreate(uint32_t threadCount)
+{
+    pthread_once(&tablesOnce, init_tables);
+
+    if (threadCount == 0) {
+        long  cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threadCount = (cpus > 0) ? (uint32_t)cpus : 1;
+    }
+    if (threadCount > PLASMA_MAX_THREADS) {
+        threadCount = PLASMA_MAX_THREADS;
+    }
+
+    PlasmaRenderer  *renderer = (PlasmaRenderer *)calloc(1, sizeof(PlasmaRenderer));
+    if (!renderer) {
+        return NULL;
+    }
+    pthread_mutex_init(&renderer->lock, NULL);
+    pthread_cond_init(&renderer->start, NULL);
+    pthread_cond_init(&renderer->done, NULL);
+    atomic_init(&renderer->nextRow, 0);
+
+    /* the calling thread is one of them */
+    if (threadCount > 1) {
+        renderer->workers = (pthread_t *)calloc(threadCount - 1, sizeof(pthread_t));
+    }
+    if (renderer->workers) {
+        while (renderer->workerCount < threadCount - 1 &&
+               pthread_create(&renderer->workers[renderer->workerCount], NULL,
+                              worker_loop, renderer) == 0) {
+            renderer->workerCount++;
+        }
+    }
+    return renderer;
+}
+
+void plasmaDestroy(PlasmaRenderer *renderer)
+{
+    if (!renderer) {
+        return;
+    }
+    pthread_mutex_lock(&renderer->lock);
+    renderer->exit = 1;
+    pthread_cond_broadcast(&renderer->start);
+    pthread_mutex_unlock(&renderer->lock);
+    for (uint32_t i = 0; i < renderer->workerCount; i++) {
+        pthread_join(renderer->workers[i], NULL);
+    }
+    pthread_cond_destroy(&renderer->done);
+    pthread_cond_destroy(&renderer->start);
+    pthread_mutex_destroy(&renderer->lock);
+    free(renderer->workers);
+    free(renderer->column);
+    free(renderer);
+}
+
+void plasmaRender(PlasmaRenderer *renderer, const PlasmaSurface *surface, double t_ms)
+{
+    if (!renderer || !surface || !surface->pixels) {
+        return;
+    }
+
+    /* the column term is the same for every row: compute it once */
+    uint32_t  size = surface->width + INDEX_BATCH;
+    if (renderer->columnSize < size) {
+        Fixed  *column = (Fixed *)realloc(renderer->column, size * sizeof(Fixed));
+        if (!column) {
+            return;
+        }
+        renderer->column = column;
+        renderer->columnSize = size;
+    }
+    uint32_t  xt = (uint32_t)FIXED_FROM_FLOAT(t_ms/3000.);
+    for (uint32_t x = 0; x < surface->width; x++) {
+        renderer->column[x] = fixed_sin(xt + x * (uint32_t)XT1_INCR) +
+                              fixed_sin(xt + x * (uint32_t)XT2_INCR);
+    }
+    memset(renderer->column + surface->width, 0, INDEX_BATCH * sizeof(Fixed));
+
+    pthread_mutex_lock(&renderer->lock);
+    renderer->surface = *surface;
+    renderer->yt = FIXED_FROM_FLOAT(t_ms/1230.);
+    atomic_store(&renderer->nextRow, 0);
+    int  pooled = renderer->workerCount > 0 &&
+                  (size_t)surface->width * surface->height >= PLASMA_MIN_POOL_PIXELS;
+    if (pooled) {
+        renderer->busy = renderer->workerCount;
+        renderer->frame++;
+        pthread_cond_broadcast(&renderer->start);
+    }
+    pthread_mutex_unlock(&renderer->lock);
+
+    render_bands(renderer);
+
+    if (pooled) {
+        pthread_mutex_lock(&renderer->lock);
+        while (renderer->busy) {
+            pthread_cond_wait(&renderer->done, &renderer->lock);
+        }
+        pthread_mutex_unlock(&renderer->lock);
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMMON_PLASMA_RENDER_H
+#define COMMON_PLASMA_RENDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Plasma effect renderer shared by bitmap-plasma and native-plasma.
+ *
+ * The effect is computed in fixed point with sine and palette tables. The
+ * column term of a frame is the same for every row, so it is computed once
+ * per frame; rows are then split in bands across a persistent pool of
+ * worker threads, and each row computes its palette indexes 16 pixels at a
+ * time with NEON (armeabi-v7a with NEON, arm64-v8a) or SSE2 (x86, x86_64)
+ * and writes whole 64 byte cache lines whenever the row alignment allows.
+ */
+typedef enum PlasmaFormat {
+    PLASMA_FORMAT_RGB_565,
+    PLASMA_FORMAT_RGBA_8888,    // R, G, B, A bytes; alpha is opaque
+} PlasmaFormat;
+
+typedef struct PlasmaSurface {
+    void         *pixels;
+    uint32_t      width;
+    uint32_t      height;
+    uint32_t      stride;       // in bytes
+    PlasmaFormat  format;
+} PlasmaSurface;
+
+typedef struct PlasmaRenderer PlasmaRenderer;
+
+/*
+ * threadCount counts the calling thread, which renders its share of the
+ * rows too; 0 picks one thread per online CPU. Returns NULL on failure.
+ */
+PlasmaRenderer *plasmaCreate(uint32_t threadCount);
+void plasmaDestroy(PlasmaRenderer *renderer);
+
+/*
+ * Render the frame at time t_ms into the surface, returning once every row
+ * is written. Not reentrant: render from one thread at a time.
+ */
+void plasmaRender(PlasmaRenderer *renderer, const PlasmaSurface *surface, double t_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COMMON_PLASMA_RENDER_H
@@ -0,0 +1,161 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Renders a few frames at several resolutions in both formats with the
+ * original one row at a time renderer, the SIMD renderer on one thread, and
+ * the SIMD renderer on the pool; checks they draw the same pixels and prints
+ * megapixels per second, one resolution and format per line. Built with the
+ * renderer itself, to reach its tables. Host only: the plasma-benchmark
+ * target of CMakeLists.txt, run by ctest, or
+ *   cc -O2 -std=c11 plasma_render_benchmark.c -lpthread -lm
+ *   ./a.out [threads]
+ */
+
+#include "plasma_render.c"
+
+#include <stdio.h>
+#include <time.h>
+
+/*
+ * The renderer as the samples had it: one row at a time on the calling
+ * thread, two table lookups per pixel for the column term. The baseline
+ * of the benchmark, and the reference the fast path output is checked against.
+ */
+static void render_by_rows(const PlasmaSurface *surface, double t)
+{
+    Fixed  yt1 = FIXED_FROM_FLOAT(t/1230.);
+    Fixed  yt2 = yt1;
+    Fixed  xt10 = FIXED_FROM_FLOAT(t/3000.);
+    Fixed  xt20 = xt10;
+    uint8_t  *pixels = (uint8_t *)surface->pixels;
+
+    for (uint32_t yy = 0; yy < surface->height; yy++) {
+        Fixed  base = fixed_sin((uint32_t)yt1) + fixed_sin((uint32_t)yt2);
+        Fixed  xt1 = xt10;
+        Fixed  xt2 = xt20;
+
+        yt1 += YT1_INCR;
+        yt2 += YT2_INCR;
+
+        for (uint32_t xx = 0; xx < surface->width; xx++) {
+            Fixed  ii = base + fixed_sin((uint32_t)xt1) + fixed_sin((uint32_t)xt2);
+
+            xt1 += XT1_INCR;
+            xt2 += XT2_INCR;
+
+            if (surface->format == PLASMA_FORMAT_RGB_565) {
+                ((uint16_t *)pixels)[xx] = palette565[palette_index(ii)];
+            } else {
+                ((uint32_t *)pixels)[xx] = palette8888[palette_index(ii)];
+            }
+        }
+        pixels += surface->stride;
+    }
+}
+
+#define BENCH_FRAMES 30
+
+static double nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return 1e9 * ts.tv_sec + ts.tv_nsec;
+}
+
+static double bench_mpps(PlasmaRenderer *renderer, const PlasmaSurface *surface)
+{
+    double  t0 = nowNs();
+    for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+        if (renderer) {
+            plasmaRender(renderer, surface, frame * 16.7);
+        } else {
+            render_by_rows(surface, frame * 16.7);
+        }
+    }
+    double  pixels = (double)BENCH_FRAMES * surface->width * surface->height;
+    return pixels / ((nowNs() - t0) / 1e3);
+}
+
+static void plasmaBenchmark(char *report, size_t reportSize, uint32_t threadCount)
+{
+    static const uint32_t  sizes[][2] = {
+        {480, 800}, {720, 1280}, {1080, 1920}, {1440, 2560},
+    };
+    size_t  used = 0;
+    if (!report || !reportSize) {
+        return;
+    }
+    report[0] = 0;
+
+    PlasmaRenderer  *single = plasmaCreate(1);
+    PlasmaRenderer  *pool = plasmaCreate(threadCount);
+    if (!single || !pool) {
+        plasmaDestroy(single);
+        plasmaDestroy(pool);
+        return;
+    }
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (int f = 0; f < 2; f++) {
+            PlasmaSurface  surface = {
+                .width = sizes[s][0],
+                .height = sizes[s][1],
+                .format = f ? PLASMA_FORMAT_RGBA_8888 : PLASMA_FORMAT_RGB_565,
+            };
+            uint32_t  bpp = f ? 4 : 2;
+            /* gralloc strides are typically 64 byte aligned */
+            surface.stride = (surface.width * bpp + CACHE_LINE - 1) & ~(CACHE_LINE - 1);
+            size_t  size = (size_t)surface.stride * surface.height;
+            uint8_t  *expected = (uint8_t *)calloc(1, size);
+            uint8_t  *buffer = (uint8_t *)calloc(1, size + CACHE_LINE);
+            if (!expected || !buffer) {
+                free(expected);
+                free(buffer);
+                break;
+            }
+            surface.pixels = buffer + (CACHE_LINE - ((uintptr_t)buffer & (CACHE_LINE - 1)));
+
+            double  byRows = bench_mpps(NULL, &surface);
+            memcpy(expected, surface.pixels, size);
+            double  simd = bench_mpps(single, &surface);
+            double  pooled = bench_mpps(pool, &surface);
+
+            int  mismatch = memcmp(expected, surface.pixels, size) != 0;
+            int  n = snprintf(report + used, reportSize - used,
+                              "%4ux%-4u %-4s by rows %6.1f  SIMD %6.1f  %u threads %6.1f"
+                              " MP/s%s\n",
+                              surface.width, surface.height, f ? "8888" : "565",
+                              byRows, simd, pool->workerCount + 1, pooled,
+                              mismatch ? "  MISMATCH" : "");
+            if (n > 0) used += (size_t)n < reportSize - used ? (size_t)n
+                                                             : reportSize - used - 1;
+            free(buffer);
+            free(expected);
+        }
+    }
+
+    plasmaDestroy(single);
+    plasmaDestroy(pool);
+}
+
+int main(int argc, char **argv)
+{
+    char  report[2048];
+    plasmaBenchmark(report, sizeof(report), argc > 1 ? (uint32_t)atoi(argv[1]) : 0);
+    fputs(report, stdout);
+    return strstr(report, "MISMATCH") ? 1 : 0;
+}
@@ -22,10 +22,14 @@
  *    Release all textures created in engine
  */
 void ImageViewEngine::DeleteTextures(void) {
+  if (loader_) {
+    loader_->Cancel();
+  }
   for (auto& tex : textures_) {
     delete tex;
   }
   textures_.resize(0);
+  texturesUploaded_ = 0;
 }
 
 /*
@@ -33,6 +37,9 @@ void ImageViewEngine::DeleteTextures(void) {
  *    Create 2 textures in current display_ color space ( P3 or sRGB)
  *    If it is P3 space, image is transformed through sRGB so colors
  *    outside sRGB gamut are removed.
+ *    Decoding and conversion run on the texture loader threads; only the
+ *    texture on display is waited for here, the others are uploaded by
+ *    DrawFrame() as they get ready.
  */
 bool ImageViewEngine::CreateTextures(void) {
   std::vector<std::string> files;
@@ -42,14 +49,64 @@ bool ImageViewEngine::CreateTextures(void) {
   }
   DeleteTextures();
 
+  textureStart_ = std::chrono::steady_clock::now();
+  if (!loader_) {
+    std::string cacheDir;
+    if (app_->activity->internalDataPath) {
+      cacheDir = std::string(app_->activity->internalDataPath) + "/textures";
+    }
+    // leave a core to the GL thread
+    uint32_t threads = std::thread::hardware_concurrency();
+    loader_.reset(new TextureLoader(app_->activity->assetManager, cacheDir,
+                                    threads > 1 ? threads - 1 : 1));
+  }
+
   for(auto& f : files) {
     AssetTexture* tex = new AssetTexture(f);
     ASSERT(tex, "OUT OF MEMORY");
     tex->ColorSpace(dispColorSpace_);
-    bool status = tex->CreateGLTextures(app_->activity->assetManager);
-    ASSERT(status, "Failed to create Texture for %s", f.c_str());
     textures_.push_back(tex);
   }
+  uint32_t texIdx = textureIdx_ % textures_.size();
+  textureIdx_ = texIdx;
+  // the texture on display first, the others in swipe order from it
+  for (size_t idx = 0; idx < textures_.size(); idx++) {
+    loader_->Submit(textures_[(texIdx + idx) % textures_.size()]);
+  }
+
+  bool status = loader_->Wait(textures_[texIdx]);
+  ASSERT(status, "Failed to create Texture for %s",
+         textures_[texIdx]->Name().c_str());
+  UploadReadyTextures();
+
+  return status;
+}
 
-  return true;
+/*
+ * UploadReadyTextures()
+ *    Upload the textures the loader has prepared since the last call.
+ *    Logs how long it took to have all of them, from CreateTextures().
+ */
+void ImageViewEngine::UploadReadyTextures(void) {
+  if (texturesUploaded_ == textures_.size()) {
+    return;
+  }
+  for (auto& tex : textures_) {
+    if (!tex->IsValid() && tex->IsPrepared()) {
+      tex->UploadGLTextures();
+      texturesUploaded_++;
+    }
+  }
+  if (texturesUploaded_ == textures_.size()) {
+    uint32_t cached = 0;
+    for (auto& tex : textures_) {
+      cached += tex->FromCache() ? 1 : 0;
+    }
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - textureStart_;
+    LOGI("%u textures ready in %.1f ms (%s start, %u from disk cache)",
+         texturesUploaded_, elapsed.count(),
+         cached == texturesUploaded_ ? "warm" : (cached ? "partly warm" : "cold"),
+         cached);
+  }
 }
@@ -15,6 +15,7 @@
  *
  */
 
+#include <cstring>
 #define STB_IMAGE_IMPLEMENTATION
 #define STBI_ONLY_PNG
 #include <stb/stb_image.h>
@@ -28,7 +29,8 @@
 #define INVALID_TEXTURE_ID 0xFFFFFFFF
 AssetTexture::AssetTexture(const std::string& name) :
   name_(name), p3Id_(INVALID_TEXTURE_ID), sRGBId_(INVALID_TEXTURE_ID),
-  valid_(false), dispColorSpace_(DISPLAY_COLORSPACE::INVALID)
+  valid_(false), dispColorSpace_(DISPLAY_COLORSPACE::INVALID),
+  prepared_(false), fromCache_(false)
 {
 }
 
@@ -55,6 +57,14 @@ bool AssetTexture::IsValid(void) {
   return valid_;
 }
 
+bool AssetTexture::IsPrepared(void) {
+  return prepared_.load(std::memory_order_acquire);
+}
+
+bool AssetTexture::FromCache(void) {
+  return fromCache_;
+}
+
 GLuint AssetTexture::P3TexId() {
   ASSERT(valid_, "Texture has not created");
   return p3Id_;
@@ -66,38 +76,46 @@ GLuint AssetTexture::SRGBATexId() {
 }
 
 /*
- * CreateGLTexture()
- *     Create textures with regard to current display_ color space.
+ * PreparePixels()
+ *     Decode the image and convert it for the current display_ color space.
  *     For P3 image, one texture is created with original image; the second
  *     texture is created from:
  *       original image --> sRGB color Space --> display_ color space
  *     during the process, colors outside sRGB are clamped.
+ *     With a cache, pixels converted on an earlier launch are read back
+ *     instead, and newly converted ones are stored.
+ *     No GL calls: this runs on the texture loader threads.
  */
-bool AssetTexture::CreateGLTextures(AAssetManager *mgr) {
+bool AssetTexture::PreparePixels(AAssetManager *mgr, TextureDiskCache* cache) {
   ASSERT(mgr, "Asset Manager is not valid");
   ASSERT(dispColorSpace_ != DISPLAY_COLORSPACE::INVALID, "eglContext_ color space not set");
-  if (valid_) {
-    glDeleteTextures(1, &p3Id_);
-    glDeleteTextures(1, &sRGBId_);
-    valid_ = false;
-    p3Id_ = INVALID_TEXTURE_ID;
-    sRGBId_ = INVALID_TEXTURE_ID;
-  }
-
-  glGenTextures(1, &p3Id_);
-  glBindTexture(GL_TEXTURE_2D, p3Id_);
 
   std::vector<uint8_t> fileData;
-  AssetReadFile(mgr, name_, fileData);
+  if (!AssetReadFile(mgr, name_, fileData)) {
+    LOGE("Unable to read %s", name_.c_str());
+    return false;
+  }
+  uint64_t hash = TextureDiskCache::Hash(fileData);
+  if (cache && cache->Load(hash, dispColorSpace_, pixels_)) {
+    fromCache_ = true;
+    prepared_.store(true, std::memory_order_release);
+    return true;
+  }
 
   uint32_t imgWidth, imgHeight, n;
   uint8_t* imageData = stbi_load_from_memory(
       fileData.data(), fileData.size(), reinterpret_cast<int*>(&imgWidth),
       reinterpret_cast<int*>(&imgHeight), reinterpret_cast<int*>(&n), 4);
-  uint8_t* imgBits = imageData;
-  std::vector<uint8_t> staging;
+  if (!imageData) {
+    LOGE("Unable to decode %s", name_.c_str());
+    return false;
+  }
+  size_t imgSize = imgWidth * imgHeight * 4 * sizeof(uint8_t);
+  pixels_.width_ = imgWidth;
+  pixels_.height_ = imgHeight;
+  pixels_.p3_.resize(imgSize);
+  pixels_.srgb_.resize(0);    // sRGB display: both textures are the same
   if (dispColorSpace_ == DISPLAY_COLORSPACE::SRGB) {
-    staging.resize(imgWidth * imgHeight * 4 * sizeof(uint8_t));
     IMAGE_FORMAT src {
         .buf_ = imageData,
         .width_ = imgWidth,
@@ -107,30 +125,17 @@ bool AssetTexture::CreateGLTextures(AAssetManager *mgr) {
     };
 
     IMAGE_FORMAT dst {
-        .buf_ = staging.data(),
+        .buf_ = pixels_.p3_.data(),
         .width_ = imgWidth,
         .height_ = imgHeight,
         .gamma_ = DEFAULT_DISPLAY_GAMMA,
         .npm_ = GetTransformNPM(NPM_TYPE::SRGB_D65_INV),
     };
     TransformColorSpace(dst, src);
-    imgBits = staging.data();
-  }
-  glTexImage2D(GL_TEXTURE_2D, 0,  // mip level
-               GL_RGBA,
-               imgWidth, imgHeight,
-               0,                // border color
-               GL_RGBA, GL_UNSIGNED_BYTE, imgBits);
+  } else {
+    memcpy(pixels_.p3_.data(), imageData, imgSize);
 
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
-
-  // Generate sRGB view texture
-  glGenTextures(1, &sRGBId_);
-  glBindTexture(GL_TEXTURE_2D, sRGBId_);
-  if(dispColorSpace_ == DISPLAY_COLORSPACE::P3) {
+    // Generate sRGB view texture
     IMAGE_FORMAT src {
         .buf_ = imageData,
         .width_ = imgWidth,
@@ -138,9 +143,9 @@ bool AssetTexture::CreateGLTextures(AAssetManager *mgr) {
         .gamma_ = DEFAULT_P3_IMAGE_GAMMA,
         .npm_ = GetTransformNPM(NPM_TYPE::P3_D65),
     };
-    std::vector<uint8_t> srgbImg(imgWidth * imgHeight * 4 * sizeof(uint8_t));
+    pixels_.srgb_.resize(imgSize);
     IMAGE_FORMAT dst{
-        .buf_ = srgbImg.data(),
+        .buf_ = pixels_.srgb_.data(),
         .width_ = imgWidth,
         .height_ = imgHeight,
         .gamma_ = 0.0f,     // intermediate image stays in linear space
@@ -148,36 +153,83 @@ bool AssetTexture::CreateGLTextures(AAssetManager *mgr) {
     };
     TransformColorSpace(dst, src);
 
-    // sRGB back to P3 so we could display_ it correctly on P3 device mode
-    staging.resize(imgWidth * imgHeight * 4 * sizeof(uint8_t));
+    // sRGB back to P3 so we could display_ it correctly on P3 device mode,
+    // in place
     IMAGE_FORMAT tmp  = src;
     src = dst;   // intermediate gamma is 0.0f
     dst = tmp;   // original src's gamma is preserved
     src.npm_ = GetTransformNPM(NPM_TYPE::SRGB_D65);
-    dst.buf_ = staging.data();
+    dst.buf_ = pixels_.srgb_.data();
     dst.npm_ = GetTransformNPM(NPM_TYPE::P3_D65_INV);
     dst.gamma_ = DEFAULT_DISPLAY_GAMMA,
 
     TransformColorSpace(dst, src);
-    imgBits = staging.data();
   }
+  stbi_image_free(imageData);
+
+  if (cache) {
+    cache->Store(hash, dispColorSpace_, pixels_);
+  }
+  fromCache_ = false;
+  prepared_.store(true, std::memory_order_release);
+  return true;
+}
+
+static void UploadTexture(GLuint* id, uint32_t width, uint32_t height,
+                          const uint8_t* bits) {
+  glGenTextures(1, id);
+  glBindTexture(GL_TEXTURE_2D, *id);
   glTexImage2D(GL_TEXTURE_2D, 0,  // mip level
                GL_RGBA,
-               imgWidth, imgHeight,
+               width, height,
                0,                // border color
-               GL_RGBA, GL_UNSIGNED_BYTE, imgBits);
+               GL_RGBA, GL_UNSIGNED_BYTE, bits);
+
   glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
   glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
-  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+}
 
+/*
+ * UploadGLTextures()
+ *     Create both textures from the prepared pixels, then drop the pixels.
+ *     GL thread only.
+ */
+bool AssetTexture::UploadGLTextures(void) {
+  if (!IsPrepared()) {
+    return false;
+  }
+  if (valid_) {
+    glDeleteTextures(1, &p3Id_);
+    glDeleteTextures(1, &sRGBId_);
+    valid_ = false;
+    p3Id_ = INVALID_TEXTURE_ID;
+    sRGBId_ = INVALID_TEXTURE_ID;
+  }
+
+  UploadTexture(&p3Id_, pixels_.width_, pixels_.height_, pixels_.p3_.data());
+  UploadTexture(&sRGBId_, pixels_.width_, pixels_.height_,
+                pixels_.srgb_.empty() ? pixels_.p3_.data()
+                                      : pixels_.srgb_.data());
   glBindTexture(GL_TEXTURE_2D, 0);
-  stbi_image_free(imageData);
+
+  std::vector<uint8_t>().swap(pixels_.p3_);
+  std::vector<uint8_t>().swap(pixels_.srgb_);
+  prepared_.store(false, std::memory_order_relaxed);
   valid_ = true;
 
   return true;
 }
 
+/*
+ * CreateGLTexture()
+ *     Prepare and upload the textures on the calling GL thread
+ */
+bool AssetTexture::CreateGLTextures(AAssetManager *mgr) {
+  return PreparePixels(mgr, nullptr) && UploadGLTextures();
+}
+
 std::string& AssetTexture::Name(void) {
   return name_;
 }
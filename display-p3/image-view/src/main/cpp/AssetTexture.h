@@ -18,10 +18,18 @@
 #ifndef  __ASSET_TEXTURE_H__
 #define  __ASSET_TEXTURE_H__
 #include "common.h"
+#include <atomic>
 #include <string>
 #include <GLES3/gl32.h>
 #include <android/asset_manager.h>
+#include "TextureCache.h"
 
+/*
+ * AssetTexture:
+ *     A P3 view and an sRGB view texture of a PNG asset. PreparePixels()
+ *     does the file decoding and color conversion, and may run on any
+ *     thread; UploadGLTextures() then creates the textures on the GL thread.
+ */
 class AssetTexture {
 private:
   std::string name_;
@@ -29,12 +37,19 @@ private:
   GLuint sRGBId_;
   bool  valid_;
   enum DISPLAY_COLORSPACE dispColorSpace_;
+  TEXTURE_PIXELS pixels_;          // from PreparePixels() to the upload
+  std::atomic<bool> prepared_;
+  bool fromCache_;
 
 public:
   explicit AssetTexture(const std::string& name);
   ~AssetTexture();
   void ColorSpace(enum DISPLAY_COLORSPACE  clrSpace);
   DISPLAY_COLORSPACE ColorSpace(void);
+  bool PreparePixels(AAssetManager* mgr, TextureDiskCache* cache);
+  bool IsPrepared(void);
+  bool FromCache(void);
+  bool UploadGLTextures(void);
   bool CreateGLTextures(AAssetManager* mgr);
   bool IsValid(void);
   GLuint P3TexId(void);
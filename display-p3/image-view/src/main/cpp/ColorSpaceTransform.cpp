@@ -14,9 +14,23 @@
  * limitations under the License.
  *
  */
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define TRANSFORM_USE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define TRANSFORM_USE_SSE2 1
+#endif
+
 #include "android_debug.h"
 #include "ColorSpaceTransform.h"
 
@@ -25,166 +39,218 @@
 #define CLIP_COLOR(color, max) ((color > max) ? max : ((color > 0) ? color : 0))
 
 /*
- * CreateGammaEncodeTable():
+ * LINEAR_BITS:
+ *   linear light is kept with 14 bits between decoding and encoding, rather
+ *   than quantized back to 8 bits: dark gradients don't band.
+ * MATRIX_BITS:
+ *   fraction bits of the fixed-point matrix; coefficients must fit int16,
+ *   so stay within +/-8.
+ * TRANSFORM_CHUNK:
+ *   pixels per call of the matrix kernel.
+ * TRANSFORM_MIN_THREAD_PIXELS:
+ *   images are split in bands of rows across threads from twice that size.
+ */
+#define LINEAR_BITS 14
+#define LINEAR_MAX ((1 << LINEAR_BITS) - 1)
+#define MATRIX_BITS 12
+#define TRANSFORM_CHUNK 8
+#define TRANSFORM_MIN_THREAD_PIXELS (256 * 1024)
+
+/*
+ * GammaTables:
+ *    decode_: 8 bit encoded value -> LINEAR_BITS linear light
+ *    encode_: LINEAR_BITS linear light -> 8 bit encoded value
+ *    Both are identity ramps for images without gamma
+ */
+struct GammaTables {
+  float gamma_;
+  uint16_t decode_[256];
+  uint8_t  encode_[LINEAR_MAX + 1];
+};
+
+/*
+ * CreateGammaTables():
+ *     Linear =  sRGB / 12.92    0 <= sRGB < 0.04045
+ *               pow((sRGB + 0.055)/1.055, 1/gamma)
  *     sRGB =
  *        12.92 * LinearRGB            0 < LinearRGB < 0.0031308
  *        1.055 * power(LinearRGB, gamma)-0.055 0.0031308 <= LinarRGB <= 1.0f
  */
-static void CreateGammaEncodeTable(float gamma, std::vector<uint8_t>& table) {
-  ASSERT(gamma < 1.0f, "Wrong Gamma (%f) for encoding", gamma);
-  uint32_t maxPixeli = ( 1<<8 ) - 1;
-  float maxPixelf = static_cast<float>(maxPixeli);
+static void CreateGammaTables(float gamma, GammaTables* tables) {
+  tables->gamma_ = gamma;
+  bool hasGamma = HAS_GAMMA(gamma);
+  ASSERT(!hasGamma || gamma < 1.0f, "Wrong Gamma (%f) for encoding", gamma);
 
-  uint32_t maxLinearVal = static_cast<uint32_t>(0.0031308f * maxPixeli);
-
-  table.resize(0);
-  for(uint32_t idx = 0; idx < maxLinearVal; idx++) {
-    double val = idx * 12.92 + .5f;
-    table.push_back(static_cast<uint8_t>(val));
+  for (uint32_t idx = 0; idx <= 255; idx++) {
+    double val = idx / 255.0;
+    if (hasGamma) {
+      val = (val < 0.04045) ? val / 12.92
+                            : pow((val + 0.055) / 1.055, 1.0 / gamma);
+    }
+    tables->decode_[idx] = static_cast<uint16_t>(val * LINEAR_MAX + 0.5);
   }
-
-  for (uint32_t idx = maxLinearVal; idx <= maxPixeli; idx++) {
-    double val = (1.055f * pow(idx / maxPixelf, gamma) - 0.055f);
-    val = val * maxPixeli + 0.5f;
-    table.push_back(static_cast<uint8_t>(CLIP_COLOR(val, maxPixelf)));
+  for (uint32_t idx = 0; idx <= LINEAR_MAX; idx++) {
+    double val = static_cast<double>(idx) / LINEAR_MAX;
+    if (hasGamma) {
+      val = (val < 0.0031308) ? val * 12.92
+                              : 1.055 * pow(val, gamma) - 0.055;
+    }
+    val = val * 255 + 0.5;
+    tables->encode_[idx] = static_cast<uint8_t>(CLIP_COLOR(val, 255.0));
   }
 }
+
 /*
- * CreateGammaEncodeTable()
- *    Retrieve linear RGB data
- *    Linear =  sRGB / 12.92    0 <= sRGB < 0.04045
- *              pow((sRGB + 0.055)/1.055, gamma)
+ * GetGammaTables():
+ *    Tables for the gamma, built on first use and kept: images share a few
+ *    gammas, and pow() over the tables costs more than a small transform.
  */
-static void CreateGammaDecodeTable(float gamma, std::vector<uint8_t>&table) {
-  ASSERT(gamma > 1.0, "Wrong Gamma(%f) for decoding", gamma);
-  uint32_t maxPixeli = ( 1<<8 ) - 1;
-  float maxPixelf = static_cast<float>(maxPixeli);
-
-  uint32_t maxLinearVal = static_cast<uint32_t>(0.04045 * maxPixeli);
-  for(uint32_t idx = 0; idx < maxLinearVal; idx++) {
-    double val = idx / 12.92 + .5f;
-    table.push_back(static_cast<uint8_t>(val));
+static const GammaTables* GetGammaTables(float gamma) {
+  static std::mutex lock;
+  static std::vector<std::unique_ptr<GammaTables>> cache;
+  if (!HAS_GAMMA(gamma)) {
+    gamma = 0.0f;   // all linear images share the identity tables
   }
 
-  for (uint32_t idx = maxLinearVal; idx <= maxPixeli; idx++) {
-    double val;
-    val = (idx / maxPixelf + 0.055f) / 1.055f;
-    val = pow(val, gamma) * maxPixeli + 0.5f;
-    table.push_back(static_cast<uint8_t>(CLIP_COLOR(val, maxPixelf)));
+  std::lock_guard<std::mutex> guard(lock);
+  for (auto& tables : cache) {
+    if (tables->gamma_ == gamma) {
+      return tables.get();
+    }
   }
+  std::unique_ptr<GammaTables> tables(new GammaTables);
+  CreateGammaTables(gamma, tables.get());
+  cache.push_back(std::move(tables));
+  return cache.back().get();
 }
 
 /*
- * ApplyGamma()
- *    Perform gamma lookup for RGBA8888 format
+ * TransformJob:
+ *    dst = encode(matrix * decode(src)), matrix in MATRIX_BITS fixed point
  */
-static bool ApplyGamma(void* dst, void* src, uint32_t w, uint32_t h,
-                std::vector<uint8_t>& gammaTable) {
-  if(!src || !dst || gammaTable.empty()) {
-    LOGE("Invalid Input to %s, dst(%p),src(%p)",
-         __FUNCTION__, dst, src);
-    return false;
-  }
-  uint8_t* imgSrc = static_cast<uint8_t*>(src);
-  uint8_t* imgDst = static_cast<uint8_t*>(dst);
-  for (uint32_t r = 0; r < w; r++) {
-    for(uint32_t c = 0; c < h; c++) {
-      *imgDst++ = gammaTable[*imgSrc++];
-      *imgDst++ = gammaTable[*imgSrc++];
-      *imgDst++ = gammaTable[*imgSrc++];
-      *imgDst++ = *imgSrc++;
-    }
-  }
-  return true;
+struct TransformJob {
+  const uint16_t* decode_;
+  const uint8_t*  encode_;
+  int32_t matrix_[3][3];
+  bool simd_;   // coefficients fit int16
+};
+
+static inline uint16_t TransformChannel(const int32_t* m, int32_t r, int32_t g,
+                                        int32_t b) {
+  int32_t val = (m[0] * r + m[1] * g + m[2] * b + (1 << (MATRIX_BITS - 1)))
+                >> MATRIX_BITS;
+  return static_cast<uint16_t>(CLIP_COLOR(val, LINEAR_MAX));
 }
 
 /*
- * GammaDecode(IMAGE_FORMAT& src):
- *    Decode gamma for src image
- *    src.gamma: the gamma used encoding the src image
- * Ouput:
- *     src.buf_: gamma decoded image with gamma value of 1.0f/src.gamma
+ * TransformChunk():
+ *    The matrix on TRANSFORM_CHUNK decoded pixels, one channel per array,
+ *    with the same rounding and clamping as TransformChannel()
  */
-static bool GammaDecode(IMAGE_FORMAT &src) {
-  if (!HAS_GAMMA(src.gamma_)) {
-    LOGE("No gamma value to source gamma");
-    return true;
-  }
-  std::vector<uint8_t> gammaTable;
-  CreateGammaDecodeTable(1.0f/src.gamma_, gammaTable);
-
-  return ApplyGamma(src.buf_, src.buf_, src.width_, src.height_,
-                    gammaTable);
+#if defined(TRANSFORM_USE_NEON)
+static inline uint16x8_t MultiplyRow(const int32_t* m, int16x8_t r,
+                                     int16x8_t g, int16x8_t b) {
+  int32x4_t lo = vmull_n_s16(vget_low_s16(r), static_cast<int16_t>(m[0]));
+  lo = vmlal_n_s16(lo, vget_low_s16(g), static_cast<int16_t>(m[1]));
+  lo = vmlal_n_s16(lo, vget_low_s16(b), static_cast<int16_t>(m[2]));
+  int32x4_t hi = vmull_n_s16(vget_high_s16(r), static_cast<int16_t>(m[0]));
+  hi = vmlal_n_s16(hi, vget_high_s16(g), static_cast<int16_t>(m[1]));
+  hi = vmlal_n_s16(hi, vget_high_s16(b), static_cast<int16_t>(m[2]));
+  uint16x8_t val = vcombine_u16(vqrshrun_n_s32(lo, MATRIX_BITS),
+                                vqrshrun_n_s32(hi, MATRIX_BITS));
+  return vminq_u16(val, vdupq_n_u16(LINEAR_MAX));
 }
 
-static bool GammaDecode(IMAGE_FORMAT &dst, IMAGE_FORMAT &src) {
-  if (!HAS_GAMMA(src.gamma_)) {
-    LOGE("No gamma value to source gamma");
-    return true;
+static void TransformChunk(const TransformJob& job, uint16_t (*rgb)[TRANSFORM_CHUNK]) {
+  int16x8_t r = vreinterpretq_s16_u16(vld1q_u16(rgb[0]));
+  int16x8_t g = vreinterpretq_s16_u16(vld1q_u16(rgb[1]));
+  int16x8_t b = vreinterpretq_s16_u16(vld1q_u16(rgb[2]));
+  for (int ch = 0; ch < 3; ch++) {
+    vst1q_u16(rgb[ch], MultiplyRow(job.matrix_[ch], r, g, b));
   }
-  std::vector<uint8_t> gammaTable;
-  CreateGammaDecodeTable(1.0f/src.gamma_, gammaTable);
-
-  return ApplyGamma(dst.buf_, src.buf_, src.width_, src.height_,
-                    gammaTable);
+}
+#elif defined(TRANSFORM_USE_SSE2)
+static inline __m128i MultiplyHalf(const int32_t* m, __m128i rg, __m128i b1) {
+  // pmaddwd: (r, g) . (m0, m1) + (b, 1) . (m2, rounding)
+  __m128i m01 = _mm_set1_epi32(static_cast<int32_t>(
+      (static_cast<uint32_t>(m[1]) << 16) | (m[0] & 0xFFFF)));
+  __m128i m2r = _mm_set1_epi32(static_cast<int32_t>(
+      (1u << (MATRIX_BITS - 1 + 16)) | (m[2] & 0xFFFF)));
+  __m128i val = _mm_add_epi32(_mm_madd_epi16(rg, m01), _mm_madd_epi16(b1, m2r));
+  return _mm_srai_epi32(val, MATRIX_BITS);
 }
 
-/*
- * GammaEncode(IMAGE_FORMAT& format dst)
- *    Gamma encode image with the gamma value of dst.gamma_
- */
-static bool GammaEncode(IMAGE_FORMAT &dst) {
-  if (!HAS_GAMMA(dst.gamma_)) {
-    LOGE("No gamma value to dst gamma");
-    return true;
+static void TransformChunk(const TransformJob& job, uint16_t (*rgb)[TRANSFORM_CHUNK]) {
+  __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb[0]));
+  __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb[1]));
+  __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb[2]));
+  __m128i one = _mm_set1_epi16(1);
+  __m128i rgLo = _mm_unpacklo_epi16(r, g), rgHi = _mm_unpackhi_epi16(r, g);
+  __m128i b1Lo = _mm_unpacklo_epi16(b, one), b1Hi = _mm_unpackhi_epi16(b, one);
+  for (int ch = 0; ch < 3; ch++) {
+    const int32_t* m = job.matrix_[ch];
+    __m128i val = _mm_packs_epi32(MultiplyHalf(m, rgLo, b1Lo),
+                                  MultiplyHalf(m, rgHi, b1Hi));
+    val = _mm_min_epi16(_mm_max_epi16(val, _mm_setzero_si128()),
+                        _mm_set1_epi16(LINEAR_MAX));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(rgb[ch]), val);
   }
-  std::vector<uint8_t> gammaTable;
-  CreateGammaEncodeTable(dst.gamma_, gammaTable);
-
-  return ApplyGamma(dst.buf_, dst.buf_, dst.width_, dst.height_,
-                    gammaTable);
 }
+#else
+static void TransformChunk(const TransformJob& job, uint16_t (*rgb)[TRANSFORM_CHUNK]) {
+  for (int i = 0; i < TRANSFORM_CHUNK; i++) {
+    int32_t r = rgb[0][i], g = rgb[1][i], b = rgb[2][i];
+    for (int ch = 0; ch < 3; ch++) {
+      rgb[ch][i] = TransformChannel(job.matrix_[ch], r, g, b);
+    }
+  }
+}
+#endif
 
 /*
- * ApplyTransform8888()
- *    dst = matrix * src
- *    and clamp the result to 0 -- 255
+ * TransformPixels()
+ *    Fused decode, matrix and encode over count R8G8B8A8 pixels; dst may be
+ *    src. Alpha is copied.
  */
-static bool TransformR8G8B8A8(uint8_t* dst, uint8_t *src,
-                           uint32_t width, uint32_t height,
-                           mathfu::mat3& transMatrix) {
-  ASSERT(src && dst, "Wrong image store to %s", __FUNCTION__);
-
-  int32_t m00, m01, m02, m10, m11, m12, m20, m21, m22;
-  m00 = static_cast<int32_t>(transMatrix(0, 0) * 1024 + 0.5f),
-  m01 = static_cast<int32_t>(transMatrix(0, 1) * 1024 + 0.5f);
-  m02 = static_cast<int32_t>(transMatrix(0, 2) * 1024 + 0.5f);
-  m10 = static_cast<int32_t>(transMatrix(1, 0) * 1024 + 0.5f);
-  m11 = static_cast<int32_t>(transMatrix(1, 1) * 1024 + 0.5f);
-  m12 = static_cast<int32_t>(transMatrix(1, 2) * 1024 + 0.5f);
-  m20 = static_cast<int32_t>(transMatrix(2, 0) * 1024 + 0.5f);
-  m21 = static_cast<int32_t>(transMatrix(2, 1) * 1024 + 0.5f);
-  m22 = static_cast<int32_t>(transMatrix(2, 2) * 1024 + 0.5f);
-    for (uint32_t row = 0; row < height; row++) {
-      for (uint32_t col = 0; col < width; col++) {
-        int32_t r, g, b;
-        r = (m00 * src[0] + m01 * src[1] + m02 * src[2] + 512) >> 10;
-        g = (m10 * src[0] + m11 * src[1] + m12 * src[2] + 512) >> 10;
-        b = (m20 * src[0] + m21 * src[1] + m22 * src[2] + 512) >> 10;
-        *dst++ = static_cast<uint8_t>(CLIP_COLOR(r, 255));
-        *dst++ = static_cast<uint8_t>(CLIP_COLOR(g, 255));
-        *dst++ = static_cast<uint8_t>(CLIP_COLOR(b, 255));
-
-        src += 3;          // update src pointer
-        *dst++ = *src++;   // copy alpha
+static void TransformPixels(const TransformJob& job, uint8_t* dst,
+                            const uint8_t* src, size_t count) {
+  const uint16_t* decode = job.decode_;
+  const uint8_t* encode = job.encode_;
+  size_t idx = 0;
+  if (job.simd_) {
+    uint16_t rgb[3][TRANSFORM_CHUNK];
+    for (; idx + TRANSFORM_CHUNK <= count; idx += TRANSFORM_CHUNK) {
+      const uint8_t* in = src + idx * 4;
+      for (int i = 0; i < TRANSFORM_CHUNK; i++, in += 4) {
+        rgb[0][i] = decode[in[0]];
+        rgb[1][i] = decode[in[1]];
+        rgb[2][i] = decode[in[2]];
+      }
+      TransformChunk(job, rgb);
+      uint8_t* out = dst + idx * 4;
+      in = src + idx * 4;
+      for (int i = 0; i < TRANSFORM_CHUNK; i++, in += 4, out += 4) {
+        out[3] = in[3];
+        out[0] = encode[rgb[0][i]];
+        out[1] = encode[rgb[1][i]];
+        out[2] = encode[rgb[2][i]];
       }
     }
-  return true;
+  }
+  for (; idx < count; idx++) {
+    const uint8_t* in = src + idx * 4;
+    uint8_t* out = dst + idx * 4;
+    int32_t r = decode[in[0]], g = decode[in[1]], b = decode[in[2]];
+    out[3] = in[3];
+    out[0] = encode[TransformChannel(job.matrix_[0], r, g, b)];
+    out[1] = encode[TransformChannel(job.matrix_[1], r, g, b)];
+    out[2] = encode[TransformChannel(job.matrix_[2], r, g, b)];
+  }
 }
 
 /*
  * Interface Function:
- *     Convert Color Spaces
+ *     Convert Color Spaces, in one pass over the image
  */
 bool TransformColorSpace(IMAGE_FORMAT &dst, IMAGE_FORMAT& src) {
   if (!src.npm_  || !dst.npm_ || !dst.buf_ || !src.buf_) {
@@ -192,25 +258,46 @@ bool TransformColorSpace(IMAGE_FORMAT &dst, IMAGE_FORMAT& src) {
     return false;
   }
 
-  uint8_t* dstBits = static_cast<uint8_t*>(dst.buf_);
-  uint8_t* srcBits = static_cast<uint8_t*>(src.buf_);
-
-  if (HAS_GAMMA(src.gamma_)) {
-    GammaDecode(dst, src);
-    srcBits = dstBits;
+  TransformJob job;
+  job.decode_ = GetGammaTables(src.gamma_)->decode_;
+  job.encode_ = GetGammaTables(dst.gamma_)->encode_;
+  mathfu::mat3 matrix = *dst.npm_ * (*src.npm_);
+  job.simd_ = true;
+  for (int row = 0; row < 3; row++) {
+    for (int col = 0; col < 3; col++) {
+      float coef = matrix(row, col) * (1 << MATRIX_BITS);
+      job.matrix_[row][col] = static_cast<int32_t>(std::lround(coef));
+      job.simd_ = job.simd_ && std::abs(job.matrix_[row][col]) <= INT16_MAX;
+    }
   }
 
-  mathfu::mat3 matrix = *dst.npm_ * (*src.npm_);
-  TransformR8G8B8A8(dstBits, srcBits, src.width_, src.height_, matrix);
+  uint8_t* dstBits = static_cast<uint8_t*>(dst.buf_);
+  const uint8_t* srcBits = static_cast<const uint8_t*>(src.buf_);
+  uint32_t width = src.width_, height = src.height_;
+  size_t pixels = static_cast<size_t>(width) * height;
 
-  if (HAS_GAMMA(dst.gamma_)) {
-    GammaEncode(dst);
+  // bands of whole rows, the calling thread takes the first one
+  uint32_t bands = std::max(1u, std::thread::hardware_concurrency());
+  bands = static_cast<uint32_t>(std::min<size_t>(
+      bands, pixels / TRANSFORM_MIN_THREAD_PIXELS));
+  bands = std::max(1u, std::min(bands, height));
+  uint32_t bandRows = (height + bands - 1) / bands;
+  std::vector<std::thread> workers;
+  for (uint32_t row = bandRows; row < height; row += bandRows) {
+    size_t offset = static_cast<size_t>(row) * width * 4;
+    size_t count = static_cast<size_t>(std::min(bandRows, height - row)) * width;
+    workers.emplace_back(TransformPixels, std::cref(job), dstBits + offset,
+                         srcBits + offset, count);
+  }
+  TransformPixels(job, dstBits, srcBits,
+                  static_cast<size_t>(std::min(bandRows, height)) * width);
+  for (auto& worker : workers) {
+    worker.join();
   }
 
   return true;
 }
 
-
 /*
  * Default NPMs with white reference points as D65
  * The array sequence should match enum NPM_TYPE definition
@@ -42,6 +42,9 @@ struct IMAGE_FORMAT {
  *     source of the image bits to transform.
  * Both src and dst must be in:
  *     R8G8B8A8 4 channels packed format
+ * The image is transformed in one pass, keeping linear light in 14 bits
+ * between the gamma tables, split in bands across threads when large.
+ * dst.buf_ may be src.buf_.
  */
 bool TransformColorSpace(IMAGE_FORMAT &dst, IMAGE_FORMAT& src);
 
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/*
+ * Host benchmark: the fused transform against the three passes it replaced
+ * (gamma decode to 8 bit linear, matrix, gamma encode, tables rebuilt per
+ * call), both compared with a double precision transform. Not part of the
+ * app build:
+ *   g++ -O2 -std=gnu++11 -pthread -DCOLOR_TRANSFORM_HOST_BENCHMARK \
+ *       -I<mathfu include> ColorSpaceTransform.cpp \
+ *       ColorSpaceTransformBenchmark.cpp
+ */
+#ifdef COLOR_TRANSFORM_HOST_BENCHMARK
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "ColorSpaceTransform.h"
+
+#define CLIP_COLOR(color, max) ((color > max) ? max : ((color > 0) ? color : 0))
+
+static void ThreePassTable(float gamma, bool decode, uint8_t* table) {
+  uint32_t linearEnd = static_cast<uint32_t>((decode ? 0.04045 : 0.0031308) * 255);
+  for (uint32_t idx = 0; idx <= 255; idx++) {
+    double val;
+    if (idx < linearEnd) {
+      val = decode ? idx / 12.92 + .5 : idx * 12.92 + .5;
+    } else if (decode) {
+      val = pow((idx / 255.0 + 0.055) / 1.055, 1.0 / gamma) * 255 + 0.5;
+    } else {
+      val = (1.055 * pow(idx / 255.0, gamma) - 0.055) * 255 + 0.5;
+    }
+    table[idx] = static_cast<uint8_t>(CLIP_COLOR(val, 255.0));
+  }
+}
+
+static void ThreePassTransform(IMAGE_FORMAT& dst, IMAGE_FORMAT& src) {
+  size_t count = static_cast<size_t>(src.width_) * src.height_;
+  uint8_t* out = static_cast<uint8_t*>(dst.buf_);
+  const uint8_t* in = static_cast<const uint8_t*>(src.buf_);
+  uint8_t table[256];
+  ThreePassTable(src.gamma_, true, table);
+  for (size_t i = 0; i < count * 4; i++) {
+    out[i] = (i & 3) == 3 ? in[i] : table[in[i]];
+  }
+  mathfu::mat3 matrix = *dst.npm_ * (*src.npm_);
+  int32_t m[3][3];
+  for (int r = 0; r < 3; r++)
+    for (int c = 0; c < 3; c++)
+      m[r][c] = static_cast<int32_t>(matrix(r, c) * 1024 + 0.5f);
+  for (size_t i = 0; i < count; i++) {
+    uint8_t* p = out + i * 4;
+    int32_t v[3];
+    for (int r = 0; r < 3; r++) {
+      v[r] = (m[r][0] * p[0] + m[r][1] * p[1] + m[r][2] * p[2] + 512) >> 10;
+    }
+    for (int r = 0; r < 3; r++) p[r] = static_cast<uint8_t>(CLIP_COLOR(v[r], 255));
+  }
+  ThreePassTable(dst.gamma_, false, table);
+  for (size_t i = 0; i < count * 4; i++) {
+    if ((i & 3) != 3) out[i] = table[out[i]];
+  }
+}
+
+static double Exact(const mathfu::mat3& m, int row, const uint8_t* p,
+                    float srcGamma, float dstGamma) {
+  double lin = 0;
+  for (int c = 0; c < 3; c++) {
+    double v = p[c] / 255.0;
+    v = v < 0.04045 ? v / 12.92 : pow((v + 0.055) / 1.055, 1.0 / srcGamma);
+    lin += m(row, c) * v;
+  }
+  lin = CLIP_COLOR(lin, 1.0);
+  lin = lin < 0.0031308 ? lin * 12.92 : 1.055 * pow(lin, dstGamma) - 0.055;
+  return lin * 255;
+}
+
+int main() {
+  const uint32_t w = 2048, h = 2048;
+  const int kIterations = 5;
+  std::vector<uint8_t> src(w * h * 4), fused(w * h * 4), threePass(w * h * 4);
+  // dark to bright gradients, where 8 bit linear light bands the most
+  for (uint32_t y = 0; y < h; y++) {
+    for (uint32_t x = 0; x < w; x++) {
+      uint8_t* p = &src[(y * w + x) * 4];
+      p[0] = static_cast<uint8_t>(x * 255 / (w - 1));
+      p[1] = static_cast<uint8_t>(y * 255 / (h - 1));
+      p[2] = static_cast<uint8_t>((x + y) * 127 / (w - 1));
+      p[3] = static_cast<uint8_t>(x ^ y);
+    }
+  }
+  IMAGE_FORMAT in {src.data(), w, h, DEFAULT_P3_IMAGE_GAMMA,
+                   GetTransformNPM(P3_D65)};
+  IMAGE_FORMAT out {fused.data(), w, h, DEFAULT_DISPLAY_GAMMA,
+                    GetTransformNPM(SRGB_D65_INV)};
+  IMAGE_FORMAT old = out;
+  old.buf_ = threePass.data();
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; i++) ThreePassTransform(old, in);
+  auto t1 = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; i++) TransformColorSpace(out, in);
+  auto t2 = std::chrono::steady_clock::now();
+  double oldMs = std::chrono::duration<double, std::milli>(t1 - t0).count();
+  double newMs = std::chrono::duration<double, std::milli>(t2 - t1).count();
+
+  // fused in place must match fused out of place, bit for bit
+  std::vector<uint8_t> inPlace(src);
+  IMAGE_FORMAT selfIn = in, selfOut = out;
+  selfIn.buf_ = selfOut.buf_ = inPlace.data();
+  TransformColorSpace(selfOut, selfIn);
+  bool match = inPlace == fused;
+
+  mathfu::mat3 matrix = *out.npm_ * (*in.npm_);
+  double oldErr = 0, newErr = 0, oldMax = 0, newMax = 0;
+  bool alpha = true;
+  for (size_t i = 0; i < static_cast<size_t>(w) * h; i++) {
+    for (int c = 0; c < 3; c++) {
+      double exact = Exact(matrix, c, &src[i * 4], in.gamma_, out.gamma_);
+      double e0 = std::abs(threePass[i * 4 + c] - exact);
+      double e1 = std::abs(fused[i * 4 + c] - exact);
+      oldErr += e0; newErr += e1;
+      oldMax = std::max(oldMax, e0); newMax = std::max(newMax, e1);
+    }
+    alpha = alpha && fused[i * 4 + 3] == src[i * 4 + 3];
+  }
+  double n = 3.0 * w * h;
+  printf("%ux%u P3 -> sRGB: three passes %.2f ms, fused %.2f ms (%.1fx, "
+         "%u threads)\n", w, h, oldMs / kIterations, newMs / kIterations,
+         oldMs / newMs, std::thread::hardware_concurrency());
+  printf("error vs double precision: three passes %.3f avg %.2f max, "
+         "fused %.3f avg %.2f max%s%s\n", oldErr / n, oldMax, newErr / n,
+         newMax, match ? "" : " IN-PLACE MISMATCH",
+         alpha ? "" : " ALPHA MISMATCH");
+  return (match && alpha) ? 0 : 1;
+}
+#endif  // COLOR_TRANSFORM_HOST_BENCHMARK
@@ -84,7 +84,13 @@ void ImageViewEngine::DrawFrame(void) {
   glVertexAttribPointer(program_.getAttribLocationTex(),
                         2, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 4, leftQuadVertices + 2);
   glEnableVertexAttribArray(program_.getAttribLocationTex());
+  UploadReadyTextures();
   int32_t texIdx = textureIdx_;
+  if (!textures_[texIdx]->IsValid()) {
+    // still being prepared, keep the screen blank
+    eglSwapBuffers(display_, surface_);
+    return;
+  }
   if(renderModeBits_ & RENDERING_P3) {
     glActiveTexture(GL_TEXTURE0 + 0);
     glBindTexture(GL_TEXTURE_2D, textures_[texIdx]->P3TexId());
@@ -129,7 +135,8 @@ void ImageViewEngine::TerminateDisplay(void) {
 ImageViewEngine::ImageViewEngine(struct android_app* app) :
     app_(app),
     animating_(0),
-    textureIdx_(0) {
+    textureIdx_(0),
+    texturesUploaded_(0) {
   textures_.resize(0);
   renderModeBits_ = RENDERING_P3 | RENDERING_SRGB;
   eglContext_ = EGL_NO_CONTEXT;
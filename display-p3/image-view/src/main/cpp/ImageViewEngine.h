@@ -23,6 +23,7 @@
 #include <condition_variable>
 #include <string>
 
+#include <chrono>
 #include <initializer_list>
 #include <memory>
 #include <vector>
@@ -36,6 +37,7 @@
 #include "gldebug.h"
 #include "ShaderProgram.h"
 #include "AssetTexture.h"
+#include "TextureLoader.h"
 
 class ImageViewEngine {
 public:
@@ -73,6 +75,10 @@ private:
   // Image file texture store
   std::vector<AssetTexture*> textures_;
   std::atomic<uint32_t>  textureIdx_;
+  // decodes and converts textures_ off the GL thread
+  std::unique_ptr<TextureLoader> loader_;
+  uint32_t texturesUploaded_;
+  std::chrono::steady_clock::time_point textureStart_;
 
   enum WIDECOLOR_MODE {
     P3_R8G8B8A8_REV,
@@ -87,6 +93,7 @@ private:
 
   bool CreateTextures(void);
   void DeleteTextures(void);
+  void UploadReadyTextures(void);
 
   uint32_t renderModeBits_;
 
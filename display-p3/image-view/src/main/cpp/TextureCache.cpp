@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <cerrno>
+#include <cstdio>
+#include <functional>
+#include <thread>
+#include <sys/stat.h>
+#include "android_debug.h"
+#include "TextureCache.h"
+
+/*
+ * Cache file: header, then the P3 view pixels, then the sRGB view pixels
+ * when imageCount_ is 2. Bump TEXTURE_CACHE_VERSION whenever the
+ * conversion changes, so stale files are not used.
+ */
+#define TEXTURE_CACHE_MAGIC   0x31435854   // "TXC1"
+#define TEXTURE_CACHE_VERSION 1
+struct TEXTURE_CACHE_HEADER {
+  uint32_t magic_;
+  uint32_t version_;
+  uint32_t width_, height_;
+  uint32_t imageCount_;
+};
+
+TextureDiskCache::TextureDiskCache(const std::string& dir) : dir_(dir) {
+  if (dir_.empty()) {
+    return;
+  }
+  if (mkdir(dir_.c_str(), 0700) && errno != EEXIST) {
+    LOGW("Texture cache disabled, unable to create %s", dir_.c_str());
+    dir_.clear();
+  }
+}
+
+uint64_t TextureDiskCache::Hash(const std::vector<uint8_t>& data) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (auto byte : data) {
+    hash = (hash ^ byte) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+std::string TextureDiskCache::FileName(uint64_t hash,
+                                       DISPLAY_COLORSPACE space) {
+  char name[64];
+  snprintf(name, sizeof(name), "/%016llx-%s.tex",
+           static_cast<unsigned long long>(hash),
+           space == DISPLAY_COLORSPACE::P3 ? "p3" : "srgb");
+  return dir_ + name;
+}
+
+/*
+ * Load()
+ *    Read the pixels prepared for the space from an earlier launch.
+ *    Returns false when there are none, or the file is not usable.
+ */
+bool TextureDiskCache::Load(uint64_t hash, DISPLAY_COLORSPACE space,
+                            TEXTURE_PIXELS& pixels) {
+  if (dir_.empty()) {
+    return false;
+  }
+  FILE* file = fopen(FileName(hash, space).c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+  TEXTURE_CACHE_HEADER header;
+  bool status = fread(&header, sizeof(header), 1, file) == 1 &&
+                header.magic_ == TEXTURE_CACHE_MAGIC &&
+                header.version_ == TEXTURE_CACHE_VERSION &&
+                (header.imageCount_ == 1 || header.imageCount_ == 2);
+  if (status) {
+    size_t size = static_cast<size_t>(header.width_) * header.height_ * 4;
+    pixels.width_ = header.width_;
+    pixels.height_ = header.height_;
+    pixels.p3_.resize(size);
+    pixels.srgb_.resize(header.imageCount_ == 2 ? size : 0);
+    status = fread(pixels.p3_.data(), 1, size, file) == size &&
+             fread(pixels.srgb_.data(), 1, pixels.srgb_.size(), file) ==
+                 pixels.srgb_.size();
+  }
+  fclose(file);
+  if (!status) {
+    LOGW("Ignoring damaged texture cache file %s",
+         FileName(hash, space).c_str());
+    pixels.p3_.clear();
+    pixels.srgb_.clear();
+  }
+  return status;
+}
+
+/*
+ * Store()
+ *    Keep the pixels prepared for the space for the next launches
+ */
+bool TextureDiskCache::Store(uint64_t hash, DISPLAY_COLORSPACE space,
+                             const TEXTURE_PIXELS& pixels) {
+  if (dir_.empty()) {
+    return false;
+  }
+  std::string name = FileName(hash, space);
+  // unique per thread, two threads may store the same content
+  std::string tmpName = name + "." +
+      std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+  FILE* file = fopen(tmpName.c_str(), "wb");
+  if (!file) {
+    LOGW("Unable to create texture cache file %s", tmpName.c_str());
+    return false;
+  }
+  TEXTURE_CACHE_HEADER header {
+      .magic_ = TEXTURE_CACHE_MAGIC,
+      .version_ = TEXTURE_CACHE_VERSION,
+      .width_ = pixels.width_,
+      .height_ = pixels.height_,
+      .imageCount_ = pixels.srgb_.empty() ? 1u : 2u,
+  };
+  bool status = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                fwrite(pixels.p3_.data(), 1, pixels.p3_.size(), file) ==
+                    pixels.p3_.size() &&
+                fwrite(pixels.srgb_.data(), 1, pixels.srgb_.size(), file) ==
+                    pixels.srgb_.size();
+  status = (fclose(file) == 0) && status;
+  if (status) {
+    status = (rename(tmpName.c_str(), name.c_str()) == 0);
+  }
+  if (!status) {
+    LOGW("Unable to write texture cache file %s", name.c_str());
+    remove(tmpName.c_str());
+  }
+  return status;
+}
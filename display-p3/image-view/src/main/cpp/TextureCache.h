@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __TEXTURE_CACHE_H__
+#define __TEXTURE_CACHE_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "common.h"
+
+/*
+ * Pixels of one asset prepared for a display color space, ready to upload:
+ *     p3_:   the P3 view texture
+ *     srgb_: the sRGB view texture; empty when it is the same as p3_
+ */
+struct TEXTURE_PIXELS {
+  uint32_t width_, height_;
+  std::vector<uint8_t> p3_;
+  std::vector<uint8_t> srgb_;
+};
+
+/*
+ * TextureDiskCache:
+ *     Converted R8G8B8A8 pixels kept on disk between launches, one file per
+ *     asset content hash and display color space, so a warm start skips
+ *     decoding and color conversion. Files are written to a temporary name
+ *     and renamed, so a reader never sees half of one.
+ *     Load() and Store() may be called from several threads.
+ */
+class TextureDiskCache {
+ public:
+  // dir: created if missing; an empty dir disables the cache
+  explicit TextureDiskCache(const std::string& dir);
+
+  bool Load(uint64_t hash, DISPLAY_COLORSPACE space, TEXTURE_PIXELS& pixels);
+  bool Store(uint64_t hash, DISPLAY_COLORSPACE space,
+             const TEXTURE_PIXELS& pixels);
+
+  // FNV-1a of the asset file content
+  static uint64_t Hash(const std::vector<uint8_t>& data);
+
+ private:
+  std::string FileName(uint64_t hash, DISPLAY_COLORSPACE space);
+  std::string dir_;
+};
+
+#endif  // __TEXTURE_CACHE_H__
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <algorithm>
+#include "android_debug.h"
+#include "TextureLoader.h"
+
+TextureLoader::TextureLoader(AAssetManager* mgr, const std::string& cacheDir,
+                             uint32_t threadCount) :
+    mgr_(mgr), cache_(cacheDir), exit_(false) {
+  ASSERT(mgr, "Asset Manager is not valid");
+  threadCount = std::max(1u, threadCount);
+  for (uint32_t idx = 0; idx < threadCount; idx++) {
+    workers_.emplace_back(&TextureLoader::WorkerLoop, this);
+  }
+}
+
+TextureLoader::~TextureLoader() {
+  Cancel();
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    exit_ = true;
+  }
+  work_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void TextureLoader::Submit(AssetTexture* tex) {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    queue_.push_back(tex);
+  }
+  work_.notify_one();
+}
+
+void TextureLoader::Cancel(void) {
+  std::unique_lock<std::mutex> guard(lock_);
+  queue_.clear();
+  done_.notify_all();
+  done_.wait(guard, [this] { return running_.empty(); });
+}
+
+/*
+ * Wait()
+ *    Block the caller until the texture is neither queued nor being prepared
+ */
+bool TextureLoader::Wait(AssetTexture* tex) {
+  std::unique_lock<std::mutex> guard(lock_);
+  done_.wait(guard, [this, tex] {
+    return std::find(queue_.begin(), queue_.end(), tex) == queue_.end() &&
+           std::find(running_.begin(), running_.end(), tex) == running_.end();
+  });
+  return tex->IsPrepared();
+}
+
+void TextureLoader::WorkerLoop(void) {
+  std::unique_lock<std::mutex> guard(lock_);
+  while (true) {
+    work_.wait(guard, [this] { return exit_ || !queue_.empty(); });
+    if (exit_) {
+      return;
+    }
+    AssetTexture* tex = queue_.front();
+    queue_.pop_front();
+    running_.push_back(tex);
+
+    guard.unlock();
+    bool status = tex->PreparePixels(mgr_, &cache_);
+    if (!status) {
+      LOGE("Failed to prepare texture for %s", tex->Name().c_str());
+    }
+    guard.lock();
+
+    running_.erase(std::find(running_.begin(), running_.end(), tex));
+    done_.notify_all();
+  }
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __TEXTURE_LOADER_H__
+#define __TEXTURE_LOADER_H__
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <android/asset_manager.h>
+#include "AssetTexture.h"
+#include "TextureCache.h"
+
+/*
+ * TextureLoader:
+ *     A pool of threads running AssetTexture::PreparePixels() for submitted
+ *     textures, oldest first, so the GL thread is left with the uploads.
+ *     Textures must outlive their preparation: Cancel() before deleting
+ *     them.
+ */
+class TextureLoader {
+ public:
+  TextureLoader(AAssetManager* mgr, const std::string& cacheDir,
+                uint32_t threadCount);
+  ~TextureLoader();
+
+  void Submit(AssetTexture* tex);
+
+  // drop the textures not started yet, wait for the ones being prepared
+  void Cancel(void);
+
+  // wait until the texture is prepared; false if it failed or was dropped
+  bool Wait(AssetTexture* tex);
+
+ private:
+  void WorkerLoop(void);
+
+  AAssetManager* mgr_;
+  TextureDiskCache cache_;
+  std::vector<std::thread> workers_;
+  std::deque<AssetTexture*> queue_;
+  std::vector<AssetTexture*> running_;
+  std::mutex lock_;
+  std::condition_variable work_;
+  std::condition_variable done_;
+  bool exit_;
+};
+
+#endif  // __TEXTURE_LOADER_H__
@@ -18,7 +18,13 @@
 #define GEOM_DEBUG LOGD
 //#define GEOM_DEBUG
 
-SimpleGeom* AsciiArtToGeom(const char *art, float scale) {
+static const int VERTICES_STRIDE = sizeof(GLfloat) * 7;
+static const int VERTICES_COLOR_OFFSET = sizeof(GLfloat) * 3;
+
+// Parses the art into vertices (VERTICES_STRIDE apart, white) and pairs of indices (lines).
+// The caller deletes the arrays.
+static void _ascii_art_to_arrays(const char *art, float scale, GLfloat **outVertices,
+        int *outVertexCount, GLushort **outIndices, int *outIndexCount) {
     // figure out width and height
     LOGD("Creating geometry from ASCII art.");
     GEOM_DEBUG("Ascii art source:\n%s", art);
@@ -94,8 +100,6 @@ SimpleGeom* AsciiArtToGeom(const char *art, float scale) {
     GEOM_DEBUG("Total vertices: %d, total indices %d", vertices, indices);
 
     // allocate arrays for the vertices and lines
-    const int VERTICES_STRIDE = sizeof(GLfloat) * 7;
-    const int VERTICES_COLOR_OFFSET = sizeof(GLfloat) * 3;
     GLfloat *verticesArray = new GLfloat[vertices * VERTICES_STRIDE];
     GLushort *indicesArray = new GLushort[indices];
     vertices = indices = 0; // current count of vertices and lines
@@ -195,7 +199,7 @@ SimpleGeom* AsciiArtToGeom(const char *art, float scale) {
     GEOM_DEBUG("Deallocating working space.");
     // get rid of the working arrays
     for (r = 0; r < rows; r++) {
-        delete v[r];
+        delete [] v[r];
     }
     delete [] v;
 
@@ -209,6 +213,18 @@ SimpleGeom* AsciiArtToGeom(const char *art, float scale) {
         }
     }
 
+    *outVertices = verticesArray;
+    *outVertexCount = vertices;
+    *outIndices = indicesArray;
+    *outIndexCount = indices;
+}
+
+SimpleGeom* AsciiArtToGeom(const char *art, float scale) {
+    GLfloat *verticesArray;
+    GLushort *indicesArray;
+    int vertices, indices;
+    _ascii_art_to_arrays(art, scale, &verticesArray, &vertices, &indicesArray, &indices);
+
     // create the buffers
     GEOM_DEBUG("Creating output VBO (%d vertices) and IBO (%d indices).", vertices, indices);
     SimpleGeom* out = new SimpleGeom(new VertexBuf(verticesArray, vertices * sizeof(GLfloat) *
@@ -228,3 +244,19 @@ SimpleGeom* AsciiArtToGeom(const char *art, float scale) {
     return out;
 }
 
+void AsciiArtToLines(const char *art, float scale, std::vector<glm::vec2> *out) {
+    GLfloat *verticesArray;
+    GLushort *indicesArray;
+    int vertices, indices;
+    _ascii_art_to_arrays(art, scale, &verticesArray, &vertices, &indicesArray, &indices);
+
+    const int floatsPerVertex = VERTICES_STRIDE / sizeof(GLfloat);
+    for (int i = 0; i < indices; i++) {
+        const GLfloat *v = verticesArray + indicesArray[i] * floatsPerVertex;
+        out->push_back(glm::vec2(v[0], v[1]));
+    }
+
+    delete [] verticesArray;
+    delete [] indicesArray;
+}
+
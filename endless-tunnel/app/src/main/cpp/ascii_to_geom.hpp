@@ -16,6 +16,8 @@
 #ifndef endlesstunnel_ascii_to_geom_hpp
 #define endlesstunnel_ascii_to_geom_hpp
 
+#include <vector>
+
 #include "engine.hpp"
 
 /* Converts ASCII art into a Vbo/Ibo pair. Useful for retro-looking drawings/text!
@@ -38,5 +40,9 @@
  */
 SimpleGeom* AsciiArtToGeom(const char *art, float scale);
 
+/* Same, but appends the lines to out on the CPU, as pairs of end points, instead of
+ * making buffers. */
+void AsciiArtToLines(const char *art, float scale, std::vector<glm::vec2> *out);
+
 #endif
 
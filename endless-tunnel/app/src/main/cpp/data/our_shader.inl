@@ -60,5 +60,51 @@
            "   gl_FragColor = mix(v_Color * u_Tint * texture2D(u_Sampler, v_TexCoord) + u_PointLightColor * att, vec4(0), v_FogFactor);\n" \
            "}";
 
-#endif
+// Same look as OurShader, for many copies of a geometry in one draw call: each instance
+// brings its model matrix and tint as attributes, u_MVP is the view-projection matrix. As
+// with OurShader, the point light is given in model coordinates, so it follows each copy.
+#define OUR_INSTANCED_VERTEX_SHADER_SOURCE \
+           "uniform mat4 u_MVP;            \n" \
+           "uniform vec4 u_PointLightPos;  \n" \
+           "attribute vec4 a_Position;     \n" \
+           "attribute vec4 a_Color;        \n" \
+           "attribute vec2 a_TexCoord;     \n" \
+           "attribute mat4 a_Model;        \n" \
+           "attribute vec4 a_Tint;         \n" \
+           "varying vec4 v_Color;          \n" \
+           "varying vec4 v_Pos;            \n" \
+           "varying float v_FogFactor;     \n" \
+           "varying vec2 v_TexCoord;       \n" \
+           "varying vec4 v_PointLightPos;  \n" \
+           "float FOG_START = 100.0;       \n" \
+           "float FOG_END = 200.0;         \n" \
+           "void main()                    \n" \
+           "{                              \n" \
+           "   v_Color = a_Color * a_Tint; \n" \
+           "   gl_Position = u_MVP         \n" \
+           "               * (a_Model * a_Position); \n" \
+           "   v_Pos = gl_Position;        \n" \
+           "   v_PointLightPos = u_MVP * (a_Model * u_PointLightPos); \n" \
+           "   v_TexCoord = a_TexCoord;    \n" \
+           "   v_FogFactor = clamp((v_Pos.z - FOG_START) / (FOG_END - FOG_START), 0.0, 1.0); \n" \
+           "}                              \n";
 
+#define OUR_INSTANCED_FRAG_SHADER_SOURCE \
+           "precision mediump float;       \n" \
+           "varying vec4 v_Color;          \n" \
+           "varying vec4 v_Pos;            \n" \
+           "varying vec2 v_TexCoord;       \n" \
+           "varying float v_FogFactor;     \n" \
+           "uniform sampler2D u_Sampler;   \n" \
+           "uniform vec4 u_PointLightColor; \n" \
+           "varying vec4 v_PointLightPos;  \n" \
+           "float ATT_FACT_2 = 0.005;      \n" \
+           "float ATT_FACT_1 = 0.00;       \n" \
+           "void main()                    \n" \
+           "{                              \n" \
+           "   float d = distance(v_PointLightPos, v_Pos);\n" \
+           "   float att = 1.0/(ATT_FACT_1 * d + ATT_FACT_2 * d * d);\n" \
+           "   gl_FragColor = mix(v_Color * texture2D(u_Sampler, v_TexCoord) + u_PointLightColor * att, vec4(0), v_FogFactor);\n" \
+           "}";
+
+#endif
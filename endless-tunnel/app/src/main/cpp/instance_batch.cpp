@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "instance_batch.hpp"
+
+// the GL backend uploads the instances as they are
+static_assert(sizeof(BatchInstance) == 20 * sizeof(float), "BatchInstance must be packed");
+
+InstanceBatch::InstanceBatch() {
+    mBucketCount = 0;
+    mLastBucket = 0;
+}
+
+void InstanceBatch::Add(Texture *texture, const glm::mat4& modelMat, const glm::vec4& tint) {
+    int b = mLastBucket;
+    if (b >= mBucketCount || mBuckets[b].texture != texture) {
+        for (b = 0; b < mBucketCount && mBuckets[b].texture != texture; b++);
+        if (b == mBucketCount) {
+            // first instance with this texture this frame
+            if (mBucketCount == (int) mBuckets.size()) {
+                mBuckets.push_back(Bucket());
+            }
+            mBuckets[b].texture = texture;
+            mBucketCount++;
+        }
+        mLastBucket = b;
+    }
+
+    BatchInstance instance;
+    instance.modelMat = modelMat;
+    instance.tint = tint;
+    mBuckets[b].instances.push_back(instance);
+}
+
+int InstanceBatch::GetInstanceCount() const {
+    size_t count = 0;
+    for (int b = 0; b < mBucketCount; b++) {
+        count += mBuckets[b].instances.size();
+    }
+    return (int) count;
+}
+
+int InstanceBatch::Submit(InstanceBatchBackend *backend, const glm::mat4& viewProjMat) {
+    if (mBucketCount == 0) {
+        return 0;
+    }
+
+    // lay the buckets out one after the other in the frame's instance buffer
+    mInstances.clear();
+    for (int b = 0; b < mBucketCount; b++) {
+        mInstances.insert(mInstances.end(), mBuckets[b].instances.begin(),
+                mBuckets[b].instances.end());
+    }
+
+    backend->BeginFrame(viewProjMat, mInstances.data(), (int) mInstances.size());
+    int first = 0;
+    for (int b = 0; b < mBucketCount; b++) {
+        int count = (int) mBuckets[b].instances.size();
+        backend->DrawInstances(mBuckets[b].texture, first, count);
+        first += count;
+    }
+    backend->EndFrame();
+
+    int draws = mBucketCount;
+    Clear();
+    return draws;
+}
+
+void InstanceBatch::Clear() {
+    for (int b = 0; b < mBucketCount; b++) {
+        mBuckets[b].instances.clear();
+    }
+    mBucketCount = 0;
+    mLastBucket = 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef endlesstunnel_instance_batch_hpp
+#define endlesstunnel_instance_batch_hpp
+
+// No OpenGL in here: the batch also builds on a desktop host, so it can be checked
+// without a GPU (see src/test/cpp/instance_batch_test.cpp).
+#include <stddef.h>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+class Texture;
+
+// One copy of the batched geometry: its model matrix and the tint color it's drawn with.
+// This is also the layout of the per-frame instance buffer (20 floats per instance).
+struct BatchInstance {
+    glm::mat4 modelMat;
+    glm::vec4 tint;
+};
+
+/* Draws what an InstanceBatch collected in a frame. BeginFrame gets the frame's instance
+ * buffer; each DrawInstances call that follows draws a range of it, all with the same
+ * texture; EndFrame finishes the frame. */
+class InstanceBatchBackend {
+    public:
+        virtual ~InstanceBatchBackend() {}
+
+        // The instances stay valid until EndFrame.
+        virtual void BeginFrame(const glm::mat4& viewProjMat, const BatchInstance *instances,
+                int count) = 0;
+
+        // Draws instances [first, first + count) of the frame with the given texture.
+        virtual void DrawInstances(Texture *texture, int first, int count) = 0;
+
+        virtual void EndFrame() = 0;
+};
+
+/* Collects the instances of a geometry over a frame, and submits them to a backend as
+ * one instance buffer and one draw per texture. Textures are drawn in the order they
+ * were first added in, and the instances of a texture in the order they were added in.
+ * The storage is kept from frame to frame, so a steady frame doesn't allocate. */
+class InstanceBatch {
+    private:
+        struct Bucket {
+            Texture *texture;
+            std::vector<BatchInstance> instances;
+        };
+
+        // buckets [0, mBucketCount) are in use this frame; the others keep their storage
+        std::vector<Bucket> mBuckets;
+        int mBucketCount;
+
+        // bucket the last instance went to (consecutive instances mostly share a texture)
+        int mLastBucket;
+
+        // the frame's instances, grouped by texture, as given to the backend
+        std::vector<BatchInstance> mInstances;
+
+    public:
+        InstanceBatch();
+
+        void Add(Texture *texture, const glm::mat4& modelMat, const glm::vec4& tint);
+
+        // instances and textures added since the last Submit
+        int GetInstanceCount() const;
+        int GetTextureCount() const { return mBucketCount; }
+
+        // Sends the frame to the backend and empties the batch. Returns the number of
+        // draws made, 0 if the batch was empty (the backend is then not called at all).
+        int Submit(InstanceBatchBackend *backend, const glm::mat4& viewProjMat);
+
+        // Empties the batch without drawing.
+        void Clear();
+};
+
+#endif
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "instance_renderer.hpp"
+#include "our_shader.hpp"
+#include "util.hpp"
+
+#include <stddef.h>
+#include <string.h>
+
+// OpenGL ES 3.0 entry points. We link against GLESv2 only (so the game still runs on
+// devices without 3.0), and look these up at run time.
+typedef void (GL_APIENTRY *DrawArraysInstancedFn)(GLenum mode, GLint first, GLsizei count,
+        GLsizei instanceCount);
+typedef void (GL_APIENTRY *VertexAttribDivisorFn)(GLuint index, GLuint divisor);
+
+static DrawArraysInstancedFn _glDrawArraysInstanced = NULL;
+static VertexAttribDivisorFn _glVertexAttribDivisor = NULL;
+
+static bool _init_instancing() {
+    const char *version = (const char*) glGetString(GL_VERSION);
+    if (!version || !strstr(version, "OpenGL ES 3.")) {
+        LOGD("InstanceRenderer: %s, no instanced drawing.", version ? version : "no version");
+        return false;
+    }
+    _glDrawArraysInstanced = (DrawArraysInstancedFn) eglGetProcAddress("glDrawArraysInstanced");
+    _glVertexAttribDivisor = (VertexAttribDivisorFn) eglGetProcAddress("glVertexAttribDivisor");
+    if (!_glDrawArraysInstanced || !_glVertexAttribDivisor) {
+        LOGW("InstanceRenderer: %s without instancing entry points.", version);
+        return false;
+    }
+    return true;
+}
+
+InstanceRenderer::InstanceRenderer(VertexBuf *geom, OurShader *ourShader) {
+    mGeom = geom;
+    mOurShader = ourShader;
+    mInstancedShader = NULL;
+    mInstanceVbo = 0;
+    mInstanceVboSize = 0;
+    mInstances = NULL;
+    mPointLightOn = false;
+
+    if (_init_instancing()) {
+        mInstancedShader = new OurInstancedShader();
+        mInstancedShader->Compile();
+        glGenBuffers(1, &mInstanceVbo);
+    }
+    LOGD("InstanceRenderer: %s draws.", IsInstanced() ? "instanced" : "per-instance");
+}
+
+InstanceRenderer::~InstanceRenderer() {
+    if (mInstanceVbo) {
+        glDeleteBuffers(1, &mInstanceVbo);
+        mInstanceVbo = 0;
+    }
+    CleanUp(&mInstancedShader);
+}
+
+void InstanceRenderer::EnablePointLight(glm::vec3 pos, float r, float g, float b) {
+    mPointLightOn = true;
+    mPointLightPos = pos;
+    mPointLightColor = glm::vec3(r, g, b);
+}
+
+void InstanceRenderer::DisablePointLight() {
+    mPointLightOn = false;
+}
+
+void InstanceRenderer::BeginFrame(const glm::mat4& viewProjMat,
+        const BatchInstance *instances, int count) {
+    mInstances = instances;
+    mViewProjMat = viewProjMat;
+
+    if (!IsInstanced()) {
+        mOurShader->BeginRender(mGeom);
+        if (mPointLightOn) {
+            mOurShader->EnablePointLight(mPointLightPos, mPointLightColor.r,
+                    mPointLightColor.g, mPointLightColor.b);
+        }
+        return;
+    }
+
+    // upload the frame's instances; reallocating the store every frame lets the driver
+    // hand us a fresh one instead of waiting for the draws of the previous frame
+    int size = count * (int) sizeof(BatchInstance);
+    glBindBuffer(GL_ARRAY_BUFFER, mInstanceVbo);
+    if (size > mInstanceVboSize) {
+        mInstanceVboSize = size;
+    }
+    glBufferData(GL_ARRAY_BUFFER, mInstanceVboSize, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, instances);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    mInstancedShader->BeginRender(mGeom);
+    mInstancedShader->SetViewProjMatrix(&mViewProjMat);
+    if (mPointLightOn) {
+        mInstancedShader->EnablePointLight(mPointLightPos, mPointLightColor.r,
+                mPointLightColor.g, mPointLightColor.b);
+    }
+
+    int modelLoc = mInstancedShader->GetModelAttribLoc();
+    int tintLoc = mInstancedShader->GetTintAttribLoc();
+    for (int col = 0; col < 4; col++) {
+        glEnableVertexAttribArray(modelLoc + col);
+        _glVertexAttribDivisor(modelLoc + col, 1);
+    }
+    glEnableVertexAttribArray(tintLoc);
+    _glVertexAttribDivisor(tintLoc, 1);
+}
+
+void InstanceRenderer::DrawInstances(Texture *texture, int first, int count) {
+    if (!IsInstanced()) {
+        mOurShader->SetTexture(texture);
+        for (int i = first; i < first + count; i++) {
+            const BatchInstance& instance = mInstances[i];
+            glm::mat4 mvpMat = mViewProjMat * instance.modelMat;
+            mOurShader->SetTintColor(instance.tint.r, instance.tint.g, instance.tint.b);
+            mOurShader->Render(&mvpMat);
+        }
+        return;
+    }
+
+    mInstancedShader->SetTexture(texture);
+
+    // ES 3.0 has no base instance, so point the instance attributes at the first one
+    int stride = (int) sizeof(BatchInstance);
+    int base = first * stride;
+    int modelLoc = mInstancedShader->GetModelAttribLoc();
+    glBindBuffer(GL_ARRAY_BUFFER, mInstanceVbo);
+    for (int col = 0; col < 4; col++) {
+        glVertexAttribPointer(modelLoc + col, 4, GL_FLOAT, GL_FALSE, stride,
+                BUFFER_OFFSET(base + offsetof(BatchInstance, modelMat) +
+                col * sizeof(glm::vec4)));
+    }
+    glVertexAttribPointer(mInstancedShader->GetTintAttribLoc(), 4, GL_FLOAT, GL_FALSE, stride,
+            BUFFER_OFFSET(base + offsetof(BatchInstance, tint)));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    _glDrawArraysInstanced(mGeom->GetPrimitive(), 0, mGeom->GetCount(), count);
+}
+
+void InstanceRenderer::EndFrame() {
+    mInstances = NULL;
+
+    if (!IsInstanced()) {
+        mOurShader->EndRender();
+        return;
+    }
+
+    // divisors stick to the attribute locations, which the other shaders reuse
+    int modelLoc = mInstancedShader->GetModelAttribLoc();
+    int tintLoc = mInstancedShader->GetTintAttribLoc();
+    for (int col = 0; col < 4; col++) {
+        _glVertexAttribDivisor(modelLoc + col, 0);
+        glDisableVertexAttribArray(modelLoc + col);
+    }
+    _glVertexAttribDivisor(tintLoc, 0);
+    glDisableVertexAttribArray(tintLoc);
+
+    mInstancedShader->EndRender();
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef endlesstunnel_instance_renderer_hpp
+#define endlesstunnel_instance_renderer_hpp
+
+#include "engine.hpp"
+#include "instance_batch.hpp"
+
+class OurShader;
+class OurInstancedShader;
+
+/* Draws the instances of an InstanceBatch with OpenGL. On OpenGL ES 3.0, the frame's
+ * instances are uploaded into one vertex buffer, and each texture is one instanced draw
+ * (OurInstancedShader). On OpenGL ES 2.0, there is no instanced drawing, so each instance
+ * is drawn with OurShader, as one draw call with its own uniforms. */
+class InstanceRenderer : public InstanceBatchBackend {
+    private:
+        // the geometry we draw copies of
+        VertexBuf *mGeom;
+
+        // per-instance fallback, not owned
+        OurShader *mOurShader;
+
+        // NULL if instanced drawing isn't supported
+        OurInstancedShader *mInstancedShader;
+        GLuint mInstanceVbo;
+        int mInstanceVboSize;
+
+        // the frame being drawn (between BeginFrame and EndFrame)
+        const BatchInstance *mInstances;
+        glm::mat4 mViewProjMat;
+
+        // point light of the frames to come, in model coordinates (see OurShader)
+        bool mPointLightOn;
+        glm::vec3 mPointLightPos;
+        glm::vec3 mPointLightColor;
+
+    public:
+        // Call with a current OpenGL context (creates the instanced shader and the
+        // instance buffer when instanced drawing is supported).
+        InstanceRenderer(VertexBuf *geom, OurShader *ourShader);
+        ~InstanceRenderer();
+
+        bool IsInstanced() { return mInstancedShader != NULL; }
+
+        // Lights (or not) the instances drawn by the next frames, on both paths.
+        void EnablePointLight(glm::vec3 pos, float r, float g, float b);
+        void DisablePointLight();
+
+        virtual void BeginFrame(const glm::mat4& viewProjMat, const BatchInstance *instances,
+                int count);
+        virtual void DrawInstances(Texture *texture, int first, int count);
+        virtual void EndFrame();
+};
+
+#endif
@@ -325,8 +325,14 @@ bool NativeEngine::InitContext() {
         
     LOGD("NativeEngine: initializing context.");
 
-    // create EGL context
-    mEglContext = eglCreateContext(mEglDisplay, mEglConfig, NULL, attribList);
+    // create EGL context: OpenGL ES 3.0 if we can, for the instanced obstacles (see
+    // InstanceRenderer), else 2.0, which has everything else
+    EGLint attribList3[] = { EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE };
+    mEglContext = eglCreateContext(mEglDisplay, mEglConfig, NULL, attribList3);
+    if (mEglContext == EGL_NO_CONTEXT) {
+        LOGD("NativeEngine: no OpenGL ES 3.0 context, EGL error %d", eglGetError());
+        mEglContext = eglCreateContext(mEglDisplay, mEglConfig, NULL, attribList);
+    }
     if (mEglContext == EGL_NO_CONTEXT) {
         LOGE("Failed to create EGL context, EGL error %d", eglGetError());
         return false;
@@ -130,3 +130,105 @@ const char* OurShader::GetShaderName() {
     return "OurShader";
 }
 
+
+OurInstancedShader::OurInstancedShader() : Shader() {
+    mColorLoc = (GLint) -1;
+    mTexCoordLoc = (GLint) -1;
+    mModelLoc = (GLint) -1;
+    mInstanceTintLoc = (GLint) -1;
+    mSamplerLoc = -1;
+    mPointLightPosLoc = -1;
+    mPointLightColorLoc = -1;
+}
+
+OurInstancedShader::~OurInstancedShader() {
+}
+
+void OurInstancedShader::Compile() {
+    Shader::Compile();
+
+    BindShader();
+    mColorLoc = glGetAttribLocation(mProgramH, "a_Color");
+    if (mColorLoc < 0) {
+        LOGE("*** Couldn't get color attrib location from shader (OurInstancedShader).");
+        ABORT_GAME;
+    }
+    mTexCoordLoc = glGetAttribLocation(mProgramH, "a_TexCoord");
+    if (mTexCoordLoc < 0) {
+        LOGE("*** Couldn't get tex coord attrib location from shader (OurInstancedShader).");
+        ABORT_GAME;
+    }
+    mModelLoc = glGetAttribLocation(mProgramH, "a_Model");
+    if (mModelLoc < 0) {
+        LOGE("*** Couldn't get model attrib location from shader (OurInstancedShader).");
+        ABORT_GAME;
+    }
+    mInstanceTintLoc = glGetAttribLocation(mProgramH, "a_Tint");
+    if (mInstanceTintLoc < 0) {
+        LOGE("*** Couldn't get tint attrib location from shader (OurInstancedShader).");
+        ABORT_GAME;
+    }
+    mSamplerLoc = glGetUniformLocation(mProgramH, "u_Sampler");
+    if (mSamplerLoc < 0) {
+        LOGE("*** Couldn't get sampler location from shader (OurInstancedShader).");
+        ABORT_GAME;
+    }
+    mPointLightPosLoc = glGetUniformLocation(mProgramH, "u_PointLightPos");
+    if (mPointLightPosLoc < 0) {
+        LOGE("*** Couldn't get point light pos location from shader (OurInstancedShader).");
+        ABORT_GAME;
+    }
+    mPointLightColorLoc = glGetUniformLocation(mProgramH, "u_PointLightColor");
+    if (mPointLightColorLoc < 0) {
+        LOGE("*** Couldn't get point light color location from shader (OurInstancedShader).");
+        ABORT_GAME;
+    }
+    UnbindShader();
+}
+
+void OurInstancedShader::SetTexture(Texture *t) {
+    MY_ASSERT(mPreparedVertexBuf != NULL);
+    t->Bind(GL_TEXTURE0);
+    glUniform1i(mSamplerLoc, 0);
+}
+
+void OurInstancedShader::EnablePointLight(glm::vec3 pos, float r, float g, float b) {
+    MY_ASSERT(mPreparedVertexBuf != NULL);
+    glUniform4f(mPointLightColorLoc, r, g, b, 1.0);
+    glUniform4f(mPointLightPosLoc, pos.x, pos.y, pos.z, 1.0);
+}
+
+void OurInstancedShader::DisablePointLight() {
+    MY_ASSERT(mPreparedVertexBuf != NULL);
+    glUniform4f(mPointLightColorLoc, 0.0f, 0.0f, 0.0f, 0.0f);
+}
+
+void OurInstancedShader::BeginRender(VertexBuf *geom) {
+    Shader::BeginRender(geom);
+
+    MY_ASSERT(geom->HasColors());
+    MY_ASSERT(geom->HasTexCoords());
+
+    glVertexAttribPointer(mColorLoc, 3, GL_FLOAT, GL_FALSE, geom->GetStride(),
+                          BUFFER_OFFSET(geom->GetColorsOffset()));
+    glEnableVertexAttribArray(mColorLoc);
+
+    glVertexAttribPointer(mTexCoordLoc, 2, GL_FLOAT, GL_FALSE, geom->GetStride(),
+                          BUFFER_OFFSET(geom->GetTexCoordsOffset()));
+    glEnableVertexAttribArray(mTexCoordLoc);
+
+    // by default, no point light
+    DisablePointLight();
+}
+
+const char* OurInstancedShader::GetVertShaderSource() {
+    return OUR_INSTANCED_VERTEX_SHADER_SOURCE;
+}
+
+const char* OurInstancedShader::GetFragShaderSource() {
+    return OUR_INSTANCED_FRAG_SHADER_SOURCE;
+}
+
+const char* OurInstancedShader::GetShaderName() {
+    return "OurInstancedShader";
+}
@@ -43,5 +43,37 @@ class OurShader : public Shader {
        virtual const char *GetShaderName();
 };
 
+// Draws many copies of a geometry in one call, each with its own model matrix and tint,
+// with the same look as OurShader. The instance attributes are set up by InstanceRenderer,
+// as they need OpenGL ES 3.0 entry points.
+class OurInstancedShader : public Shader {
+    protected:
+       GLint mColorLoc;
+       GLint mTexCoordLoc;
+       GLint mModelLoc;
+       GLint mInstanceTintLoc;
+       int mSamplerLoc;
+       int mPointLightPosLoc;
+       int mPointLightColorLoc;
+    public:
+       OurInstancedShader();
+       virtual ~OurInstancedShader();
+       virtual void Compile();
+       void SetTexture(Texture *t);
+       void SetViewProjMatrix(glm::mat4 *mat) { PushMVPMatrix(mat); }
+       void EnablePointLight(glm::vec3 pos, float r, float g, float b);
+       void DisablePointLight();
+
+       // the model matrix takes four consecutive locations, one per column
+       int GetModelAttribLoc() { return mModelLoc; }
+       int GetTintAttribLoc() { return mInstanceTintLoc; }
+
+       virtual void BeginRender(VertexBuf *geom);
+   protected:
+       virtual const char *GetVertShaderSource();
+       virtual const char *GetFragShaderSource();
+       virtual const char *GetShaderName();
+};
+
 #endif
 
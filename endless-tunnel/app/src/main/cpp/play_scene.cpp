@@ -17,6 +17,7 @@
 #include "anim.hpp"
 #include "ascii_to_geom.hpp"
 #include "game_consts.hpp"
+#include "instance_renderer.hpp"
 #include "our_shader.hpp"
 #include "play_scene.hpp"
 #include "util.hpp"
@@ -70,6 +71,7 @@ PlayScene::PlayScene() : Scene() {
     mUseCloudSave = false;
 
     mCubeGeom = NULL;
+    mCubeRenderer = NULL;
     mTunnelGeom = NULL;
 
     mObstacleCount = 0;
@@ -118,6 +120,20 @@ PlayScene::PlayScene() : Scene() {
 
     SetScore(0);
 
+    // synthesize all sound effects up front so that playing them during the
+    // game is only a cache lookup; they must all fit to never be evicted
+    static_assert(5 + sizeof(TONE_BONUS) / sizeof(TONE_BONUS[0]) <= SFX_MAX_CACHED_TONES,
+            "the game's tones don't fit in the SfxMan tone cache");
+    SfxMan *sfxMan = SfxMan::GetInstance();
+    sfxMan->PreloadTone(TONE_AMBIENT_0);
+    sfxMan->PreloadTone(TONE_AMBIENT_1);
+    sfxMan->PreloadTone(TONE_CRASHED);
+    sfxMan->PreloadTone(TONE_GAME_OVER);
+    sfxMan->PreloadTone(TONE_LEVEL_UP);
+    for (int i = 0; i < static_cast<int>(sizeof(TONE_BONUS)/sizeof(char*)); i++) {
+        sfxMan->PreloadTone(TONE_BONUS[i]);
+    }
+
     /*
      * where do I put the program???
      */
@@ -254,6 +270,7 @@ void PlayScene::OnStartGraphics() {
     mCubeGeom = new SimpleGeom(new VertexBuf(CUBE_GEOM, sizeof(CUBE_GEOM),CUBE_GEOM_STRIDE));
     mCubeGeom->vbuf->SetColorsOffset(CUBE_GEOM_COLOR_OFFSET);
     mCubeGeom->vbuf->SetTexCoordsOffset(CUBE_GEOM_TEXCOORD_OFFSET);
+    mCubeRenderer = new InstanceRenderer(mCubeGeom->vbuf, mOurShader);
 
     // make the wall texture
     mWallTexture = new Texture();
@@ -277,6 +294,7 @@ void PlayScene::OnKillGraphics() {
     CleanUp(&mOurShader);
     CleanUp(&mTrivialShader);
     CleanUp(&mTunnelGeom);
+    CleanUp(&mCubeRenderer);
     CleanUp(&mCubeGeom);
     CleanUp(&mWallTexture);
     CleanUp(&mLifeGeom);
@@ -456,10 +474,9 @@ void PlayScene::RenderObstacles() {
     int r, c;
     float red, green, blue;
     glm::mat4 modelMat;
-    glm::mat4 mvpMat;
 
-    mOurShader->BeginRender(mCubeGeom->vbuf);
-    mOurShader->SetTexture(mWallTexture);
+    // all bonuses shimmer together
+    float shimmer = SineWave(0.8f, 1.0f, 0.5f, 0.0f);
 
     for (i = 0; i < mObstacleCount; i++) {
         Obstacle *o = GetObstacleAt(i);
@@ -474,32 +491,31 @@ void PlayScene::RenderObstacles() {
             for (c = 0; c < OBS_GRID_SIZE; c++) {
                 bool isBonus = r == o->bonusRow && c == o->bonusCol;
                 if (o->grid[c][r]) {
-                    // set up matrices
+                    // box
                     modelMat = glm::translate(glm::mat4(1.0f), o->GetBoxCenter(c, r, posY));
                     modelMat = glm::scale(modelMat, o->GetBoxSize(c, r));
-                    mvpMat = mProjMat * mViewMat * modelMat;
-
-                    // set up color
                     _get_obs_color(o->style, &red, &green, &blue);
-                    mOurShader->SetTintColor(red, green, blue);
-
-                    // render box
-                    mOurShader->Render(&mvpMat);
+                    mObstacleBatch.Add(mWallTexture, modelMat,
+                            glm::vec4(red, green, blue, 1.0f));
                 } else if (isBonus) {
+                    // bonus
                     modelMat = glm::translate(glm::mat4(1.0f), o->GetBoxCenter(c, r, posY));
                     modelMat = glm::scale(modelMat, glm::vec3(OBS_BONUS_SIZE, OBS_BONUS_SIZE,
                             OBS_BONUS_SIZE));
                     modelMat = glm::rotate(modelMat, Clock() * 90.0f, glm::vec3(0.0f, 0.0f, 1.0f));
-                    mvpMat = mProjMat * mViewMat * modelMat;
-                    mOurShader->SetTintColor(SineWave(0.8f, 1.0f, 0.5f, 0.0f),
-                            SineWave(0.8f, 1.0f, 0.5f, 0.0f),
-                            SineWave(0.8f, 1.0f, 0.5f, 0.0f)); // shimmering color
-                    mOurShader->Render(&mvpMat); // render
+                    mObstacleBatch.Add(mWallTexture, modelMat,
+                            glm::vec4(shimmer, shimmer, shimmer, 1.0f));
                 }
             }
         }
     }
-    mOurShader->EndRender();
+
+    // RenderTunnel leaves the point light of the last section on; the obstacles have
+    // always been drawn without it
+    mCubeRenderer->DisablePointLight();
+
+    // one draw per texture (per box, where instanced drawing isn't supported)
+    mObstacleBatch.Submit(mCubeRenderer, mProjMat * mViewMat);
 }
 
 void PlayScene::GenObstacles() {
@@ -625,6 +641,7 @@ void PlayScene::RenderHUD() {
         mTextRenderer->RenderText(mSignText, aspect * 0.5f, 0.5f);
         mTextRenderer->ResetMatrix();
     }
+    mTextRenderer->Flush();
 
     // render life icons
     glLineWidth(LIFE_LINE_WIDTH);
@@ -663,6 +680,10 @@ void PlayScene::RenderMenu() {
     }
     mTextRenderer->ResetColor();
 
+    // background first, then the menu items over it
+    mShapeRenderer->Flush();
+    mTextRenderer->Flush();
+
     glEnable(GL_DEPTH_TEST);
 }
 
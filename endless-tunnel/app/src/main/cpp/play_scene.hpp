@@ -17,6 +17,7 @@
 #define endlesstunnel_play_scene_h
 
 #include "engine.hpp"
+#include "instance_batch.hpp"
 #include "obstacle_generator.hpp"
 #include "obstacle.hpp"
 #include "sfxman.hpp"
@@ -24,6 +25,7 @@
 #include "text_renderer.hpp"
 #include "util.hpp"
 
+class InstanceRenderer;
 class OurShader;
 
 /* This is the gameplay scene -- the scene that shows the player flying down
@@ -86,6 +88,10 @@ class PlayScene : public Scene {
         // vertex buffer to render obstacles
         SimpleGeom *mCubeGeom;
 
+        // obstacle boxes and bonuses of the frame, drawn as instances of mCubeGeom
+        InstanceBatch mObstacleBatch;
+        InstanceRenderer *mCubeRenderer;
+
         // what is the first tunnel section that we are rendering
         int mFirstSection;
 
@@ -14,15 +14,27 @@
  * limitations under the License.
  */
 #include <random>
+#include <stdlib.h>
+#include <string.h>
+#include "audio_convert.h"
 #include "sfxman.hpp"
 
 #define SAMPLES_PER_SEC 8000
 #define BUF_SAMPLES_MAX SAMPLES_PER_SEC*5 // 5 seconds
 #define DEFAULT_VOLUME 0.9f
 
+// the queue holds every cached tone at most once, plus the one the audio
+// callback may be about to pop as it gets queued again
+static_assert(SFX_PENDING_QUEUE_SIZE > SFX_MAX_CACHED_TONES,
+        "pending queue must hold every cached tone");
+static_assert((SFX_PENDING_QUEUE_SIZE & (SFX_PENDING_QUEUE_SIZE - 1)) == 0,
+        "pending queue size must be a power of 2");
+
 static SfxMan *_instance = new SfxMan();
+
+// scratch buffer for synthesis (game thread only); finished tones are copied
+// into the tone cache
 static short _sample_buf[BUF_SAMPLES_MAX];
-static volatile bool _bufferActive = false;
 
 SfxMan* SfxMan::GetInstance() {
     return _instance ? _instance : (_instance = new SfxMan());
@@ -38,11 +50,12 @@ static bool _checkError(SLresult r, const char *what) {
 }
 
 static void _bqPlayerCallback(SLAndroidSimpleBufferQueueItf bq, void *context) {
-    _bufferActive = false;
+    static_cast<SfxMan*>(context)->OnBufferDone(bq);
 }
 
 
-SfxMan::SfxMan() {
+SfxMan::SfxMan() : mInitOk(false), mToneCount(0), mUseClock(0), mPendingHead(0), mPendingTail(0),
+        mNextMixBuf(0), mActiveVoices(0) {
     // Note: this initialization code was mostly copied from the NDK audio sample.
     SLresult result;
     SLObjectItf engineObject = NULL;
@@ -58,6 +71,8 @@ SfxMan::SfxMan() {
 
     LOGD("SfxMan: initializing.");
     mPlayerBufferQueue = NULL;
+    memset(mVoices, 0, sizeof(mVoices));
+    memset(mMixBuf, 0, sizeof(mMixBuf));
 
     // create engine
     result = slCreateEngine(&engineObject, 0, NULL, 0, NULL, NULL);
@@ -128,7 +143,7 @@ SfxMan::SfxMan() {
     if (_checkError(result, "getting buffer queue interface")) return;
 
     // register callback on the buffer queue
-    result = (*mPlayerBufferQueue)->RegisterCallback(mPlayerBufferQueue, _bqPlayerCallback, NULL);
+    result = (*mPlayerBufferQueue)->RegisterCallback(mPlayerBufferQueue, _bqPlayerCallback, this);
     if (_checkError(result, "registering callback on buffer queue")) return;
 
     // get the effect send interface
@@ -144,12 +159,22 @@ SfxMan::SfxMan() {
     result = (*bqPlayerPlay)->SetPlayState(bqPlayerPlay, SL_PLAYSTATE_PLAYING);
     if (_checkError(result, "setting play state to playing")) return;
 
+    // prime the queue with both (silent) mix buffers; from now on every
+    // completed buffer is re-mixed and re-enqueued by the callback
+    for (int i = 0; i < 2; i++) {
+        result = (*mPlayerBufferQueue)->Enqueue(mPlayerBufferQueue, mMixBuf[i],
+                sizeof(mMixBuf[i]));
+        if (_checkError(result, "enqueueing mix buffer")) return;
+    }
+
     LOGD("SfxMan: initialization complete.");
     mInitOk = true;
 }
 
 bool SfxMan::IsIdle() {
-    return !_bufferActive;
+    return mActiveVoices.load(std::memory_order_acquire) == 0 &&
+            mPendingHead.load(std::memory_order_acquire) ==
+            mPendingTail.load(std::memory_order_acquire);
 }
 
 static const char *_parseInt(const char *s, int *result) {
@@ -188,33 +213,28 @@ static int _synth(int frequency, int duration, float amplitude, short *sample_bu
     return i;
 }
 
+// Fades the tone in over its first tenth, and out over its last one.
 static void _taper(short *sample_buf, int samples) {
-    int i;
     const float TAPER_SAMPLES_FRACTION = 0.1f;
     int taper_samples = (int)(TAPER_SAMPLES_FRACTION * samples);
-    for (i = 0; i < taper_samples && i < samples; i++) {
-        float factor = i / (float)taper_samples;
-        sample_buf[i] = (short)((float)sample_buf[i] * factor);
-    }
-    for (i = samples - taper_samples; i < samples; i++) {
-        if (i < 0) continue;
-        float factor = (samples - i)/ (float)taper_samples;
-        sample_buf[i] = (short)((float)sample_buf[i] * factor);
+    if (taper_samples <= 0) {
+        return;
     }
+    applyGainRampI16(sample_buf, taper_samples, 0.0f, 1.0f);
+    applyGainRampI16(sample_buf + samples - taper_samples, taper_samples, 1.0f, 0.0f);
 }
 
-void SfxMan::PlayTone(const char *tone) {
-    if (!mInitOk) {
-        LOGW("SfxMan: not playing sound because initialization failed.");
-        return;
-    }
-    if (_bufferActive) {
-        // can't play -- the buffer is in use
-        LOGW("SfxMan: can't play tone; buffer is active.");
-        return;
+static unsigned _hashRecipe(const char *s) {
+    // FNV-1a
+    unsigned h = 2166136261u;
+    while (*s) {
+        h = (h ^ (unsigned char)*s++) * 16777619u;
     }
+    return h;
+}
 
-    // synth the tone
+// Synthesizes the given recipe into _sample_buf. Returns the number of samples.
+static int _synthRecipe(const char *tone) {
     int total_samples = 0;
     int num_samples;
     int frequency = 100;
@@ -255,20 +275,144 @@ void SfxMan::PlayTone(const char *tone) {
        }
     }
 
-    SLresult result;
-    int total_size = total_samples * sizeof(short);
-    if (total_size <= 0) {
+    if (total_samples > 0) {
+        _taper(_sample_buf, total_samples);
+    }
+    return total_samples;
+}
+
+SfxMan::CachedTone *SfxMan::FindOrSynthTone(const char *tone) {
+    unsigned hash = _hashRecipe(tone);
+    for (int i = 0; i < mToneCount; i++) {
+        if (mTones[i].hash == hash && !strcmp(mTones[i].recipe, tone)) {
+            mTones[i].lastUse = ++mUseClock;
+            return &mTones[i];
+        }
+    }
+
+    CachedTone *entry = NULL;
+    if (mToneCount < SFX_MAX_CACHED_TONES) {
+        entry = &mTones[mToneCount];
+    } else {
+        // evict the least recently used tone the audio callback doesn't use: once
+        // it is off the queue (no pending plays) and no voice plays it, nothing
+        // refers to its samples anymore
+        for (int i = 0; i < SFX_MAX_CACHED_TONES; i++) {
+            CachedTone *t = &mTones[i];
+            if (t->pendingPlays.load(std::memory_order_acquire) == 0 &&
+                    t->playingVoices.load(std::memory_order_acquire) == 0 &&
+                    (!entry || t->lastUse < entry->lastUse)) {
+                entry = t;
+            }
+        }
+        if (!entry) {
+            LOGW("SfxMan: all %d cached tones are busy, can't cache tone %s",
+                    SFX_MAX_CACHED_TONES, tone);
+            return NULL;
+        }
+    }
+
+    int total_samples = _synthRecipe(tone);
+    if (total_samples <= 0) {
         LOGW("Tone is empty. Not playing.");
+        return NULL;
+    }
+
+    if (entry == &mTones[mToneCount]) {
+        mToneCount++;
+    } else {
+        free(entry->recipe);
+        delete[] entry->samples;
+    }
+    entry->hash = hash;
+    entry->recipe = strdup(tone);
+    entry->samples = new short[total_samples];
+    memcpy(entry->samples, _sample_buf, total_samples * sizeof(short));
+    entry->sampleCount = total_samples;
+    entry->lastUse = ++mUseClock;
+    return entry;
+}
+
+void SfxMan::PreloadTone(const char *tone) {
+    FindOrSynthTone(tone);
+}
+
+void SfxMan::PlayTone(const char *tone) {
+    if (!mInitOk) {
+        LOGW("SfxMan: not playing sound because initialization failed.");
+        return;
+    }
+
+    CachedTone *entry = FindOrSynthTone(tone);
+    if (!entry) {
+        return;
+    }
+
+    // a tone already waiting for a voice just owes one more play; the audio
+    // callback takes it off the queue when its count drops back to 0
+    if (entry->pendingPlays.fetch_add(1, std::memory_order_acq_rel) > 0) {
+        return;
+    }
+    // single producer: only the game thread advances the tail
+    unsigned tail = mPendingTail.load(std::memory_order_relaxed);
+    unsigned head = mPendingHead.load(std::memory_order_acquire);
+    if (tail - head >= SFX_PENDING_QUEUE_SIZE) {
+        // can't happen: the queue holds each of the cached tones at most once
+        entry->pendingPlays.fetch_sub(1, std::memory_order_relaxed);
+        LOGW("SfxMan: too many pending sounds; can't play tone.");
         return;
     }
+    mPending[tail & (SFX_PENDING_QUEUE_SIZE - 1)] = entry;
+    mPendingTail.store(tail + 1, std::memory_order_release);
+}
 
-    _taper(_sample_buf, total_samples);
+void SfxMan::StartPendingVoices() {
+    unsigned head = mPendingHead.load(std::memory_order_relaxed);
+    unsigned tail = mPendingTail.load(std::memory_order_acquire);
+    for (int v = 0; v < SFX_MAX_VOICES && head != tail; v++) {
+        if (mVoices[v].tone) continue;
+        CachedTone *entry = mPending[head & (SFX_PENDING_QUEUE_SIZE - 1)];
+        // counted as playing before its pending play is given up, so the game
+        // thread never sees the tone unused while this voice starts
+        entry->playingVoices.fetch_add(1, std::memory_order_relaxed);
+        mVoices[v].tone = entry;
+        mVoices[v].pos = 0;
+        mActiveVoices.fetch_add(1, std::memory_order_relaxed);
+        if (entry->pendingPlays.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            ++head;
+        }
+    }
+    // whatever did not get a voice stays queued until one frees up
+    mPendingHead.store(head, std::memory_order_release);
+}
+
+void SfxMan::MixInto(short *out, int samples) {
+    memset(out, 0, samples * sizeof(short));
+    StartPendingVoices();
+    for (int v = 0; v < SFX_MAX_VOICES; v++) {
+        Voice *voice = &mVoices[v];
+        if (!voice->tone) continue;
+        int count = voice->tone->sampleCount - voice->pos;
+        count = count < samples ? count : samples;
+        mixI16Saturate(out, voice->tone->samples + voice->pos, count);
+        voice->pos += count;
+        if (voice->pos >= voice->tone->sampleCount) {
+            // done with its samples: the game thread may evict the tone now
+            voice->tone->playingVoices.fetch_sub(1, std::memory_order_release);
+            voice->tone = NULL;
+            mActiveVoices.fetch_sub(1, std::memory_order_release);
+        }
+    }
+}
 
-    _bufferActive = true;
-    result = (*mPlayerBufferQueue)->Enqueue(mPlayerBufferQueue, _sample_buf, total_size);
+void SfxMan::OnBufferDone(SLAndroidSimpleBufferQueueItf bq) {
+    // the buffer that just finished playing is free; the other one is playing
+    short *buf = mMixBuf[mNextMixBuf];
+    mNextMixBuf ^= 1;
+    MixInto(buf, SFX_MIX_BUF_SAMPLES);
+    SLresult result = (*bq)->Enqueue(bq, buf, SFX_MIX_BUF_SAMPLES * sizeof(short));
     if (result != SL_RESULT_SUCCESS) {
         LOGW("SfxMan: warning: failed to enqueue buffer: %lu", (unsigned long)result);
-        return;
     }
 }
 
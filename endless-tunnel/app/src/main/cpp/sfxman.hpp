@@ -18,21 +18,70 @@
 
 #include <SLES/OpenSLES.h>
 #include <SLES/OpenSLES_Android.h>
+#include <atomic>
 
 #include "engine.hpp"
 
 /* Sound effect manager. This class is a singleton that manages sound effect
  * playback. Sound effects are defined by recipes (which are strings) that
  * indicate frequencies and durations. See the PlayTone() method for more info.
- * Note: our sfx generation code is very simplistic and lacks a mixer, so
- * only one sound can be playing at any given time. This is not a problematic
- * limitation for this simple sample but, needless to say, doesn't scale well
- * to a more complex game. */
+ *
+ * Each recipe is synthesized only the first time it is played; the samples are
+ * kept in a tone cache keyed by the recipe string, so repeat effects cost the
+ * game thread nothing but a cache lookup. Playback goes through a small software
+ * mixer: up to SFX_MAX_VOICES effects are summed (with saturation) into a pair
+ * of output buffers that are ping-ponged through the OpenSL buffer queue. The
+ * game thread hands new effects to the audio callback through a lock-free
+ * queue; if all voices are busy, the effect waits for the next free voice
+ * rather than being dropped. An effect played again while it is still waiting
+ * for a voice stays in the queue once, with a count of the plays it owes, so
+ * the queue can't overflow and every play gets its voice. When the cache is
+ * full, the least recently used tone that is neither playing nor waiting is
+ * evicted. */
+#define SFX_MAX_VOICES 8
+#define SFX_MAX_CACHED_TONES 32
+#define SFX_PENDING_QUEUE_SIZE 64   // must be a power of 2, > SFX_MAX_CACHED_TONES
+#define SFX_MIX_BUF_SAMPLES 128   // 16ms at 8kHz
+
 class SfxMan {
     private:
+        struct CachedTone {
+            unsigned hash = 0;
+            char *recipe = nullptr;
+            short *samples = nullptr;
+            int sampleCount = 0;
+            unsigned lastUse = 0;                 // game thread, for eviction
+            std::atomic<int> pendingPlays{0};     // plays waiting for a voice
+            std::atomic<int> playingVoices{0};    // voices playing it
+        };
+        struct Voice {
+            CachedTone *tone;
+            int pos;
+        };
+
         bool mInitOk;
         SLAndroidSimpleBufferQueueItf mPlayerBufferQueue;
 
+        // tone cache: only touched by the game thread
+        CachedTone mTones[SFX_MAX_CACHED_TONES];
+        int mToneCount;
+        unsigned mUseClock;
+
+        // effects posted by the game thread, consumed by the audio callback
+        CachedTone *mPending[SFX_PENDING_QUEUE_SIZE];
+        std::atomic<unsigned> mPendingHead; // written by audio callback
+        std::atomic<unsigned> mPendingTail; // written by game thread
+
+        // mixer state: only touched by the audio callback
+        Voice mVoices[SFX_MAX_VOICES];
+        short mMixBuf[2][SFX_MIX_BUF_SAMPLES];
+        int mNextMixBuf;
+        std::atomic<int> mActiveVoices;
+
+        CachedTone *FindOrSynthTone(const char *tone);
+        void StartPendingVoices();
+        void MixInto(short *out, int samples);
+
     public:
         SfxMan();
 
@@ -58,9 +107,16 @@ class SfxMan {
          * by 50 milliseconds of loud random noise. */
         void PlayTone(const char *tone);
 
-        // Returns whether or not the sound effect pipeline is idle (able to play
-        // a tone right now).
+        // Synthesizes the given recipe into the tone cache without playing it,
+        // so that the first PlayTone() call for it is cheap as well.
+        void PreloadTone(const char *tone);
+
+        // Returns whether or not the sound effect pipeline is idle (no effect
+        // is playing or waiting to be played).
         bool IsIdle();
+
+        // Called from the OpenSL buffer queue callback; mixes the next buffer.
+        void OnBufferDone(SLAndroidSimpleBufferQueueItf bq);
 };
 
 #endif
@@ -16,28 +16,17 @@
 #include "shape_renderer.hpp"
 #include "util.hpp"
 
-// geometry
-static GLfloat RECT_VERTICES[] = {
-    //  x      y     z      r     g     b     a
-    -0.5f, -0.5f, 0.0f,  1.0f, 1.0f, 1.0f, 1.0f,  // vertex 0
-     0.5f, -0.5f, 0.0f,  1.0f, 1.0f, 1.0f, 1.0f,  // vertex 1
-     0.5f,  0.5f, 0.0f,  1.0f, 1.0f, 1.0f, 1.0f,  // vertex 2
-    -0.5f,  0.5f, 0.0f,  1.0f, 1.0f, 1.0f, 1.0f   // vertex 3
-};
-
-// indices
-static GLushort RECT_INDICES[] = { 0, 1, 2, 0, 2, 3 };
+#define VERTEX_FLOATS 6
 
 ShapeRenderer::ShapeRenderer(TrivialShader *ts) {
     mTrivialShader = ts;
     mColor[0] = mColor[1] = mColor[2] = 1.0f;
     mGeom = NULL;
 
-    // create geometry
-    VertexBuf *vbuf = new VertexBuf(RECT_VERTICES, sizeof(RECT_VERTICES), 7 * sizeof(GLfloat));
+    // create geometry, filled in by Flush()
+    VertexBuf *vbuf = new VertexBuf(NULL, 0, VERTEX_FLOATS * sizeof(GLfloat));
     vbuf->SetColorsOffset(3 * sizeof(GLfloat));
-    IndexBuf *ibuf = new IndexBuf(RECT_INDICES, sizeof(RECT_INDICES));
-    mGeom = new SimpleGeom(vbuf, ibuf);
+    mGeom = new SimpleGeom(vbuf);
 }
 
 ShapeRenderer::~ShapeRenderer() {
@@ -46,13 +35,30 @@ ShapeRenderer::~ShapeRenderer() {
 }
 
 void ShapeRenderer::RenderRect(float centerX, float centerY, float width, float height) {
+    float left = centerX - 0.5f * width, right = centerX + 0.5f * width;
+    float bottom = centerY - 0.5f * height, top = centerY + 0.5f * height;
+    const GLfloat corners[4][2] = {
+        { left, bottom }, { right, bottom }, { right, top }, { left, top }
+    };
+    static const int RECT_INDICES[] = { 0, 1, 2, 0, 2, 3 };
+    for (int i = 0; i < 6; i++) {
+        const GLfloat *c = corners[RECT_INDICES[i]];
+        GLfloat vertex[VERTEX_FLOATS] = { c[0], c[1], 0.0f, mColor[0], mColor[1], mColor[2] };
+        mVertices.insert(mVertices.end(), vertex, vertex + VERTEX_FLOATS);
+    }
+}
+
+void ShapeRenderer::Flush() {
+    if (mVertices.empty()) {
+        return;
+    }
+    mGeom->vbuf->SetData(mVertices.data(), mVertices.size() * sizeof(GLfloat));
+    mVertices.clear();
+
     float aspect = SceneManager::GetInstance()->GetScreenAspect();
     glm::mat4 orthoMat = glm::ortho(0.0f, aspect, 0.0f, 1.0f);
-    glm::mat4 modelMat, mat;
-    modelMat = glm::translate(glm::mat4(1.0f), glm::vec3(centerX, centerY, 0.0f));
-    modelMat = glm::scale(modelMat, glm::vec3(width, height, 1.0f));
-    mat = orthoMat * modelMat;
-    mTrivialShader->SetTintColor(mColor[0], mColor[1], mColor[2]);
-    mTrivialShader->RenderSimpleGeom(&mat, mGeom);
-}
 
+    // the colors are in the vertices
+    mTrivialShader->SetTintColor(1.0f, 1.0f, 1.0f);
+    mTrivialShader->RenderSimpleGeom(&orthoMat, mGeom);
+}
@@ -16,17 +16,23 @@
 #ifndef endlesstunnel_shape_renderer_hpp
 #define endlesstunnel_shape_renderer_hpp
 
+#include <vector>
+
 #include "engine.hpp"
 
 /* Convenience class that renders shapes (currently, only rects). The
  * coordinate system is the "normalized 2D coordinate system" -- see
- * README for more info. */
+ * README for more info. Shapes are queued, and Flush draws all the shapes
+ * queued since the last Flush, in order, in one draw call. */
 class ShapeRenderer {
     private:
         TrivialShader *mTrivialShader;
         float mColor[3];
         SimpleGeom* mGeom;
 
+        // queued shapes, as triangles: x, y, z, r, g, b per vertex
+        std::vector<GLfloat> mVertices;
+
     public:
         ShapeRenderer(TrivialShader *trivialShader);
         ~ShapeRenderer();
@@ -40,6 +46,9 @@ class ShapeRenderer {
 
         // Render a rectangle
         void RenderRect(float centerX, float centerY, float width, float height);
+
+        // Draws the shapes queued since the last call.
+        void Flush();
 };
 
 #endif
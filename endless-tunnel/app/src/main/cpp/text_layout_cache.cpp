@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "text_layout_cache.hpp"
+
+#include <string.h>
+
+#include "glm/gtc/matrix_transform.hpp"
+
+// FNV-1a
+static unsigned _hash(const char *str) {
+    unsigned h = 2166136261u;
+    for (; *str; ++str) {
+        h = (h ^ (unsigned char) *str) * 16777619u;
+    }
+    return h;
+}
+
+static bool _same_item_data(float x1, float y1, float s1, const glm::mat4& m1, const float *c1,
+        float x2, float y2, float s2, const glm::mat4& m2, const float *c2) {
+    return x1 == x2 && y1 == y2 && s1 == s2 && m1 == m2 &&
+            c1[0] == c2[0] && c1[1] == c2[1] && c1[2] == c2[2];
+}
+
+TextLayoutCache::TextLayoutCache(const TextMetrics& metrics, int maxLayouts, int maxVertices) {
+    mMetrics = metrics;
+    memset(mGlyphFirst, 0, sizeof(mGlyphFirst));
+    memset(mGlyphCount, 0, sizeof(mGlyphCount));
+    mLiveLayouts = 0;
+    mMaxLayouts = maxLayouts;
+    mMaxVertices = maxVertices;
+    mNextSerial = 1;
+    memset(&mStats, 0, sizeof(mStats));
+}
+
+void TextLayoutCache::SetGlyph(int code, const glm::vec2 *lines, int count) {
+    if (code < 0 || code >= CHAR_CODES) {
+        return;
+    }
+    mGlyphFirst[code] = (int) mGlyphLines.size();
+    mGlyphCount[code] = count;
+    mGlyphLines.insert(mGlyphLines.end(), lines, lines + count);
+}
+
+int TextLayoutCache::Find(const char *str, unsigned hash) {
+    for (int i = 0; i < (int) mLayouts.size(); i++) {
+        const Layout& l = mLayouts[i];
+        if (l.serial && l.hash == hash && l.text == str) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void TextLayoutCache::Evict(unsigned olderThan) {
+    std::vector<glm::vec2> kept;
+    kept.reserve(mLayoutVertices.size());
+    for (int i = 0; i < (int) mLayouts.size(); i++) {
+        Layout& l = mLayouts[i];
+        if (!l.serial) {
+            continue;
+        }
+        if (l.lastUsed < olderThan) {
+            l.serial = 0;
+            l.text.clear();
+            mLiveLayouts--;
+            mStats.evictions++;
+        } else {
+            int first = (int) kept.size();
+            kept.insert(kept.end(), mLayoutVertices.begin() + l.first,
+                    mLayoutVertices.begin() + l.first + l.count);
+            l.first = first;
+        }
+    }
+    mLayoutVertices.swap(kept);
+}
+
+int TextLayoutCache::Insert(const char *str, unsigned hash) {
+    const char *p;
+    int cols = 0, rows = 1, curCols = 0, needed = 0;
+    for (p = str; *p; ++p) {
+        if (*p == '\n') {
+            ++rows;
+            curCols = 0;
+        } else {
+            cols = ++curCols > cols ? curCols : cols;
+            int code = (int) *p;
+            if (code >= 0 && code < CHAR_CODES) {
+                needed += mGlyphCount[code];
+            }
+        }
+    }
+
+    // make room: first drop what wasn't used this frame or the last one, then what wasn't
+    // used this frame. What this frame uses always stays, even past the limits.
+    unsigned frame = mStats.frames;
+    if (mLiveLayouts >= mMaxLayouts || (int) mLayoutVertices.size() + needed > mMaxVertices) {
+        Evict(frame > 0 ? frame - 1 : 0);
+    }
+    if (mLiveLayouts >= mMaxLayouts || (int) mLayoutVertices.size() + needed > mMaxVertices) {
+        Evict(frame);
+    }
+
+    int slot;
+    for (slot = 0; slot < (int) mLayouts.size() && mLayouts[slot].serial; slot++);
+    if (slot == (int) mLayouts.size()) {
+        mLayouts.push_back(Layout());
+    }
+    Layout& l = mLayouts[slot];
+    l.serial = mNextSerial++;
+    l.hash = hash;
+    l.text = str;
+    l.first = (int) mLayoutVertices.size();
+    l.count = needed;
+    l.lastUsed = frame;
+    mLiveLayouts++;
+
+    // same arrangement as TextRenderer always had: a block of rows centered on the origin,
+    // each row starting at the left of the block
+    const TextMetrics& m = mMetrics;
+    float width = cols * m.charWidth + (cols - 1) * m.charSpacing;
+    float height = rows * m.charHeight + (rows - 1) * m.lineSpacing;
+    float startX = -width * 0.5f + 0.5f * m.charWidth;
+    float x = startX;
+    float y = height * 0.5f - 0.5f * m.charHeight;
+    for (p = str; *p; ++p) {
+        if (*p == '\n') {
+            y -= m.charHeight + m.lineSpacing;
+            x = startX;
+        } else {
+            int code = (int) *p;
+            if (code >= 0 && code < CHAR_CODES) {
+                const glm::vec2 *g = &mGlyphLines[0] + mGlyphFirst[code];
+                for (int i = 0; i < mGlyphCount[code]; i++) {
+                    mLayoutVertices.push_back(glm::vec2(x + g[i].x, y + g[i].y));
+                }
+            }
+            x += m.charWidth + m.charSpacing;
+        }
+    }
+    return slot;
+}
+
+void TextLayoutCache::Add(const char *str, float centerX, float centerY, float fontScale,
+        const glm::mat4& mat, const float *color) {
+    unsigned hash = _hash(str);
+    int layout = Find(str, hash);
+    if (layout >= 0) {
+        mStats.hits++;
+        mLayouts[layout].lastUsed = mStats.frames;
+    } else {
+        mStats.misses++;
+        layout = Insert(str, hash);
+    }
+
+    Item item;
+    item.serial = mLayouts[layout].serial;
+    item.layout = layout;
+    item.x = centerX;
+    item.y = centerY;
+    item.scale = fontScale;
+    item.mat = mat;
+    item.color[0] = color[0], item.color[1] = color[1], item.color[2] = color[2];
+    mItems.push_back(item);
+}
+
+void TextLayoutCache::Compose() {
+    static const glm::mat4 IDENTITY(1.0f);
+    int total = 0;
+    for (int i = 0; i < (int) mItems.size(); i++) {
+        total += mLayouts[mItems[i].layout].count;
+    }
+    mVertices.resize(total * TEXT_VERTEX_FLOATS);
+
+    float *out = mVertices.empty() ? NULL : &mVertices[0];
+    for (int i = 0; i < (int) mItems.size(); i++) {
+        const Item& item = mItems[i];
+        const Layout& l = mLayouts[item.layout];
+        const glm::vec2 *u = l.count ? &mLayoutVertices[l.first] : NULL;
+        float s = item.scale;
+        float ox = item.x;
+        float oy = item.y + mMetrics.correctionY * s;
+        bool identity = item.mat == IDENTITY;
+        for (int v = 0; v < l.count; v++, out += TEXT_VERTEX_FLOATS) {
+            if (identity) {
+                out[0] = ox + s * u[v].x;
+                out[1] = oy + s * u[v].y;
+                out[2] = 0.0f;
+            } else {
+                glm::vec4 q = item.mat * glm::vec4(u[v].x, u[v].y, 0.0f, 1.0f);
+                out[0] = ox + s * q.x;
+                out[1] = oy + s * q.y;
+                out[2] = q.z;
+            }
+            out[3] = item.color[0];
+            out[4] = item.color[1];
+            out[5] = item.color[2];
+        }
+    }
+}
+
+bool TextLayoutCache::Finish() {
+    bool changed = mItems.size() != mLastItems.size();
+    for (int i = 0; !changed && i < (int) mItems.size(); i++) {
+        const Item& a = mItems[i];
+        const Item& b = mLastItems[i];
+        changed = a.serial != b.serial || !_same_item_data(a.x, a.y, a.scale, a.mat, a.color,
+                b.x, b.y, b.scale, b.mat, b.color);
+    }
+    if (changed) {
+        Compose();
+        mStats.composes++;
+    }
+    mLastItems.swap(mItems);
+    mItems.clear();
+    mStats.frames++;
+    return changed;
+}
+
+float TextLayoutCache::GetHitRate() const {
+    unsigned lookups = mStats.hits + mStats.misses;
+    return lookups ? (float) mStats.hits / lookups : 0.0f;
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef endlesstunnel_text_layout_cache_hpp
+#define endlesstunnel_text_layout_cache_hpp
+
+// No OpenGL in here, so the cache also builds and can be checked on a desktop host
+// (see src/test/cpp/text_layout_cache_test.cpp).
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+// Vertices the cache composes: x, y, z, r, g, b (what TrivialShader takes).
+#define TEXT_VERTEX_FLOATS 6
+
+// Size and spacing of the characters at font scale 1, in the normalized 2D coordinate system.
+struct TextMetrics {
+    float charWidth, charHeight;
+    float charSpacing, lineSpacing;
+    float correctionY; // added to the center Y of the text
+};
+
+/* Lays out the text a TextRenderer draws, and keeps the layouts from frame to frame.
+ *
+ * A layout is the glyph lines of a whole string, positioned at font scale 1 around the
+ * center of the text. Since positions are linear in the font scale, the layouts are
+ * keyed by string only, and the scale is applied when composing: text with a pulsing
+ * scale still hits the cache.
+ *
+ * Each frame, Add() queues strings to draw, and Finish() composes them all into one
+ * array of line vertices with their color baked in, so the frame's text is one draw.
+ * When a frame queues exactly what the last one did, Finish() leaves the vertices as
+ * they are, so text that doesn't change costs a lookup per string and no layout,
+ * composing or upload. */
+class TextLayoutCache {
+    public:
+        static const int CHAR_CODES = 128;
+
+        struct Stats {
+            unsigned hits;      // strings found laid out
+            unsigned misses;    // strings laid out
+            unsigned evictions; // layouts dropped to make room
+            unsigned composes;  // frames whose vertices had to be rebuilt
+            unsigned frames;
+        };
+
+    private:
+        struct Layout {
+            unsigned serial; // unique to this layout; 0 for a free slot
+            unsigned hash;
+            std::string text;
+            int first, count; // in mLayoutVertices
+            unsigned lastUsed; // frame
+        };
+
+        // one draw of a layout; a frame is a list of these
+        struct Item {
+            unsigned serial;
+            int layout;
+            float x, y, scale;
+            glm::mat4 mat;
+            float color[3];
+        };
+
+        TextMetrics mMetrics;
+
+        // lines of each glyph, as pairs of end points, at font scale 1
+        std::vector<glm::vec2> mGlyphLines;
+        int mGlyphFirst[CHAR_CODES];
+        int mGlyphCount[CHAR_CODES];
+
+        std::vector<Layout> mLayouts;
+        std::vector<glm::vec2> mLayoutVertices;
+        int mLiveLayouts;
+        int mMaxLayouts;
+        int mMaxVertices;
+        unsigned mNextSerial;
+
+        std::vector<Item> mItems;
+        std::vector<Item> mLastItems;
+        std::vector<float> mVertices;
+
+        Stats mStats;
+
+        int Find(const char *str, unsigned hash);
+        int Insert(const char *str, unsigned hash);
+        void Evict(unsigned olderThan);
+        void Compose();
+
+    public:
+        // Past maxLayouts laid out strings or maxVertices layout vertices, the layouts not
+        // used recently are dropped.
+        TextLayoutCache(const TextMetrics& metrics, int maxLayouts, int maxVertices);
+
+        // Sets the lines (pairs of end points, font scale 1, centered) of a character.
+        void SetGlyph(int code, const glm::vec2 *lines, int count);
+
+        // Queues str for this frame: centered on centerX, centerY, scaled by fontScale,
+        // with mat applied to the text about its center (see TextRenderer::SetMatrix).
+        void Add(const char *str, float centerX, float centerY, float fontScale,
+                const glm::mat4& mat, const float *color);
+
+        // Ends the frame. Returns true if the vertices changed since the last frame.
+        bool Finish();
+
+        // the vertices of the last finished frame (GL_LINES)
+        const float *GetVertices() const { return mVertices.empty() ? NULL : &mVertices[0]; }
+        int GetVertexCount() const { return (int) mVertices.size() / TEXT_VERTEX_FLOATS; }
+
+        const Stats& GetStats() const { return mStats; }
+        float GetHitRate() const;
+        int GetLayoutCount() const { return mLiveLayouts; }
+};
+
+#endif
@@ -26,28 +26,52 @@
 
 #define CORRECTION_Y -0.02f
 
-TextRenderer::TextRenderer(TrivialShader *t) {
+// how many strings (and their vertices) we keep laid out
+#define LAYOUT_CACHE_STRINGS 64
+#define LAYOUT_CACHE_VERTICES 16384
+
+static TextMetrics _text_metrics() {
+    TextMetrics m;
+    m.charWidth = ALPHABET_GLYPH_COLS * ALPHABET_SCALE;
+    m.charHeight = ALPHABET_GLYPH_ROWS * ALPHABET_SCALE;
+    m.charSpacing = CHAR_SPACING_F * m.charWidth;
+    m.lineSpacing = LINE_SPACING_F * m.charHeight;
+    m.correctionY = CORRECTION_Y;
+    return m;
+}
+
+TextRenderer::TextRenderer(TrivialShader *t) :
+        mLayoutCache(_text_metrics(), LAYOUT_CACHE_STRINGS, LAYOUT_CACHE_VERTICES) {
     mTrivialShader = t;
-    memset(mCharGeom, 0, sizeof(mCharGeom));
     mFontScale = 1.0f;
     mMatrix = glm::mat4(1.0f);
     mColor[0] = mColor[1] = mColor[2] = 1.0f;
 
     LOGD("Loading alphabet glyphs.");
+    std::vector<glm::vec2> lines;
     int i;
-    for (i = 0; i < CHAR_CODES; ++i) {
+    for (i = 0; i < TextLayoutCache::CHAR_CODES; ++i) {
         if (ALPHABET_ART[i]) {
             LOGD("Creating glyph for chr %d.", i);
-            mCharGeom[i] = AsciiArtToGeom(ALPHABET_ART[i], ALPHABET_SCALE);
+            lines.clear();
+            AsciiArtToLines(ALPHABET_ART[i], ALPHABET_SCALE, &lines);
+            mLayoutCache.SetGlyph(i, lines.data(), (int) lines.size());
         }
     }
+
+    // the frame's text, rebuilt when it changes
+    VertexBuf *vbuf = new VertexBuf(NULL, 0, TEXT_VERTEX_FLOATS * sizeof(GLfloat));
+    vbuf->SetColorsOffset(3 * sizeof(GLfloat));
+    vbuf->SetPrimitive(GL_LINES);
+    mGeom = new SimpleGeom(vbuf);
 }
 
 TextRenderer::~TextRenderer() {
-    int i;
-    for (i = 0; i < CHAR_CODES; i++) {
-        CleanUp(&mCharGeom[i]);
-    }
+    const TextLayoutCache::Stats& s = mLayoutCache.GetStats();
+    LOGD("TextRenderer: layout cache %u hits, %u misses (%.1f%% hits), %u evictions, "
+            "%u of %u frames rebuilt.", s.hits, s.misses, 100.0f * mLayoutCache.GetHitRate(),
+            s.evictions, s.composes, s.frames);
+    CleanUp(&mGeom);
 }
 
 TextRenderer* TextRenderer::SetFontScale(float scale) {
@@ -91,52 +115,34 @@ void TextRenderer::MeasureText(const char *str, float fontScale, float *outWidth
 }
 
 TextRenderer* TextRenderer::RenderText(const char *str, float centerX, float centerY) {
+    mLayoutCache.Add(str, centerX, centerY, mFontScale, mMatrix, mColor);
+    return this;
+}
+
+void TextRenderer::Flush() {
+    if (mLayoutCache.Finish()) {
+        mGeom->vbuf->SetData(mLayoutCache.GetVertices(),
+                mLayoutCache.GetVertexCount() * TEXT_VERTEX_FLOATS * sizeof(GLfloat));
+    }
+    if (mLayoutCache.GetVertexCount() == 0) {
+        return;
+    }
+
     float aspect = SceneManager::GetInstance()->GetScreenAspect();
     glm::mat4 orthoMat = glm::ortho(0.0f, aspect, 0.0f, 1.0f);
-    glm::mat4 modelMat, mat, scaleMat;
-    int cols, rows;
     bool hadDepthTest;
 
-    centerY += CORRECTION_Y * mFontScale;
-
     glLineWidth(TEXT_LINE_WIDTH);
 
     hadDepthTest = glIsEnabled(GL_DEPTH_TEST);
     glDisable(GL_DEPTH_TEST);
 
-    mTrivialShader->SetTintColor(mColor[0], mColor[1], mColor[2]);
-
-    _count_rows_cols(str, &cols, &rows);
-    scaleMat = glm::scale(glm::mat4(1.0f), glm::vec3(mFontScale, mFontScale, 1.0f));
-    float charWidth = ALPHABET_GLYPH_COLS * ALPHABET_SCALE * mFontScale;
-    float charHeight = ALPHABET_GLYPH_ROWS * ALPHABET_SCALE * mFontScale;
-    float charSpacing = CHAR_SPACING_F * charWidth;
-    float lineSpacing = LINE_SPACING_F * charHeight;
-    float width = cols * charWidth + (cols - 1) * charSpacing;
-    float height = rows * charHeight + (rows - 1) * lineSpacing;
-    float startX = centerX - width * 0.5f + 0.5f * charWidth;
-    float startY = centerY + height * 0.5f - 0.5f * charHeight;
-    float y = startY;
-
-    modelMat = glm::translate(glm::mat4(1.0f), glm::vec3(startX, startY, 0.0f));
-    for (; *str; ++str) {
-        if (*str == '\n') {
-            y -= charHeight + lineSpacing;
-            modelMat = glm::translate(glm::mat4(1.0f), glm::vec3(startX, y, 0.0f));
-        } else {
-            int code = (int) *str;
-            if (code >= 0 && code < CHAR_CODES && mCharGeom[code]) {
-                mat = orthoMat * modelMat * scaleMat * mMatrix;
-                mTrivialShader->RenderSimpleGeom(&mat, mCharGeom[code]);
-            }
-            modelMat = glm::translate(modelMat, glm::vec3(charWidth + charSpacing, 0.0f, 0.0f));
-        }
-    }
+    // the colors are in the vertices
+    mTrivialShader->SetTintColor(1.0f, 1.0f, 1.0f);
+    mTrivialShader->RenderSimpleGeom(&orthoMat, mGeom);
 
     glLineWidth(1);
     if (hadDepthTest) {
         glEnable(GL_DEPTH_TEST);
     }
-    return this;
 }
-
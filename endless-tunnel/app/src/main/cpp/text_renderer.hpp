@@ -17,13 +17,16 @@
 #define endlesstunnel_text_renderer_hpp
 
 #include "engine.hpp"
+#include "text_layout_cache.hpp"
 
 /* Renders text to the screen. Uses the "normalized 2D coordinate system" as
- * described in the README. */
+ * described in the README. RenderText only queues the text; Flush draws all the
+ * text queued since the last Flush, in one draw call. The layouts of the strings
+ * are cached from frame to frame (see TextLayoutCache). */
 class TextRenderer {
     private:
-        static const int CHAR_CODES = 128;
-        SimpleGeom* mCharGeom[CHAR_CODES];
+        TextLayoutCache mLayoutCache;
+        SimpleGeom* mGeom; // the composed text
         TrivialShader *mTrivialShader;
 
         float mFontScale;
@@ -34,9 +37,21 @@ class TextRenderer {
         TextRenderer(TrivialShader *t);
         ~TextRenderer();
 
+        // The matrix applies to the text as a whole, about its center (for a single line
+        // of text, the same as applying it to each character).
         TextRenderer* SetMatrix(glm::mat4 mat);
         TextRenderer* SetFontScale(float size);
         TextRenderer* RenderText(const char *str, float centerX, float centerY);
+
+        // Draws the text queued since the last call.
+        void Flush();
+
+        const TextLayoutCache::Stats& GetCacheStats() const {
+            return mLayoutCache.GetStats();
+        }
+        float GetCacheHitRate() const {
+            return mLayoutCache.GetHitRate();
+        }
         void SetColor(float r, float g, float b) {
             mColor[0] = r, mColor[1] = g, mColor[2] = b;
         }
@@ -124,6 +124,8 @@ void UiScene::DoFrame() {
         mTextRenderer->SetFontScale(WAIT_SIGN_SCALE);
         mTextRenderer->SetColor(1.0f, 1.0f, 1.0f);
         mTextRenderer->RenderText(S_PLEASE_WAIT, mgr->GetScreenAspect() * 0.5f, 0.5f);
+        mShapeRenderer->Flush();
+        mTextRenderer->Flush();
         glEnable(GL_DEPTH_TEST);
         return;
     }
@@ -145,6 +147,11 @@ void UiScene::DoFrame() {
                 (mFocusWidget == i) ? UiWidget::FOCUS_YES : UiWidget::FOCUS_NO, tf);
     }
 
+    // draw what the background and the widgets queued: shapes first, then text (widgets
+    // put their text over their shapes, and don't overlap each other)
+    mShapeRenderer->Flush();
+    mTextRenderer->Flush();
+
     glEnable(GL_DEPTH_TEST);
 }
 
@@ -31,6 +31,16 @@ VertexBuf::VertexBuf(GLfloat *geomData, int dataSize, int stride) {
     UnbindBuffer();
 }
 
+void VertexBuf::SetData(const GLfloat *geomData, int dataSize) {
+    MY_ASSERT(dataSize % mStride == 0);
+    mCount = dataSize / mStride;
+
+    // a new data store, so we don't wait on draws still reading the old one
+    BindBuffer();
+    glBufferData(GL_ARRAY_BUFFER, dataSize, geomData, GL_DYNAMIC_DRAW);
+    UnbindBuffer();
+}
+
 void VertexBuf::BindBuffer() {
     glBindBuffer(GL_ARRAY_BUFFER, mVbo);
 }
@@ -32,6 +32,9 @@ class VertexBuf {
         VertexBuf(GLfloat *geomData, int dataSize, int stride);
         ~VertexBuf();
 
+        // Replaces the contents (for geometry rebuilt at run time).
+        void SetData(const GLfloat *geomData, int dataSize);
+
         void BindBuffer();
         void UnbindBuffer();
 
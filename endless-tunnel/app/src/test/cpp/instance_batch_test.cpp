@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks InstanceBatch against a recording backend, and times a worst case frame. Host
+// only, not part of the app build: see CMakeLists.txt in this directory.
+#include <stdio.h>
+#include <string.h>
+
+#include "glm/gtc/matrix_transform.hpp"
+#include "instance_batch.hpp"
+#include "self_test.hpp"
+
+/* A backend that draws nothing, but keeps a copy of the last frame and counts the
+ * draws, so what a batch submits can be checked without a GPU. */
+class RecordingBatchBackend : public InstanceBatchBackend {
+    public:
+        struct Draw {
+            Texture *texture;
+            int first;
+            int count;
+        };
+
+    private:
+        glm::mat4 mViewProjMat;
+        std::vector<BatchInstance> mInstances;
+        std::vector<Draw> mDraws;
+        bool mInFrame;
+        int mErrorCount;
+        int mFrameCount;
+        int mTotalDraws;
+        int mTotalInstances;
+
+    public:
+        RecordingBatchBackend();
+
+        virtual void BeginFrame(const glm::mat4& viewProjMat, const BatchInstance *instances,
+                int count);
+        virtual void DrawInstances(Texture *texture, int first, int count);
+        virtual void EndFrame();
+
+        // the last frame
+        const glm::mat4& GetViewProjMat() const { return mViewProjMat; }
+        const std::vector<BatchInstance>& GetInstances() const { return mInstances; }
+        const std::vector<Draw>& GetDraws() const { return mDraws; }
+
+        // totals since construction
+        int GetFrameCount() const { return mFrameCount; }
+        int GetTotalDraws() const { return mTotalDraws; }
+        int GetTotalInstances() const { return mTotalInstances; }
+
+        // calls out of order, or draws outside of the instance buffer
+        int GetErrorCount() const { return mErrorCount; }
+};
+
+RecordingBatchBackend::RecordingBatchBackend() {
+    mViewProjMat = glm::mat4(1.0f);
+    mInFrame = false;
+    mErrorCount = 0;
+    mFrameCount = 0;
+    mTotalDraws = 0;
+    mTotalInstances = 0;
+}
+
+void RecordingBatchBackend::BeginFrame(const glm::mat4& viewProjMat,
+        const BatchInstance *instances, int count) {
+    if (mInFrame || count < 0) {
+        mErrorCount++;
+    }
+    mInFrame = true;
+    mViewProjMat = viewProjMat;
+    mInstances.assign(instances, instances + (count > 0 ? count : 0));
+    mDraws.clear();
+}
+
+void RecordingBatchBackend::DrawInstances(Texture *texture, int first, int count) {
+    if (!mInFrame || first < 0 || count <= 0 || first + count > (int) mInstances.size()) {
+        mErrorCount++;
+    }
+    Draw draw;
+    draw.texture = texture;
+    draw.first = first;
+    draw.count = count;
+    mDraws.push_back(draw);
+    mTotalDraws++;
+    mTotalInstances += count;
+}
+
+void RecordingBatchBackend::EndFrame() {
+    if (!mInFrame) {
+        mErrorCount++;
+    }
+    mInFrame = false;
+    mFrameCount++;
+}
+
+// Textures are only keys to the batch, so any distinct addresses will do.
+
+static bool _same_instance(const BatchInstance& a, const glm::mat4& modelMat,
+        const glm::vec4& tint) {
+    return memcmp(&a.modelMat, &modelMat, sizeof(modelMat)) == 0 &&
+            memcmp(&a.tint, &tint, sizeof(tint)) == 0;
+}
+
+static glm::mat4 _box_mat(int i) {
+    glm::mat4 m = glm::translate(glm::mat4(1.0f), glm::vec3(i % 5, i / 5 % 5, i / 25 * 10));
+    return glm::scale(m, glm::vec3(1.0f + i % 3, 1.0f, 1.0f));
+}
+
+static glm::vec4 _box_tint(int i) {
+    return glm::vec4(i & 1, (i >> 1) & 1, (i >> 2) & 1, 1.0f);
+}
+
+static bool InstanceBatchSelfTest(char *report, size_t reportSize) {
+    SelfTestReport r(report, reportSize);
+
+    char textures[3];
+    Texture *texA = reinterpret_cast<Texture*>(&textures[0]);
+    Texture *texB = reinterpret_cast<Texture*>(&textures[1]);
+    Texture *texC = reinterpret_cast<Texture*>(&textures[2]);
+    glm::mat4 viewProjMat = glm::perspective(1.0f, 1.5f, 1.0f, 100.0f);
+
+    InstanceBatch batch;
+    RecordingBatchBackend rec;
+
+    // an empty batch doesn't reach the backend
+    r.Check(batch.Submit(&rec, viewProjMat) == 0, "empty batch makes no draws");
+    r.Check(rec.GetFrameCount() == 0, "empty batch makes no frame");
+
+    // interleaved textures: one draw per texture, in first-added order, instances of a
+    // texture in added order
+    static const int ORDER[] = { 0, 0, 1, 0, 2, 1, 1, 0, 2, 0 };
+    static const int ORDER_COUNT = sizeof(ORDER) / sizeof(ORDER[0]);
+    Texture *texOf[] = { texA, texB, texC };
+    for (int i = 0; i < ORDER_COUNT; i++) {
+        batch.Add(texOf[ORDER[i]], _box_mat(i), _box_tint(i));
+    }
+    r.Check(batch.GetInstanceCount() == ORDER_COUNT, "instance count");
+    r.Check(batch.GetTextureCount() == 3, "texture count");
+    r.Check(batch.Submit(&rec, viewProjMat) == 3, "one draw per texture");
+    r.Check(batch.GetInstanceCount() == 0 && batch.GetTextureCount() == 0,
+            "submit empties the batch");
+    r.Check(memcmp(&rec.GetViewProjMat(), &viewProjMat, sizeof(viewProjMat)) == 0,
+            "view-projection matrix passed through");
+    r.Check((int) rec.GetInstances().size() == ORDER_COUNT, "instance buffer size");
+    r.Check(rec.GetDraws().size() == 3, "recorded draws");
+    if (rec.GetDraws().size() == 3 && (int) rec.GetInstances().size() == ORDER_COUNT) {
+        int first = 0;
+        for (int t = 0; t < 3; t++) {
+            const RecordingBatchBackend::Draw& draw = rec.GetDraws()[t];
+            r.Check(draw.texture == texOf[t], "draw order follows first use");
+            r.Check(draw.first == first, "draws cover the buffer in order");
+            int k = draw.first;
+            for (int i = 0; i < ORDER_COUNT; i++) {
+                if (ORDER[i] == t) {
+                    r.Check(k < draw.first + draw.count &&
+                            _same_instance(rec.GetInstances()[k], _box_mat(i), _box_tint(i)),
+                            "instances of a texture keep their order");
+                    k++;
+                }
+            }
+            r.Check(k == draw.first + draw.count, "draw count matches instances");
+            first += draw.count;
+        }
+    }
+
+    // a cleared batch draws nothing, and the next frame starts afresh
+    batch.Add(texA, _box_mat(0), _box_tint(0));
+    batch.Clear();
+    r.Check(batch.Submit(&rec, viewProjMat) == 0, "cleared batch makes no draws");
+    batch.Add(texC, _box_mat(1), _box_tint(1));
+    r.Check(batch.Submit(&rec, viewProjMat) == 1, "single texture frame");
+    r.Check(rec.GetDraws().size() == 1 && rec.GetDraws()[0].texture == texC &&
+            rec.GetDraws()[0].first == 0 && rec.GetDraws()[0].count == 1,
+            "bucket reused for another texture");
+
+    // a frame the size of the game's worst case: every cell of every obstacle on screen,
+    // one texture. The per-box path made a draw call per instance.
+    static const int OBSTACLES = 32, CELLS = 25, FRAMES = 200;
+    int instancesPerFrame = OBSTACLES * CELLS;
+    int draws = 0;
+    double start = SelfTestNowUs();
+    for (int f = 0; f < FRAMES; f++) {
+        for (int i = 0; i < instancesPerFrame; i++) {
+            batch.Add(texA, _box_mat(i), _box_tint(i + f));
+        }
+        draws += batch.Submit(&rec, viewProjMat);
+    }
+    double usPerFrame = (SelfTestNowUs() - start) / FRAMES;
+    r.Check(draws == FRAMES, "one draw per frame for one texture");
+    r.Check((int) rec.GetInstances().size() == instancesPerFrame &&
+            _same_instance(rec.GetInstances()[instancesPerFrame - 1],
+            _box_mat(instancesPerFrame - 1), _box_tint(instancesPerFrame - 1 + FRAMES - 1)),
+            "last frame recorded");
+
+    r.Check(rec.GetErrorCount() == 0, "backend calls in order and in range");
+    r.Report("%d instances/frame: %d draw/frame (was %d), %.1f us/frame to batch\n",
+            instancesPerFrame, draws / FRAMES, instancesPerFrame, usPerFrame);
+    r.Report("%d frames, %d draws, %d instances recorded: %s\n", rec.GetFrameCount(),
+            rec.GetTotalDraws(), rec.GetTotalInstances(), r.IsOk() ? "OK" : "FAILED");
+    return r.IsOk();
+}
+
+int main() {
+    char report[2048];
+    bool ok = InstanceBatchSelfTest(report, sizeof(report));
+    fputs(report, stdout);
+    return ok ? 0 : 1;
+}
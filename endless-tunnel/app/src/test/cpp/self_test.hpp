@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef endlesstunnel_self_test_hpp
+#define endlesstunnel_self_test_hpp
+
+// Scaffolding of the host checks in this directory (InstanceBatchSelfTest,
+// TextLayoutCacheSelfTest). No OpenGL or Android in here.
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+
+/* The report of a self-check, written into a caller's buffer (truncated if it doesn't
+ * fit), and whether all of its checks passed. */
+class SelfTestReport {
+    private:
+        char *mBuf;
+        size_t mSize;
+        size_t mLen;
+        bool mOk;
+
+    public:
+        SelfTestReport(char *buf, size_t size) : mBuf(buf), mSize(size), mLen(0), mOk(true) {
+            if (size > 0) {
+                buf[0] = '\0';
+            }
+        }
+
+        // Appends to the report, printf style.
+        void Report(const char *fmt, ...) {
+            if (mLen >= mSize) {
+                return;
+            }
+            va_list ap;
+            va_start(ap, fmt);
+            int n = vsnprintf(mBuf + mLen, mSize - mLen, fmt, ap);
+            va_end(ap);
+            if (n > 0) {
+                mLen += (size_t) n;
+            }
+        }
+
+        // Fails the self-check, and reports what failed, unless cond holds.
+        void Check(bool cond, const char *what) {
+            if (!cond) {
+                mOk = false;
+                Report("FAILED: %s\n", what);
+            }
+        }
+
+        bool IsOk() const { return mOk; }
+};
+
+// Monotonic time in microseconds, to time the self-checks.
+inline double SelfTestNowUs() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e6 + t.tv_nsec / 1e3;
+}
+
+#endif
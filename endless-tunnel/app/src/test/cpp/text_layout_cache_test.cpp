@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks the cache's vertices against the glyph by glyph layout TextRenderer used to do,
+// and its hits, misses and evictions, and times steady and recomposed frames. Host only,
+// not part of the app build: see CMakeLists.txt in this directory.
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "glm/gtc/matrix_transform.hpp"
+#include "self_test.hpp"
+#include "text_layout_cache.hpp"
+
+// Made up glyphs: the layout TextRenderer::RenderText used to do glyph by
+// glyph (T(char position) * S(font scale) * matrix * glyph) is the reference.
+
+static const TextMetrics TEST_METRICS = { 0.05f, 0.09f, 0.005f, 0.009f, -0.02f };
+
+static void _test_glyph(int code, std::vector<glm::vec2> *lines) {
+    // a box with a diagonal that depends on the code, and one more line for odd codes
+    float w = TEST_METRICS.charWidth * 0.5f, h = TEST_METRICS.charHeight * 0.5f;
+    float d = ((code % 7) - 3) * 0.1f * w;
+    lines->clear();
+    lines->push_back(glm::vec2(-w, -h)); lines->push_back(glm::vec2(w, -h));
+    lines->push_back(glm::vec2(w, -h)); lines->push_back(glm::vec2(w, h));
+    lines->push_back(glm::vec2(-w + d, h)); lines->push_back(glm::vec2(w, -h + d));
+    if (code & 1) {
+        lines->push_back(glm::vec2(d, 0.0f)); lines->push_back(glm::vec2(-w, h));
+    }
+}
+
+static void _reference_layout(const char *str, float centerX, float centerY, float fontScale,
+        const glm::mat4& mat, const float *color, std::vector<float> *out) {
+    std::vector<glm::vec2> lines;
+    int cols = 0, rows = 1, curCols = 0;
+    for (const char *p = str; *p; ++p) {
+        if (*p == '\n') {
+            ++rows;
+            curCols = 0;
+        } else if (++curCols > cols) {
+            cols = curCols;
+        }
+    }
+    centerY += TEST_METRICS.correctionY * fontScale;
+    glm::mat4 scaleMat = glm::scale(glm::mat4(1.0f), glm::vec3(fontScale, fontScale, 1.0f));
+    float charWidth = TEST_METRICS.charWidth * fontScale;
+    float charHeight = TEST_METRICS.charHeight * fontScale;
+    float charSpacing = TEST_METRICS.charSpacing * fontScale;
+    float lineSpacing = TEST_METRICS.lineSpacing * fontScale;
+    float width = cols * charWidth + (cols - 1) * charSpacing;
+    float height = rows * charHeight + (rows - 1) * lineSpacing;
+    float startX = centerX - width * 0.5f + 0.5f * charWidth;
+    float startY = centerY + height * 0.5f - 0.5f * charHeight;
+    float y = startY;
+    glm::mat4 modelMat = glm::translate(glm::mat4(1.0f), glm::vec3(startX, startY, 0.0f));
+    for (const char *p = str; *p; ++p) {
+        if (*p == '\n') {
+            y -= charHeight + lineSpacing;
+            modelMat = glm::translate(glm::mat4(1.0f), glm::vec3(startX, y, 0.0f));
+        } else {
+            if (*p != ' ') {
+                _test_glyph(*p, &lines);
+                glm::mat4 m = modelMat * scaleMat * mat;
+                for (size_t i = 0; i < lines.size(); i++) {
+                    glm::vec4 v = m * glm::vec4(lines[i].x, lines[i].y, 0.0f, 1.0f);
+                    float vertex[TEXT_VERTEX_FLOATS] = { v.x, v.y, v.z,
+                            color[0], color[1], color[2] };
+                    out->insert(out->end(), vertex, vertex + TEXT_VERTEX_FLOATS);
+                }
+            }
+            modelMat = glm::translate(modelMat, glm::vec3(charWidth + charSpacing, 0.0f, 0.0f));
+        }
+    }
+}
+
+static bool _same_vertices(const TextLayoutCache& cache, const std::vector<float>& ref) {
+    if (cache.GetVertexCount() * TEXT_VERTEX_FLOATS != (int) ref.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < ref.size(); i++) {
+        if (fabsf(cache.GetVertices()[i] - ref[i]) > 1e-5f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool TextLayoutCacheSelfTest(char *report, size_t reportSize) {
+    SelfTestReport r(report, reportSize);
+
+    TextLayoutCache cache(TEST_METRICS, 8, 4096);
+    std::vector<glm::vec2> lines;
+    for (int code = 33; code < TextLayoutCache::CHAR_CODES; code++) {
+        _test_glyph(code, &lines);
+        cache.SetGlyph(code, &lines[0], (int) lines.size());
+    }
+
+    static const float WHITE[] = { 1.0f, 1.0f, 1.0f };
+    static const float YELLOW[] = { 1.0f, 1.0f, 0.0f };
+    glm::mat4 identity(1.0f);
+    glm::mat4 squash = glm::scale(identity, glm::vec3(1.0f, 0.4f, 1.0f));
+    std::vector<float> ref;
+
+    // a HUD-like frame: a score, a multi-line text and a sign being animated
+    cache.Add("01234", 0.2f, 0.9f, 2.0f, identity, WHITE);
+    cache.Add("Start from\ncheckpoint", 0.8f, 0.5f, 1.3f, identity, YELLOW);
+    cache.Add("Game Over", 0.8f, 0.5f, 3.0f, squash, WHITE);
+    r.Check(cache.Finish(), "first frame is composed");
+    _reference_layout("01234", 0.2f, 0.9f, 2.0f, identity, WHITE, &ref);
+    _reference_layout("Start from\ncheckpoint", 0.8f, 0.5f, 1.3f, identity, YELLOW, &ref);
+    _reference_layout("Game Over", 0.8f, 0.5f, 3.0f, squash, WHITE, &ref);
+    r.Check(_same_vertices(cache, ref), "vertices match the glyph by glyph layout");
+    r.Check(cache.GetStats().misses == 3 && cache.GetStats().hits == 0, "3 misses");
+
+    // the same frame again: no composing, vertices unchanged
+    cache.Add("01234", 0.2f, 0.9f, 2.0f, identity, WHITE);
+    cache.Add("Start from\ncheckpoint", 0.8f, 0.5f, 1.3f, identity, YELLOW);
+    cache.Add("Game Over", 0.8f, 0.5f, 3.0f, squash, WHITE);
+    r.Check(!cache.Finish(), "unchanged frame isn't composed");
+    r.Check(_same_vertices(cache, ref), "unchanged frame keeps its vertices");
+    r.Check(cache.GetStats().hits == 3 && cache.GetStats().misses == 3, "3 hits");
+
+    // a pulsing scale and another color hit the cache, but recompose
+    ref.clear();
+    cache.Add("01234", 0.2f, 0.9f, 2.5f, identity, YELLOW);
+    r.Check(cache.Finish(), "changed frame is composed");
+    _reference_layout("01234", 0.2f, 0.9f, 2.5f, identity, YELLOW, &ref);
+    r.Check(_same_vertices(cache, ref), "rescaled and recolored text");
+    r.Check(cache.GetStats().misses == 3, "new scale hits the cache");
+
+    // an empty frame, then strings without glyphs
+    r.Check(cache.Finish() && cache.GetVertexCount() == 0, "empty frame");
+    r.Check(!cache.Finish(), "second empty frame unchanged");
+    cache.Add("", 0.5f, 0.5f, 1.0f, identity, WHITE);
+    cache.Add("   \n ", 0.5f, 0.5f, 1.0f, identity, WHITE);
+    cache.Finish();
+    r.Check(cache.GetVertexCount() == 0, "no glyphs, no vertices");
+
+    // a score that changes every frame: the layouts of old scores get evicted, the cache
+    // stays within its limits, and what a frame uses is still right
+    char score[8];
+    bool allRight = true;
+    for (int f = 0; f < 100; f++) {
+        snprintf(score, sizeof(score), "%05d", f * 37);
+        cache.Add("Ouch", 0.5f, 0.5f, 2.0f, identity, WHITE);
+        cache.Add(score, 0.2f, 0.9f, 2.0f, identity, WHITE);
+        cache.Finish();
+        ref.clear();
+        _reference_layout("Ouch", 0.5f, 0.5f, 2.0f, identity, WHITE, &ref);
+        _reference_layout(score, 0.2f, 0.9f, 2.0f, identity, WHITE, &ref);
+        allRight = allRight && _same_vertices(cache, ref);
+    }
+    r.Check(allRight, "vertices right while evicting");
+    r.Check(cache.GetLayoutCount() <= 8, "layout limit");
+    r.Check(cache.GetStats().evictions > 0, "old scores evicted");
+
+    // more strings in a frame than the cache holds: they all stay until the frame is done
+    ref.clear();
+    for (int i = 0; i < 12; i++) {
+        snprintf(score, sizeof(score), "x%d", i);
+        cache.Add(score, 0.1f * i, 0.5f, 1.0f, identity, WHITE);
+        _reference_layout(score, 0.1f * i, 0.5f, 1.0f, identity, WHITE, &ref);
+    }
+    cache.Finish();
+    r.Check(_same_vertices(cache, ref), "oversized frame");
+
+    // cost of a steady HUD frame, and of one that has to be composed
+    static const int FRAMES = 10000;
+    double start = SelfTestNowUs();
+    for (int f = 0; f < FRAMES; f++) {
+        cache.Add("01234", 0.2f, 0.9f, 2.0f, identity, WHITE);
+        cache.Add("Checkpoint saved", 0.8f, 0.5f, 3.0f, identity, WHITE);
+        cache.Finish();
+    }
+    double steadyUs = (SelfTestNowUs() - start) / FRAMES;
+    start = SelfTestNowUs();
+    for (int f = 0; f < FRAMES; f++) {
+        cache.Add("01234", 0.2f, 0.9f, 2.0f, identity, WHITE);
+        cache.Add("Checkpoint saved", 0.8f, 0.5f, 3.0f, f & 1 ? squash : identity, WHITE);
+        cache.Finish();
+    }
+    double composeUs = (SelfTestNowUs() - start) / FRAMES;
+
+    const TextLayoutCache::Stats& s = cache.GetStats();
+    r.Report("steady frame %.2f us, recomposed frame %.2f us (%d vertices, 1 draw)\n",
+            steadyUs, composeUs, cache.GetVertexCount());
+    r.Report("%u hits, %u misses (%.1f%% hits), %u evictions, %u/%u frames composed: %s\n",
+            s.hits, s.misses, 100.0f * cache.GetHitRate(), s.evictions, s.composes, s.frames,
+            r.IsOk() ? "OK" : "FAILED");
+    return r.IsOk();
+}
+
+int main() {
+    char report[2048];
+    bool ok = TextLayoutCacheSelfTest(report, sizeof(report));
+    fputs(report, stdout);
+    return ok ? 0 : 1;
+}
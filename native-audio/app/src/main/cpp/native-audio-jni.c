@@ -40,6 +40,9 @@
 #include <android/asset_manager.h>
 #include <android/asset_manager_jni.h>
 
+#include "audio_convert.h"
+#include "stream_recorder.h"
+
 // pre-recorded sound clips, both are 8 kHz mono 16-bit signed little endian
 static const char hello[] =
 #include "hello_clip.h"
@@ -139,7 +142,6 @@ void releaseResampleBuf(void) {
  */
 short* createResampledBuf(uint32_t idx, uint32_t srcRate, unsigned *size) {
     short  *src = NULL;
-    short  *workBuf;
     int    upSampleRate;
     int32_t srcSampleCount = 0;
 
@@ -182,12 +184,7 @@ short* createResampledBuf(uint32_t idx, uint32_t srcRate, unsigned *size) {
     if(resampleBuf == NULL) {
         return resampleBuf;
     }
-    workBuf = resampleBuf;
-    for(int sample=0; sample < srcSampleCount; sample++) {
-        for(int dup = 0; dup  < upSampleRate; dup++) {
-            *workBuf++ = src[sample];
-        }
-    }
+    upsampleI16Hold(src, resampleBuf, srcSampleCount, upSampleRate);
 
     *size = (srcSampleCount * upSampleRate) << 1;     // sample format is 16 bit
     return resampleBuf;
@@ -221,8 +218,12 @@ void bqRecorderCallback(SLAndroidSimpleBufferQueueItf bq, void *context)
 {
     assert(bq == recorderBufferQueue);
     assert(NULL == context);
-    // for streaming recording, here we would call Enqueue to give recorder the next buffer to fill
-    // but instead, this is a one-time buffer so we stop recording
+    if (streamRecorderIsActive()) {
+        // streaming recording: hand the full buffer to the writer, enqueue the next one
+        streamRecorderOnBufferFull(bq);
+        return;
+    }
+    // this is a one-time buffer so we stop recording
     SLresult result;
     result = (*recorderRecord)->SetRecordState(recorderRecord, SL_RECORDSTATE_STOPPED);
     if (SL_RESULT_SUCCESS == result) {
@@ -661,10 +662,7 @@ jboolean Java_com_example_nativeaudio_NativeAudio_selectClip(JNIEnv* env, jclass
         nextBuffer = createResampledBuf(4, SL_SAMPLINGRATE_16, &nextSize);
         // we recorded at 16 kHz, but are playing buffers at 8 Khz, so do a primitive down-sample
         if(!nextBuffer) {
-            unsigned i;
-            for (i = 0; i < recorderSize; i += 2 * sizeof(short)) {
-                recorderBuffer[i >> 2] = recorderBuffer[i >> 1];
-            }
+            decimateI16(recorderBuffer, recorderBuffer, recorderSize / sizeof(short), 2);
             recorderSize >>= 1;
             nextBuffer = recorderBuffer;
             nextSize = recorderSize;
@@ -880,9 +878,50 @@ void Java_com_example_nativeaudio_NativeAudio_startRecording(JNIEnv* env, jclass
 }
 
 
+// record to a WAV file for as long as streaming is on, using constant memory
+jboolean Java_com_example_nativeaudio_NativeAudio_startStreamingRecording(JNIEnv* env,
+        jclass clazz, jstring path)
+{
+    if (NULL == recorderRecord || pthread_mutex_trylock(&audioEngineLock)) {
+        return JNI_FALSE;
+    }
+
+    const char *utf8 = (*env)->GetStringUTFChars(env, path, NULL);
+    assert(NULL != utf8);
+    SLboolean started = streamRecorderStart(recorderRecord, recorderBufferQueue, utf8);
+    (*env)->ReleaseStringUTFChars(env, path, utf8);
+
+    if (!started) {
+        pthread_mutex_unlock(&audioEngineLock);
+        return JNI_FALSE;
+    }
+    return JNI_TRUE;
+}
+
+
+// stop streaming recording and finalize the file; returns the number of
+// recorder buffers lost because the writer could not keep up
+jint Java_com_example_nativeaudio_NativeAudio_stopStreamingRecording(JNIEnv* env, jclass clazz)
+{
+    StreamRecorderStats stats;
+
+    if (!streamRecorderIsActive()) {
+        return 0;
+    }
+    streamRecorderStop(recorderRecord, recorderBufferQueue);
+    streamRecorderGetStats(&stats);
+    pthread_mutex_unlock(&audioEngineLock);
+    return (jint)stats.overruns;
+}
+
+
 // shut down the native audio system
 void Java_com_example_nativeaudio_NativeAudio_shutdown(JNIEnv* env, jclass clazz)
 {
+    if (streamRecorderIsActive()) {
+        streamRecorderStop(recorderRecord, recorderBufferQueue);
+        pthread_mutex_unlock(&audioEngineLock);
+    }
 
     // destroy buffer queue audio player object, and invalidate all associated interfaces
     if (bqPlayerObject != NULL) {
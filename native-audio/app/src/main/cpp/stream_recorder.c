@@ -0,0 +1,277 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "stream_recorder.h"
+
+#define STREAM_SAMPLE_RATE      16000
+#define STREAM_CHANNELS         1
+#define STREAM_BITS_PER_SAMPLE  16
+#define STREAM_PAGE_SIZE        4096
+
+// The WAV header is padded with a JUNK chunk to a full page, so that the
+// audio data, and therefore every slot written to the file, is page aligned.
+#define WAV_DATA_OFFSET         STREAM_PAGE_SIZE
+#define WAV_JUNK_BYTES          (WAV_DATA_OFFSET - 12 - (8 + 16) - 8 - 8)
+
+#define SCRATCH_SLOT            (-1)
+
+typedef struct StreamRecorder {
+    int fd;
+    uint8_t *ring;          // STREAM_SLOT_COUNT * STREAM_SLOT_BYTES, page aligned
+    uint8_t *scratch;       // handed to the recorder when the ring is full
+
+    // ring indices, free running; slot = index % STREAM_SLOT_COUNT
+    uint32_t head;          // next slot to write to disk; writer thread only
+    uint32_t tail;          // next slot to be committed; callback only
+    uint32_t nextFill;      // next slot to hand to the recorder; callback only
+
+    // recorder buffers in flight, in enqueue order; callback only
+    int32_t inflight[2];
+    uint32_t inflightCount;
+
+    uint64_t bytesWritten;
+    uint32_t overruns;
+    uint32_t maxRingOccupancy;
+
+    sem_t dataReady;
+    pthread_t writer;
+    uint32_t stopping;
+    uint32_t active;
+} StreamRecorder;
+
+static StreamRecorder streamRec;
+
+static void putLE16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void putLE32(uint8_t *p, uint32_t v) {
+    putLE16(p, (uint16_t)v);
+    putLE16(p + 2, (uint16_t)(v >> 16));
+}
+
+static int writeWavHeader(int fd, uint64_t dataBytes) {
+    uint8_t header[WAV_DATA_OFFSET];
+    uint32_t dataSize = dataBytes > 0xFFFFFFFFull - WAV_DATA_OFFSET ?
+                        (uint32_t)(0xFFFFFFFFull - WAV_DATA_OFFSET) : (uint32_t)dataBytes;
+    uint8_t *p = header;
+
+    memset(header, 0, sizeof(header));
+    memcpy(p, "RIFF", 4);
+    putLE32(p + 4, WAV_DATA_OFFSET - 8 + dataSize);
+    memcpy(p + 8, "WAVE", 4);
+    p += 12;
+
+    memcpy(p, "fmt ", 4);
+    putLE32(p + 4, 16);
+    putLE16(p + 8, 1);                  // PCM
+    putLE16(p + 10, STREAM_CHANNELS);
+    putLE32(p + 12, STREAM_SAMPLE_RATE);
+    putLE32(p + 16, STREAM_SAMPLE_RATE * STREAM_CHANNELS * STREAM_BITS_PER_SAMPLE / 8);
+    putLE16(p + 20, STREAM_CHANNELS * STREAM_BITS_PER_SAMPLE / 8);
+    putLE16(p + 22, STREAM_BITS_PER_SAMPLE);
+    p += 8 + 16;
+
+    memcpy(p, "JUNK", 4);
+    putLE32(p + 4, WAV_JUNK_BYTES);
+    p += 8 + WAV_JUNK_BYTES;
+
+    memcpy(p, "data", 4);
+    putLE32(p + 4, dataSize);
+    assert(p + 8 == header + WAV_DATA_OFFSET);
+
+    return pwrite(fd, header, sizeof(header), 0) == (ssize_t)sizeof(header) ? 0 : -1;
+}
+
+// drain every committed slot; contiguous slots go out in a single write
+static void drainRing(StreamRecorder *rec) {
+    uint32_t tail = __atomic_load_n(&rec->tail, __ATOMIC_ACQUIRE);
+    uint32_t head = rec->head;
+
+    while (head != tail) {
+        uint32_t slot = head % STREAM_SLOT_COUNT;
+        uint32_t count = tail - head;
+        if (count > STREAM_SLOT_COUNT - slot) {
+            count = STREAM_SLOT_COUNT - slot;   // stop at the wrap
+        }
+        size_t bytes = (size_t)count * STREAM_SLOT_BYTES;
+        ssize_t written = pwrite(rec->fd, rec->ring + (size_t)slot * STREAM_SLOT_BYTES,
+                bytes, (off_t)(WAV_DATA_OFFSET + rec->bytesWritten));
+        if (written == (ssize_t)bytes) {
+            __atomic_store_n(&rec->bytesWritten, rec->bytesWritten + bytes,
+                    __ATOMIC_RELAXED);
+        }
+        // on a write error the audio is gone either way; keep the ring moving
+        head += count;
+        __atomic_store_n(&rec->head, head, __ATOMIC_RELEASE);
+    }
+}
+
+static void *writerThread(void *arg) {
+    StreamRecorder *rec = (StreamRecorder *)arg;
+    for (;;) {
+        while (sem_wait(&rec->dataReady) != 0) {
+            // EINTR: retry
+        }
+        drainRing(rec);
+        if (__atomic_load_n(&rec->stopping, __ATOMIC_ACQUIRE)) {
+            drainRing(rec);
+            break;
+        }
+    }
+    return NULL;
+}
+
+// hand the next free slot (or the scratch buffer) to the recorder
+static SLresult enqueueNext(StreamRecorder *rec, SLAndroidSimpleBufferQueueItf bq) {
+    uint32_t head = __atomic_load_n(&rec->head, __ATOMIC_ACQUIRE);
+    uint8_t *buf;
+    int32_t tag;
+
+    if (rec->nextFill - head < STREAM_SLOT_COUNT) {
+        tag = (int32_t)(rec->nextFill % STREAM_SLOT_COUNT);
+        buf = rec->ring + (size_t)tag * STREAM_SLOT_BYTES;
+        rec->nextFill++;
+    } else {
+        tag = SCRATCH_SLOT;
+        buf = rec->scratch;
+    }
+    assert(rec->inflightCount < 2);
+    rec->inflight[rec->inflightCount++] = tag;
+    return (*bq)->Enqueue(bq, buf, STREAM_SLOT_BYTES);
+}
+
+void streamRecorderOnBufferFull(SLAndroidSimpleBufferQueueItf bq) {
+    StreamRecorder *rec = &streamRec;
+    int32_t tag;
+
+    assert(rec->inflightCount > 0);
+    tag = rec->inflight[0];
+    rec->inflight[0] = rec->inflight[1];
+    rec->inflightCount--;
+
+    if (tag == SCRATCH_SLOT) {
+        __atomic_add_fetch(&rec->overruns, 1, __ATOMIC_RELAXED);
+    } else {
+        assert((uint32_t)tag == rec->tail % STREAM_SLOT_COUNT);
+        __atomic_store_n(&rec->tail, rec->tail + 1, __ATOMIC_RELEASE);
+        sem_post(&rec->dataReady);
+    }
+
+    uint32_t occupancy = rec->tail - __atomic_load_n(&rec->head, __ATOMIC_RELAXED);
+    if (occupancy > rec->maxRingOccupancy) {
+        __atomic_store_n(&rec->maxRingOccupancy, occupancy, __ATOMIC_RELAXED);
+    }
+
+    enqueueNext(rec, bq);
+}
+
+SLboolean streamRecorderStart(SLRecordItf record, SLAndroidSimpleBufferQueueItf bq,
+        const char *path) {
+    StreamRecorder *rec = &streamRec;
+    SLresult result;
+    void *mem;
+
+    if (rec->active) {
+        return SL_BOOLEAN_FALSE;
+    }
+    memset(rec, 0, sizeof(*rec));
+
+    rec->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (rec->fd < 0) {
+        return SL_BOOLEAN_FALSE;
+    }
+    if (writeWavHeader(rec->fd, 0) ||
+        posix_memalign(&mem, STREAM_PAGE_SIZE,
+                       (size_t)(STREAM_SLOT_COUNT + 1) * STREAM_SLOT_BYTES)) {
+        close(rec->fd);
+        return SL_BOOLEAN_FALSE;
+    }
+    rec->ring = (uint8_t *)mem;
+    rec->scratch = rec->ring + (size_t)STREAM_SLOT_COUNT * STREAM_SLOT_BYTES;
+
+    sem_init(&rec->dataReady, 0, 0);
+    if (pthread_create(&rec->writer, NULL, writerThread, rec)) {
+        sem_destroy(&rec->dataReady);
+        free(rec->ring);
+        close(rec->fd);
+        return SL_BOOLEAN_FALSE;
+    }
+
+    result = (*record)->SetRecordState(record, SL_RECORDSTATE_STOPPED);
+    assert(SL_RESULT_SUCCESS == result);
+    result = (*bq)->Clear(bq);
+    assert(SL_RESULT_SUCCESS == result);
+
+    // two buffers in the device queue keep the recorder running continuously
+    enqueueNext(rec, bq);
+    enqueueNext(rec, bq);
+    rec->active = 1;
+
+    result = (*record)->SetRecordState(record, SL_RECORDSTATE_RECORDING);
+    assert(SL_RESULT_SUCCESS == result);
+    (void)result;
+    return SL_BOOLEAN_TRUE;
+}
+
+void streamRecorderStop(SLRecordItf record, SLAndroidSimpleBufferQueueItf bq) {
+    StreamRecorder *rec = &streamRec;
+    SLresult result;
+
+    if (!rec->active) {
+        return;
+    }
+    // the partially filled buffers still in the device queue are discarded
+    result = (*record)->SetRecordState(record, SL_RECORDSTATE_STOPPED);
+    assert(SL_RESULT_SUCCESS == result);
+    result = (*bq)->Clear(bq);
+    assert(SL_RESULT_SUCCESS == result);
+    (void)result;
+
+    __atomic_store_n(&rec->stopping, 1, __ATOMIC_RELEASE);
+    sem_post(&rec->dataReady);
+    pthread_join(rec->writer, NULL);
+
+    writeWavHeader(rec->fd, rec->bytesWritten);
+    close(rec->fd);
+    sem_destroy(&rec->dataReady);
+    free(rec->ring);
+    rec->ring = rec->scratch = NULL;
+    rec->fd = -1;
+    rec->active = 0;
+}
+
+SLboolean streamRecorderIsActive(void) {
+    return streamRec.active ? SL_BOOLEAN_TRUE : SL_BOOLEAN_FALSE;
+}
+
+void streamRecorderGetStats(StreamRecorderStats *stats) {
+    stats->bytesWritten = __atomic_load_n(&streamRec.bytesWritten, __ATOMIC_RELAXED);
+    stats->overruns = __atomic_load_n(&streamRec.overruns, __ATOMIC_RELAXED);
+    stats->maxRingOccupancy = __atomic_load_n(&streamRec.maxRingOccupancy,
+            __ATOMIC_RELAXED);
+}
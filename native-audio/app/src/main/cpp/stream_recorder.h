@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef NATIVE_AUDIO_STREAM_RECORDER_H
+#define NATIVE_AUDIO_STREAM_RECORDER_H
+
+#include <stdint.h>
+#include <SLES/OpenSLES.h>
+#include <SLES/OpenSLES_Android.h>
+
+/* Streaming recorder: records for as long as it is running, straight into a
+ * WAV file, using a constant amount of memory.
+ *
+ * The recorder fills the slots of a fixed ring directly. bqRecorderCallback
+ * only commits the filled slot and enqueues the next free one; a writer
+ * thread drains committed slots to disk with large, page aligned pwrite()s.
+ * If the writer falls behind and no slot is free, the recorder is given a
+ * scratch buffer instead and the lost buffer is counted as an overrun.
+ */
+
+// each slot is one recorder buffer: 8192 frames, ~0.5 s at 16 kHz mono 16-bit
+#define STREAM_SLOT_BYTES   (16 * 1024)
+#define STREAM_SLOT_COUNT   16
+
+typedef struct StreamRecorderStats {
+    uint64_t bytesWritten;     // audio bytes written to the file so far
+    uint32_t overruns;         // recorder buffers lost because the ring was full
+    uint32_t maxRingOccupancy; // high water mark of slots waiting for the writer
+} StreamRecorderStats;
+
+// Starts streaming the recorder into a 16 kHz mono 16-bit WAV file at path.
+// The recorder must be created and stopped; returns SL_BOOLEAN_FALSE on error.
+SLboolean streamRecorderStart(SLRecordItf record, SLAndroidSimpleBufferQueueItf bq,
+        const char *path);
+
+// Stops recording, flushes everything captured so far and finalizes the file.
+void streamRecorderStop(SLRecordItf record, SLAndroidSimpleBufferQueueItf bq);
+
+// Must be called from the recorder's buffer queue callback while streaming.
+void streamRecorderOnBufferFull(SLAndroidSimpleBufferQueueItf bq);
+
+SLboolean streamRecorderIsActive(void);
+void streamRecorderGetStats(StreamRecorderStats *stats);
+
+#endif // NATIVE_AUDIO_STREAM_RECORDER_H
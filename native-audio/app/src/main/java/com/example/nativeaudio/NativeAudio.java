@@ -303,6 +303,37 @@ public class NativeAudio extends Activity
             }
         });
 
+        ((Button) findViewById(R.id.stream_record)).setOnClickListener(new OnClickListener() {
+            public void onClick(View view) {
+                Button button = (Button) view;
+                if (isStreamingRecord) {
+                    int overruns = stopStreamingRecording();
+                    isStreamingRecord = false;
+                    button.setText(R.string.stream_record);
+                    Toast.makeText(getApplicationContext(),
+                            "Recorded to " + streamFile() + ", lost buffers: " + overruns,
+                            Toast.LENGTH_SHORT).show();
+                    return;
+                }
+                int status = ActivityCompat.checkSelfPermission(NativeAudio.this,
+                        Manifest.permission.RECORD_AUDIO);
+                if (status != PackageManager.PERMISSION_GRANTED) {
+                    ActivityCompat.requestPermissions(
+                            NativeAudio.this,
+                            new String[]{Manifest.permission.RECORD_AUDIO},
+                            AUDIO_ECHO_REQUEST);
+                    return;
+                }
+                if (!created) {
+                    created = createAudioRecorder();
+                }
+                if (created && startStreamingRecording(streamFile())) {
+                    isStreamingRecord = true;
+                    button.setText(R.string.stop_stream_record);
+                }
+            }
+        });
+
         ((Button) findViewById(R.id.playback)).setOnClickListener(new OnClickListener() {
             public void onClick(View view) {
                 // ignore the return value
@@ -314,6 +345,12 @@ public class NativeAudio extends Activity
 
     // Single out recording for run-permission needs
     static boolean created = false;
+    static boolean isStreamingRecord = false;
+
+    private String streamFile() {
+        return getFilesDir().getAbsolutePath() + "/stream_record.wav";
+    }
+
     private void recordAudio() {
         if (!created) {
             created = createAudioRecorder();
@@ -328,6 +365,11 @@ public class NativeAudio extends Activity
     protected void onPause()
     {
         // turn off all audio
+        if (isStreamingRecord) {
+            stopStreamingRecording();
+            isStreamingRecord = false;
+            ((Button) findViewById(R.id.stream_record)).setText(R.string.stream_record);
+        }
         selectClip(CLIP_NONE, 0);
         isPlayingAsset = false;
         setPlayingAssetAudioPlayer(false);
@@ -395,6 +437,8 @@ public class NativeAudio extends Activity
     public static native boolean enableReverb(boolean enabled);
     public static native boolean createAudioRecorder();
     public static native void startRecording();
+    public static native boolean startStreamingRecording(String path);
+    public static native int stopStreamingRecording();
     public static native void shutdown();
 
     /** Load jni .so on initialization */
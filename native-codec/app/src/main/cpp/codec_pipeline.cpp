@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "codec_pipeline.h"
+#include "looper.h"
+
+#include <string.h>
+#include <algorithm>
+
+codecpipeline::codecpipeline(looper *l, int what, mediasource *src,
+                             mediadecoder *dec)
+    : l(l), what(what), src(src), dec(dec), token(0), renderstart(-1),
+      playing(false), renderonce(false), sawinputeos(false),
+      sawoutputeos(false), inflight(0) {
+    memset(&counters, 0, sizeof(counters));
+}
+
+codecpipeline::~codecpipeline() {
+}
+
+void codecpipeline::schedule(int64_t when) {
+    l->postat(what, reinterpret_cast<void*>(token), when);
+}
+
+void codecpipeline::start(bool once) {
+    if (playing) {
+        return;
+    }
+    playing = !once;
+    renderonce = once;
+    // the clock restarts from the next frame shown
+    renderstart = -1;
+    token++;
+    schedule(0);
+}
+
+void codecpipeline::pause() {
+    playing = false;
+    renderonce = false;
+    token++;
+}
+
+void codecpipeline::seek(int64_t timeus) {
+    releaseheld();
+    src->seekto(timeus);
+    dec->flush();
+    sawinputeos = false;
+    sawoutputeos = false;
+    inflight = 0;
+    renderstart = -1;
+    if (!playing) {
+        renderonce = true;
+    }
+    token++;
+    schedule(0);
+}
+
+void codecpipeline::stop() {
+    releaseheld();
+    playing = false;
+    renderonce = false;
+    token++;
+}
+
+void codecpipeline::releaseheld() {
+    for (auto &f : held) {
+        dec->releaseoutput(f.idx, false, 0);
+    }
+    held.clear();
+}
+
+void codecpipeline::work(void *data) {
+    if (reinterpret_cast<uintptr_t>(data) != token ||
+        !(playing || renderonce)) {
+        return;  // posted before a pause, seek or stop
+    }
+    feed();
+    int64_t next = drain(looper::now());
+    if (next >= 0) {
+        schedule(next);
+    }
+}
+
+/*
+ * Demux stage: every input buffer the decoder has free gets a sample, so
+ * several are in flight while frames wait for their presentation time
+ */
+void codecpipeline::feed() {
+    while (!sawinputeos) {
+        ssize_t idx = dec->dequeueinput();
+        if (idx < 0) {
+            counters.inputfull++;
+            break;
+        }
+        size_t capacity;
+        uint8_t *buf = dec->getinput(idx, &capacity);
+        ssize_t size = src->readsample(buf, capacity);
+        if (size < 0) {
+            size = 0;
+            sawinputeos = true;
+        }
+        int64_t ptsus = src->sampletime();
+        dec->queueinput(idx, size, ptsus, sawinputeos);
+        src->advance();
+        counters.samplesqueued++;
+        inflight++;
+        counters.maxinputinflight = std::max(counters.maxinputinflight, inflight);
+    }
+}
+
+/*
+ * Render stage: collect decoded frames, release the ones due soon with their
+ * presentation time. Returns when to run again, -1 for never.
+ */
+int64_t codecpipeline::drain(int64_t now) {
+    while (held.size() < kMaxHeldFrames && !sawoutputeos) {
+        int64_t ptsus;
+        size_t size;
+        bool eos;
+        ssize_t idx = dec->dequeueoutput(&ptsus, &size, &eos);
+        if (idx < 0) {
+            break;
+        }
+        if (inflight) {
+            inflight--;
+        }
+        counters.framesdecoded++;
+        sawoutputeos = eos;
+        if (!size) {
+            dec->releaseoutput(idx, false, 0);
+            continue;
+        }
+        held.push_back(heldframe{static_cast<size_t>(idx), ptsus * 1000});
+    }
+
+    while (!held.empty()) {
+        heldframe f = held.front();
+        if (renderstart < 0) {
+            renderstart = now - f.ptsns;
+        }
+        int64_t due = renderstart + f.ptsns;
+        if (due - now > kRenderAheadNs) {
+            break;
+        }
+        held.pop_front();
+
+        // late, and either too late or about to be replaced by the next
+        // frame already due: showing it would only delay that one
+        int64_t lateness = now - due;
+        bool superseded = !held.empty() &&
+                renderstart + held.front().ptsns <= now;
+        if ((lateness > kDropLateNs || superseded) && !renderonce) {
+            dec->releaseoutput(f.idx, false, 0);
+            counters.framesdropped++;
+            continue;
+        }
+        if (lateness > 0) {
+            counters.frameslate++;
+            counters.maxlatenessus =
+                    std::max(counters.maxlatenessus, lateness / 1000);
+        }
+        dec->releaseoutput(f.idx, true, std::max(due, now));
+        counters.framesrendered++;
+        if (renderonce) {
+            renderonce = false;
+            if (!playing) {
+                return -1;
+            }
+        }
+    }
+
+    if (finished()) {
+        return -1;
+    }
+    int64_t next = now + kPollNs;
+    if (!held.empty()) {
+        next = std::min(next, renderstart + held.front().ptsns - kRenderAheadNs);
+    }
+    return next;
+}
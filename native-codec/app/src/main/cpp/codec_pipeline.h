@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NATIVE_CODEC_PIPELINE_H
+#define NATIVE_CODEC_PIPELINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <deque>
+
+class looper;
+
+/*
+ * mediasource: the demuxer side, AMediaExtractor in the app
+ */
+class mediasource {
+    public:
+        virtual ~mediasource() {}
+        // copy the current sample into buf; negative at the end of stream
+        virtual ssize_t readsample(uint8_t *buf, size_t capacity) = 0;
+        virtual int64_t sampletime() = 0;   // us
+        virtual void advance() = 0;
+        virtual void seekto(int64_t timeus) = 0;
+};
+
+/*
+ * mediadecoder: the decoder side, AMediaCodec in the app. None of the calls
+ * may block.
+ */
+class mediadecoder {
+    public:
+        virtual ~mediadecoder() {}
+        // index of a free input buffer, negative if none
+        virtual ssize_t dequeueinput() = 0;
+        virtual uint8_t *getinput(size_t idx, size_t *capacity) = 0;
+        virtual void queueinput(size_t idx, size_t size, int64_t ptsus,
+                                bool eos) = 0;
+        // index of a decoded buffer, negative if none is ready
+        virtual ssize_t dequeueoutput(int64_t *ptsus, size_t *size,
+                                      bool *eos) = 0;
+        // renderns: CLOCK_MONOTONIC time the frame should be shown at
+        virtual void releaseoutput(size_t idx, bool render, int64_t renderns) = 0;
+        virtual void flush() = 0;
+};
+
+/*
+ * playerstats: counters of a codecpipeline
+ */
+struct playerstats {
+    uint64_t samplesqueued;
+    uint64_t framesdecoded;
+    uint64_t framesrendered;
+    uint64_t framesdropped;     // too late, or already replaced by a later
+                                // frame: released unrendered
+    uint64_t frameslate;        // shown, but released after their time
+    uint64_t inputfull;         // feed found every input buffer in flight
+    uint32_t maxinputinflight;  // samples queued and not decoded yet
+    int64_t maxlatenessus;
+};
+
+/*
+ * codecpipeline: demux, decode and render stages of a video player, run as
+ * messages on a looper without ever blocking it.
+ *   - feed keeps every free input buffer of the decoder filled
+ *   - drain takes decoded frames as soon as they are ready and holds them
+ *     until shortly before their presentation time, then releases them with
+ *     a render timestamp (releaseOutputBufferAtTime) instead of sleeping.
+ *     Frames already too late are dropped.
+ * Each run of work() does both stages and posts the next run at the
+ * earliest of the next frame due and a short poll interval.
+ * All methods are called on the looper thread.
+ */
+class codecpipeline {
+    public:
+        // what: the message code the looper hands to work()
+        codecpipeline(looper *l, int what, mediasource *src, mediadecoder *dec);
+        ~codecpipeline();
+
+        // renderonce: show the next frame, then pause
+        void start(bool renderonce);
+        void pause();
+        void seek(int64_t timeus);
+        // drop held frames and stop running; before the decoder goes away
+        void stop();
+        bool isplaying() const { return playing; }
+        // every frame up to the end of stream has been released
+        bool finished() const { return sawoutputeos && held.empty(); }
+
+        // data: the data of the message, identifies the run
+        void work(void *data);
+        void getstats(playerstats *stats) const { *stats = counters; }
+
+        static const int64_t kRenderAheadNs = 30000000;  // release that early
+        static const int64_t kDropLateNs = 40000000;     // later: drop
+        static const int64_t kPollNs = 5000000;
+        static const size_t kMaxHeldFrames = 4;
+
+    private:
+        struct heldframe {
+            size_t idx;
+            int64_t ptsns;
+        };
+        void feed();
+        int64_t drain(int64_t now);
+        void releaseheld();
+        void schedule(int64_t when);
+
+        looper *l;
+        int what;
+        mediasource *src;
+        mediadecoder *dec;
+        std::deque<heldframe> held;
+        uintptr_t token;        // runs posted with an older token are stale
+        int64_t renderstart;    // presentation time 0, CLOCK_MONOTONIC ns
+        bool playing;
+        bool renderonce;
+        bool sawinputeos;
+        bool sawoutputeos;
+        uint32_t inflight;      // samples queued, not out of the decoder yet
+        playerstats counters;
+};
+
+#endif // NATIVE_CODEC_PIPELINE_H
@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Plays a fake stream through a codecpipeline on a real looper: a decoder
+ * with a few input buffers, a decode delay and occasional slow frames.
+ * Checks frames are shown in order at their presentation time, late ones
+ * dropped, and every buffer released; prints the statistics.
+ * No Android dependency, runs on the host:
+ *   g++ -std=c++11 -O2 -pthread -DCODEC_PIPELINE_HOST_CHECK \
+ *       looper.cpp codec_pipeline.cpp codec_pipeline_check.cpp
+ */
+
+#ifdef CODEC_PIPELINE_HOST_CHECK
+#include "codec_pipeline.h"
+#include "looper.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+/*
+ * A fake extractor and decoder, run on the looper thread
+ */
+namespace {
+
+const int64_t kFrameUs = 8333;  // 120 fps, to keep the run short
+
+class fakesource : public mediasource {
+    public:
+        explicit fakesource(int frames) : frames(frames), next(0) {}
+        virtual ssize_t readsample(uint8_t *buf, size_t capacity) {
+            if (next >= frames || capacity < sizeof(next)) {
+                return -1;
+            }
+            memcpy(buf, &next, sizeof(next));
+            return sizeof(next);
+        }
+        virtual int64_t sampletime() {
+            return next < frames ? next * kFrameUs : -1;
+        }
+        virtual void advance() { next++; }
+        virtual void seekto(int64_t timeus) {
+            next = static_cast<int>(timeus / kFrameUs);
+        }
+    private:
+        int frames;
+        int next;
+};
+
+/*
+ * Decodes one frame at a time, kDecodeNs each, every kSlowFrame-th one
+ * takes kSlowDecodeNs. An input buffer is busy until its frame is decoded.
+ */
+class fakedecoder : public mediadecoder {
+    public:
+        static const int kInputs = 4;
+        static const int kOutputs = 8;
+        static const int64_t kDecodeNs = 2000000;
+        static const int64_t kSlowDecodeNs = 100000000;
+        static const int kSlowFrame = 40;
+
+        struct release {
+            int64_t ptsus;
+            bool render;
+            int64_t renderns;
+            int64_t releasedns;
+        };
+
+        fakedecoder() : renders(0), badcalls(0), lastready(0), decoded(0) {
+            for (auto &b : inputs) b.busy = false;
+            for (auto &b : outputs) b.busy = false;
+        }
+        virtual ssize_t dequeueinput() {
+            for (int i = 0; i < kInputs; i++) {
+                if (!inputs[i].busy) {
+                    inputs[i].busy = true;
+                    return i;
+                }
+            }
+            return -1;
+        }
+        virtual uint8_t *getinput(size_t idx, size_t *capacity) {
+            *capacity = sizeof(inputs[idx].data);
+            return inputs[idx].data;
+        }
+        virtual void queueinput(size_t idx, size_t size, int64_t ptsus,
+                                bool eos) {
+            int64_t cost = (++decoded % kSlowFrame) ? kDecodeNs : kSlowDecodeNs;
+            lastready = std::max(looper::now(), lastready) + cost;
+            decoding.push_back(frame{idx, ptsus, size, eos, lastready});
+        }
+        virtual ssize_t dequeueoutput(int64_t *ptsus, size_t *size, bool *eos) {
+            if (decoding.empty() || decoding.front().readyns > looper::now()) {
+                return -1;
+            }
+            for (int i = 0; i < kOutputs; i++) {
+                if (!outputs[i].busy) {
+                    frame f = decoding.front();
+                    decoding.pop_front();
+                    inputs[f.input].busy = false;
+                    outputs[i].busy = true;
+                    outputs[i].ptsus = f.ptsus;
+                    *ptsus = f.ptsus;
+                    *size = f.size;
+                    *eos = f.eos;
+                    return i;
+                }
+            }
+            return -1;
+        }
+        virtual void releaseoutput(size_t idx, bool render, int64_t renderns) {
+            if (!outputs[idx].busy) {
+                badcalls++;
+                return;
+            }
+            outputs[idx].busy = false;
+            released.push_back(
+                    release{outputs[idx].ptsus, render, renderns, looper::now()});
+            if (render) {
+                renders.fetch_add(1, std::memory_order_release);
+            }
+        }
+        virtual void flush() {
+            decoding.clear();
+            for (auto &b : inputs) b.busy = false;
+            for (auto &b : outputs) {
+                if (b.busy) badcalls++;  // the pipeline must release first
+            }
+        }
+        int busyoutputs() const {
+            int n = 0;
+            for (auto &b : outputs) n += b.busy;
+            return n;
+        }
+
+        std::vector<release> released;
+        std::atomic<uint32_t> renders;
+        uint32_t badcalls;
+
+    private:
+        struct frame {
+            size_t input;
+            int64_t ptsus;
+            size_t size;
+            bool eos;
+            int64_t readyns;
+        };
+        struct inputbuffer {
+            bool busy;
+            uint8_t data[64];
+        } inputs[kInputs];
+        struct outputbuffer {
+            bool busy;
+            int64_t ptsus;
+        } outputs[kOutputs];
+        std::deque<frame> decoding;
+        int64_t lastready;
+        int decoded;
+};
+
+enum {
+    kMsgWork,
+    kMsgStart,
+    kMsgSeek,
+};
+
+class checklooper : public looper {
+    public:
+        checklooper() : pipeline(NULL), done(false) {}
+        virtual void handle(int what, void *data) {
+            switch (what) {
+                case kMsgWork:
+                    pipeline->work(data);
+                    if (pipeline->finished()) {
+                        done.store(true, std::memory_order_release);
+                    }
+                    break;
+                case kMsgStart:
+                    pipeline->start(false);
+                    break;
+                case kMsgSeek:
+                    pipeline->pause();
+                    pipeline->seek(0);
+                    break;
+            }
+        }
+        codecpipeline *pipeline;
+        std::atomic<bool> done;
+};
+
+}  // namespace
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            used += snprintf(report + used, size - used,                \
+                             "FAILED line %d: %s\n", __LINE__, #cond);  \
+            return false;                                               \
+        }                                                               \
+    } while (0)
+
+static bool codecpipelineselfcheck(char *report, size_t size) {
+    const int kFrames = 240;
+    int used = 0;
+    report[0] = 0;
+
+    fakesource src(kFrames);
+    fakedecoder dec;
+    checklooper l;
+    codecpipeline pipeline(&l, kMsgWork, &src, &dec);
+    l.pipeline = &pipeline;
+
+    int64_t start = looper::now();
+    l.post(kMsgStart, NULL);
+    while (!l.done.load(std::memory_order_acquire)) {
+        usleep(1000);
+    }
+    double seconds = (looper::now() - start) / 1e9;
+
+    // rewind while paused: exactly the first frame is shown
+    uint32_t renders = dec.renders.load(std::memory_order_acquire);
+    l.post(kMsgSeek, NULL);
+    while (dec.renders.load(std::memory_order_acquire) == renders) {
+        usleep(1000);
+    }
+    usleep(50000);
+    l.quit();
+
+    playerstats stats;
+    pipeline.getstats(&stats);
+    CHECK(dec.badcalls == 0);
+    CHECK(dec.renders == stats.framesrendered);
+    CHECK(dec.released.back().render && dec.released.back().ptsus == 0);
+    // frames, the empty end of stream buffer, the frame after the rewind
+    CHECK(dec.released.size() == kFrames + 2u);
+
+    // first pass: everything released once, in order, shown on time unless
+    // a slow frame made it late
+    int64_t lastrender = 0, lastpts = -1, leadsum = 0, base = 0;
+    uint32_t ontime = 0;
+    for (int i = 0; i < kFrames; i++) {
+        const fakedecoder::release &r = dec.released[i];
+        CHECK(r.ptsus > lastpts);
+        lastpts = r.ptsus;
+        if (!r.render) {
+            continue;
+        }
+        CHECK(r.renderns > lastrender);
+        lastrender = r.renderns;
+        if (!base) {
+            base = r.renderns - r.ptsus * 1000;
+        }
+        if (r.renderns == base + r.ptsus * 1000) {
+            // released ahead of time, with its presentation time
+            // (drain() reads the clock once per run)
+            CHECK(r.renderns - r.releasedns > -1000000 &&
+                  r.renderns - r.releasedns <= codecpipeline::kRenderAheadNs);
+            leadsum += r.renderns - r.releasedns;
+            ontime++;
+        }
+    }
+    CHECK(stats.framesrendered + stats.framesdropped == kFrames + 1);
+    CHECK(stats.framesdropped > 0 && stats.framesdropped < kFrames / 4);
+    CHECK(stats.maxinputinflight >= 2);
+
+    used += snprintf(report + used, size - used,
+                     "codec pipeline checks passed: %d frames in %.2f s\n"
+                     "rendered %llu (%u on time, released %.1f ms ahead avg), "
+                     "late %llu (max %lld us), dropped %llu\n"
+                     "samples in flight max %u, feed found input full %llu "
+                     "times\n",
+                     kFrames, seconds,
+                     (unsigned long long)stats.framesrendered, ontime,
+                     ontime ? leadsum / 1e6 / ontime : 0.0,
+                     (unsigned long long)stats.frameslate,
+                     (long long)stats.maxlatenessus,
+                     (unsigned long long)stats.framesdropped,
+                     stats.maxinputinflight,
+                     (unsigned long long)stats.inputfull);
+    return true;
+}
+
+int main() {
+    char report[1024];
+    bool ok = codecpipelineselfcheck(report, sizeof(report));
+    fputs(report, stdout);
+    return ok ? 0 : 1;
+}
+#endif // CODEC_PIPELINE_HOST_CHECK
@@ -17,49 +17,99 @@
 #include "looper.h"
 
 #include <assert.h>
-#include <jni.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
 #include <errno.h>
 #include <limits.h>
 #include <semaphore.h>
+#include <algorithm>
 
+#ifdef __ANDROID__
 // for __android_log_print(ANDROID_LOG_INFO, "YourApp", "formatted message");
 #include <android/log.h>
 #define TAG "NativeCodec-looper"
 #define LOGV(...) __android_log_print(ANDROID_LOG_VERBOSE, TAG, __VA_ARGS__)
+#else
+// host build of looper_benchmark.cpp
+#define LOGV(...) ((void)0)
+#endif
 
+// messages preallocated per looper; more are allocated when they run out
+static const uint32_t kPoolSize = 256;
+static const uint32_t kNotPooled = UINT32_MAX;
+static const uint32_t kEndOfList = UINT32_MAX;
 
 struct loopermessage;
 typedef struct loopermessage loopermessage;
 
 struct loopermessage {
+    std::atomic<loopermessage*> next;
     int what;
     void *obj;
-    loopermessage *next;
+    int64_t when;           // CLOCK_MONOTONIC ns, 0 for right away
+    uint32_t generation;    // flush generation at post time
+    uint32_t poolindex;
+    std::atomic<uint32_t> nextfree;
     bool quit;
+    bool flush;
+    bool unique;
 };
 
+/*
+ * Vyukov's intrusive MPSC queue: a post is one atomic exchange plus one
+ * store, whatever the queue length
+ */
+static void link(std::atomic<loopermessage*> &head, loopermessage *msg) {
+    msg->next.store(NULL, std::memory_order_relaxed);
+    loopermessage *prev = head.exchange(msg);
+    prev->next.store(msg, std::memory_order_release);
+}
+
+static bool later(const loopermessage *a, const loopermessage *b) {
+    return a->when > b->when;
+}
 
+int64_t looper::now() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
 
 void* looper::trampoline(void* p) {
     ((looper*)p)->loop();
     return NULL;
 }
 
-looper::looper() {
+looper::looper()
+    : flushgeneration(0), sleeping(false), posted(0), coalesced(0),
+      poolmisses(0), wakeups(0), flushed(0), handled(0) {
+    stub = new loopermessage();
+    stub->poolindex = kNotPooled;
+    stub->next.store(NULL);
+    head.store(stub);
+    tail = stub;
+
+    pool = new loopermessage[kPoolSize];
+    for (uint32_t i = 0; i < kPoolSize; i++) {
+        pool[i].poolindex = i;
+        pool[i].nextfree.store(i + 1 < kPoolSize ? i + 1 : kEndOfList);
+    }
+    freelist.store(0);
+    for (auto &pending : pendingwhat) {
+        pending.store(false);
+    }
+    timers.reserve(kPoolSize);
+
     sem_init(&headdataavailable, 0, 0);
-    sem_init(&headwriteprotect, 0, 1);
     pthread_attr_t attr;
     pthread_attr_init(&attr);
 
-    pthread_create(&worker, &attr, trampoline, this);
     running = true;
+    pthread_create(&worker, &attr, trampoline, this);
 }
 
 
@@ -68,85 +118,248 @@ looper::~looper() {
         LOGV("Looper deleted while still running. Some messages will not be processed");
         quit();
     }
+    delete[] pool;
+    delete stub;
 }
 
-void looper::post(int what, void *data, bool flush) {
-    loopermessage *msg = new loopermessage();
+/*
+ * Pop a message off the free list; the tag in the upper 32 bits changes on
+ * every update, so a stale compare-exchange cannot succeed (ABA)
+ */
+loopermessage *looper::obtain(int what, void *data, int64_t when) {
+    loopermessage *msg = NULL;
+    uint64_t top = freelist.load(std::memory_order_acquire);
+    while (static_cast<uint32_t>(top) != kEndOfList) {
+        loopermessage *candidate = &pool[static_cast<uint32_t>(top)];
+        uint64_t next = (((top >> 32) + 1) << 32) |
+                candidate->nextfree.load(std::memory_order_relaxed);
+        if (freelist.compare_exchange_weak(top, next,
+                                           std::memory_order_acq_rel,
+                                           std::memory_order_acquire)) {
+            msg = candidate;
+            break;
+        }
+    }
+    if (!msg) {
+        poolmisses++;
+        msg = new loopermessage();
+        msg->poolindex = kNotPooled;
+    }
     msg->what = what;
     msg->obj = data;
-    msg->next = NULL;
+    msg->when = when;
+    msg->generation = flushgeneration.load(std::memory_order_acquire);
     msg->quit = false;
-    addmsg(msg, flush);
+    msg->flush = false;
+    msg->unique = false;
+    return msg;
 }
 
-void looper::addmsg(loopermessage *msg, bool flush) {
-    sem_wait(&headwriteprotect);
-    loopermessage *h = head;
+void looper::recycle(loopermessage *msg) {
+    if (msg->poolindex == kNotPooled) {
+        delete msg;
+        return;
+    }
+    uint64_t top = freelist.load(std::memory_order_relaxed);
+    uint64_t next;
+    do {
+        msg->nextfree.store(static_cast<uint32_t>(top), std::memory_order_relaxed);
+        next = (((top >> 32) + 1) << 32) | msg->poolindex;
+    } while (!freelist.compare_exchange_weak(top, next,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed));
+}
 
-    if (flush) {
-        while(h) {
-            loopermessage *next = h->next;
-            delete h;
-            h = next;
+void looper::enqueue(loopermessage *msg) {
+    link(head, msg);
+    posted++;
+    // only the poster finding the worker asleep pays for the semaphore
+    if (sleeping.load() && sleeping.exchange(false)) {
+        wakeups++;
+        sem_post(&headdataavailable);
+    }
+}
+
+/*
+ * Worker side of the queue. NULL when empty, or when a post is half way
+ * through (head moved, link to it not stored yet): then head != tail.
+ */
+loopermessage *looper::dequeue() {
+    loopermessage *t = tail;
+    loopermessage *next = t->next.load(std::memory_order_acquire);
+    if (t == stub) {
+        if (!next) {
+            return NULL;
         }
-        h = NULL;
+        tail = next;
+        t = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+    if (next) {
+        tail = next;
+        return t;
+    }
+    if (t != head.load()) {
+        return NULL;
+    }
+    link(head, stub);
+    next = t->next.load(std::memory_order_acquire);
+    if (next) {
+        tail = next;
+        return t;
     }
-    if (h) {
-        while (h->next) {
-            h = h->next;
+    return NULL;
+}
+
+void looper::post(int what, void *data, bool flush) {
+    loopermessage *msg = obtain(what, data, 0);
+    if (flush) {
+        // everything posted before carries an older generation
+        msg->generation = flushgeneration.fetch_add(1) + 1;
+        msg->flush = true;
+    }
+    enqueue(msg);
+}
+
+void looper::postdelayed(int what, void *data, int64_t delayns) {
+    postat(what, data, now() + std::max(delayns, static_cast<int64_t>(0)));
+}
+
+void looper::postat(int what, void *data, int64_t whenns) {
+    enqueue(obtain(what, data, whenns));
+}
+
+void looper::postunique(int what, void *data) {
+    assert(what >= 0 && what < kMaxUniqueWhat);
+    if (pendingwhat[what].exchange(true)) {
+        coalesced++;
+        return;
+    }
+    loopermessage *msg = obtain(what, data, 0);
+    msg->unique = true;
+    enqueue(msg);
+}
+
+void looper::dispatch(loopermessage *msg) {
+    if (msg->unique) {
+        // posts from here on queue a new message, even from handle()
+        pendingwhat[msg->what].store(false);
+    }
+    if (msg->generation != flushgeneration.load(std::memory_order_acquire)) {
+        flushed++;
+        recycle(msg);
+        return;
+    }
+    if (msg->flush) {
+        // delayed messages posted before are dropped too
+        auto stale = std::partition(timers.begin(), timers.end(),
+                [msg](const loopermessage *m) {
+                    return m->generation == msg->generation;
+                });
+        for (auto it = stale; it != timers.end(); ++it) {
+            flushed++;
+            recycle(*it);
         }
-        h->next = msg;
-    } else {
-        head = msg;
+        timers.erase(stale, timers.end());
+        std::make_heap(timers.begin(), timers.end(), later);
     }
-    LOGV("post msg %d", msg->what);
-    sem_post(&headwriteprotect);
-    sem_post(&headdataavailable);
+    int what = msg->what;
+    void *obj = msg->obj;
+    recycle(msg);
+    handle(what, obj);
+    handled++;
 }
 
 void looper::loop() {
     while(true) {
-        // wait for available message
-        sem_wait(&headdataavailable);
-
-        // get next available message
-        sem_wait(&headwriteprotect);
-        loopermessage *msg = head;
-        if (msg == NULL) {
-            LOGV("no msg");
-            sem_post(&headwriteprotect);
+        loopermessage *msg = dequeue();
+        if (msg) {
+            if (msg->quit) {
+                LOGV("quitting");
+                recycle(msg);
+                break;
+            }
+            if (msg->when > now()) {
+                timers.push_back(msg);
+                std::push_heap(timers.begin(), timers.end(), later);
+            } else {
+                dispatch(msg);
+            }
+            continue;
+        }
+        if (tail != head.load()) {
+            // a post is being linked in, it only takes a few instructions
+            sched_yield();
             continue;
         }
-        head = msg->next;
-        sem_post(&headwriteprotect);
 
-        if (msg->quit) {
-            LOGV("quitting");
-            delete msg;
-            return;
+        int64_t t = now();
+        if (!timers.empty() && timers.front()->when <= t) {
+            std::pop_heap(timers.begin(), timers.end(), later);
+            msg = timers.back();
+            timers.pop_back();
+            dispatch(msg);
+            continue;
         }
-        LOGV("processing msg %d", msg->what);
-        handle(msg->what, msg->obj);
-        delete msg;
+
+        // nothing to do: sleep until a post or the next delayed message.
+        // Posters read sleeping after moving head, so either they see it
+        // set or the check below sees their message.
+        sleeping.store(true);
+        if (tail != head.load()) {
+            sleeping.store(false);
+            continue;
+        }
+        if (timers.empty()) {
+            while (sem_wait(&headdataavailable) && errno == EINTR) {}
+        } else {
+            // sem_timedwait() takes a CLOCK_REALTIME deadline
+            timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            int64_t ns = deadline.tv_sec * 1000000000LL + deadline.tv_nsec +
+                    (timers.front()->when - t);
+            deadline.tv_sec = ns / 1000000000LL;
+            deadline.tv_nsec = ns % 1000000000LL;
+            while (sem_timedwait(&headdataavailable, &deadline) &&
+                   errno == EINTR) {}
+        }
+        sleeping.store(false);
+    }
+
+    // delayed messages not due yet are dropped
+    for (auto m : timers) {
+        recycle(m);
     }
+    timers.clear();
 }
 
 void looper::quit() {
     LOGV("quit");
-    loopermessage *msg = new loopermessage();
-    msg->what = 0;
-    msg->obj = NULL;
-    msg->next = NULL;
+    loopermessage *msg = obtain(0, NULL, 0);
     msg->quit = true;
-    addmsg(msg, false);
+    enqueue(msg);
     void *retval;
     pthread_join(worker, &retval);
+
+    // posted after the quit message
+    while ((msg = dequeue()) != NULL) {
+        recycle(msg);
+    }
     sem_destroy(&headdataavailable);
-    sem_destroy(&headwriteprotect);
     running = false;
 }
 
 void looper::handle(int what, void* obj) {
+    (void)what;     // LOGV compiles to nothing in the host build
+    (void)obj;
     LOGV("dropping msg %d %p", what, obj);
 }
 
+void looper::getstats(looperstats *stats) {
+    stats->posted = posted.load();
+    stats->coalesced = coalesced.load();
+    stats->flushed = flushed.load();
+    stats->handled = handled.load();
+    stats->poolmisses = poolmisses.load();
+    stats->wakeups = wakeups.load();
+}
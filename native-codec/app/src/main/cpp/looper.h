@@ -16,9 +16,34 @@
 
 #include <pthread.h>
 #include <semaphore.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
 
 struct loopermessage;
 
+/*
+ * looperstats: counters of a looper since it was created
+ */
+struct looperstats {
+    uint64_t posted;        // messages queued
+    uint64_t coalesced;     // postunique() calls folded into a pending message
+    uint64_t flushed;       // dropped by a flushing post
+    uint64_t handled;
+    uint64_t poolmisses;    // messages allocated because the pool was empty
+    uint64_t wakeups;       // times the worker had to be woken up
+};
+
+/*
+ * looper: a worker thread handling messages in the order they are posted.
+ *
+ * Posting is O(1) and lock free: messages come from a preallocated pool and
+ * are appended to an intrusive multi-producer / single-consumer queue. The
+ * worker is only woken up (one semaphore post) when it is sleeping.
+ * Messages may be delayed, and a message whose what code is already pending
+ * may be coalesced into it with postunique().
+ */
 class looper {
     public:
         looper();
@@ -26,18 +51,60 @@ class looper {
         looper(looper&) = delete;
         virtual ~looper();
 
+        // flush: drop every message still pending, delayed ones included
         void post(int what, void *data, bool flush = false);
+        // handled no earlier than delayns / whenns (CLOCK_MONOTONIC) from now
+        void postdelayed(int what, void *data, int64_t delayns);
+        void postat(int what, void *data, int64_t whenns);
+        // nothing is queued if a what message is already pending; the data of
+        // the pending message is kept. what must be below kMaxUniqueWhat.
+        void postunique(int what, void *data);
         void quit();
 
         virtual void handle(int what, void *data);
 
+        void getstats(looperstats *stats);
+        static int64_t now();
+
+        static const int kMaxUniqueWhat = 64;
+
     private:
-        void addmsg(loopermessage *msg, bool flush);
+        loopermessage *obtain(int what, void *data, int64_t when);
+        void recycle(loopermessage *msg);
+        void enqueue(loopermessage *msg);
+        loopermessage *dequeue();
+        void dispatch(loopermessage *msg);
         static void* trampoline(void* p);
         void loop();
-        loopermessage *head;
+
+        // queue: producers swap head, the worker walks from tail
+        std::atomic<loopermessage*> head;
+        loopermessage *tail;
+        loopermessage *stub;
+
+        // pool: lock free stack of free message indices, with an ABA tag
+        loopermessage *pool;
+        std::atomic<uint64_t> freelist;
+
+        std::atomic<uint32_t> flushgeneration;
+        std::atomic<bool> pendingwhat[kMaxUniqueWhat];
+        std::atomic<bool> sleeping;
+        std::vector<loopermessage*> timers;  // worker only: min heap on when
+
+        std::atomic<uint64_t> posted;
+        std::atomic<uint64_t> coalesced;
+        std::atomic<uint64_t> poolmisses;
+        std::atomic<uint64_t> wakeups;
+        std::atomic<uint64_t> flushed;
+        std::atomic<uint64_t> handled;
+
         pthread_t worker;
-        sem_t headwriteprotect;
         sem_t headdataavailable;
         bool running;
 };
+
+/*
+ * Throughput and wake-up latency of looper against the previous linked list
+ * implementation, printed into report. See looper_benchmark.cpp.
+ */
+void looperbenchmark(char *report, size_t size);
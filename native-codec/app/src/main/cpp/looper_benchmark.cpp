@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compares looper with the implementation it replaced: message throughput
+ * with 1 and 4 posting threads, and the latency from post() to handle()
+ * when the worker is asleep. Also times delayed messages and coalescing.
+ * No Android dependency, runs on the host:
+ *   g++ -std=c++11 -O2 -pthread -DLOOPER_HOST_BENCHMARK \
+ *       looper.cpp looper_benchmark.cpp
+ */
+
+#include "looper.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/*
+ * The previous looper: a new per message, appended at the end of a linked
+ * list under a semaphore used as a mutex
+ */
+struct legacymessage {
+    int what;
+    void *obj;
+    legacymessage *next;
+    bool quit;
+};
+
+class legacylooper {
+    public:
+        legacylooper() : head(NULL) {
+            sem_init(&headdataavailable, 0, 0);
+            sem_init(&headwriteprotect, 0, 1);
+            pthread_create(&worker, NULL, trampoline, this);
+        }
+        virtual ~legacylooper() {}
+
+        void post(int what, void *data, bool flush = false) {
+            legacymessage *msg = new legacymessage();
+            msg->what = what;
+            msg->obj = data;
+            msg->next = NULL;
+            msg->quit = false;
+            addmsg(msg, flush);
+        }
+        void quit() {
+            legacymessage *msg = new legacymessage();
+            msg->what = 0;
+            msg->obj = NULL;
+            msg->next = NULL;
+            msg->quit = true;
+            addmsg(msg, false);
+            pthread_join(worker, NULL);
+            sem_destroy(&headdataavailable);
+            sem_destroy(&headwriteprotect);
+        }
+        virtual void handle(int what, void *data) = 0;
+
+    private:
+        void addmsg(legacymessage *msg, bool flush) {
+            sem_wait(&headwriteprotect);
+            legacymessage *h = head;
+            if (flush) {
+                while(h) {
+                    legacymessage *next = h->next;
+                    delete h;
+                    h = next;
+                }
+                h = NULL;
+            }
+            if (h) {
+                while (h->next) {
+                    h = h->next;
+                }
+                h->next = msg;
+            } else {
+                head = msg;
+            }
+            sem_post(&headwriteprotect);
+            sem_post(&headdataavailable);
+        }
+        static void* trampoline(void* p) {
+            ((legacylooper*)p)->loop();
+            return NULL;
+        }
+        void loop() {
+            while(true) {
+                sem_wait(&headdataavailable);
+                sem_wait(&headwriteprotect);
+                legacymessage *msg = head;
+                if (msg == NULL) {
+                    sem_post(&headwriteprotect);
+                    continue;
+                }
+                head = msg->next;
+                sem_post(&headwriteprotect);
+                if (msg->quit) {
+                    delete msg;
+                    return;
+                }
+                handle(msg->what, msg->obj);
+                delete msg;
+            }
+        }
+        legacymessage *head;
+        pthread_t worker;
+        sem_t headwriteprotect;
+        sem_t headdataavailable;
+};
+
+enum {
+    kMsgCount,
+    kMsgStamp,
+    kMsgSlow,
+};
+
+template <class L>
+class benchlooper : public L {
+    public:
+        benchlooper() : count(0), latencysum(0), latencymax(0) {}
+        virtual void handle(int what, void *data) {
+            switch (what) {
+                case kMsgStamp:
+                {
+                    // data points to the time it was posted, or is due
+                    int64_t latency = looper::now() - *(int64_t*)data;
+                    latencysum += latency;
+                    latencymax = std::max(latencymax, latency);
+                }
+                break;
+                case kMsgSlow:
+                    usleep(50);
+                    break;
+            }
+            count.fetch_add(1, std::memory_order_release);
+        }
+        void waitfor(uint64_t n) {
+            while (count.load(std::memory_order_acquire) < n) {
+                sched_yield();
+            }
+        }
+        std::atomic<uint64_t> count;
+        int64_t latencysum;
+        int64_t latencymax;
+};
+
+template <class L>
+static double throughput(int producers, int messages) {
+    benchlooper<L> l;
+    int64_t start = looper::now();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&l, producers, messages] {
+            for (int i = 0; i < messages / producers; i++) {
+                l.post(kMsgCount, NULL);
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    l.waitfor(messages / producers * producers);
+    double seconds = (looper::now() - start) / 1e9;
+    l.quit();
+    return messages / seconds;
+}
+
+template <class L>
+static void wakeuplatency(int messages, double *avgus, double *maxus) {
+    benchlooper<L> l;
+    std::vector<int64_t> stamps(messages);
+    for (int i = 0; i < messages; i++) {
+        usleep(200);  // let the worker fall asleep
+        stamps[i] = looper::now();
+        l.post(kMsgStamp, &stamps[i]);
+        l.waitfor(i + 1);
+    }
+    l.quit();
+    *avgus = l.latencysum / 1000.0 / messages;
+    *maxus = l.latencymax / 1000.0;
+}
+
+void looperbenchmark(char *report, size_t size) {
+    const int kMessages = 40000;
+    const int kWakeups = 500;
+    int used = 0;
+    report[0] = 0;
+
+    for (int producers = 1; producers <= 4; producers *= 4) {
+        double legacy = throughput<legacylooper>(producers, kMessages);
+        double mpsc = throughput<looper>(producers, kMessages);
+        used += snprintf(report + used, size - used,
+                         "%d poster(s): %.2f M msg/s, was %.2f M msg/s\n",
+                         producers, mpsc / 1e6, legacy / 1e6);
+    }
+
+    double legacyavg, legacymax, avg, max;
+    wakeuplatency<legacylooper>(kWakeups, &legacyavg, &legacymax);
+    wakeuplatency<looper>(kWakeups, &avg, &max);
+    used += snprintf(report + used, size - used,
+                     "wake-up latency: %.1f us avg %.1f us max, "
+                     "was %.1f us avg %.1f us max\n",
+                     avg, max, legacyavg, legacymax);
+
+    {
+        // delayed messages: how late after their due time they run
+        benchlooper<looper> l;
+        std::vector<int64_t> due(kWakeups / 5);
+        for (size_t i = 0; i < due.size(); i++) {
+            due[i] = looper::now() + 1000000;
+            l.postat(kMsgStamp, &due[i], due[i]);
+            l.waitfor(i + 1);
+        }
+        l.quit();
+        used += snprintf(report + used, size - used,
+                         "delayed 1 ms: %.1f us late avg %.1f us max\n",
+                         l.latencysum / 1000.0 / due.size(),
+                         l.latencymax / 1000.0);
+    }
+
+    {
+        // coalescing: a slow handler and a fast poster
+        benchlooper<looper> l;
+        for (int i = 0; i < 10000; i++) {
+            l.postunique(kMsgSlow, NULL);
+        }
+        l.quit();
+        looperstats stats;
+        l.getstats(&stats);
+        used += snprintf(report + used, size - used,
+                         "postunique: 10000 posts, %llu handled, %llu "
+                         "coalesced, %llu pool misses\n",
+                         (unsigned long long)stats.handled,
+                         (unsigned long long)stats.coalesced,
+                         (unsigned long long)stats.poolmisses);
+    }
+}
+
+#ifdef LOOPER_HOST_BENCHMARK
+int main() {
+    char report[1024];
+    looperbenchmark(report, sizeof(report));
+    fputs(report, stdout);
+    return 0;
+}
+#endif
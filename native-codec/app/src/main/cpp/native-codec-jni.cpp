@@ -35,6 +35,7 @@
 #include <errno.h>
 #include <limits.h>
 
+#include "codec_pipeline.h"
 #include "looper.h"
 #include "media/NdkMediaCodec.h"
 #include "media/NdkMediaExtractor.h"
@@ -50,25 +51,99 @@
 #include <android/asset_manager.h>
 #include <android/asset_manager_jni.h>
 
+/*
+ * The AMedia* objects behind the stages of codecpipeline
+ */
+class ndksource : public mediasource {
+    public:
+        explicit ndksource(AMediaExtractor *ex) : ex(ex) {}
+        virtual ssize_t readsample(uint8_t *buf, size_t capacity) {
+            return AMediaExtractor_readSampleData(ex, buf, capacity);
+        }
+        virtual int64_t sampletime() {
+            return AMediaExtractor_getSampleTime(ex);
+        }
+        virtual void advance() {
+            AMediaExtractor_advance(ex);
+        }
+        virtual void seekto(int64_t timeus) {
+            AMediaExtractor_seekTo(ex, timeus, AMEDIAEXTRACTOR_SEEK_NEXT_SYNC);
+        }
+    private:
+        AMediaExtractor *ex;
+};
+
+class ndkdecoder : public mediadecoder {
+    public:
+        explicit ndkdecoder(AMediaCodec *codec) : codec(codec) {}
+        virtual ssize_t dequeueinput() {
+            return AMediaCodec_dequeueInputBuffer(codec, 0);
+        }
+        virtual uint8_t *getinput(size_t idx, size_t *capacity) {
+            return AMediaCodec_getInputBuffer(codec, idx, capacity);
+        }
+        virtual void queueinput(size_t idx, size_t size, int64_t ptsus, bool eos) {
+            AMediaCodec_queueInputBuffer(codec, idx, 0, size, ptsus,
+                    eos ? AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM : 0);
+        }
+        virtual ssize_t dequeueoutput(int64_t *ptsus, size_t *size, bool *eos) {
+            while (true) {
+                AMediaCodecBufferInfo info;
+                auto status = AMediaCodec_dequeueOutputBuffer(codec, &info, 0);
+                if (status >= 0) {
+                    *ptsus = info.presentationTimeUs;
+                    *size = info.size;
+                    *eos = (info.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM) != 0;
+                    if (*eos) {
+                        LOGV("output EOS");
+                    }
+                    return status;
+                } else if (status == AMEDIACODEC_INFO_OUTPUT_BUFFERS_CHANGED) {
+                    LOGV("output buffers changed");
+                } else if (status == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED) {
+                    auto format = AMediaCodec_getOutputFormat(codec);
+                    LOGV("format changed to: %s", AMediaFormat_toString(format));
+                    AMediaFormat_delete(format);
+                } else if (status == AMEDIACODEC_INFO_TRY_AGAIN_LATER) {
+                    return -1;
+                } else {
+                    LOGV("unexpected info code: %zd", status);
+                    return -1;
+                }
+            }
+        }
+        virtual void releaseoutput(size_t idx, bool render, int64_t renderns) {
+            if (render) {
+                // shown at renderns by the compositor: no sleeping here
+                AMediaCodec_releaseOutputBufferAtTime(codec, idx, renderns);
+            } else {
+                AMediaCodec_releaseOutputBuffer(codec, idx, false);
+            }
+        }
+        virtual void flush() {
+            AMediaCodec_flush(codec);
+        }
+    private:
+        AMediaCodec *codec;
+};
+
 typedef struct {
     int fd;
     ANativeWindow* window;
     AMediaExtractor* ex;
     AMediaCodec *codec;
-    int64_t renderstart;
-    bool sawInputEOS;
-    bool sawOutputEOS;
-    bool isPlaying;
-    bool renderonce;
+    ndksource *source;
+    ndkdecoder *decoder;
+    codecpipeline *pipeline;
 } workerdata;
 
-workerdata data = {-1, NULL, NULL, NULL, 0, false, false, false, false};
+workerdata data = {-1, NULL, NULL, NULL, NULL, NULL, NULL};
 
 enum {
     kMsgCodecBuffer,
     kMsgPause,
     kMsgResume,
-    kMsgPauseAck,
+    kMsgRenderOnce,
     kMsgDecodeDone,
     kMsgSeek,
 };
@@ -81,134 +156,65 @@ class mylooper: public looper {
 
 static mylooper *mlooper = NULL;
 
-int64_t systemnanotime() {
-    timespec now;
-    clock_gettime(CLOCK_MONOTONIC, &now);
-    return now.tv_sec * 1000000000LL + now.tv_nsec;
-}
-
-void doCodecWork(workerdata *d) {
-
-    ssize_t bufidx = -1;
-    if (!d->sawInputEOS) {
-        bufidx = AMediaCodec_dequeueInputBuffer(d->codec, 2000);
-        LOGV("input buffer %zd", bufidx);
-        if (bufidx >= 0) {
-            size_t bufsize;
-            auto buf = AMediaCodec_getInputBuffer(d->codec, bufidx, &bufsize);
-            auto sampleSize = AMediaExtractor_readSampleData(d->ex, buf, bufsize);
-            if (sampleSize < 0) {
-                sampleSize = 0;
-                d->sawInputEOS = true;
-                LOGV("EOS");
-            }
-            auto presentationTimeUs = AMediaExtractor_getSampleTime(d->ex);
-
-            AMediaCodec_queueInputBuffer(d->codec, bufidx, 0, sampleSize, presentationTimeUs,
-                    d->sawInputEOS ? AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM : 0);
-            AMediaExtractor_advance(d->ex);
-        }
-    }
-
-    if (!d->sawOutputEOS) {
-        AMediaCodecBufferInfo info;
-        auto status = AMediaCodec_dequeueOutputBuffer(d->codec, &info, 0);
-        if (status >= 0) {
-            if (info.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM) {
-                LOGV("output EOS");
-                d->sawOutputEOS = true;
-            }
-            int64_t presentationNano = info.presentationTimeUs * 1000;
-            if (d->renderstart < 0) {
-                d->renderstart = systemnanotime() - presentationNano;
-            }
-            int64_t delay = (d->renderstart + presentationNano) - systemnanotime();
-            if (delay > 0) {
-                usleep(delay / 1000);
-            }
-            AMediaCodec_releaseOutputBuffer(d->codec, status, info.size != 0);
-            if (d->renderonce) {
-                d->renderonce = false;
-                return;
-            }
-        } else if (status == AMEDIACODEC_INFO_OUTPUT_BUFFERS_CHANGED) {
-            LOGV("output buffers changed");
-        } else if (status == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED) {
-            auto format = AMediaCodec_getOutputFormat(d->codec);
-            LOGV("format changed to: %s", AMediaFormat_toString(format));
-            AMediaFormat_delete(format);
-        } else if (status == AMEDIACODEC_INFO_TRY_AGAIN_LATER) {
-            LOGV("no output buffer right now");
-        } else {
-            LOGV("unexpected info code: %zd", status);
+void mylooper::handle(int what, void* obj) {
+    if (what == kMsgCodecBuffer) {
+        // obj identifies the run, see codecpipeline::work()
+        if (data.pipeline) {
+            data.pipeline->work(obj);
         }
+        return;
     }
 
-    if (!d->sawInputEOS || !d->sawOutputEOS) {
-        mlooper->post(kMsgCodecBuffer, d);
+    workerdata *d = (workerdata*)obj;
+    if (!d->pipeline) {
+        return;
     }
-}
-
-void mylooper::handle(int what, void* obj) {
     switch (what) {
-        case kMsgCodecBuffer:
-            doCodecWork((workerdata*)obj);
-            break;
-
         case kMsgDecodeDone:
         {
-            workerdata *d = (workerdata*)obj;
+            playerstats stats;
+            d->pipeline->stop();
+            d->pipeline->getstats(&stats);
+            LOGV("decoded %llu frames: %llu rendered, %llu late (max %lld us), "
+                 "%llu dropped; %u samples in flight max",
+                 (unsigned long long)stats.framesdecoded,
+                 (unsigned long long)stats.framesrendered,
+                 (unsigned long long)stats.frameslate,
+                 (long long)stats.maxlatenessus,
+                 (unsigned long long)stats.framesdropped,
+                 stats.maxinputinflight);
+            delete d->pipeline;
+            delete d->decoder;
+            delete d->source;
+            d->pipeline = NULL;
+            d->decoder = NULL;
+            d->source = NULL;
             AMediaCodec_stop(d->codec);
             AMediaCodec_delete(d->codec);
             AMediaExtractor_delete(d->ex);
-            d->sawInputEOS = true;
-            d->sawOutputEOS = true;
         }
         break;
 
         case kMsgSeek:
-        {
-            workerdata *d = (workerdata*)obj;
-            AMediaExtractor_seekTo(d->ex, 0, AMEDIAEXTRACTOR_SEEK_NEXT_SYNC);
-            AMediaCodec_flush(d->codec);
-            d->renderstart = -1;
-            d->sawInputEOS = false;
-            d->sawOutputEOS = false;
-            if (!d->isPlaying) {
-                d->renderonce = true;
-                post(kMsgCodecBuffer, d);
-            }
+            d->pipeline->seek(0);
             LOGV("seeked");
-        }
-        break;
+            break;
 
         case kMsgPause:
-        {
-            workerdata *d = (workerdata*)obj;
-            if (d->isPlaying) {
-                // flush all outstanding codecbuffer messages with a no-op message
-                d->isPlaying = false;
-                post(kMsgPauseAck, NULL, true);
-            }
-        }
-        break;
+            // runs already posted are ignored from now on
+            d->pipeline->pause();
+            break;
 
         case kMsgResume:
-        {
-            workerdata *d = (workerdata*)obj;
-            if (!d->isPlaying) {
-                d->renderstart = -1;
-                d->isPlaying = true;
-                post(kMsgCodecBuffer, d);
-            }
-        }
-        break;
+            d->pipeline->start(false);
+            break;
+
+        case kMsgRenderOnce:
+            d->pipeline->start(true);
+            break;
     }
 }
 
-
-
-
 extern "C" {
 
 jboolean Java_com_example_nativecodec_NativeCodec_createStreamingMediaPlayer(JNIEnv* env,
@@ -265,18 +271,20 @@ jboolean Java_com_example_nativecodec_NativeCodec_createStreamingMediaPlayer(JNI
             AMediaCodec_configure(codec, format, d->window, NULL, 0);
             d->ex = ex;
             d->codec = codec;
-            d->renderstart = -1;
-            d->sawInputEOS = false;
-            d->sawOutputEOS = false;
-            d->isPlaying = false;
-            d->renderonce = true;
             AMediaCodec_start(codec);
         }
         AMediaFormat_delete(format);
     }
 
     mlooper = new mylooper();
-    mlooper->post(kMsgCodecBuffer, d);
+    if (d->codec) {
+        d->source = new ndksource(d->ex);
+        d->decoder = new ndkdecoder(d->codec);
+        d->pipeline = new codecpipeline(mlooper, kMsgCodecBuffer, d->source,
+                                        d->decoder);
+    }
+    // show the first frame, paused
+    mlooper->post(kMsgRenderOnce, d);
 
     return JNI_TRUE;
 }
@@ -303,6 +311,13 @@ void Java_com_example_nativecodec_NativeCodec_shutdown(JNIEnv* env, jclass clazz
     if (mlooper) {
         mlooper->post(kMsgDecodeDone, &data, true /* flush */);
         mlooper->quit();
+        looperstats stats;
+        mlooper->getstats(&stats);
+        LOGV("looper: %llu posted, %llu handled, %llu coalesced, %llu flushed, "
+             "%llu wake-ups, %llu pool misses",
+             (unsigned long long)stats.posted, (unsigned long long)stats.handled,
+             (unsigned long long)stats.coalesced, (unsigned long long)stats.flushed,
+             (unsigned long long)stats.wakeups, (unsigned long long)stats.poolmisses);
         delete mlooper;
         mlooper = NULL;
     }
@@ -42,6 +42,7 @@
 #include <android/native_window_jni.h>
 #include <android/asset_manager_jni.h>
 #include "android_fopen.h"
+#include "ts_source.h"
 
 // engine interfaces
 static XAObjectItf engineObject = NULL;
@@ -67,20 +68,17 @@ static ANativeWindow* theNativeWindow;
 #define NB_BUFFERS 8
 
 // we're streaming MPEG-2 transport stream data, operate on transport stream block size
-#define MPEG2_TS_PACKET_SIZE 188
+#define MPEG2_TS_PACKET_SIZE TS_PACKET_SIZE
 
 // number of MPEG-2 transport stream blocks per buffer, an arbitrary number
 #define PACKETS_PER_BUFFER 10
 
-// determines how much memory we're dedicating to memory caching
+// size of the slices of prefetched data we enqueue
 #define BUFFER_SIZE (PACKETS_PER_BUFFER*MPEG2_TS_PACKET_SIZE)
 
-// where we cache in memory the data to play
-// note this memory is re-used by the buffer queue callback
-static char dataCache[BUFFER_SIZE * NB_BUFFERS];
-
-// handle of the file to play
-static FILE *file;
+// the file to play, read ahead on a background thread;
+// the buffer queue plays straight out of its prefetch blocks
+static TsSource *source;
 
 // has the app reached the end of the file
 static jboolean reachedEof = JNI_FALSE;
@@ -88,8 +86,8 @@ static jboolean reachedEof = JNI_FALSE;
 // constant to identify a buffer context which is the end of the stream to decode
 static const int kEosBufferCntxt = 1980; // a magic value we can compare against
 
-// For mutual exclusion between callback thread and application thread(s).
-// The mutex protects reachedEof, discontinuity,
+// For mutual exclusion between callback thread, prefetch thread and application thread(s).
+// The mutex protects reachedEof, discontinuity, starvedBuffers, pendingDiscontinuity,
 // The condition is signalled when a discontinuity is acknowledged.
 
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -98,7 +96,77 @@ static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
 // whether a discontinuity is in progress
 static jboolean discontinuity = JNI_FALSE;
 
-static jboolean enqueueInitialBuffers(jboolean discontinuity);
+// number of buffer queue slots we owe a buffer, because nothing was prefetched yet
+static XAuint32 starvedBuffers = 0;
+
+// whether the next buffer enqueued must carry a discontinuity indicator
+static jboolean pendingDiscontinuity = JNI_FALSE;
+
+static void enqueueInitialBuffers(jboolean discontinuity);
+
+// Enqueue prefetched slices into the slots we owe a buffer, or EOS once the whole file
+// was handed out. Never blocks: what is not prefetched yet is enqueued from
+// SourceReadyCallback. Called with the mutex held.
+static void enqueueReadySlices(void)
+{
+    XAresult res;
+
+    while (starvedBuffers > 0 && !reachedEof) {
+        void *slice;
+        size_t sliceSize;
+        int status = ts_source_next_slice(source, &slice, &sliceSize);
+        if (TS_SLICE_UNDERRUN == status) {
+            break;
+        }
+        if (TS_SLICE_END == status) {
+            // signal EOS
+            XAAndroidBufferItem msgEos[1];
+            msgEos[0].itemKey = XA_ANDROID_ITEMKEY_EOS;
+            msgEos[0].itemSize = 0;
+            // EOS message has no parameters, so the total size of the message is the size of
+            //   the key plus the size if itemSize, both XAuint32
+            res = (*playerBQItf)->Enqueue(playerBQItf, (void *)&kEosBufferCntxt /*pBufferContext*/,
+                    NULL /*pData*/, 0 /*dataLength*/,
+                    msgEos /*pMsg*/,
+                    sizeof(XAuint32)*2 /*msgLength*/);
+            assert(XA_RESULT_SUCCESS == res);
+            reachedEof = JNI_TRUE;
+            break;
+        }
+        if (pendingDiscontinuity) {
+            // signal discontinuity
+            XAAndroidBufferItem items[1];
+            items[0].itemKey = XA_ANDROID_ITEMKEY_DISCONTINUITY;
+            items[0].itemSize = 0;
+            // DISCONTINUITY message has no parameters,
+            //   so the total size of the message is the size of the key
+            //   plus the size if itemSize, both XAuint32
+            res = (*playerBQItf)->Enqueue(playerBQItf, NULL /*pBufferContext*/,
+                    slice, sliceSize, items /*pMsg*/,
+                    sizeof(XAuint32)*2 /*msgLength*/);
+            pendingDiscontinuity = JNI_FALSE;
+        } else {
+            res = (*playerBQItf)->Enqueue(playerBQItf, NULL /*pBufferContext*/,
+                    slice, sliceSize, NULL, 0);
+        }
+        assert(XA_RESULT_SUCCESS == res);
+        starvedBuffers--;
+    }
+}
+
+// TsSource callback, invoked on the prefetch thread when more packets are ready
+static void SourceReadyCallback(void *context)
+{
+    int ok;
+
+    ok = pthread_mutex_lock(&mutex);
+    assert(0 == ok);
+    if (NULL != playerBQItf) {
+        enqueueReadySlices();
+    }
+    ok = pthread_mutex_unlock(&mutex);
+    assert(0 == ok);
+}
 
 // AndroidBufferQueueItf callback to supply MPEG-2 TS packets to the media player
 static XAresult AndroidBufferQueueCallback(
@@ -130,9 +198,9 @@ static XAresult AndroidBufferQueueCallback(
             res = (*playerBQItf)->Clear(playerBQItf);
             assert(XA_RESULT_SUCCESS == res);
             // rewind the data source so we are guaranteed to be at an appropriate point
-            rewind(file);
+            ts_source_rewind(source);
             // Enqueue the initial buffers, with a discontinuity indicator on first buffer
-            (void) enqueueInitialBuffers(JNI_TRUE);
+            enqueueInitialBuffers(JNI_TRUE);
         }
         // acknowledge the discontinuity request
         discontinuity = JNI_FALSE;
@@ -151,46 +219,19 @@ static XAresult AndroidBufferQueueCallback(
         }
     }
 
-    // pBufferData is a pointer to a buffer that we previously Enqueued
+    // pBufferData is a pointer to a slice that we previously Enqueued,
+    // its prefetch block can be read into again once all its slices are played
     assert((dataSize > 0) && ((dataSize % MPEG2_TS_PACKET_SIZE) == 0));
-    assert(dataCache <= (char *) pBufferData && (char *) pBufferData <
-            &dataCache[BUFFER_SIZE * NB_BUFFERS]);
-    assert(0 == (((char *) pBufferData - dataCache) % BUFFER_SIZE));
+    ts_source_release_slice(source, pBufferData, dataSize);
 
     // don't bother trying to read more data once we've hit EOF
     if (reachedEof) {
         goto exit;
     }
 
-    // note we do call fread from multiple threads, but never concurrently
-    size_t bytesRead;
-    bytesRead = fread(pBufferData, 1, BUFFER_SIZE, file);
-    if (bytesRead > 0) {
-        if ((bytesRead % MPEG2_TS_PACKET_SIZE) != 0) {
-            LOGV("Dropping last packet because it is not whole");
-        }
-        size_t packetsRead = bytesRead / MPEG2_TS_PACKET_SIZE;
-        size_t bufferSize = packetsRead * MPEG2_TS_PACKET_SIZE;
-        res = (*caller)->Enqueue(caller, NULL /*pBufferContext*/,
-                pBufferData /*pData*/,
-                bufferSize /*dataLength*/,
-                NULL /*pMsg*/,
-                0 /*msgLength*/);
-        assert(XA_RESULT_SUCCESS == res);
-    } else {
-        // EOF or I/O error, signal EOS
-        XAAndroidBufferItem msgEos[1];
-        msgEos[0].itemKey = XA_ANDROID_ITEMKEY_EOS;
-        msgEos[0].itemSize = 0;
-        // EOS message has no parameters, so the total size of the message is the size of the key
-        //   plus the size if itemSize, both XAuint32
-        res = (*caller)->Enqueue(caller, (void *)&kEosBufferCntxt /*pBufferContext*/,
-                NULL /*pData*/, 0 /*dataLength*/,
-                msgEos /*pMsg*/,
-                sizeof(XAuint32)*2 /*msgLength*/);
-        assert(XA_RESULT_SUCCESS == res);
-        reachedEof = JNI_TRUE;
-    }
+    // hand over the next prefetched slice, no I/O happens here
+    starvedBuffers++;
+    enqueueReadySlices();
 
 exit:
     ok = pthread_mutex_unlock(&mutex);
@@ -270,59 +311,17 @@ void Java_com_example_nativemedia_NativeMedia_createEngine(JNIEnv* env, jclass c
 }
 
 
-// Enqueue the initial buffers, and optionally signal a discontinuity in the first buffer
-static jboolean enqueueInitialBuffers(jboolean discontinuity)
+// Enqueue the initial buffers, and optionally signal a discontinuity in the first buffer.
+// Called with the mutex held.
+static void enqueueInitialBuffers(jboolean discontinuity)
 {
-
-    /* Fill our cache.
-     * We want to read whole packets (integral multiples of MPEG2_TS_PACKET_SIZE).
-     * fread returns units of "elements" not bytes, so we ask for 1-byte elements
-     * and then check that the number of elements is a multiple of the packet size.
+    /* Fill every buffer of the queue from what is prefetched.
+     * Buffers which can't be filled yet are enqueued by SourceReadyCallback
+     * as soon as the prefetch thread gets to them.
      */
-    size_t bytesRead;
-    bytesRead = fread(dataCache, 1, BUFFER_SIZE * NB_BUFFERS, file);
-    if (bytesRead <= 0) {
-        // could be premature EOF or I/O error
-        return JNI_FALSE;
-    }
-    if ((bytesRead % MPEG2_TS_PACKET_SIZE) != 0) {
-        LOGV("Dropping last packet because it is not whole");
-    }
-    size_t packetsRead = bytesRead / MPEG2_TS_PACKET_SIZE;
-    LOGV("Initially queueing %zu packets", packetsRead);
-
-    /* Enqueue the content of our cache before starting to play,
-       we don't want to starve the player */
-    size_t i;
-    for (i = 0; i < NB_BUFFERS && packetsRead > 0; i++) {
-        // compute size of this buffer
-        size_t packetsThisBuffer = packetsRead;
-        if (packetsThisBuffer > PACKETS_PER_BUFFER) {
-            packetsThisBuffer = PACKETS_PER_BUFFER;
-        }
-        size_t bufferSize = packetsThisBuffer * MPEG2_TS_PACKET_SIZE;
-        XAresult res;
-        if (discontinuity) {
-            // signal discontinuity
-            XAAndroidBufferItem items[1];
-            items[0].itemKey = XA_ANDROID_ITEMKEY_DISCONTINUITY;
-            items[0].itemSize = 0;
-            // DISCONTINUITY message has no parameters,
-            //   so the total size of the message is the size of the key
-            //   plus the size if itemSize, both XAuint32
-            res = (*playerBQItf)->Enqueue(playerBQItf, NULL /*pBufferContext*/,
-                    dataCache + i*BUFFER_SIZE, bufferSize, items /*pMsg*/,
-                    sizeof(XAuint32)*2 /*msgLength*/);
-            discontinuity = JNI_FALSE;
-        } else {
-            res = (*playerBQItf)->Enqueue(playerBQItf, NULL /*pBufferContext*/,
-                    dataCache + i*BUFFER_SIZE, bufferSize, NULL, 0);
-        }
-        assert(XA_RESULT_SUCCESS == res);
-        packetsRead -= packetsThisBuffer;
-    }
-
-    return JNI_TRUE;
+    starvedBuffers = NB_BUFFERS;
+    pendingDiscontinuity = discontinuity;
+    enqueueReadySlices();
 }
 
 
@@ -338,11 +337,17 @@ jboolean Java_com_example_nativemedia_NativeMedia_createStreamingMediaPlayer(JNI
     assert(NULL != utf8);
 
     // open the file to play
-    file = android_fopen(utf8, "rb");
+    FILE *file = android_fopen(utf8, "rb");
     if (file == NULL) {
         return JNI_FALSE;
     }
 
+    // start reading it ahead, so that the buffer queue callback never waits on I/O
+    source = ts_source_create(file, BUFFER_SIZE, SourceReadyCallback, NULL);
+    if (source == NULL) {
+        return JNI_FALSE;
+    }
+
     // configure data source
     XADataLocator_AndroidBufferQueue loc_abq = { XA_DATALOCATOR_ANDROIDBUFFERQUEUE, NB_BUFFERS };
     XADataFormat_MIME format_mime = {
@@ -414,11 +419,19 @@ jboolean Java_com_example_nativemedia_NativeMedia_createStreamingMediaPlayer(JNI
             StreamChangeCallback, NULL);
     assert(XA_RESULT_SUCCESS == res);
 
-    // enqueue the initial buffers
-    if (!enqueueInitialBuffers(JNI_FALSE)) {
+    // wait for the first packets, could be premature EOF or I/O error
+    if (!ts_source_wait_ready(source)) {
         return JNI_FALSE;
     }
 
+    // enqueue the initial buffers, we don't want to starve the player
+    int ok;
+    ok = pthread_mutex_lock(&mutex);
+    assert(0 == ok);
+    enqueueInitialBuffers(JNI_FALSE);
+    ok = pthread_mutex_unlock(&mutex);
+    assert(0 == ok);
+
     // prepare the player
     res = (*playerPlayItf)->SetPlayState(playerPlayItf, XA_PLAYSTATE_PAUSED);
     assert(XA_RESULT_SUCCESS == res);
@@ -457,6 +470,11 @@ void Java_com_example_nativemedia_NativeMedia_setPlayingStreamingMediaPlayer(JNI
 // shut down the native media system
 void Java_com_example_nativemedia_NativeMedia_shutdown(JNIEnv* env, jclass clazz)
 {
+    // stop prefetching, the prefetch thread enqueues buffers too
+    if (source != NULL) {
+        ts_source_stop(source);
+    }
+
     // destroy streaming media player object, and invalidate all associated interfaces
     if (playerObj != NULL) {
         (*playerObj)->Destroy(playerObj);
@@ -481,9 +499,16 @@ void Java_com_example_nativemedia_NativeMedia_shutdown(JNIEnv* env, jclass clazz
     }
 
     // close the file
-    if (file != NULL) {
-        fclose(file);
-        file = NULL;
+    if (source != NULL) {
+        TsSourceStats stats;
+        ts_source_get_stats(source, &stats);
+        LOGV("Read-ahead: %llu slices, %llu prefetch hits, %llu underruns, %llu sync losses",
+                (unsigned long long) stats.slicesHanded,
+                (unsigned long long) stats.prefetchHits,
+                (unsigned long long) stats.underruns,
+                (unsigned long long) stats.syncLosses);
+        ts_source_destroy(source);
+        source = NULL;
     }
 
     // make sure we don't leak native windows
@@ -520,7 +545,7 @@ void Java_com_example_nativemedia_NativeMedia_rewindStreamingMediaPlayer(JNIEnv
     }
 
     // make sure the streaming media player was created
-    if (NULL != playerBQItf && NULL != file) {
+    if (NULL != playerBQItf && NULL != source) {
         // first wait for buffers currently in queue to be drained
         int ok;
         ok = pthread_mutex_lock(&mutex);
@@ -0,0 +1,373 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ts_source.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __ANDROID__
+#include <android/log.h>
+#define TAG "NativeMedia"
+#define LOGV(...) __android_log_print(ANDROID_LOG_VERBOSE, TAG, __VA_ARGS__)
+#else
+// host build of ts_source_check.c
+#define LOGV(...) ((void)0)
+#endif
+
+typedef struct TsBlock {
+    uint8_t *data;
+    size_t bytes;       // whole packets prefetched
+    size_t handed;      // bytes handed out as slices
+    size_t released;    // bytes of those released by the player
+    int ready;          // prefetched, not fully released yet
+} TsBlock;
+
+struct TsSource {
+    FILE *file;
+    size_t sliceSize;
+    ts_source_ready_fn ready;
+    void *context;
+
+    // blocks are filled, handed out and released in ring order
+    TsBlock blocks[TS_SOURCE_NB_BLOCKS];
+    unsigned fillIndex;
+    unsigned readIndex;
+    unsigned releaseIndex;
+
+    // prefetch thread only: start of a packet cut by the end of a block
+    uint8_t carry[TS_PACKET_SIZE];
+    size_t carryBytes;
+
+    // the mutex protects everything below and the block indices and states,
+    // it is never held during I/O. The condition is signalled when a block
+    // is prefetched or released, and on rewind and stop.
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    unsigned generation;    // bumped by rewind, in-flight reads are discarded
+    int rewindPending;
+    int endOfFile;
+    int stopping;
+    int running;
+    pthread_t thread;
+    TsSourceStats stats;
+};
+
+/* Checks the sync byte of every packet. On a packet without one, drops
+   bytes up to the next pair of sync bytes a packet apart, so that a 0x47
+   inside garbage is not taken for a packet start.
+   *length is updated to the bytes left; returns the bytes of the whole
+   packets at the start of data, what follows is a partial packet. */
+static size_t syncPackets(uint8_t *data, size_t *length, uint64_t *losses,
+        uint64_t *skipped)
+{
+    size_t len = *length;
+    size_t pos = 0;
+    while (pos + TS_PACKET_SIZE <= len) {
+        // the common case: one byte compare per packet
+        while (pos + TS_PACKET_SIZE <= len && data[pos] == TS_SYNC_BYTE) {
+            pos += TS_PACKET_SIZE;
+        }
+        if (pos + TS_PACKET_SIZE > len) {
+            break;
+        }
+        (*losses)++;
+        size_t next = pos + 1;
+        while (next + TS_PACKET_SIZE < len && !(data[next] == TS_SYNC_BYTE &&
+                data[next + TS_PACKET_SIZE] == TS_SYNC_BYTE)) {
+            next++;
+        }
+        if (next + TS_PACKET_SIZE >= len) {
+            // not confirmed yet: keep less than a packet for the next block
+            next = len - (TS_PACKET_SIZE - 1);
+        }
+        memmove(data + pos, data + next, len - next);
+        *skipped += next - pos;
+        len -= next - pos;
+    }
+    *length = len;
+    return pos;
+}
+
+/* Reads the next block of the file into data, after the carried over
+   partial packet. Returns the bytes of whole packets in data. */
+static size_t readBlock(TsSource *src, uint8_t *data, int *eof, TsSourceStats *stats)
+{
+    memcpy(data, src->carry, src->carryBytes);
+    size_t wanted = TS_SOURCE_BLOCK_SIZE - src->carryBytes;
+    size_t bytesRead = fread(data + src->carryBytes, 1, wanted, src->file);
+    *eof = bytesRead < wanted;
+    stats->bytesRead += bytesRead;
+
+    size_t length = src->carryBytes + bytesRead;
+    size_t packets = syncPackets(data, &length, &stats->syncLosses,
+            &stats->bytesSkipped);
+    src->carryBytes = length - packets;
+    memcpy(src->carry, data + packets, src->carryBytes);
+    if (*eof && src->carryBytes != 0) {
+        LOGV("Dropping last packet because it is not whole");
+        src->carryBytes = 0;
+    }
+    return packets;
+}
+
+static void* prefetchThread(void *arg)
+{
+    TsSource *src = (TsSource *) arg;
+    int ok;
+
+    ok = pthread_mutex_lock(&src->mutex);
+    assert(0 == ok);
+    while (!src->stopping) {
+        if (src->rewindPending) {
+            src->rewindPending = 0;
+            ok = pthread_mutex_unlock(&src->mutex);
+            assert(0 == ok);
+            rewind(src->file);
+            src->carryBytes = 0;
+            ok = pthread_mutex_lock(&src->mutex);
+            assert(0 == ok);
+            continue;
+        }
+        TsBlock *block = &src->blocks[src->fillIndex];
+        if (src->endOfFile || block->ready) {
+            ok = pthread_cond_wait(&src->cond, &src->mutex);
+            assert(0 == ok);
+            continue;
+        }
+
+        // the block is not ready, so nobody else touches its data
+        unsigned generation = src->generation;
+        ok = pthread_mutex_unlock(&src->mutex);
+        assert(0 == ok);
+        TsSourceStats stats;
+        memset(&stats, 0, sizeof(stats));
+        int eof;
+        size_t bytes = readBlock(src, block->data, &eof, &stats);
+        ok = pthread_mutex_lock(&src->mutex);
+        assert(0 == ok);
+
+        if (generation != src->generation) {
+            // rewound meanwhile
+            continue;
+        }
+        src->stats.bytesRead += stats.bytesRead;
+        src->stats.syncLosses += stats.syncLosses;
+        src->stats.bytesSkipped += stats.bytesSkipped;
+        if (bytes > 0) {
+            block->bytes = bytes;
+            block->handed = 0;
+            block->released = 0;
+            block->ready = 1;
+            src->fillIndex = (src->fillIndex + 1) % TS_SOURCE_NB_BLOCKS;
+            src->stats.blocksRead++;
+        }
+        if (eof) {
+            src->endOfFile = 1;
+        }
+        if (bytes == 0 && !eof) {
+            // nothing but garbage, read on
+            continue;
+        }
+        ok = pthread_cond_broadcast(&src->cond);
+        assert(0 == ok);
+        if (NULL != src->ready) {
+            ok = pthread_mutex_unlock(&src->mutex);
+            assert(0 == ok);
+            src->ready(src->context);
+            ok = pthread_mutex_lock(&src->mutex);
+            assert(0 == ok);
+        }
+    }
+    ok = pthread_mutex_unlock(&src->mutex);
+    assert(0 == ok);
+    return NULL;
+}
+
+TsSource* ts_source_create(FILE *file, size_t sliceSize,
+        ts_source_ready_fn ready, void *context)
+{
+    assert(NULL != file);
+    assert(sliceSize > 0 && (sliceSize % TS_PACKET_SIZE) == 0);
+
+    TsSource *src = (TsSource *) calloc(1, sizeof(TsSource));
+    if (NULL == src) {
+        fclose(file);
+        return NULL;
+    }
+    src->file = file;
+    src->sliceSize = sliceSize;
+    src->ready = ready;
+    src->context = context;
+    pthread_mutex_init(&src->mutex, NULL);
+    pthread_cond_init(&src->cond, NULL);
+    int i;
+    for (i = 0; i < TS_SOURCE_NB_BLOCKS; i++) {
+        void *data;
+        if (posix_memalign(&data, 4096, TS_SOURCE_BLOCK_SIZE) != 0) {
+            ts_source_destroy(src);
+            return NULL;
+        }
+        src->blocks[i].data = (uint8_t *) data;
+    }
+    // whole blocks are read at once, stdio buffering would only add a copy
+    setvbuf(file, NULL, _IONBF, 0);
+
+    if (pthread_create(&src->thread, NULL, prefetchThread, src) != 0) {
+        ts_source_destroy(src);
+        return NULL;
+    }
+    src->running = 1;
+    return src;
+}
+
+void ts_source_stop(TsSource *src)
+{
+    int ok;
+    if (!src->running) {
+        return;
+    }
+    ok = pthread_mutex_lock(&src->mutex);
+    assert(0 == ok);
+    src->stopping = 1;
+    ok = pthread_cond_broadcast(&src->cond);
+    assert(0 == ok);
+    ok = pthread_mutex_unlock(&src->mutex);
+    assert(0 == ok);
+    pthread_join(src->thread, NULL);
+    src->running = 0;
+}
+
+void ts_source_destroy(TsSource *src)
+{
+    ts_source_stop(src);
+    int i;
+    for (i = 0; i < TS_SOURCE_NB_BLOCKS; i++) {
+        free(src->blocks[i].data);
+    }
+    pthread_mutex_destroy(&src->mutex);
+    pthread_cond_destroy(&src->cond);
+    if (NULL != src->file) {
+        fclose(src->file);
+    }
+    free(src);
+}
+
+int ts_source_wait_ready(TsSource *src)
+{
+    int ok;
+    ok = pthread_mutex_lock(&src->mutex);
+    assert(0 == ok);
+    TsBlock *block = &src->blocks[src->readIndex];
+    while (!(block->ready && block->handed < block->bytes) && !src->endOfFile) {
+        ok = pthread_cond_wait(&src->cond, &src->mutex);
+        assert(0 == ok);
+        block = &src->blocks[src->readIndex];
+    }
+    int hasData = block->ready && block->handed < block->bytes;
+    ok = pthread_mutex_unlock(&src->mutex);
+    assert(0 == ok);
+    return hasData;
+}
+
+int ts_source_next_slice(TsSource *src, void **data, size_t *size)
+{
+    int status;
+    int ok;
+    ok = pthread_mutex_lock(&src->mutex);
+    assert(0 == ok);
+    TsBlock *block = &src->blocks[src->readIndex];
+    if (block->ready && block->handed < block->bytes) {
+        size_t bytes = block->bytes - block->handed;
+        if (bytes > src->sliceSize) {
+            bytes = src->sliceSize;
+        }
+        *data = block->data + block->handed;
+        *size = bytes;
+        block->handed += bytes;
+        if (block->handed == block->bytes) {
+            src->readIndex = (src->readIndex + 1) % TS_SOURCE_NB_BLOCKS;
+        }
+        src->stats.slicesHanded++;
+        src->stats.prefetchHits++;
+        status = TS_SLICE_OK;
+    } else if (src->endOfFile) {
+        // the prefetch thread published its last block before setting this
+        status = TS_SLICE_END;
+    } else {
+        src->stats.underruns++;
+        status = TS_SLICE_UNDERRUN;
+    }
+    ok = pthread_mutex_unlock(&src->mutex);
+    assert(0 == ok);
+    return status;
+}
+
+void ts_source_release_slice(TsSource *src, const void *data, size_t size)
+{
+    int ok;
+    ok = pthread_mutex_lock(&src->mutex);
+    assert(0 == ok);
+    TsBlock *block = &src->blocks[src->releaseIndex];
+    if (!block->ready || (const uint8_t *) data != block->data + block->released ||
+            block->released + size > block->handed) {
+        // handed out before a rewind
+        LOGV("Ignoring release of a stale slice");
+    } else {
+        block->released += size;
+        if (block->released == block->bytes) {
+            block->ready = 0;
+            src->releaseIndex = (src->releaseIndex + 1) % TS_SOURCE_NB_BLOCKS;
+            ok = pthread_cond_broadcast(&src->cond);
+            assert(0 == ok);
+        }
+    }
+    ok = pthread_mutex_unlock(&src->mutex);
+    assert(0 == ok);
+}
+
+void ts_source_rewind(TsSource *src)
+{
+    int ok;
+    ok = pthread_mutex_lock(&src->mutex);
+    assert(0 == ok);
+    src->generation++;
+    int i;
+    for (i = 0; i < TS_SOURCE_NB_BLOCKS; i++) {
+        src->blocks[i].ready = 0;
+    }
+    src->fillIndex = 0;
+    src->readIndex = 0;
+    src->releaseIndex = 0;
+    src->endOfFile = 0;
+    src->rewindPending = 1;
+    ok = pthread_cond_broadcast(&src->cond);
+    assert(0 == ok);
+    ok = pthread_mutex_unlock(&src->mutex);
+    assert(0 == ok);
+}
+
+void ts_source_get_stats(TsSource *src, TsSourceStats *stats)
+{
+    int ok;
+    ok = pthread_mutex_lock(&src->mutex);
+    assert(0 == ok);
+    *stats = src->stats;
+    ok = pthread_mutex_unlock(&src->mutex);
+    assert(0 == ok);
+}
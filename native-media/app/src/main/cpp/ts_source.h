@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TS_SOURCE_H
+#define TS_SOURCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TS_PACKET_SIZE 188
+#define TS_SYNC_BYTE 0x47
+
+/* read-ahead blocks: 1024 packets, which is also a multiple of 4096 bytes,
+   so a clean stream is always read at page aligned file offsets */
+#define TS_SOURCE_BLOCK_SIZE (1024 * TS_PACKET_SIZE)
+#define TS_SOURCE_NB_BLOCKS 4
+
+/* MPEG-2 transport stream read from a FILE by a prefetch thread.
+   The thread reads whole blocks ahead of the player and checks the sync
+   byte of every packet, dropping garbage until sync is found again.
+   The player is handed slices pointing straight into the blocks; a block
+   is read into again once every slice of it has been released. Slices
+   must be released in the order they were handed out. */
+typedef struct TsSource TsSource;
+
+typedef struct TsSourceStats {
+    uint64_t slicesHanded;   /* slices given to the player */
+    uint64_t prefetchHits;   /* slice requests served from a prefetched block */
+    uint64_t underruns;      /* slice requests finding nothing prefetched */
+    uint64_t blocksRead;
+    uint64_t bytesRead;
+    uint64_t syncLosses;     /* packets without a sync byte */
+    uint64_t bytesSkipped;   /* garbage dropped to find sync again */
+} TsSourceStats;
+
+/* called on the prefetch thread after a block is ready or the end of the
+   file is reached, so that a player which found nothing can try again */
+typedef void (*ts_source_ready_fn)(void *context);
+
+enum {
+    TS_SLICE_OK,
+    TS_SLICE_UNDERRUN,       /* nothing prefetched yet, ready is called later */
+    TS_SLICE_END,            /* every packet of the file was handed out */
+};
+
+/* takes ownership of file, closed on failure too; sliceSize is a multiple
+   of TS_PACKET_SIZE */
+TsSource* ts_source_create(FILE *file, size_t sliceSize,
+        ts_source_ready_fn ready, void *context);
+/* stops the prefetch thread, after that ready is not called any more */
+void ts_source_stop(TsSource *src);
+/* stops the prefetch thread if needed, closes the file */
+void ts_source_destroy(TsSource *src);
+
+/* blocks until the first block is prefetched; 0 if the file has no packet */
+int ts_source_wait_ready(TsSource *src);
+/* never blocks nor reads the file */
+int ts_source_next_slice(TsSource *src, void **data, size_t *size);
+void ts_source_release_slice(TsSource *src, const void *data, size_t size);
+/* forget every slice handed out and prefetch from the start of the file
+   again; slices handed out before must not be released */
+void ts_source_rewind(TsSource *src);
+void ts_source_get_stats(TsSource *src, TsSourceStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
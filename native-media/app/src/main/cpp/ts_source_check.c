@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Plays a generated stream with garbage between packets through a
+   TsSource, the way the buffer queue does, with a rewind half way; checks
+   every packet comes out once and in order, and prints the statistics.
+   No Android dependency, runs on the host:
+     gcc -O2 -pthread -DTS_SOURCE_HOST_CHECK ts_source.c ts_source_check.c */
+
+#ifdef TS_SOURCE_HOST_CHECK
+#include "ts_source.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// packet n carries n in bytes 1..4, and n * 7 in its last byte
+
+#define CHECK_PACKETS 6000
+#define CHECK_GARBAGE_EVERY 1000
+#define CHECK_REWIND_AT 2500
+#define CHECK_OUTSTANDING 8
+#define CHECK_SLICE_SIZE (10 * TS_PACKET_SIZE)
+
+static void checkReady(void *context)
+{
+    __atomic_add_fetch((int *) context, 1, __ATOMIC_RELAXED);
+}
+
+static int checkSlice(const uint8_t *data, size_t size, uint32_t *expected)
+{
+    if (size == 0 || (size % TS_PACKET_SIZE) != 0) {
+        return 0;
+    }
+    size_t i;
+    for (i = 0; i < size; i += TS_PACKET_SIZE, (*expected)++) {
+        const uint8_t *packet = data + i;
+        uint32_t index = ((uint32_t) packet[1] << 24) | ((uint32_t) packet[2] << 16) |
+                ((uint32_t) packet[3] << 8) | packet[4];
+        if (packet[0] != TS_SYNC_BYTE || index != *expected ||
+                packet[TS_PACKET_SIZE - 1] != (uint8_t) (index * 7)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int ts_source_selfcheck(char *report, size_t size)
+{
+    FILE *file = tmpfile();
+    if (NULL == file) {
+        snprintf(report, size, "no temporary file\n");
+        return 0;
+    }
+    uint8_t packet[TS_PACKET_SIZE];
+    uint32_t n;
+    int garbageRuns = 0;
+    for (n = 0; n < CHECK_PACKETS; n++) {
+        if (n > 0 && (n % CHECK_GARBAGE_EVERY) == 0) {
+            // garbage with a lone sync byte in it
+            uint8_t garbage[300];
+            size_t length = 37 + n % 250;
+            memset(garbage, 0, length);
+            garbage[length / 2] = TS_SYNC_BYTE;
+            fwrite(garbage, 1, length, file);
+            garbageRuns++;
+        }
+        memset(packet, (int) (n & 0x3f), sizeof(packet));
+        packet[0] = TS_SYNC_BYTE;
+        packet[1] = (uint8_t) (n >> 24);
+        packet[2] = (uint8_t) (n >> 16);
+        packet[3] = (uint8_t) (n >> 8);
+        packet[4] = (uint8_t) n;
+        packet[TS_PACKET_SIZE - 1] = (uint8_t) (n * 7);
+        fwrite(packet, 1, sizeof(packet), file);
+    }
+    // a cut packet at the end of the file, to be dropped
+    fwrite(packet, 1, 100, file);
+    rewind(file);
+
+    int readyCalls = 0;
+    TsSource *src = ts_source_create(file, CHECK_SLICE_SIZE, checkReady, &readyCalls);
+    int passed = NULL != src && ts_source_wait_ready(src);
+
+    // the buffer queue: slices in flight, released oldest first
+    void *inFlight[CHECK_OUTSTANDING];
+    size_t inFlightSize[CHECK_OUTSTANDING];
+    int first = 0, count = 0;
+    uint32_t expected = 0;
+    int rewound = 0;
+    while (passed) {
+        int status = TS_SLICE_OK;
+        while (count < CHECK_OUTSTANDING) {
+            void *data;
+            size_t bytes;
+            status = ts_source_next_slice(src, &data, &bytes);
+            if (TS_SLICE_OK != status) {
+                break;
+            }
+            if (!checkSlice((const uint8_t *) data, bytes, &expected)) {
+                passed = 0;
+                break;
+            }
+            int last = (first + count) % CHECK_OUTSTANDING;
+            inFlight[last] = data;
+            inFlightSize[last] = bytes;
+            count++;
+        }
+        if (!passed || (TS_SLICE_END == status && 0 == count)) {
+            break;
+        }
+        if (!rewound && expected >= CHECK_REWIND_AT) {
+            // the buffer queue is cleared: in flight slices are not released
+            ts_source_rewind(src);
+            rewound = 1;
+            expected = 0;
+            first = 0;
+            count = 0;
+            continue;
+        }
+        if (count > 0) {
+            ts_source_release_slice(src, inFlight[first], inFlightSize[first]);
+            first = (first + 1) % CHECK_OUTSTANDING;
+            count--;
+        } else {
+            usleep(100);
+        }
+    }
+    passed = passed && rewound && expected == CHECK_PACKETS;
+
+    TsSourceStats stats;
+    memset(&stats, 0, sizeof(stats));
+    if (NULL != src) {
+        ts_source_get_stats(src, &stats);
+        ts_source_destroy(src);
+    } else {
+        fclose(file);
+    }
+    passed = passed && stats.syncLosses >= (uint64_t) garbageRuns &&
+            __atomic_load_n(&readyCalls, __ATOMIC_RELAXED) > 0;
+    snprintf(report, size,
+            "%s: %u packets, %llu slices, %llu prefetch hits, %llu underruns, "
+            "%llu blocks, %llu sync losses, %llu bytes skipped\n",
+            passed ? "passed" : "FAILED", expected,
+            (unsigned long long) stats.slicesHanded,
+            (unsigned long long) stats.prefetchHits,
+            (unsigned long long) stats.underruns,
+            (unsigned long long) stats.blocksRead,
+            (unsigned long long) stats.syncLosses,
+            (unsigned long long) stats.bytesSkipped);
+    return passed;
+}
+
+int main(void)
+{
+    char report[256];
+    int passed = ts_source_selfcheck(report, sizeof(report));
+    fputs(report, stdout);
+    return passed ? 0 : 1;
+}
+#endif
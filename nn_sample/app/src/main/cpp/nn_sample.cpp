@@ -16,6 +16,7 @@
 
 #include <jni.h>
 #include <string>
+#include <vector>
 #include <iomanip>
 #include <sstream>
 #include <fcntl.h>
@@ -77,6 +78,51 @@ Java_com_example_android_nnapidemo_MainActivity_startCompute(
     return result;
 }
 
+extern "C"
+JNIEXPORT jfloatArray
+JNICALL
+Java_com_example_android_nnapidemo_MainActivity_startComputeBatch(
+        JNIEnv *env,
+        jobject /* this */,
+        jlong _nnModel,
+        jfloatArray _inputValues1,
+        jfloatArray _inputValues2) {
+    SimpleModel* nn_model = (SimpleModel*) _nnModel;
+    jsize count = env->GetArrayLength(_inputValues1);
+    if (env->GetArrayLength(_inputValues2) != count) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
+                            "Input arrays differ in length.");
+        return nullptr;
+    }
+    std::vector<float> inputValues1(count), inputValues2(count), results(count);
+    env->GetFloatArrayRegion(_inputValues1, 0, count, inputValues1.data());
+    env->GetFloatArrayRegion(_inputValues2, 0, count, inputValues2.data());
+    if (!nn_model->ComputeBatch(inputValues1.data(), inputValues2.data(),
+                                count, results.data())) {
+        return nullptr;
+    }
+    jfloatArray _results = env->NewFloatArray(count);
+    if (_results) {
+        env->SetFloatArrayRegion(_results, 0, count, results.data());
+    }
+    return _results;
+}
+
+#ifndef NDEBUG
+// Debug builds only: time count pairs one per execution against batched.
+extern "C"
+JNIEXPORT jboolean
+JNICALL
+Java_com_example_android_nnapidemo_MainActivity_benchmarkModel(
+        JNIEnv *env,
+        jobject /* this */,
+        jlong _nnModel,
+        jint count) {
+    SimpleModel* nn_model = (SimpleModel*) _nnModel;
+    return nn_model->Benchmark(count > 0 ? count : 0) ? JNI_TRUE : JNI_FALSE;
+}
+#endif
+
 extern "C"
 JNIEXPORT void
 JNICALL
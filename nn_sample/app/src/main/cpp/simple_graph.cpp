@@ -0,0 +1,163 @@
+/**
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "simple_graph.h"
+
+#include <algorithm>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define GRAPH_USE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define GRAPH_USE_SSE2 1
+#endif
+
+/**
+ * Operands are listed in the order the NN API model adds them, after the
+ * fused activation scalar:
+ *   0: weight0 (constant)   1: input0
+ *   2: weight1 (constant)   3: input1
+ *   4: weight0 + input0     5: weight1 + input1
+ *   6: output
+ */
+SimpleGraph CreateAddAddMulGraph() {
+    SimpleGraph graph;
+    graph.operands_ = {
+            {GraphOperandKind::CONSTANT, 0},
+            {GraphOperandKind::INPUT, 0},
+            {GraphOperandKind::CONSTANT, 1},
+            {GraphOperandKind::INPUT, 0},
+            {GraphOperandKind::TEMPORARY, 0},
+            {GraphOperandKind::TEMPORARY, 0},
+            {GraphOperandKind::OUTPUT, 0},
+    };
+    graph.nodes_ = {
+            {GraphOperation::ADD, {0, 1}, 4},
+            {GraphOperation::ADD, {2, 3}, 5},
+            {GraphOperation::MUL, {4, 5}, 6},
+    };
+    graph.inputs_ = {1, 3};
+    graph.output_ = 6;
+    return graph;
+}
+
+/**
+ * An element-wise operand: a row, or a value broadcast over the row.
+ */
+struct RowValue {
+    const float *row_;
+    float scalar_;
+};
+
+/**
+ * Kernel of one operation on one row, specialized on which operands are
+ * broadcast values so the inner loop has no branches
+ */
+template <GraphOperation OP, bool A_ROW, bool B_ROW>
+static void ElementWiseRow(const RowValue &a, const RowValue &b, float *out,
+                           uint32_t count) {
+    uint32_t idx = 0;
+#if defined(GRAPH_USE_NEON)
+    float32x4_t aDup = vdupq_n_f32(a.scalar_), bDup = vdupq_n_f32(b.scalar_);
+    for (; idx + 4 <= count; idx += 4) {
+        float32x4_t va = A_ROW ? vld1q_f32(a.row_ + idx) : aDup;
+        float32x4_t vb = B_ROW ? vld1q_f32(b.row_ + idx) : bDup;
+        vst1q_f32(out + idx, OP == GraphOperation::ADD ? vaddq_f32(va, vb)
+                                                       : vmulq_f32(va, vb));
+    }
+#elif defined(GRAPH_USE_SSE2)
+    __m128 aDup = _mm_set1_ps(a.scalar_), bDup = _mm_set1_ps(b.scalar_);
+    for (; idx + 4 <= count; idx += 4) {
+        __m128 va = A_ROW ? _mm_loadu_ps(a.row_ + idx) : aDup;
+        __m128 vb = B_ROW ? _mm_loadu_ps(b.row_ + idx) : bDup;
+        _mm_storeu_ps(out + idx, OP == GraphOperation::ADD ? _mm_add_ps(va, vb)
+                                                           : _mm_mul_ps(va, vb));
+    }
+#endif
+    for (; idx < count; idx++) {
+        float va = A_ROW ? a.row_[idx] : a.scalar_;
+        float vb = B_ROW ? b.row_[idx] : b.scalar_;
+        out[idx] = (OP == GraphOperation::ADD) ? va + vb : va * vb;
+    }
+}
+
+template <GraphOperation OP>
+static void ElementWiseRow(const RowValue &a, const RowValue &b, float *out,
+                           uint32_t count) {
+    if (a.row_ && b.row_) {
+        ElementWiseRow<OP, true, true>(a, b, out, count);
+    } else if (a.row_) {
+        ElementWiseRow<OP, true, false>(a, b, out, count);
+    } else if (b.row_) {
+        ElementWiseRow<OP, false, true>(a, b, out, count);
+    } else {
+        ElementWiseRow<OP, false, false>(a, b, out, count);
+    }
+}
+
+static void ElementWise(GraphOperation op, const RowValue &a, const RowValue &b,
+                        float *out, uint32_t count) {
+    if (op == GraphOperation::ADD) {
+        ElementWiseRow<GraphOperation::ADD>(a, b, out, count);
+    } else {
+        ElementWiseRow<GraphOperation::MUL>(a, b, out, count);
+    }
+}
+
+CpuGraph::CpuGraph(const SimpleGraph &graph, const float *weights, uint32_t tensorSize) :
+        graph_(graph),
+        tensorSize_(tensorSize) {
+    uint32_t weightCount = 0, temporaryCount = 0;
+    for (auto &operand : graph_.operands_) {
+        if (operand.kind_ == GraphOperandKind::CONSTANT) {
+            weightCount = std::max(weightCount, operand.weightIdx_ + 1);
+        } else if (operand.kind_ == GraphOperandKind::TEMPORARY) {
+            temporaryCount++;
+        }
+    }
+    weights_.assign(weights, weights + weightCount * tensorSize_);
+    scratch_.resize(temporaryCount * tensorSize_);
+}
+
+void CpuGraph::Compute(const float *const *inputs, size_t rows, float *outputs) {
+    std::vector<RowValue> values(graph_.operands_.size());
+    std::vector<float *> targets(graph_.operands_.size());   // node outputs
+    uint32_t temporaryIdx = 0;
+    for (size_t idx = 0; idx < graph_.operands_.size(); idx++) {
+        const GraphOperand &operand = graph_.operands_[idx];
+        if (operand.kind_ == GraphOperandKind::CONSTANT) {
+            values[idx].row_ = weights_.data() + operand.weightIdx_ * tensorSize_;
+        } else if (operand.kind_ == GraphOperandKind::TEMPORARY) {
+            targets[idx] = scratch_.data() + (temporaryIdx++) * tensorSize_;
+            values[idx].row_ = targets[idx];
+        }
+    }
+
+    for (size_t row = 0; row < rows; row++) {
+        for (size_t idx = 0; idx < graph_.inputs_.size(); idx++) {
+            RowValue &input = values[graph_.inputs_[idx]];
+            input.row_ = nullptr;
+            input.scalar_ = inputs[idx][row];
+        }
+        targets[graph_.output_] = outputs + row * tensorSize_;
+        values[graph_.output_].row_ = targets[graph_.output_];
+
+        for (auto &node : graph_.nodes_) {
+            ElementWise(node.op_, values[node.inputs_[0]], values[node.inputs_[1]],
+                        targets[node.output_], tensorSize_);
+        }
+    }
+}
@@ -0,0 +1,92 @@
+/**
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NNAPI_SIMPLE_GRAPH_H
+#define NNAPI_SIMPLE_GRAPH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Backend independent description of the sample graph, built into an NN API
+ * model by SimpleModel and run directly by CpuGraph.
+ *
+ * Tensors are rows of tensorSize floats. A batch evaluates several rows at
+ * once: each model input holds one value per row, broadcast over the row,
+ * constants are the same for all rows.
+ */
+enum class GraphOperandKind {
+    CONSTANT,   // trained weights, from the model data
+    INPUT,      // one value per batch row
+    TEMPORARY,
+    OUTPUT,
+};
+
+enum class GraphOperation {
+    ADD,
+    MUL,
+};
+
+struct GraphOperand {
+    GraphOperandKind kind_;
+    uint32_t weightIdx_;     // CONSTANT only: tensor index in the model data
+};
+
+struct GraphNode {
+    GraphOperation op_;
+    uint32_t inputs_[2];     // operand indexes
+    uint32_t output_;
+};
+
+struct SimpleGraph {
+    std::vector<GraphOperand> operands_;
+    std::vector<GraphNode> nodes_;        // in execution order
+    std::vector<uint32_t> inputs_;        // INPUT operands, in model order
+    uint32_t output_;
+};
+
+/**
+ * The sample graph
+ *   (weight0 + input0) * (weight1 + input1)
+ */
+SimpleGraph CreateAddAddMulGraph();
+
+/**
+ * CpuGraph
+ * Reference backend: runs a SimpleGraph on the CPU, a row at a time, with
+ * NEON or SSE2 element-wise kernels.
+ */
+class CpuGraph {
+public:
+    // weights: the constant tensors, tensorSize floats each, back to back
+    CpuGraph(const SimpleGraph &graph, const float *weights, uint32_t tensorSize);
+
+    /**
+     * Evaluate rows of the graph.
+     * @param inputs: one array of rows values per graph input
+     * @param outputs: rows * tensorSize floats
+     */
+    void Compute(const float *const *inputs, size_t rows, float *outputs);
+
+private:
+    SimpleGraph graph_;
+    std::vector<float> weights_;
+    uint32_t tensorSize_;
+    std::vector<float> scratch_;          // a row per TEMPORARY operand
+};
+
+#endif  // NNAPI_SIMPLE_GRAPH_H
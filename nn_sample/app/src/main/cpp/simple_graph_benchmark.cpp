@@ -0,0 +1,78 @@
+/**
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Host check and benchmark of the CPU backend, against the graph written out
+ * by hand. Not part of the app build:
+ *   g++ -O2 -std=c++11 -DSIMPLE_GRAPH_HOST_BENCHMARK \
+ *       simple_graph.cpp simple_graph_benchmark.cpp
+ */
+
+#ifdef SIMPLE_GRAPH_HOST_BENCHMARK
+#include "simple_graph.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+int main() {
+    const uint32_t tensorSize = 200;      // TENSOR_SIZE of simple_model.h
+    const size_t rows = 20000;
+    const int kIterations = 10;
+    std::vector<float> weights(2 * tensorSize);
+    for (uint32_t idx = 0; idx < weights.size(); idx++) {
+        weights[idx] = 0.5f + 0.001f * idx;
+    }
+    std::vector<float> input0(rows), input1(rows);
+    for (size_t row = 0; row < rows; row++) {
+        input0[row] = static_cast<float>(row % 97) * 0.25f;
+        input1[row] = static_cast<float>(row % 89) * -0.5f;
+    }
+    const float *inputs[] = {input0.data(), input1.data()};
+    std::vector<float> expected(rows * tensorSize), outputs(rows * tensorSize);
+
+    CpuGraph graph(CreateAddAddMulGraph(), weights.data(), tensorSize);
+    auto t0 = std::chrono::steady_clock::now();
+    for (int iter = 0; iter < kIterations; iter++) {
+        for (size_t row = 0; row < rows; row++) {
+            float *out = &expected[row * tensorSize];
+            for (uint32_t idx = 0; idx < tensorSize; idx++) {
+                out[idx] = (weights[idx] + input0[row]) *
+                           (weights[tensorSize + idx] + input1[row]);
+            }
+        }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    for (int iter = 0; iter < kIterations; iter++) {
+        graph.Compute(inputs, rows, outputs.data());
+    }
+    auto t2 = std::chrono::steady_clock::now();
+
+    size_t mismatches = 0;
+    for (size_t idx = 0; idx < outputs.size(); idx++) {
+        if (std::fabs(outputs[idx] - expected[idx]) > 1e-6) {
+            mismatches++;
+        }
+    }
+    double byHandMs = std::chrono::duration<double, std::milli>(t1 - t0).count() / kIterations;
+    double graphMs = std::chrono::duration<double, std::milli>(t2 - t1).count() / kIterations;
+    printf("%zu pairs x %u: by hand %.2f ms, CpuGraph %.2f ms, %.1f M pairs/s, "
+           "%.2f GFLOP/s, %zu mismatches\n",
+           rows, tensorSize, byHandMs, graphMs, rows / graphMs / 1000.0,
+           3.0 * rows * tensorSize / graphMs / 1e6, mismatches);
+    return mismatches ? 1 : 0;
+}
+#endif  // SIMPLE_GRAPH_HOST_BENCHMARK
@@ -15,8 +15,12 @@
  */
 #include "simple_model.h"
 
+#include <algorithm>
+#include <chrono>
+#include <android/api-level.h>
 #include <android/log.h>
 #include <android/sharedmem.h>
+#include <dlfcn.h>
 #include <sys/mman.h>
 #include <string>
 #include <unistd.h>
@@ -29,11 +33,24 @@
 SimpleModel::SimpleModel(size_t size, int protect, int fd, size_t offset) :
         model_(nullptr),
         compilation_(nullptr),
+        memoryModel_(nullptr),
+        setReusable_(nullptr),
         dimLength_(TENSOR_SIZE),
+        offset_(offset),
         modelDataFd_(fd),
-        offset_(offset) {
+        graph_(CreateAddAddMulGraph()) {
     tensorSize_ = dimLength_;
-    inputTensor1_.resize(tensorSize_);
+    for (auto &slot : slots_) {
+        slot = ExecutionSlot{nullptr, false, nullptr, -1, -1, nullptr, nullptr,
+                             nullptr, nullptr, 0, 0};
+    }
+
+    // Executions are reusable from API level 31. The app runs from API level
+    // 27, so look the entry point up on the device rather than at build time.
+    if (android_get_device_api_level() >= 31) {
+        setReusable_ = reinterpret_cast<int (*)(ANeuralNetworksExecution *, bool)>(
+                dlsym(RTLD_DEFAULT, "ANeuralNetworksExecution_setReusable"));
+    }
 
     // Create ANeuralNetworksMemory from a file containing the trained data.
     int32_t status = ANeuralNetworksMemory_createFromFd(size + offset, protect, fd, 0,
@@ -44,29 +61,70 @@ SimpleModel::SimpleModel(size_t size, int protect, int fd, size_t offset) :
         return;
     }
 
-    // Create ASharedMemory to hold the data for the second input tensor and output output tensor.
-    inputTensor2Fd_ = ASharedMemory_create("input2", tensorSize_ * sizeof(float));
-    outputTensorFd_ = ASharedMemory_create("output", tensorSize_ * sizeof(float));
+    // The CPU reference backend reads the same trained data.
+    std::vector<float> weights(2 * tensorSize_);
+    ssize_t weightsSize = weights.size() * sizeof(float);
+    if (pread(fd, weights.data(), weightsSize, offset) == weightsSize) {
+        cpuGraph_.reset(new CpuGraph(graph_, weights.data(), tensorSize_));
+    } else {
+        __android_log_print(ANDROID_LOG_WARN, LOG_TAG,
+                            "Unable to read trained weights, results are not checked");
+    }
+
+    // Create the input and output memory of every execution.
+    for (auto &slot : slots_) {
+        if (!CreateSlot(slot)) {
+            return;
+        }
+    }
+}
+
+/**
+ * Create the ASharedMemory objects holding the inputs and the outputs of an
+ * execution, map them, and wrap them into ANeuralNetworksMemory objects.
+ */
+bool SimpleModel::CreateSlot(ExecutionSlot &slot) {
+    size_t inputSize = graph_.inputs_.size() * kBatchSize * sizeof(float);
+    size_t outputSize = kBatchSize * tensorSize_ * sizeof(float);
+    slot.inputFd_ = ASharedMemory_create("input", inputSize);
+    slot.outputFd_ = ASharedMemory_create("output", outputSize);
+    if (slot.inputFd_ < 0 || slot.outputFd_ < 0) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
+                            "ASharedMemory_create failed");
+        return false;
+    }
+
+    // Map them once: the inputs are written and the outputs read in place
+    // for every batch.
+    void *inputs = mmap(nullptr, inputSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        slot.inputFd_, 0);
+    void *outputs = mmap(nullptr, outputSize, PROT_READ, MAP_SHARED,
+                         slot.outputFd_, 0);
+    slot.inputs_ = (inputs == MAP_FAILED) ? nullptr : reinterpret_cast<float *>(inputs);
+    slot.outputs_ = (outputs == MAP_FAILED) ? nullptr : reinterpret_cast<float *>(outputs);
+    if (!slot.inputs_ || !slot.outputs_) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
+                            "mmap failed for execution memory");
+        return false;
+    }
 
-    // Create ANeuralNetworksMemory objects from the corresponding ASharedMemory objects.
-    status = ANeuralNetworksMemory_createFromFd(tensorSize_ * sizeof(float),
-                                                PROT_READ,
-                                                inputTensor2Fd_, 0,
-                                                &memoryInput2_);
+    int32_t status = ANeuralNetworksMemory_createFromFd(inputSize, PROT_READ,
+                                                        slot.inputFd_, 0,
+                                                        &slot.memoryInput_);
     if (status != ANEURALNETWORKS_NO_ERROR) {
         __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                            "ANeuralNetworksMemory_createFromFd failed for Input2");
-        return;
+                            "ANeuralNetworksMemory_createFromFd failed for inputs");
+        return false;
     }
-    status = ANeuralNetworksMemory_createFromFd(tensorSize_ * sizeof(float),
-                                                PROT_READ | PROT_WRITE,
-                                                outputTensorFd_, 0,
-                                                &memoryOutput_);
+    status = ANeuralNetworksMemory_createFromFd(outputSize, PROT_READ | PROT_WRITE,
+                                                slot.outputFd_, 0,
+                                                &slot.memoryOutput_);
     if (status != ANEURALNETWORKS_NO_ERROR) {
         __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                            "ANeuralNetworksMemory_createFromFd failed for Output");
-        return;
+                            "ANeuralNetworksMemory_createFromFd failed for output");
+        return false;
     }
+    return true;
 }
 
 /**
@@ -90,6 +148,11 @@ SimpleModel::SimpleModel(size_t size, int protect, int fd, size_t offset) :
  * The other two tensors, tensor1 and tensor3 will be inputs to the model. Their values will be
  * provided when we execute the model. These values can change from execution to execution.
  *
+ * The operands and operations come from graph_, the same SimpleGraph the CPU
+ * reference backend runs. Weights are [dimLength] tensors; inputs are
+ * [kBatchSize, 1] tensors, one value per input pair, broadcast by ADD over
+ * the weights; the other tensors are [kBatchSize, dimLength].
+ *
  * Besides the two input tensors, an optional fused activation function can
  * also be defined for ADD and MUL. In this example, we'll simply set it to NONE.
  *
@@ -115,11 +178,27 @@ bool SimpleModel::CreateCompiledModel() {
         return false;
     }
 
-    uint32_t dimensions[] = {dimLength_};
-    ANeuralNetworksOperandType float32TensorType{
+    uint32_t weightDimensions[] = {dimLength_};
+    uint32_t inputDimensions[] = {kBatchSize, 1};
+    uint32_t batchDimensions[] = {kBatchSize, dimLength_};
+    ANeuralNetworksOperandType weightTensorType{
             .type = ANEURALNETWORKS_TENSOR_FLOAT32,
-            .dimensionCount = sizeof(dimensions) / sizeof(dimensions[0]),
-            .dimensions = dimensions,
+            .dimensionCount = sizeof(weightDimensions) / sizeof(weightDimensions[0]),
+            .dimensions = weightDimensions,
+            .scale = 0.0f,
+            .zeroPoint = 0,
+    };
+    ANeuralNetworksOperandType inputTensorType{
+            .type = ANEURALNETWORKS_TENSOR_FLOAT32,
+            .dimensionCount = sizeof(inputDimensions) / sizeof(inputDimensions[0]),
+            .dimensions = inputDimensions,
+            .scale = 0.0f,
+            .zeroPoint = 0,
+    };
+    ANeuralNetworksOperandType batchTensorType{
+            .type = ANEURALNETWORKS_TENSOR_FLOAT32,
+            .dimensionCount = sizeof(batchDimensions) / sizeof(batchDimensions[0]),
+            .dimensions = batchDimensions,
             .scale = 0.0f,
             .zeroPoint = 0,
     };
@@ -165,162 +244,78 @@ bool SimpleModel::CreateCompiledModel() {
         return false;
     }
 
-    // Add operands for the tensors.
-    status = ANeuralNetworksModel_addOperand(model_, &float32TensorType);
-    uint32_t tensor0 = opIdx++;
-    if (status != ANEURALNETWORKS_NO_ERROR) {
-        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                            "ANeuralNetworksModel_addOperand failed for operand (%d)",
-                            tensor0);
-        return false;
-    }
-    // tensor0 is a constant tensor that was established during training.
-    // We read these values from the corresponding ANeuralNetworksMemory object.
-    status = ANeuralNetworksModel_setOperandValueFromMemory(model_,
-                                                            tensor0,
-                                                            memoryModel_,
-                                                            offset_,
-                                                            tensorSize_ * sizeof(float));
-    if (status != ANEURALNETWORKS_NO_ERROR) {
-        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                            "ANeuralNetworksModel_setOperandValueFromMemory failed for operand (%d)",
-                            tensor0);
-        return false;
-    }
-
-    // tensor1 is one of the user provided input tensors to the trained model.
-    // Its value is determined pre-execution.
-    status = ANeuralNetworksModel_addOperand(model_, &float32TensorType);
-    uint32_t tensor1 = opIdx++;
-    if (status != ANEURALNETWORKS_NO_ERROR) {
-        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                            "ANeuralNetworksModel_addOperand failed for operand (%d)",
-                            tensor1);
-        return false;
-    }
-
-    // tensor2 is a constant tensor that was established during training.
-    // We read these values from the corresponding ANeuralNetworksMemory object.
-    status = ANeuralNetworksModel_addOperand(model_, &float32TensorType);
-    uint32_t tensor2 = opIdx++;
-    if (status != ANEURALNETWORKS_NO_ERROR) {
-        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                            "ANeuralNetworksModel_addOperand failed for operand (%d)",
-                            tensor2);
-        return false;
-    }
-    status = ANeuralNetworksModel_setOperandValueFromMemory(
-            model_, tensor2, memoryModel_, offset_ + tensorSize_ * sizeof(float),
-            tensorSize_ * sizeof(float));
-    if (status != ANEURALNETWORKS_NO_ERROR) {
-        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                            "ANeuralNetworksModel_setOperandValueFromMemory failed for operand (%d)",
-                            tensor2);
-        return false;
-    }
-
-    // tensor3 is one of the user provided input tensors to the trained model.
-    // Its value is determined pre-execution.
-    status = ANeuralNetworksModel_addOperand(model_, &float32TensorType);
-    uint32_t tensor3 = opIdx++;
-    if (status != ANEURALNETWORKS_NO_ERROR) {
-        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                            "ANeuralNetworksModel_addOperand failed for operand (%d)",
-                            tensor3);
-        return false;
-    }
-
-    // intermediateOutput0 is the output of the first ADD operation.
-    // Its value is computed during execution.
-    status = ANeuralNetworksModel_addOperand(model_, &float32TensorType);
-    uint32_t intermediateOutput0 = opIdx++;
-    if (status != ANEURALNETWORKS_NO_ERROR) {
-        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                            "ANeuralNetworksModel_addOperand failed for operand (%d)",
-                            intermediateOutput0);
-        return false;
-    }
-
-    // intermediateOutput1 is the output of the second ADD operation.
-    // Its value is computed during execution.
-    status = ANeuralNetworksModel_addOperand(model_, &float32TensorType);
-    uint32_t intermediateOutput1 = opIdx++;
-    if (status != ANEURALNETWORKS_NO_ERROR) {
-        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                            "ANeuralNetworksModel_addOperand failed for operand (%d)",
-                            intermediateOutput1);
-        return false;
-    }
-
-    // multiplierOutput is the output of the MUL operation.
-    // Its value will be computed during execution.
-    status = ANeuralNetworksModel_addOperand(model_, &float32TensorType);
-    uint32_t multiplierOutput = opIdx++;
-    if (status != ANEURALNETWORKS_NO_ERROR) {
-        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                            "ANeuralNetworksModel_addOperand failed for operand (%d)",
-                            multiplierOutput);
-        return false;
-    }
-
-    // Add the first ADD operation.
-    std::vector<uint32_t> add1InputOperands = {
-            tensor0,
-            tensor1,
-            fusedActivationFuncNone,
-    };
-    status = ANeuralNetworksModel_addOperation(model_, ANEURALNETWORKS_ADD,
-                                               add1InputOperands.size(), add1InputOperands.data(),
-                                               1, &intermediateOutput0);
-    if (status != ANEURALNETWORKS_NO_ERROR) {
-        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                            "ANeuralNetworksModel_addOperation failed for ADD_1");
-        return false;
-    }
+    // Add operands for the tensors of the graph, graph operand n being
+    // model operand n + 1.
+    const uint32_t firstTensor = opIdx;
+    for (auto &operand : graph_.operands_) {
+        const ANeuralNetworksOperandType *type = &batchTensorType;
+        if (operand.kind_ == GraphOperandKind::CONSTANT) {
+            type = &weightTensorType;
+        } else if (operand.kind_ == GraphOperandKind::INPUT) {
+            type = &inputTensorType;
+        }
+        status = ANeuralNetworksModel_addOperand(model_, type);
+        uint32_t tensor = opIdx++;
+        if (status != ANEURALNETWORKS_NO_ERROR) {
+            __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
+                                "ANeuralNetworksModel_addOperand failed for operand (%d)",
+                                tensor);
+            return false;
+        }
+        if (operand.kind_ != GraphOperandKind::CONSTANT) {
+            continue;
+        }
 
-    // Add the second ADD operation.
-    // Note the fusedActivationFuncNone is used again.
-    std::vector<uint32_t> add2InputOperands = {
-            tensor2,
-            tensor3,
-            fusedActivationFuncNone,
-    };
-    status = ANeuralNetworksModel_addOperation(model_, ANEURALNETWORKS_ADD,
-                                               add2InputOperands.size(),add2InputOperands.data(),
-                                               1, &intermediateOutput1);
-    if (status != ANEURALNETWORKS_NO_ERROR) {
-        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                            "ANeuralNetworksModel_addOperation failed for ADD_2");
-        return false;
+        // Constant tensors were established during training.
+        // We read these values from the corresponding ANeuralNetworksMemory object.
+        status = ANeuralNetworksModel_setOperandValueFromMemory(
+                model_, tensor, memoryModel_,
+                offset_ + operand.weightIdx_ * tensorSize_ * sizeof(float),
+                tensorSize_ * sizeof(float));
+        if (status != ANEURALNETWORKS_NO_ERROR) {
+            __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
+                                "ANeuralNetworksModel_setOperandValueFromMemory failed for operand (%d)",
+                                tensor);
+            return false;
+        }
     }
 
-    // Add the MUL operation.
-    // Note that intermediateOutput0 and intermediateOutput1 are specified
-    // as inputs to the operation.
-    std::vector<uint32_t> mulInputOperands = {
-            intermediateOutput0,
-            intermediateOutput1,
-            fusedActivationFuncNone};
-    status = ANeuralNetworksModel_addOperation(model_, ANEURALNETWORKS_MUL,
-                                               mulInputOperands.size(),mulInputOperands.data(),
-                                               1, &multiplierOutput);
-    if (status != ANEURALNETWORKS_NO_ERROR) {
-        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                            "ANeuralNetworksModel_addOperation failed for MUL");
-        return false;
+    // Add the ADD and MUL operations.
+    // Note the fusedActivationFuncNone is used for all of them.
+    for (auto &node : graph_.nodes_) {
+        std::vector<uint32_t> inputOperands = {
+                firstTensor + node.inputs_[0],
+                firstTensor + node.inputs_[1],
+                fusedActivationFuncNone,
+        };
+        uint32_t outputOperand = firstTensor + node.output_;
+        bool isAdd = (node.op_ == GraphOperation::ADD);
+        status = ANeuralNetworksModel_addOperation(model_,
+                                                   isAdd ? ANEURALNETWORKS_ADD
+                                                         : ANEURALNETWORKS_MUL,
+                                                   inputOperands.size(), inputOperands.data(),
+                                                   1, &outputOperand);
+        if (status != ANEURALNETWORKS_NO_ERROR) {
+            __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
+                                "ANeuralNetworksModel_addOperation failed for %s",
+                                isAdd ? "ADD" : "MUL");
+            return false;
+        }
     }
 
     // Identify the input and output tensors to the model.
     // Inputs: {tensor1, tensor3}
     // Outputs: {multiplierOutput}
-    std::vector<uint32_t> modelInputOperands = {
-            tensor1, tensor3,
-    };
+    std::vector<uint32_t> modelInputOperands;
+    for (auto input : graph_.inputs_) {
+        modelInputOperands.push_back(firstTensor + input);
+    }
+    uint32_t modelOutputOperand = firstTensor + graph_.output_;
     status = ANeuralNetworksModel_identifyInputsAndOutputs(model_,
                                                            modelInputOperands.size(),
                                                            modelInputOperands.data(),
                                                            1,
-                                                           &multiplierOutput);
+                                                           &modelOutputOperand);
     if (status != ANEURALNETWORKS_NO_ERROR) {
         __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
                             "ANeuralNetworksModel_identifyInputsAndOutputs failed");
@@ -347,10 +342,10 @@ bool SimpleModel::CreateCompiledModel() {
 
     // Set the preference for the compilation, so that the runtime and drivers
     // can make better decisions.
-    // Here we prefer to get the answer quickly, so we choose
-    // ANEURALNETWORKS_PREFER_FAST_SINGLE_ANSWER.
+    // Batches of input pairs are streamed through several executions, so we
+    // choose ANEURALNETWORKS_PREFER_SUSTAINED_SPEED.
     status = ANeuralNetworksCompilation_setPreference(compilation_,
-                                                      ANEURALNETWORKS_PREFER_FAST_SINGLE_ANSWER);
+                                                      ANEURALNETWORKS_PREFER_SUSTAINED_SPEED);
     if (status != ANEURALNETWORKS_NO_ERROR) {
         __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
                             "ANeuralNetworksCompilation_setPreference failed");
@@ -369,126 +364,282 @@ bool SimpleModel::CreateCompiledModel() {
 }
 
 /**
- * Compute with the given input data.
- * @param modelInputs:
- *    inputValue1:   The values to fill tensor1
- *    inputValue2:   The values to fill tensor3
- * @return  computed result, or 0.0f if there is error.
+ * Start the execution of a slot on the batch in its input memory.
+ * Note:
+ *   1. All the input and output data are tied to the ANeuralNetworksExecution object.
+ *   2. Multiple concurrent execution instances could be created from the same compiled model.
+ * Executions are reusable from API level 31 and are then set up once;
+ * before that, or if the runtime refuses, a new one is created for every
+ * batch, on the same memory.
  */
-bool SimpleModel::Compute(float inputValue1, float inputValue2,
-                          float *result) {
-    if (!result) {
-        return false;
+bool SimpleModel::StartSlot(ExecutionSlot &slot) {
+    int32_t status;
+    if (!slot.execution_) {
+        status = ANeuralNetworksExecution_create(compilation_, &slot.execution_);
+        if (status != ANEURALNETWORKS_NO_ERROR) {
+            __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
+                                "ANeuralNetworksExecution_create failed");
+            slot.execution_ = nullptr;
+            return false;
+        }
+        slot.reusable_ = false;
+        if (setReusable_) {
+            status = setReusable_(slot.execution_, true);
+            if (status == ANEURALNETWORKS_NO_ERROR) {
+                slot.reusable_ = true;
+            } else {
+                // don't ask again for every batch
+                __android_log_print(ANDROID_LOG_WARN, LOG_TAG,
+                                    "ANeuralNetworksExecution_setReusable failed (%d)",
+                                    status);
+                setReusable_ = nullptr;
+            }
+        }
+
+        // ANeuralNetworksExecution_setInputFromMemory associates the operand with a shared
+        // memory region to minimize the number of copies of raw data.
+        // Input n takes the n-th kBatchSize values of the slot's input memory.
+        for (uint32_t idx = 0; idx < graph_.inputs_.size(); idx++) {
+            status = ANeuralNetworksExecution_setInputFromMemory(
+                    slot.execution_, idx, nullptr, slot.memoryInput_,
+                    idx * kBatchSize * sizeof(float), kBatchSize * sizeof(float));
+            if (status != ANEURALNETWORKS_NO_ERROR) {
+                __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
+                                    "ANeuralNetworksExecution_setInputFromMemory failed for input%d",
+                                    idx + 1);
+                ANeuralNetworksExecution_free(slot.execution_);
+                slot.execution_ = nullptr;
+                return false;
+            }
+        }
+
+        // Set the output tensor that will be filled by executing the model.
+        // We use shared memory here to minimize the copies needed for getting the output data.
+        status = ANeuralNetworksExecution_setOutputFromMemory(
+                slot.execution_, 0, nullptr, slot.memoryOutput_, 0,
+                kBatchSize * tensorSize_ * sizeof(float));
+        if (status != ANEURALNETWORKS_NO_ERROR) {
+            __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
+                                "ANeuralNetworksExecution_setOutputFromMemory failed for output");
+            ANeuralNetworksExecution_free(slot.execution_);
+            slot.execution_ = nullptr;
+            return false;
+        }
     }
 
-    // Create an ANeuralNetworksExecution object from the compiled model.
-    // Note:
-    //   1. All the input and output data are tied to the ANeuralNetworksExecution object.
-    //   2. Multiple concurrent execution instances could be created from the same compiled model.
-    // This sample only uses one execution of the compiled model.
-    ANeuralNetworksExecution *execution;
-    int32_t status = ANeuralNetworksExecution_create(compilation_, &execution);
+    // Start the execution of the model.
+    // Note that the execution here is asynchronous, and an ANeuralNetworksEvent object will be
+    // created to monitor the status of the execution.
+    status = ANeuralNetworksExecution_startCompute(slot.execution_, &slot.event_);
     if (status != ANEURALNETWORKS_NO_ERROR) {
         __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                            "ANeuralNetworksExecution_create failed");
+                            "ANeuralNetworksExecution_startCompute failed");
+        slot.event_ = nullptr;
         return false;
     }
+    return true;
+}
 
-    // Set all the elements of the first input tensor (tensor1) to the same value as inputValue1.
-    // It's not a realistic example but it shows how to pass a small tensor
-    // to an execution.
-    std::fill(inputTensor1_.data(), inputTensor1_.data() + tensorSize_,
-              inputValue1);
-
-    // Tell the execution to associate inputTensor1 to the first of the two model inputs.
-    // Note that the index "0" here means the first operand of the modelInput list
-    // {tensor1, tensor3}, which means tensor1.
-    status = ANeuralNetworksExecution_setInput(execution, 0, nullptr,
-                                               inputTensor1_.data(),
-                                               tensorSize_ * sizeof(float));
+/**
+ * Wait for the execution of a slot, and hand out its results.
+ */
+bool SimpleModel::FinishSlot(ExecutionSlot &slot, float *results, float *tensors) {
+    int32_t status = ANeuralNetworksEvent_wait(slot.event_);
+    ANeuralNetworksEvent_free(slot.event_);
+    slot.event_ = nullptr;
+    if (!slot.reusable_) {
+        ANeuralNetworksExecution_free(slot.execution_);
+        slot.execution_ = nullptr;
+    }
     if (status != ANEURALNETWORKS_NO_ERROR) {
         __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                            "ANeuralNetworksExecution_setInput failed for input1");
+                            "ANeuralNetworksEvent_wait failed");
         return false;
     }
 
-    // Set the values of the the second input operand (tensor3) to be inputValue2.
-    // In reality, the values in the shared memory region will be manipulated by
-    // other modules or processes.
-    float *inputTensor2Ptr = reinterpret_cast<float *>(mmap(nullptr, tensorSize_ * sizeof(float),
-                                                            PROT_READ | PROT_WRITE, MAP_SHARED,
-                                                            inputTensor2Fd_, 0));
-    for (int i = 0; i < tensorSize_; i++) {
-        *inputTensor2Ptr = inputValue2;
-        inputTensor2Ptr++;
-    }
-    munmap(inputTensor2Ptr, tensorSize_ * sizeof(float));
-
-    // ANeuralNetworksExecution_setInputFromMemory associates the operand with a shared memory
-    // region to minimize the number of copies of raw data.
-    // Note that the index "1" here means the second operand of the modelInput list
-    // {tensor1, tensor3}, which means tensor3.
-    status = ANeuralNetworksExecution_setInputFromMemory(execution, 1, nullptr,
-                                                         memoryInput2_, 0,
-                                                         tensorSize_ * sizeof(float));
-    if (status != ANEURALNETWORKS_NO_ERROR) {
-        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                            "ANeuralNetworksExecution_setInputFromMemory failed for input2");
-        return false;
+    for (size_t idx = 0; idx < slot.count_; idx++) {
+        results[slot.first_ + idx] = slot.outputs_[idx * tensorSize_];
+    }
+    if (tensors) {
+        std::copy(slot.outputs_, slot.outputs_ + slot.count_ * tensorSize_,
+                  tensors + slot.first_ * tensorSize_);
     }
+    return true;
+}
 
-    // Set the output tensor that will be filled by executing the model.
-    // We use shared memory here to minimize the copies needed for getting the output data.
-    status = ANeuralNetworksExecution_setOutputFromMemory(execution, 0, nullptr,
-                                                          memoryOutput_, 0,
-                                                          tensorSize_ * sizeof(float));
-    if (status != ANEURALNETWORKS_NO_ERROR) {
-        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                            "ANeuralNetworksExecution_setOutputFromMemory failed for output");
+/**
+ * Compute input pairs in batches of kBatchSize, keeping up to kInFlight
+ * executions running: a slot's inputs are written while the other slots
+ * compute, and its results are read when it comes round again.
+ */
+bool SimpleModel::ComputeBatch(const float *inputValues1, const float *inputValues2,
+                               size_t count, float *results, float *tensors) {
+    if (!compilation_ || !inputValues1 || !inputValues2 || !results) {
         return false;
     }
+    for (auto &slot : slots_) {
+        if (!slot.memoryInput_ || !slot.memoryOutput_) {
+            return false;
+        }
+    }
 
-    // Start the execution of the model.
-    // Note that the execution here is asynchronous, and an ANeuralNetworksEvent object will be
-    // created to monitor the status of the execution.
-    ANeuralNetworksEvent *event = nullptr;
-    status = ANeuralNetworksExecution_startCompute(execution, &event);
-    if (status != ANEURALNETWORKS_NO_ERROR) {
-        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                            "ANeuralNetworksExecution_startCompute failed");
+    bool status = true;
+    size_t next = 0;
+    uint32_t slotIdx = 0;
+    while (status && next < count) {
+        ExecutionSlot &slot = slots_[slotIdx];
+        if (slot.event_) {
+            status = FinishSlot(slot, results, tensors);
+            if (!status) {
+                break;
+            }
+        }
+
+        // Fill the slot's inputs; rows past the last pair are padded.
+        size_t rows = std::min<size_t>(kBatchSize, count - next);
+        float *input1 = slot.inputs_;
+        float *input2 = slot.inputs_ + kBatchSize;
+        std::copy(inputValues1 + next, inputValues1 + next + rows, input1);
+        std::copy(inputValues2 + next, inputValues2 + next + rows, input2);
+        std::fill(input1 + rows, input1 + kBatchSize, 0.0f);
+        std::fill(input2 + rows, input2 + kBatchSize, 0.0f);
+        slot.first_ = next;
+        slot.count_ = rows;
+
+        status = StartSlot(slot);
+        next += rows;
+        slotIdx = (slotIdx + 1) % kInFlight;
+    }
+
+    // Collect the executions still running.
+    for (auto &slot : slots_) {
+        if (slot.event_) {
+            status = FinishSlot(slot, results, tensors) && status;
+        }
+    }
+    return status;
+}
+
+/**
+ * Compare result tensors with the CPU reference backend.
+ * @return the number of values that differ, 0 without a reference backend
+ */
+size_t SimpleModel::CheckResults(const float *inputValues1, const float *inputValues2,
+                                 size_t count, const float *tensors) {
+    if (!cpuGraph_) {
+        return 0;
+    }
+    std::vector<float> goldenRef(count * tensorSize_);
+    const float *inputs[] = {inputValues1, inputValues2};
+    cpuGraph_->Compute(inputs, count, goldenRef.data());
+    size_t errors = 0;
+    for (size_t idx = 0; idx < count * tensorSize_; idx++) {
+        float delta = tensors[idx] - goldenRef[idx];
+        delta = (delta < 0.0f) ? (-delta) : delta;
+        if (delta > FLOAT_EPISILON) {
+            if (!errors) {
+                __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
+                                    "Output computation Error: output0(%f), delta(%f) @ pair(%zu) idx(%zu)",
+                                    tensors[idx - idx % tensorSize_], delta,
+                                    idx / tensorSize_, idx % tensorSize_);
+            }
+            errors++;
+        }
+    }
+    return errors;
+}
+
+/**
+ * Compute with the given input data.
+ * @param modelInputs:
+ *    inputValue1:   The values to fill tensor1
+ *    inputValue2:   The values to fill tensor3
+ * @return  computed result, or 0.0f if there is error.
+ */
+bool SimpleModel::Compute(float inputValue1, float inputValue2,
+                          float *result) {
+    if (!result) {
         return false;
     }
 
-    // Wait until the completion of the execution. This could be done on a different
-    // thread. By waiting immediately, we effectively make this a synchronous call.
-    status = ANeuralNetworksEvent_wait(event);
-    if (status != ANEURALNETWORKS_NO_ERROR) {
-        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                            "ANeuralNetworksEvent_wait failed");
+    std::vector<float> output(tensorSize_);
+    if (!ComputeBatch(&inputValue1, &inputValue2, 1, result, output.data())) {
         return false;
     }
 
-    ANeuralNetworksEvent_free(event);
-    ANeuralNetworksExecution_free(execution);
+    // Validate the results against the CPU reference backend.
+    CheckResults(&inputValue1, &inputValue2, 1, output.data());
+    return true;
+}
 
-    // Validate the results.
-    const float goldenRef = (inputValue1 + 0.5f) * (inputValue2 + 0.5f);
-    float *outputTensorPtr = reinterpret_cast<float *>(mmap(nullptr,
-                                                            tensorSize_ * sizeof(float),
-                                                            PROT_READ, MAP_SHARED,
-                                                            outputTensorFd_, 0));
-    for (int32_t idx = 0; idx < tensorSize_; idx++) {
-        float delta = outputTensorPtr[idx] - goldenRef;
-        delta = (delta < 0.0f) ? (-delta) : delta;
-        if (delta > FLOAT_EPISILON) {
-            __android_log_print(ANDROID_LOG_ERROR, LOG_TAG,
-                                "Output computation Error: output0(%f), delta(%f) @ idx(%d)",
-                                outputTensorPtr[0], delta, idx);
+#ifndef NDEBUG
+/**
+ * Run count input pairs one per execution, then all of them through the
+ * batched, pipelined executions, and log how long each took.
+ */
+bool SimpleModel::Benchmark(size_t count) {
+    std::vector<float> inputs1(count), inputs2(count);
+    for (size_t idx = 0; idx < count; idx++) {
+        inputs1[idx] = static_cast<float>(idx) / count;
+        inputs2[idx] = 1.0f - 2.0f * inputs1[idx];
+    }
+    std::vector<float> singleResults(count), results(count);
+    std::vector<float> tensors(count * tensorSize_);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t idx = 0; idx < count; idx++) {
+        if (!ComputeBatch(&inputs1[idx], &inputs2[idx], 1, &singleResults[idx])) {
+            return false;
         }
     }
-    *result = outputTensorPtr[0];
-    munmap(outputTensorPtr, tensorSize_ * sizeof(float));
-    return result;
+    auto single = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    if (!ComputeBatch(inputs1.data(), inputs2.data(), count, results.data(),
+                      tensors.data())) {
+        return false;
+    }
+    auto batched = std::chrono::steady_clock::now() - start;
+
+    size_t errors = CheckResults(inputs1.data(), inputs2.data(), count, tensors.data());
+    for (size_t idx = 0; idx < count; idx++) {
+        if (singleResults[idx] != results[idx]) {
+            errors++;
+        }
+    }
+    long long singleUs =
+            std::chrono::duration_cast<std::chrono::microseconds>(single).count();
+    long long batchedUs =
+            std::chrono::duration_cast<std::chrono::microseconds>(batched).count();
+    __android_log_print(errors ? ANDROID_LOG_ERROR : ANDROID_LOG_INFO, LOG_TAG,
+                        "Benchmark: %zu pairs in %lld us one per execution, %lld us in "
+                        "batches of %u with %u in flight; %zu mismatches",
+                        count, singleUs, batchedUs, kBatchSize, kInFlight, errors);
+    return errors == 0;
+}
+#endif
+
+/**
+ * Release the NN API objects and the memory of an execution slot.
+ */
+void SimpleModel::FreeSlot(ExecutionSlot &slot) {
+    if (slot.execution_) {
+        ANeuralNetworksExecution_free(slot.execution_);
+    }
+    ANeuralNetworksMemory_free(slot.memoryInput_);
+    ANeuralNetworksMemory_free(slot.memoryOutput_);
+    if (slot.inputs_) {
+        munmap(slot.inputs_, graph_.inputs_.size() * kBatchSize * sizeof(float));
+    }
+    if (slot.outputs_) {
+        munmap(slot.outputs_, kBatchSize * tensorSize_ * sizeof(float));
+    }
+    if (slot.inputFd_ >= 0) {
+        close(slot.inputFd_);
+    }
+    if (slot.outputFd_ >= 0) {
+        close(slot.outputFd_);
+    }
 }
 
 /**
@@ -497,12 +648,11 @@ bool SimpleModel::Compute(float inputValue1, float inputValue2,
  * Release NN API objects and close the file descriptors.
  */
 SimpleModel::~SimpleModel() {
+    for (auto &slot : slots_) {
+        FreeSlot(slot);
+    }
     ANeuralNetworksCompilation_free(compilation_);
     ANeuralNetworksModel_free(model_);
     ANeuralNetworksMemory_free(memoryModel_);
-    ANeuralNetworksMemory_free(memoryInput2_);
-    ANeuralNetworksMemory_free(memoryOutput_);
-    close(inputTensor2Fd_);
-    close(outputTensorFd_);
     close(modelDataFd_);
-}
\ No newline at end of file
+}
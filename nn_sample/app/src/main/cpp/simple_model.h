@@ -18,8 +18,11 @@
 #define NNAPI_SIMPLE_MODEL_H
 
 #include <android/NeuralNetworks.h>
+#include <memory>
 #include <vector>
 
+#include "simple_graph.h"
+
 #define FLOAT_EPISILON (1e-6)
 #define TENSOR_SIZE 200
 #define LOG_TAG "NNAPI_DEMO"
@@ -35,6 +38,12 @@
  *       dimLength x dimLength
  *   with NO fused_activation operation
  *
+ * The model evaluates kBatchSize input pairs per execution: inputs are
+ * [kBatchSize, 1] tensors, broadcast against the [dimLength] weights into
+ * [kBatchSize, dimLength] results. Up to kInFlight executions run at once,
+ * each with its own input and output memory, created and mapped once.
+ * A CpuGraph of the same graph checks the results of Compute() and
+ * Benchmark().
  */
 class SimpleModel {
 public:
@@ -44,21 +53,64 @@ public:
     bool CreateCompiledModel();
     bool Compute(float inputValue1, float inputValue2, float *result);
 
+    /**
+     * Evaluate count input pairs.
+     * @param results: first element of each result tensor, count floats
+     * @param tensors: optional, the whole result tensors, count x TENSOR_SIZE
+     */
+    bool ComputeBatch(const float *inputValues1, const float *inputValues2,
+                      size_t count, float *results, float *tensors = nullptr);
+
+#ifndef NDEBUG
+    /**
+     * Time count input pairs computed one per execution, as Compute() does,
+     * against the same pairs through ComputeBatch(), and check the batched
+     * results. Logs the timings; returns false on errors or mismatches.
+     * Debug builds only.
+     */
+    bool Benchmark(size_t count);
+#endif
+
+    static const uint32_t kBatchSize = 64;
+    static const uint32_t kInFlight = 3;
+
 private:
+    // An execution with its memory, reused from batch to batch
+    struct ExecutionSlot {
+        ANeuralNetworksExecution *execution_;
+        bool reusable_;                 // execution_ kept from batch to batch
+        ANeuralNetworksEvent *event_;   // running when set
+        int inputFd_;                   // kBatchSize values of each input
+        int outputFd_;
+        ANeuralNetworksMemory *memoryInput_;
+        ANeuralNetworksMemory *memoryOutput_;
+        float *inputs_;                 // mappings of the fds
+        float *outputs_;
+        size_t first_;                  // index of the batch's first pair
+        size_t count_;
+    };
+    bool CreateSlot(ExecutionSlot &slot);
+    void FreeSlot(ExecutionSlot &slot);
+    bool StartSlot(ExecutionSlot &slot);
+    bool FinishSlot(ExecutionSlot &slot, float *results, float *tensors);
+    size_t CheckResults(const float *inputValues1, const float *inputValues2,
+                        size_t count, const float *tensors);
+
     ANeuralNetworksModel *model_;
     ANeuralNetworksCompilation *compilation_;
     ANeuralNetworksMemory *memoryModel_;
-    ANeuralNetworksMemory *memoryInput2_;
-    ANeuralNetworksMemory *memoryOutput_;
+
+    // ANeuralNetworksExecution_setReusable(), on devices that have it
+    int (*setReusable_)(ANeuralNetworksExecution *execution, bool reusable);
 
     uint32_t dimLength_;
     uint32_t tensorSize_;
     size_t offset_;
 
-    std::vector<float> inputTensor1_;
     int modelDataFd_;
-    int inputTensor2Fd_;
-    int outputTensorFd_;
+    SimpleGraph graph_;
+    std::unique_ptr<CpuGraph> cpuGraph_;
+    ExecutionSlot slots_[kInFlight];
 };
 
 #endif  // NNAPI_SIMPLE_MODEL_H
\ No newline at end of file
@@ -40,6 +40,12 @@ public class MainActivity extends Activity {
 
     public native float startCompute(long modelHandle, float input1, float input2);
 
+    // Computes inputs1[i], inputs2[i] pairs in batches; null on errors.
+    public native float[] startComputeBatch(long modelHandle, float[] inputs1, float[] inputs2);
+
+    // Debug builds of the native library only: logs batched vs single timings.
+    public native boolean benchmarkModel(long modelHandle, int count);
+
     public native void destroyModel(long modelHandle);
 
     @Override
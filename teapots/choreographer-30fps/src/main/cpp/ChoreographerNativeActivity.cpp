@@ -137,6 +137,7 @@ Engine::Engine()
      initialized_resources_(false),
      has_focus_(false),
      fps_throttle_(true),
+     monitor_("choreographer-30fps"),
      api_mode_(kAPINone),
      prevFrameTimeNanos_(static_cast<int64_t>(0)),
      should_render_(true) {
@@ -192,6 +193,7 @@ void Engine::CheckAPISupport() {
 }
 
 void Engine::StartFPSThrottle() {
+  monitor_.SetDeadline(1000.0 / 30);
   api_mode_ = original_api_mode_;
   if (api_mode_ == kAPINativeChoreographer) {
     // Initiate choreographer callback.
@@ -203,6 +205,7 @@ void Engine::StartFPSThrottle() {
 }
 
 void Engine::StopFPSThrottle() {
+  monitor_.SetDeadline(0);
   if (api_mode_ == kAPINativeChoreographer) {
     should_render_ = true;
     //    ALooper_wake(app_->looper);
@@ -315,6 +318,7 @@ int64_t Engine::GetCurrentTime() {
 }
 
 void Engine::Swap() {
+  FramePhaseScope swap(monitor_.Timer(), FRAME_PHASE_SWAP);
   if (EGL_SUCCESS != gl_context_->Swap()) {
     UnloadResources();
     LoadResources();
@@ -386,21 +390,30 @@ void Engine::DrawFrame() {
   if (monitor_.Update(fps)) {
     UpdateFPS(fps);
   }
-  renderer_.Update(monitor_.GetCurrentTime());
-
-  // Just fill the screen with a color.
-  glClearColor(0.5f, 0.5f, 0.5f, 1.f);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  float color[2][3] = {{1.0f, 0.5f, 0.5f}, {1.0f, 0.0f, 0.0f}};
-  int32_t i = fps_throttle_ ? 0 : 1;
-  renderer_.Render(color[i][0], color[i][1], color[i][2]);
+  {
+    FramePhaseScope update(monitor_.Timer(), FRAME_PHASE_UPDATE);
+    renderer_.Update(monitor_.GetCurrentTime());
+  }
+
+  {
+    FramePhaseScope render(monitor_.Timer(), FRAME_PHASE_RENDER);
+    // Just fill the screen with a color.
+    glClearColor(0.5f, 0.5f, 0.5f, 1.f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    float color[2][3] = {{1.0f, 0.5f, 0.5f}, {1.0f, 0.0f, 0.0f}};
+    int32_t i = fps_throttle_ ? 0 : 1;
+    renderer_.Render(color[i][0], color[i][1], color[i][2]);
+  }
   DoSwap();
 }
 
 /**
  * Tear down the EGL context currently associated with the display.
  */
-void Engine::TermDisplay() { gl_context_->Suspend(); }
+void Engine::TermDisplay() {
+  gl_context_->Suspend();
+  monitor_.Pause();
+}
 
 void Engine::TrimMemory() {
   LOGI("Trimming memory");
@@ -509,6 +522,7 @@ void Engine::HandleCmd(struct android_app* app, int32_t cmd) {
       // Also stop animating.
       eng->has_focus_ = false;
       eng->DrawFrame();
+      eng->monitor_.Pause();
       break;
     case APP_CMD_LOW_MEMORY:
       // Free up GL resources
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jobSystem.h"
+
+#include <unistd.h>
+
+namespace ndk_helper {
+
+JobSystem::JobSystem(int32_t thread_count)
+    : generation_(0),
+      busy_(0),
+      quit_(false),
+      job_(NULL),
+      count_(0),
+      chunk_size_(1),
+      next_(0) {
+  if (thread_count <= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    thread_count = cpus > 0 ? static_cast<int32_t>(cpus) : 1;
+  }
+  for (int32_t i = 1; i < thread_count; ++i) {
+    workers_.push_back(std::thread(&JobSystem::WorkerMain, this));
+  }
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  start_.notify_all();
+  for (size_t i = 0; i < workers_.size(); ++i) workers_[i].join();
+}
+
+void JobSystem::ParallelFor(size_t count, size_t chunk_size, const Job& job) {
+  if (chunk_size == 0) chunk_size = 1;
+  if (workers_.empty() || count <= chunk_size) {
+    for (size_t begin = 0; begin < count; begin += chunk_size) {
+      job(begin, begin + chunk_size < count ? begin + chunk_size : count);
+    }
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    job_ = &job;
+    count_ = count;
+    chunk_size_ = chunk_size;
+    next_.store(0, std::memory_order_relaxed);
+    busy_ = static_cast<int32_t>(workers_.size());
+    ++generation_;
+  }
+  start_.notify_all();
+
+  RunChunks();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this]() { return busy_ == 0; });
+  job_ = NULL;
+}
+
+void JobSystem::RunChunks() {
+  for (;;) {
+    size_t begin = next_.fetch_add(chunk_size_, std::memory_order_relaxed);
+    if (begin >= count_) return;
+    size_t end = begin + chunk_size_ < count_ ? begin + chunk_size_ : count_;
+    (*job_)(begin, end);
+  }
+}
+
+void JobSystem::WorkerMain() {
+  // the generation the pool was created with, not the current one: a loop
+  // may have started before this thread did
+  uint64_t seen = 0;
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    start_.wait(lock, [this, seen]() { return quit_ || generation_ != seen; });
+    if (quit_) return;
+    seen = generation_;
+
+    lock.unlock();
+    RunChunks();
+    lock.lock();
+
+    if (--busy_ == 0) done_.notify_one();
+  }
+}
+
+}  // namespace ndk_helper
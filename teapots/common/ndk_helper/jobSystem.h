@@ -0,0 +1,85 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef JOBSYSTEM_H_
+#define JOBSYSTEM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ndk_helper {
+
+/******************************************************************
+ * Persistent pool of worker threads for the data parallel parts of a frame
+ *
+ * ParallelFor() splits [0, count) in chunks of chunk_size, and the workers
+ * and the calling thread take the chunks from an atomic counter until none
+ * is left. Workers sleep on a condition variable between loops, so an idle
+ * pool costs nothing.
+ */
+class JobSystem {
+ public:
+  // job(begin, end): one chunk, begin is a multiple of chunk_size
+  typedef std::function<void(size_t begin, size_t end)> Job;
+
+  // thread_count counts the calling thread; 0 for one per online CPU
+  explicit JobSystem(int32_t thread_count = 0);
+  virtual ~JobSystem();
+
+  int32_t ThreadCount() const {
+    return static_cast<int32_t>(workers_.size()) + 1;
+  }
+
+  /*
+   * Runs job over every chunk, and returns once all of them are done: what
+   * the chunks wrote is then visible to the caller. Loops of a single chunk
+   * run on the calling thread. Not reentrant: one loop at a time.
+   */
+  void ParallelFor(size_t count, size_t chunk_size, const Job& job);
+
+ private:
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+
+  void WorkerMain();
+  void RunChunks();
+
+  std::vector<std::thread> workers_;
+
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  // guarded by mutex_
+  uint64_t generation_;
+  int32_t busy_;
+  bool quit_;
+
+  // the current loop, published with generation_
+  const Job* job_;
+  size_t count_;
+  size_t chunk_size_;
+  std::atomic<size_t> next_;
+};
+
+}  // namespace ndk_helper
+#endif /* JOBSYSTEM_H_ */
@@ -18,38 +18,30 @@
 
 namespace ndk_helper {
 
-PerfMonitor::PerfMonitor()
-    : current_FPS_(0),
-      tv_last_sec_(0),
-      last_tick_(0.f),
-      tickindex_(0),
-      ticksum_(0) {
-  for (int32_t i = 0; i < kNumSamples; ++i) ticklist_[i] = 0;
+// Period of the frame time reports in logcat
+const double kReportPeriodMs = 5000.0;
+
+PerfMonitor::PerfMonitor(const char* name)
+    : current_FPS_(0), fps_start_(0), fps_frames_(0) {
+  FrameTimerConfig config = {};
+  config.name = name;
+  config.dumpPeriodMs = kReportPeriodMs;
+  timer_ = frameTimerCreate(&config);
 }
 
-PerfMonitor::~PerfMonitor() {}
-
-double PerfMonitor::UpdateTick(double currentTick) {
-  ticksum_ -= ticklist_[tickindex_];
-  ticksum_ += currentTick;
-  ticklist_[tickindex_] = currentTick;
-  tickindex_ = (tickindex_ + 1) % kNumSamples;
-
-  return ((double)ticksum_ / kNumSamples);
-}
+PerfMonitor::~PerfMonitor() { frameTimerDestroy(timer_); }
 
 bool PerfMonitor::Update(float &fFPS) {
-  struct timeval Time;
-  gettimeofday(&Time, NULL);
-
-  double time = Time.tv_sec + Time.tv_usec * 1.0 / 1000000.0;
-  double tick = time - last_tick_;
-  double d = UpdateTick(tick);
-  last_tick_ = time;
-
-  if (Time.tv_sec - tv_last_sec_ >= 1) {
-    current_FPS_ = 1.f / d;
-    tv_last_sec_ = Time.tv_sec;
+  frameTimerFrame(timer_);
+
+  double time = GetCurrentTime();
+  fps_frames_++;
+  if (time - fps_start_ >= 1.0) {
+    if (fps_start_ > 0) {
+      current_FPS_ = fps_frames_ / (time - fps_start_);
+    }
+    fps_start_ = time;
+    fps_frames_ = 0;
     fFPS = current_FPS_;
     return true;
   } else {
@@ -21,32 +21,42 @@
 #include <errno.h>
 #include <time.h>
 #include "JNIHelper.h"
+#include "frame_timing.h"
 
 namespace ndk_helper {
 
-const int32_t kNumSamples = 100;
-
 /******************************************************************
  * Helper class for a performance monitoring and get current tick time
+ *
+ * Frame times go to a FrameTimer: phases can be timed with
+ *   FramePhaseScope scope(monitor.Timer(), FRAME_PHASE_RENDER);
+ * and the percentiles of every phase are written to logcat periodically.
  */
 class PerfMonitor {
  private:
+  FrameTimer* timer_;
   float current_FPS_;
-  time_t tv_last_sec_;
-
-  double last_tick_;
-  int32_t tickindex_;
-  double ticksum_;
-  double ticklist_[kNumSamples];
+  double fps_start_;
+  int32_t fps_frames_;
 
-  double UpdateTick(double current_tick);
+  PerfMonitor(const PerfMonitor&) = delete;
+  PerfMonitor& operator=(const PerfMonitor&) = delete;
 
  public:
-  PerfMonitor();
+  explicit PerfMonitor(const char* name = "teapot");
   virtual ~PerfMonitor();
 
+  // Call once per frame; true when fFPS was updated, about every second
   bool Update(float &fFPS);
 
+  // frame budget for the missed deadline counts, 1000/60 ms by default
+  void SetDeadline(double deadline_ms) { frameTimerSetDeadline(timer_, deadline_ms); }
+
+  // The animation stopped: the next interval is not a frame
+  void Pause() { frameTimerPause(timer_); }
+
+  FrameTimer* Timer() { return timer_; }
+
   static double GetCurrentTime() {
     struct timeval time;
     gettimeofday(&time, NULL);
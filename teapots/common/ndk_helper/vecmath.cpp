@@ -19,126 +19,84 @@
 //--------------------------------------------------------------------------------
 #include "vecmath.h"
 
+#include <stdint.h>
+#include <string.h>
+
 namespace ndk_helper {
 
-//--------------------------------------------------------------------------------
-// vec3
-//--------------------------------------------------------------------------------
-Vec3::Vec3(const Vec4& vec) {
-  x_ = vec.x_;
-  y_ = vec.y_;
-  z_ = vec.z_;
-}
+namespace {
 
 //--------------------------------------------------------------------------------
-// vec4
+// Scalar kernels: the fallback of builds without NEON / SSE, and the reference
+// of vecmath_benchmark.cpp. Matrices are 16 floats, column major.
 //--------------------------------------------------------------------------------
-Vec4 Vec4::operator*(const Mat4& rhs) const {
-  Vec4 out;
-  out.x_ = x_ * rhs.f_[0] + y_ * rhs.f_[1] + z_ * rhs.f_[2] + w_ * rhs.f_[3];
-  out.y_ = x_ * rhs.f_[4] + y_ * rhs.f_[5] + z_ * rhs.f_[6] + w_ * rhs.f_[7];
-  out.z_ = x_ * rhs.f_[8] + y_ * rhs.f_[9] + z_ * rhs.f_[10] + w_ * rhs.f_[11];
-  out.w_ =
-      x_ * rhs.f_[12] + y_ * rhs.f_[13] + z_ * rhs.f_[14] + w_ * rhs.f_[15];
-  return out;
-}
-
-//--------------------------------------------------------------------------------
-// mat4
-//--------------------------------------------------------------------------------
-Mat4::Mat4() {
-  for (int32_t i = 0; i < 16; ++i) f_[i] = 0.f;
-  // column major identity matrix
-  f_[0] = f_[5] = f_[10] = f_[15] = 1.0f;
-}
-
-Mat4::Mat4(const float* mIn) {
-  for (int32_t i = 0; i < 16; ++i) f_[i] = mIn[i];
+// out = a * b; out may be a or b
+inline void MultiplyScalar(const float* a, const float* b, float* out) {
+  float ret[16];
+  for (int32_t c = 0; c < 4; ++c) {
+    const float* col = b + c * 4;
+    for (int32_t r = 0; r < 4; ++r) {
+      ret[c * 4 + r] = a[r] * col[0] + a[4 + r] * col[1] + a[8 + r] * col[2] +
+                       a[12 + r] * col[3];
+    }
+  }
+  memcpy(out, ret, sizeof(ret));
 }
 
-Mat4 Mat4::operator*(const Mat4& rhs) const {
-  Mat4 ret;
-  ret.f_[0] = f_[0] * rhs.f_[0] + f_[4] * rhs.f_[1] + f_[8] * rhs.f_[2] +
-              f_[12] * rhs.f_[3];
-  ret.f_[1] = f_[1] * rhs.f_[0] + f_[5] * rhs.f_[1] + f_[9] * rhs.f_[2] +
-              f_[13] * rhs.f_[3];
-  ret.f_[2] = f_[2] * rhs.f_[0] + f_[6] * rhs.f_[1] + f_[10] * rhs.f_[2] +
-              f_[14] * rhs.f_[3];
-  ret.f_[3] = f_[3] * rhs.f_[0] + f_[7] * rhs.f_[1] + f_[11] * rhs.f_[2] +
-              f_[15] * rhs.f_[3];
-
-  ret.f_[4] = f_[0] * rhs.f_[4] + f_[4] * rhs.f_[5] + f_[8] * rhs.f_[6] +
-              f_[12] * rhs.f_[7];
-  ret.f_[5] = f_[1] * rhs.f_[4] + f_[5] * rhs.f_[5] + f_[9] * rhs.f_[6] +
-              f_[13] * rhs.f_[7];
-  ret.f_[6] = f_[2] * rhs.f_[4] + f_[6] * rhs.f_[5] + f_[10] * rhs.f_[6] +
-              f_[14] * rhs.f_[7];
-  ret.f_[7] = f_[3] * rhs.f_[4] + f_[7] * rhs.f_[5] + f_[11] * rhs.f_[6] +
-              f_[15] * rhs.f_[7];
-
-  ret.f_[8] = f_[0] * rhs.f_[8] + f_[4] * rhs.f_[9] + f_[8] * rhs.f_[10] +
-              f_[12] * rhs.f_[11];
-  ret.f_[9] = f_[1] * rhs.f_[8] + f_[5] * rhs.f_[9] + f_[9] * rhs.f_[10] +
-              f_[13] * rhs.f_[11];
-  ret.f_[10] = f_[2] * rhs.f_[8] + f_[6] * rhs.f_[9] + f_[10] * rhs.f_[10] +
-               f_[14] * rhs.f_[11];
-  ret.f_[11] = f_[3] * rhs.f_[8] + f_[7] * rhs.f_[9] + f_[11] * rhs.f_[10] +
-               f_[15] * rhs.f_[11];
-
-  ret.f_[12] = f_[0] * rhs.f_[12] + f_[4] * rhs.f_[13] + f_[8] * rhs.f_[14] +
-               f_[12] * rhs.f_[15];
-  ret.f_[13] = f_[1] * rhs.f_[12] + f_[5] * rhs.f_[13] + f_[9] * rhs.f_[14] +
-               f_[13] * rhs.f_[15];
-  ret.f_[14] = f_[2] * rhs.f_[12] + f_[6] * rhs.f_[13] + f_[10] * rhs.f_[14] +
-               f_[14] * rhs.f_[15];
-  ret.f_[15] = f_[3] * rhs.f_[12] + f_[7] * rhs.f_[13] + f_[11] * rhs.f_[14] +
-               f_[15] * rhs.f_[15];
-
-  return ret;
+// out = m * v
+inline void TransformScalar(const float* m, const float* v, float* out) {
+  float ret[4];
+  for (int32_t r = 0; r < 4; ++r) {
+    ret[r] = v[0] * m[r] + v[1] * m[4 + r] + v[2] * m[8 + r] + v[3] * m[12 + r];
+  }
+  memcpy(out, ret, sizeof(ret));
 }
 
-Vec4 Mat4::operator*(const Vec4& rhs) const {
-  Vec4 ret;
-  ret.x_ = rhs.x_ * f_[0] + rhs.y_ * f_[4] + rhs.z_ * f_[8] + rhs.w_ * f_[12];
-  ret.y_ = rhs.x_ * f_[1] + rhs.y_ * f_[5] + rhs.z_ * f_[9] + rhs.w_ * f_[13];
-  ret.z_ = rhs.x_ * f_[2] + rhs.y_ * f_[6] + rhs.z_ * f_[10] + rhs.w_ * f_[14];
-  ret.w_ = rhs.x_ * f_[3] + rhs.y_ * f_[7] + rhs.z_ * f_[11] + rhs.w_ * f_[15];
-  return ret;
+// out = v * m, v as a row vector
+inline void TransformRowScalar(const float* v, const float* m, float* out) {
+  float ret[4];
+  for (int32_t c = 0; c < 4; ++c) {
+    const float* col = m + c * 4;
+    ret[c] = v[0] * col[0] + v[1] * col[1] + v[2] * col[2] + v[3] * col[3];
+  }
+  memcpy(out, ret, sizeof(ret));
 }
 
-Mat4 Mat4::Inverse() {
-  Mat4 ret;
+// out = inverse(f), f affine; out is the identity when f is singular
+void InverseScalar(const float* f, float* out) {
+  float ret[16] = {1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f,
+                   0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f};
   float det_1;
   float pos = 0;
   float neg = 0;
   float temp;
 
-  temp = f_[0] * f_[5] * f_[10];
+  temp = f[0] * f[5] * f[10];
   if (temp >= 0)
     pos += temp;
   else
     neg += temp;
-  temp = f_[4] * f_[9] * f_[2];
+  temp = f[4] * f[9] * f[2];
   if (temp >= 0)
     pos += temp;
   else
     neg += temp;
-  temp = f_[8] * f_[1] * f_[6];
+  temp = f[8] * f[1] * f[6];
   if (temp >= 0)
     pos += temp;
   else
     neg += temp;
-  temp = -f_[8] * f_[5] * f_[2];
+  temp = -f[8] * f[5] * f[2];
   if (temp >= 0)
     pos += temp;
   else
     neg += temp;
-  temp = -f_[4] * f_[1] * f_[10];
+  temp = -f[4] * f[1] * f[10];
   if (temp >= 0)
     pos += temp;
   else
     neg += temp;
-  temp = -f_[0] * f_[9] * f_[6];
+  temp = -f[0] * f[9] * f[6];
   if (temp >= 0)
     pos += temp;
   else
@@ -149,34 +107,257 @@ Mat4 Mat4::Inverse() {
     // Error
   } else {
     det_1 = 1.0f / det_1;
-    ret.f_[0] = (f_[5] * f_[10] - f_[9] * f_[6]) * det_1;
-    ret.f_[1] = -(f_[1] * f_[10] - f_[9] * f_[2]) * det_1;
-    ret.f_[2] = (f_[1] * f_[6] - f_[5] * f_[2]) * det_1;
-    ret.f_[4] = -(f_[4] * f_[10] - f_[8] * f_[6]) * det_1;
-    ret.f_[5] = (f_[0] * f_[10] - f_[8] * f_[2]) * det_1;
-    ret.f_[6] = -(f_[0] * f_[6] - f_[4] * f_[2]) * det_1;
-    ret.f_[8] = (f_[4] * f_[9] - f_[8] * f_[5]) * det_1;
-    ret.f_[9] = -(f_[0] * f_[9] - f_[8] * f_[1]) * det_1;
-    ret.f_[10] = (f_[0] * f_[5] - f_[4] * f_[1]) * det_1;
+    ret[0] = (f[5] * f[10] - f[9] * f[6]) * det_1;
+    ret[1] = -(f[1] * f[10] - f[9] * f[2]) * det_1;
+    ret[2] = (f[1] * f[6] - f[5] * f[2]) * det_1;
+    ret[4] = -(f[4] * f[10] - f[8] * f[6]) * det_1;
+    ret[5] = (f[0] * f[10] - f[8] * f[2]) * det_1;
+    ret[6] = -(f[0] * f[6] - f[4] * f[2]) * det_1;
+    ret[8] = (f[4] * f[9] - f[8] * f[5]) * det_1;
+    ret[9] = -(f[0] * f[9] - f[8] * f[1]) * det_1;
+    ret[10] = (f[0] * f[5] - f[4] * f[1]) * det_1;
 
     /* Calculate -C * inverse(A) */
-    ret.f_[12] =
-        -(f_[12] * ret.f_[0] + f_[13] * ret.f_[4] + f_[14] * ret.f_[8]);
-    ret.f_[13] =
-        -(f_[12] * ret.f_[1] + f_[13] * ret.f_[5] + f_[14] * ret.f_[9]);
-    ret.f_[14] =
-        -(f_[12] * ret.f_[2] + f_[13] * ret.f_[6] + f_[14] * ret.f_[10]);
-
-    ret.f_[3] = 0.0f;
-    ret.f_[7] = 0.0f;
-    ret.f_[11] = 0.0f;
-    ret.f_[15] = 1.0f;
+    ret[12] = -(f[12] * ret[0] + f[13] * ret[4] + f[14] * ret[8]);
+    ret[13] = -(f[12] * ret[1] + f[13] * ret[5] + f[14] * ret[9]);
+    ret[14] = -(f[12] * ret[2] + f[13] * ret[6] + f[14] * ret[10]);
+  }
+  memcpy(out, ret, sizeof(ret));
+}
+
+#if defined(VECMATH_USE_SIMD)
+//--------------------------------------------------------------------------------
+// NEON / SSE kernels. A matrix is held as its 4 columns; a * b is then, for
+// each column of b, the columns of a scaled by its 4 elements and summed in
+// the order of the scalar code.
+//--------------------------------------------------------------------------------
+using simd::Float4;
+
+inline void LoadColumns(const float* m, Float4 c[4]) {
+  c[0] = simd::Load(m);
+  c[1] = simd::Load(m + 4);
+  c[2] = simd::Load(m + 8);
+  c[3] = simd::Load(m + 12);
+}
+
+// a * v, the columns of a in registers
+inline Float4 Transform(const Float4 a[4], const float* v) {
+  Float4 r = simd::Mul(a[0], simd::SplatLoad(v));
+  r = simd::MulAdd(r, a[1], simd::SplatLoad(v + 1));
+  r = simd::MulAdd(r, a[2], simd::SplatLoad(v + 2));
+  return simd::MulAdd(r, a[3], simd::SplatLoad(v + 3));
+}
+
+// out = a * b; out may be b, every column is computed before the stores
+inline void Multiply(const Float4 a[4], const float* b, float* out) {
+  Float4 c0 = Transform(a, b);
+  Float4 c1 = Transform(a, b + 4);
+  Float4 c2 = Transform(a, b + 8);
+  Float4 c3 = Transform(a, b + 12);
+  simd::Store(out, c0);
+  simd::Store(out + 4, c1);
+  simd::Store(out + 8, c2);
+  simd::Store(out + 12, c3);
+}
+
+inline void Transpose(Float4& r0, Float4& r1, Float4& r2, Float4& r3) {
+#if defined(VECMATH_USE_NEON)
+  float32x4x2_t t01 = vtrnq_f32(r0, r1);
+  float32x4x2_t t23 = vtrnq_f32(r2, r3);
+  r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+  r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+  r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+  r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+#else
+  _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+#endif
+}
+
+// (y, z, x, x)
+inline Float4 Yzx(Float4 v) {
+#if defined(VECMATH_USE_NEON)
+  v = vsetq_lane_f32(vgetq_lane_f32(v, 0), v, 3);
+  return vextq_f32(v, v, 1);
+#else
+  return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 2, 1));
+#endif
+}
+
+// a x b in x, y, z; each element is the difference of the same products as
+// the cofactors of InverseScalar()
+inline Float4 Cross(Float4 a, Float4 b) {
+  return Yzx(simd::Sub(simd::Mul(a, Yzx(b)), simd::Mul(Yzx(a), b)));
+}
+
+/*
+ * The rows of the inverse of the upper 3x3 block, columns a, b and c, are
+ * b x c, c x a and a x b over the determinant a . (b x c); they are
+ * transposed into the columns of the result.
+ */
+void Inverse(const float* f, float* out) {
+  Float4 a = simd::Load(f);
+  Float4 b = simd::Load(f + 4);
+  Float4 c = simd::Load(f + 8);
+  Float4 r0 = Cross(b, c);
+  Float4 r1 = Cross(c, a);
+  Float4 r2 = Cross(a, b);
+
+  float bc[4];
+  simd::Store(bc, r0);
+  float det = f[0] * bc[0] + f[1] * bc[1] + f[2] * bc[2];
+  if (det == 0.0f) {
+    InverseScalar(f, out);
+    return;
   }
 
-  *this = ret;
+  Float4 r3 = simd::Splat(0.f);
+  Transpose(r0, r1, r2, r3);
+  Float4 det_1 = simd::Splat(1.0f / det);
+  r0 = simd::Mul(r0, det_1);
+  r1 = simd::Mul(r1, det_1);
+  r2 = simd::Mul(r2, det_1);
+
+  // -C * inverse(A), then w = 1
+  Float4 t = simd::Mul(r0, simd::SplatLoad(f + 12));
+  t = simd::MulAdd(t, r1, simd::SplatLoad(f + 13));
+  t = simd::MulAdd(t, r2, simd::SplatLoad(f + 14));
+  t = simd::Sub(simd::Splat(0.f), t);
+
+  simd::Store(out, r0);
+  simd::Store(out + 4, r1);
+  simd::Store(out + 8, r2);
+  simd::Store(out + 12, t);
+  out[15] = 1.0f;
+}
+#endif
+
+}  // namespace
+
+//--------------------------------------------------------------------------------
+// vec3
+//--------------------------------------------------------------------------------
+Vec3::Vec3(const Vec4& vec) {
+  x_ = vec.x_;
+  y_ = vec.y_;
+  z_ = vec.z_;
+}
+
+//--------------------------------------------------------------------------------
+// vec4
+//--------------------------------------------------------------------------------
+Vec4 Vec4::operator*(const Mat4& rhs) const {
+  Vec4 out;
+#if defined(VECMATH_USE_SIMD)
+  // v * m is transpose(m) * v
+  Float4 m[4];
+  LoadColumns(rhs.f_, m);
+  Transpose(m[0], m[1], m[2], m[3]);
+  simd::Store(&out.x_, Transform(m, &x_));
+#else
+  TransformRowScalar(&x_, rhs.f_, &out.x_);
+#endif
+  return out;
+}
+
+//--------------------------------------------------------------------------------
+// mat4
+//--------------------------------------------------------------------------------
+Mat4::Mat4() {
+  for (int32_t i = 0; i < 16; ++i) f_[i] = 0.f;
+  // column major identity matrix
+  f_[0] = f_[5] = f_[10] = f_[15] = 1.0f;
+}
+
+Mat4::Mat4(const float* mIn) {
+  for (int32_t i = 0; i < 16; ++i) f_[i] = mIn[i];
+}
+
+Mat4 Mat4::operator*(const Mat4& rhs) const {
+  Mat4 ret;
+  Multiply(*this, rhs, ret);
+  return ret;
+}
+
+Vec4 Mat4::operator*(const Vec4& rhs) const {
+  Vec4 ret;
+#if defined(VECMATH_USE_SIMD)
+  Float4 a[4];
+  LoadColumns(f_, a);
+  simd::Store(&ret.x_, Transform(a, &rhs.x_));
+#else
+  TransformScalar(f_, &rhs.x_, &ret.x_);
+#endif
+  return ret;
+}
+
+Mat4 Mat4::Inverse() {
+#if defined(VECMATH_USE_SIMD)
+  ndk_helper::Inverse(f_, f_);
+#else
+  InverseScalar(f_, f_);
+#endif
   return *this;
 }
 
+void Mat4::Multiply(const Mat4& lhs, const Mat4& rhs, Mat4& out) {
+#if defined(VECMATH_USE_SIMD)
+  Float4 a[4];
+  LoadColumns(lhs.f_, a);
+  ndk_helper::Multiply(a, rhs.f_, out.f_);
+#else
+  MultiplyScalar(lhs.f_, rhs.f_, out.f_);
+#endif
+}
+
+void Mat4::MultiplyBatch(const Mat4& lhs, const Mat4* rhs, size_t count,
+                         float* out, size_t stride) {
+  uint8_t* dst = reinterpret_cast<uint8_t*>(out);
+  if (stride == 0) stride = sizeof(Mat4);
+#if defined(VECMATH_USE_SIMD)
+  Float4 a[4];
+  LoadColumns(lhs.f_, a);
+  for (size_t i = 0; i < count; ++i, dst += stride) {
+    ndk_helper::Multiply(a, rhs[i].f_, reinterpret_cast<float*>(dst));
+  }
+#else
+  for (size_t i = 0; i < count; ++i, dst += stride) {
+    MultiplyScalar(lhs.f_, rhs[i].f_, reinterpret_cast<float*>(dst));
+  }
+#endif
+}
+
+void Mat4::MultiplyBatch(const Mat4* lhs, const Mat4* rhs, size_t count,
+                         float* out, size_t stride) {
+  uint8_t* dst = reinterpret_cast<uint8_t*>(out);
+  if (stride == 0) stride = sizeof(Mat4);
+  for (size_t i = 0; i < count; ++i, dst += stride) {
+#if defined(VECMATH_USE_SIMD)
+    Float4 a[4];
+    LoadColumns(lhs[i].f_, a);
+    ndk_helper::Multiply(a, rhs[i].f_, reinterpret_cast<float*>(dst));
+#else
+    MultiplyScalar(lhs[i].f_, rhs[i].f_, reinterpret_cast<float*>(dst));
+#endif
+  }
+}
+
+void Mat4::TransformBatch(const Mat4& m, const Vec4* in, size_t count,
+                          float* out, size_t stride) {
+  uint8_t* dst = reinterpret_cast<uint8_t*>(out);
+  if (stride == 0) stride = sizeof(Vec4);
+#if defined(VECMATH_USE_SIMD)
+  Float4 a[4];
+  LoadColumns(m.f_, a);
+  for (size_t i = 0; i < count; ++i, dst += stride) {
+    simd::Store(reinterpret_cast<float*>(dst), Transform(a, &in[i].x_));
+  }
+#else
+  for (size_t i = 0; i < count; ++i, dst += stride) {
+    TransformScalar(m.f_, &in[i].x_, reinterpret_cast<float*>(dst));
+  }
+#endif
+}
+
 //--------------------------------------------------------------------------------
 // Misc
 //--------------------------------------------------------------------------------
@@ -184,8 +365,7 @@ Mat4 Mat4::RotationX(const float fAngle) {
   Mat4 ret;
   float fCosine, fSine;
 
-  fCosine = cosf(fAngle);
-  fSine = sinf(fAngle);
+  sincosf(fAngle, &fSine, &fCosine);
 
   ret.f_[0] = 1.0f;
   ret.f_[4] = 0.0f;
@@ -210,8 +390,7 @@ Mat4 Mat4::RotationY(const float fAngle) {
   Mat4 ret;
   float fCosine, fSine;
 
-  fCosine = cosf(fAngle);
-  fSine = sinf(fAngle);
+  sincosf(fAngle, &fSine, &fCosine);
 
   ret.f_[0] = fCosine;
   ret.f_[4] = 0.0f;
@@ -236,8 +415,7 @@ Mat4 Mat4::RotationZ(const float fAngle) {
   Mat4 ret;
   float fCosine, fSine;
 
-  fCosine = cosf(fAngle);
-  fSine = sinf(fAngle);
+  sincosf(fAngle, &fSine, &fCosine);
 
   ret.f_[0] = fCosine;
   ret.f_[4] = fSine;
@@ -18,13 +18,30 @@
 #define VECMATH_H_
 
 #include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#ifdef __ANDROID__
 #include "JNIHelper.h"
+#else
+// host builds of the benchmarks
+#include <cstdio>
+#define LOGI(...) (printf(__VA_ARGS__), printf("\n"))
+#endif
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define VECMATH_USE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define VECMATH_USE_SSE 1
+#endif
 
 namespace ndk_helper {
 
 /******************************************************************
  * Helper class for vector math operations
- * Currently all implementations are in pure C++.
+ * Vec4 and Mat4 arithmetic uses NEON (armeabi-v7a with NEON, arm64-v8a) or
+ * SSE (x86, x86_64), other builds and classes are in pure C++.
  * Each class is an opaque class so caller does not have a direct access
  * to each element. This is for an ease of future optimization to use vector
  *operations.
@@ -36,6 +53,89 @@ class Vec3;
 class Vec4;
 class Mat4;
 
+#if defined(VECMATH_USE_NEON) || defined(VECMATH_USE_SSE)
+#define VECMATH_USE_SIMD 1
+/******************************************************************
+ * 4 lanes float operations behind the Vec4 and Mat4 kernels.
+ * Loads and stores are unaligned ones: they cost the same as aligned ones on
+ * the aligned members, and still work on a matrix in a mapped buffer.
+ * Products and sums are separate instructions, never fused multiply-adds, so
+ * each lane rounds like the scalar expression it replaces.
+ */
+namespace simd {
+#if defined(VECMATH_USE_NEON)
+typedef float32x4_t Float4;
+
+inline Float4 Load(const float* p) { return vld1q_f32(p); }
+inline Float4 SplatLoad(const float* p) { return vld1q_dup_f32(p); }
+inline Float4 Splat(float f) { return vdupq_n_f32(f); }
+inline void Store(float* p, Float4 v) { vst1q_f32(p, v); }
+inline Float4 Add(Float4 a, Float4 b) { return vaddq_f32(a, b); }
+inline Float4 Sub(Float4 a, Float4 b) { return vsubq_f32(a, b); }
+inline Float4 Mul(Float4 a, Float4 b) { return vmulq_f32(a, b); }
+inline Float4 Div(Float4 a, Float4 b) {
+#if defined(__aarch64__)
+  return vdivq_f32(a, b);
+#else
+  // ARMv7 NEON only has a reciprocal estimate, divide lane by lane
+  float fa[4], fb[4];
+  vst1q_f32(fa, a);
+  vst1q_f32(fb, b);
+  for (int32_t i = 0; i < 4; ++i) fa[i] /= fb[i];
+  return vld1q_f32(fa);
+#endif
+}
+#else
+typedef __m128 Float4;
+
+inline Float4 Load(const float* p) { return _mm_loadu_ps(p); }
+inline Float4 SplatLoad(const float* p) { return _mm_load1_ps(p); }
+inline Float4 Splat(float f) { return _mm_set1_ps(f); }
+inline void Store(float* p, Float4 v) { _mm_storeu_ps(p, v); }
+inline Float4 Add(Float4 a, Float4 b) { return _mm_add_ps(a, b); }
+inline Float4 Sub(Float4 a, Float4 b) { return _mm_sub_ps(a, b); }
+inline Float4 Mul(Float4 a, Float4 b) { return _mm_mul_ps(a, b); }
+inline Float4 Div(Float4 a, Float4 b) { return _mm_div_ps(a, b); }
+#endif
+
+// a + b * c
+inline Float4 MulAdd(Float4 a, Float4 b, Float4 c) { return Add(a, Mul(b, c)); }
+}  // namespace simd
+#endif
+
+/******************************************************************
+ * std::allocator only guarantees the alignment of malloc, 8 bytes on 32 bit
+ * Android, while the compiler may copy a Vec4 or a Mat4 with 16 byte aligned
+ * loads. Use this allocator for containers of them:
+ *   std::vector<Mat4, AlignedAllocator<Mat4> > matrices;
+ */
+template <typename T>
+class AlignedAllocator {
+ public:
+  typedef T value_type;
+
+  AlignedAllocator() {}
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    void* p = NULL;
+    size_t alignment = alignof(T) < sizeof(void*) ? sizeof(void*) : alignof(T);
+    if (posix_memalign(&p, alignment, n * sizeof(T)) != 0) abort();
+    return static_cast<T*>(p);
+  }
+  void deallocate(T* p, size_t) { free(p); }
+
+  template <typename U>
+  bool operator==(const AlignedAllocator<U>&) const {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const AlignedAllocator<U>&) const {
+    return false;
+  }
+};
+
 /******************************************************************
  * 2 elements vector class
  *
@@ -63,6 +163,8 @@ class Vec2 {
     y_ = vec.y_;
   }
 
+  Vec2& operator=(const Vec2& vec) = default;
+
   Vec2(const float* pVec) {
     x_ = (*pVec++);
     y_ = (*pVec++);
@@ -228,6 +330,8 @@ class Vec3 {
     z_ = vec.z_;
   }
 
+  Vec3& operator=(const Vec3& vec) = default;
+
   Vec3(const float* pVec) {
     x_ = (*pVec++);
     y_ = (*pVec++);
@@ -403,10 +507,15 @@ class Vec3 {
  * 4 elements vector class
  *
  */
-class Vec4 {
+class alignas(16) Vec4 {
  private:
   float x_, y_, z_, w_;
 
+#if defined(VECMATH_USE_SIMD)
+  explicit Vec4(simd::Float4 v) { simd::Store(&x_, v); }
+  simd::Float4 Get() const { return simd::Load(&x_); }
+#endif
+
  public:
   friend class Vec3;
   friend class Mat4;
@@ -428,6 +537,8 @@ class Vec4 {
     w_ = vec.w_;
   }
 
+  Vec4& operator=(const Vec4& vec) = default;
+
   Vec4(const Vec3& vec, const float fW) {
     x_ = vec.x_;
     y_ = vec.y_;
@@ -438,17 +549,67 @@ class Vec4 {
   Vec4(const float* pVec) {
     x_ = (*pVec++);
     y_ = (*pVec++);
-    z_ = *pVec;
+    z_ = (*pVec++);
     w_ = *pVec;
   }
 
+#if defined(VECMATH_USE_SIMD)
+  // Operators
+  Vec4 operator*(const Vec4& rhs) const {
+    return Vec4(simd::Mul(Get(), rhs.Get()));
+  }
+
+  Vec4 operator/(const Vec4& rhs) const {
+    return Vec4(simd::Div(Get(), rhs.Get()));
+  }
+
+  Vec4 operator+(const Vec4& rhs) const {
+    return Vec4(simd::Add(Get(), rhs.Get()));
+  }
+
+  Vec4 operator-(const Vec4& rhs) const {
+    return Vec4(simd::Sub(Get(), rhs.Get()));
+  }
+
+  Vec4& operator+=(const Vec4& rhs) { return *this = *this + rhs; }
+
+  Vec4& operator-=(const Vec4& rhs) { return *this = *this - rhs; }
+
+  Vec4& operator*=(const Vec4& rhs) { return *this = *this * rhs; }
+
+  Vec4& operator/=(const Vec4& rhs) { return *this = *this / rhs; }
+
+  // External operators
+  friend Vec4 operator-(const Vec4& rhs) { return Vec4(rhs) *= -1; }
+
+  friend Vec4 operator*(const float lhs, const Vec4& rhs) {
+    return Vec4(simd::Mul(simd::Splat(lhs), rhs.Get()));
+  }
+
+  friend Vec4 operator/(const float lhs, const Vec4& rhs) {
+    return Vec4(simd::Div(simd::Splat(lhs), rhs.Get()));
+  }
+
+  // Operators with float
+  Vec4 operator*(const float& rhs) const {
+    return Vec4(simd::Mul(Get(), simd::Splat(rhs)));
+  }
+
+  Vec4& operator*=(const float& rhs) { return *this = *this * rhs; }
+
+  Vec4 operator/(const float& rhs) const {
+    return Vec4(simd::Div(Get(), simd::Splat(rhs)));
+  }
+
+  Vec4& operator/=(const float& rhs) { return *this = *this / rhs; }
+#else
   // Operators
   Vec4 operator*(const Vec4& rhs) const {
     Vec4 ret;
     ret.x_ = x_ * rhs.x_;
     ret.y_ = y_ * rhs.y_;
     ret.z_ = z_ * rhs.z_;
-    ret.w_ = z_ * rhs.w_;
+    ret.w_ = w_ * rhs.w_;
     return ret;
   }
 
@@ -457,7 +618,7 @@ class Vec4 {
     ret.x_ = x_ / rhs.x_;
     ret.y_ = y_ / rhs.y_;
     ret.z_ = z_ / rhs.z_;
-    ret.w_ = z_ / rhs.w_;
+    ret.w_ = w_ / rhs.w_;
     return ret;
   }
 
@@ -466,7 +627,7 @@ class Vec4 {
     ret.x_ = x_ + rhs.x_;
     ret.y_ = y_ + rhs.y_;
     ret.z_ = z_ + rhs.z_;
-    ret.w_ = z_ + rhs.w_;
+    ret.w_ = w_ + rhs.w_;
     return ret;
   }
 
@@ -475,7 +636,7 @@ class Vec4 {
     ret.x_ = x_ - rhs.x_;
     ret.y_ = y_ - rhs.y_;
     ret.z_ = z_ - rhs.z_;
-    ret.w_ = z_ - rhs.w_;
+    ret.w_ = w_ - rhs.w_;
     return ret;
   }
 
@@ -566,6 +727,7 @@ class Vec4 {
     w_ = w_ / rhs;
     return *this;
   }
+#endif
 
   // Compare
   bool operator==(const Vec4& rhs) const {
@@ -574,11 +736,7 @@ class Vec4 {
     return true;
   }
 
-  bool operator!=(const Vec4& rhs) const {
-    if (x_ == rhs.x_) return false;
-
-    return true;
-  }
+  bool operator!=(const Vec4& rhs) const { return !(*this == rhs); }
 
   Vec4 operator*(const Mat4& rhs) const;
 
@@ -621,9 +779,10 @@ class Vec4 {
 
 /******************************************************************
  * 4x4 matrix
+ * Column major, as glUniformMatrix4fv and std140 uniform blocks expect it.
  *
  */
-class Mat4 {
+class alignas(16) Mat4 {
  private:
   float f_[16];
 
@@ -669,44 +828,7 @@ class Mat4 {
   }
 
   Mat4& operator*=(const Mat4& rhs) {
-    Mat4 ret;
-    ret.f_[0] = f_[0] * rhs.f_[0] + f_[4] * rhs.f_[1] + f_[8] * rhs.f_[2] +
-                f_[12] * rhs.f_[3];
-    ret.f_[1] = f_[1] * rhs.f_[0] + f_[5] * rhs.f_[1] + f_[9] * rhs.f_[2] +
-                f_[13] * rhs.f_[3];
-    ret.f_[2] = f_[2] * rhs.f_[0] + f_[6] * rhs.f_[1] + f_[10] * rhs.f_[2] +
-                f_[14] * rhs.f_[3];
-    ret.f_[3] = f_[3] * rhs.f_[0] + f_[7] * rhs.f_[1] + f_[11] * rhs.f_[2] +
-                f_[15] * rhs.f_[3];
-
-    ret.f_[4] = f_[0] * rhs.f_[4] + f_[4] * rhs.f_[5] + f_[8] * rhs.f_[6] +
-                f_[12] * rhs.f_[7];
-    ret.f_[5] = f_[1] * rhs.f_[4] + f_[5] * rhs.f_[5] + f_[9] * rhs.f_[6] +
-                f_[13] * rhs.f_[7];
-    ret.f_[6] = f_[2] * rhs.f_[4] + f_[6] * rhs.f_[5] + f_[10] * rhs.f_[6] +
-                f_[14] * rhs.f_[7];
-    ret.f_[7] = f_[3] * rhs.f_[4] + f_[7] * rhs.f_[5] + f_[11] * rhs.f_[6] +
-                f_[15] * rhs.f_[7];
-
-    ret.f_[8] = f_[0] * rhs.f_[8] + f_[4] * rhs.f_[9] + f_[8] * rhs.f_[10] +
-                f_[12] * rhs.f_[11];
-    ret.f_[9] = f_[1] * rhs.f_[8] + f_[5] * rhs.f_[9] + f_[9] * rhs.f_[10] +
-                f_[13] * rhs.f_[11];
-    ret.f_[10] = f_[2] * rhs.f_[8] + f_[6] * rhs.f_[9] + f_[10] * rhs.f_[10] +
-                 f_[14] * rhs.f_[11];
-    ret.f_[11] = f_[3] * rhs.f_[8] + f_[7] * rhs.f_[9] + f_[11] * rhs.f_[10] +
-                 f_[15] * rhs.f_[11];
-
-    ret.f_[12] = f_[0] * rhs.f_[12] + f_[4] * rhs.f_[13] + f_[8] * rhs.f_[14] +
-                 f_[12] * rhs.f_[15];
-    ret.f_[13] = f_[1] * rhs.f_[12] + f_[5] * rhs.f_[13] + f_[9] * rhs.f_[14] +
-                 f_[13] * rhs.f_[15];
-    ret.f_[14] = f_[2] * rhs.f_[12] + f_[6] * rhs.f_[13] + f_[10] * rhs.f_[14] +
-                 f_[14] * rhs.f_[15];
-    ret.f_[15] = f_[3] * rhs.f_[12] + f_[7] * rhs.f_[13] + f_[11] * rhs.f_[14] +
-                 f_[15] * rhs.f_[15];
-
-    *this = ret;
+    Multiply(*this, rhs, *this);
     return *this;
   }
 
@@ -725,6 +847,8 @@ class Mat4 {
     return *this;
   }
 
+  Mat4(const Mat4& rhs) = default;
+
   Mat4& operator=(const Mat4& rhs) {
     for (int32_t i = 0; i < 16; ++i) {
       f_[i] = rhs.f_[i];
@@ -732,6 +856,7 @@ class Mat4 {
     return *this;
   }
 
+  // Inverse of an affine transform: the last row is taken as 0 0 0 1
   Mat4 Inverse();
 
   Mat4 Transpose() {
@@ -765,6 +890,28 @@ class Mat4 {
   }
 
   float* Ptr() { return f_; }
+  const float* Ptr() const { return f_; }
+
+  //--------------------------------------------------------------------------------
+  // Without temporaries
+  //--------------------------------------------------------------------------------
+  // out = lhs * rhs; out may be lhs or rhs
+  static void Multiply(const Mat4& lhs, const Mat4& rhs, Mat4& out);
+
+  /*
+   * Batches: each result is written as 16 floats, column major, stride bytes
+   * after the previous one (0: packed Mat4), so per instance matrices can go
+   * straight into a mapped uniform buffer. out must not overlap the inputs.
+   */
+  // out[i] = lhs * rhs[i], with lhs loaded once
+  static void MultiplyBatch(const Mat4& lhs, const Mat4* rhs, size_t count,
+                            float* out, size_t stride = 0);
+  // out[i] = lhs[i] * rhs[i]
+  static void MultiplyBatch(const Mat4* lhs, const Mat4* rhs, size_t count,
+                            float* out, size_t stride = 0);
+  // out[i] = m * in[i], 4 floats per result (stride 0: packed Vec4)
+  static void TransformBatch(const Mat4& m, const Vec4* in, size_t count,
+                             float* out, size_t stride = 0);
 
   //--------------------------------------------------------------------------------
   // Misc
@@ -0,0 +1,343 @@
+/*
+ * Copy_right 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * y_ou may_ not use this file ex_cept in compliance with the License.
+ * You may_ obtain a copy_ of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by_ applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either ex_press or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// vecmath_benchmark.cpp
+//--------------------------------------------------------------------------------
+/*
+ * Checks the NEON / SSE kernels of Vec4 and Mat4 against the scalar code on
+ * random transforms, and times both. Products and sums are rounded like the
+ * scalar code, so results are expected to be bit exact, and must be within
+ * a few ulps of the sum of the magnitudes of their terms for builds that
+ * contract the scalar code into fused multiply-adds; inverses, whose
+ * determinant is summed in another order, within 16 ulps of the largest
+ * element. Prints one line per kernel; exits with 1 when a result is out of
+ * tolerance.
+ *
+ * Built with vecmath.cpp itself, so the scalar kernels stay internal to it.
+ * Not part of the app builds:
+ *   c++ -O2 -std=gnu++11 -DVECMATH_HOST_BENCHMARK vecmath_benchmark.cpp
+ */
+#ifdef VECMATH_HOST_BENCHMARK
+#include "vecmath.cpp"
+
+#include <float.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <vector>
+
+namespace ndk_helper {
+
+namespace {
+
+const size_t kBenchCount = 1024;
+const int32_t kBenchRounds = 200;
+
+typedef std::vector<Mat4, AlignedAllocator<Mat4> > Mat4Array;
+typedef std::vector<Vec4, AlignedAllocator<Vec4> > Vec4Array;
+
+uint64_t NowNs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + now.tv_nsec;
+}
+
+// nanoseconds per operation of kBenchRounds runs of f, count operations each
+template <typename F>
+double TimeNs(F f, size_t count) {
+  uint64_t start = NowNs();
+  for (int32_t r = 0; r < kBenchRounds; ++r) {
+    f();
+    // keep the compiler from merging the rounds
+    __asm__ __volatile__("" : : : "memory");
+  }
+  return static_cast<double>(NowNs() - start) / (kBenchRounds * count);
+}
+
+// from -1 to 1; deterministic, so that a failure can be reproduced
+float Random(uint32_t* seed) {
+  *seed = *seed * 1664525u + 1013904223u;
+  return static_cast<float>(*seed >> 8) * (2.0f / 16777216.0f) - 1.0f;
+}
+
+Mat4 RandomMatrix(uint32_t* seed) {
+  float f[16];
+  for (int32_t i = 0; i < 16; ++i) f[i] = Random(seed) * 4.0f;
+  return Mat4(f);
+}
+
+// rotation, scale from 0.5 to 2, and translation
+Mat4 RandomTransform(uint32_t* seed) {
+  Mat4 m = Mat4::RotationX(Random(seed) * 3.2f) *
+           Mat4::RotationY(Random(seed) * 3.2f) *
+           Mat4::RotationZ(Random(seed) * 3.2f);
+  m *= Mat4::Scale(1.25f + 0.75f * Random(seed), 1.25f + 0.75f * Random(seed),
+                   1.25f + 0.75f * Random(seed));
+  return Mat4::Translation(Random(seed) * 10.0f, Random(seed) * 10.0f,
+                           Random(seed) * 10.0f) *
+         m;
+}
+
+struct Comparison {
+  size_t count;
+  size_t exact;
+  size_t failed;
+};
+
+// value against reference, within ulps of scale
+void Compare(const float* value, const float* reference, const float* scale,
+             size_t n, float ulps, Comparison* result) {
+  for (size_t i = 0; i < n; ++i) {
+    result->count++;
+    if (value[i] == reference[i]) {
+      result->exact++;
+    } else if (!(fabsf(value[i] - reference[i]) <=
+                 ulps * FLT_EPSILON * scale[i])) {
+      result->failed++;
+    }
+  }
+}
+
+// |m|, element by element
+void Abs(const float* m, float* out, size_t n) {
+  for (size_t i = 0; i < n; ++i) out[i] = fabsf(m[i]);
+}
+
+size_t Report(char* report, size_t report_size, size_t used, const char* name,
+              double scalar_ns, double simd_ns, const Comparison& result) {
+  if (used >= report_size) return used;
+  int n = snprintf(report + used, report_size - used,
+                   "%-16s scalar %7.2f ns  simd %7.2f ns  %5.2fx  "
+                   "exact %zu/%zu%s\n",
+                   name, scalar_ns, simd_ns, scalar_ns / simd_ns, result.exact,
+                   result.count, result.failed ? "  OUT OF TOLERANCE" : "");
+  return n > 0 ? used + n : used;
+}
+
+}  // namespace
+
+bool VecmathBenchmark(char* report, size_t report_size) {
+  const float kUlps = 4.0f;
+  const float kInverseUlps = 16.0f;
+  const size_t n = kBenchCount;
+  uint32_t seed = 1;
+
+  Mat4Array a(n), b(n), affine(n), out(n);
+  Vec4Array v(n), w(n), d(n);
+  std::vector<float> reference(n * 16), scale(n * 16), value(n * 16);
+  for (size_t i = 0; i < n; ++i) {
+    a[i] = RandomMatrix(&seed);
+    b[i] = RandomMatrix(&seed);
+    affine[i] = RandomTransform(&seed);
+    v[i] = Vec4(Random(&seed), Random(&seed), Random(&seed), Random(&seed));
+    w[i] = Vec4(Random(&seed), Random(&seed), Random(&seed), Random(&seed));
+    // keep the divisors away from 0
+    d[i] = Vec4(1.5f + Random(&seed), 1.5f + Random(&seed),
+                1.5f + Random(&seed), -1.5f + Random(&seed));
+  }
+
+  size_t used = 0;
+  bool ok = true;
+  report[0] = '\0';
+#if !defined(VECMATH_USE_SIMD)
+  int header = snprintf(report, report_size, "no NEON / SSE in this build\n");
+  if (header > 0) used = header;
+#endif
+
+  // mat4 * mat4
+  {
+    double scalar_ns = TimeNs([&]() {
+      for (size_t i = 0; i < n; ++i) {
+        MultiplyScalar(a[i].Ptr(), b[i].Ptr(), &reference[i * 16]);
+      }
+    }, n);
+    double simd_ns = TimeNs([&]() {
+      for (size_t i = 0; i < n; ++i) Mat4::Multiply(a[i], b[i], out[i]);
+    }, n);
+    Comparison result = Comparison();
+    for (size_t i = 0; i < n; ++i) {
+      float abs_a[16], abs_b[16];
+      Abs(a[i].Ptr(), abs_a, 16);
+      Abs(b[i].Ptr(), abs_b, 16);
+      MultiplyScalar(abs_a, abs_b, &scale[i * 16]);
+      Compare(out[i].Ptr(), &reference[i * 16], &scale[i * 16], 16, kUlps,
+              &result);
+    }
+    used = Report(report, report_size, used, "mat4 * mat4", scalar_ns,
+                  simd_ns, result);
+    ok = ok && !result.failed;
+  }
+
+  // mat4 * mat4[] into a buffer
+  {
+    const Mat4& lhs = a[0];
+    double scalar_ns = TimeNs([&]() {
+      for (size_t i = 0; i < n; ++i) {
+        MultiplyScalar(lhs.Ptr(), b[i].Ptr(), &reference[i * 16]);
+      }
+    }, n);
+    double simd_ns = TimeNs([&]() {
+      Mat4::MultiplyBatch(lhs, &b[0], n, &value[0]);
+    }, n);
+    Comparison result = Comparison();
+    float abs_lhs[16];
+    Abs(lhs.Ptr(), abs_lhs, 16);
+    for (size_t i = 0; i < n; ++i) {
+      float abs_b[16];
+      Abs(b[i].Ptr(), abs_b, 16);
+      MultiplyScalar(abs_lhs, abs_b, &scale[i * 16]);
+    }
+    Compare(&value[0], &reference[0], &scale[0], n * 16, kUlps, &result);
+    used = Report(report, report_size, used, "mat4 * mat4[]", scalar_ns,
+                  simd_ns, result);
+    ok = ok && !result.failed;
+  }
+
+  // mat4 * vec4[] into a buffer
+  {
+    const Mat4& m = a[0];
+    double scalar_ns = TimeNs([&]() {
+      for (size_t i = 0; i < n; ++i) {
+        float in[4];
+        v[i].Value(in[0], in[1], in[2], in[3]);
+        TransformScalar(m.Ptr(), in, &reference[i * 4]);
+      }
+    }, n);
+    double simd_ns = TimeNs([&]() {
+      Mat4::TransformBatch(m, &v[0], n, &value[0]);
+    }, n);
+    Comparison result = Comparison();
+    float abs_m[16];
+    Abs(m.Ptr(), abs_m, 16);
+    for (size_t i = 0; i < n; ++i) {
+      float abs_v[4];
+      v[i].Value(abs_v[0], abs_v[1], abs_v[2], abs_v[3]);
+      Abs(abs_v, abs_v, 4);
+      TransformScalar(abs_m, abs_v, &scale[i * 4]);
+    }
+    Compare(&value[0], &reference[0], &scale[0], n * 4, kUlps, &result);
+    used = Report(report, report_size, used, "mat4 * vec4[]", scalar_ns,
+                  simd_ns, result);
+    ok = ok && !result.failed;
+  }
+
+  // vec4 * mat4
+  {
+    double scalar_ns = TimeNs([&]() {
+      for (size_t i = 0; i < n; ++i) {
+        float in[4];
+        v[i].Value(in[0], in[1], in[2], in[3]);
+        TransformRowScalar(in, a[i].Ptr(), &reference[i * 4]);
+      }
+    }, n);
+    double simd_ns = TimeNs([&]() {
+      for (size_t i = 0; i < n; ++i) w[i] = v[i] * a[i];
+    }, n);
+    Comparison result = Comparison();
+    for (size_t i = 0; i < n; ++i) {
+      float abs_v[4], abs_m[16];
+      v[i].Value(abs_v[0], abs_v[1], abs_v[2], abs_v[3]);
+      Abs(abs_v, abs_v, 4);
+      Abs(a[i].Ptr(), abs_m, 16);
+      TransformRowScalar(abs_v, abs_m, &scale[i * 4]);
+      w[i].Value(value[i * 4], value[i * 4 + 1], value[i * 4 + 2],
+                 value[i * 4 + 3]);
+    }
+    Compare(&value[0], &reference[0], &scale[0], n * 4, kUlps, &result);
+    used = Report(report, report_size, used, "vec4 * mat4", scalar_ns,
+                  simd_ns, result);
+    ok = ok && !result.failed;
+  }
+
+  // affine inverse
+  {
+    double scalar_ns = TimeNs([&]() {
+      for (size_t i = 0; i < n; ++i) {
+        InverseScalar(affine[i].Ptr(), &reference[i * 16]);
+      }
+    }, n);
+    double simd_ns = TimeNs([&]() {
+      for (size_t i = 0; i < n; ++i) {
+        out[i] = affine[i];
+        out[i].Inverse();
+      }
+    }, n);
+    Comparison result = Comparison();
+    for (size_t i = 0; i < n; ++i) {
+      float largest = 0.f;
+      for (int32_t j = 0; j < 16; ++j) {
+        largest = fmaxf(largest, fabsf(reference[i * 16 + j]));
+      }
+      for (int32_t j = 0; j < 16; ++j) scale[i * 16 + j] = largest;
+      Compare(out[i].Ptr(), &reference[i * 16], &scale[i * 16], 16,
+              kInverseUlps, &result);
+    }
+    used = Report(report, report_size, used, "inverse", scalar_ns, simd_ns,
+                  result);
+    ok = ok && !result.failed;
+  }
+
+  // vec4 arithmetic
+  {
+    double scalar_ns = TimeNs([&]() {
+      for (size_t i = 0; i < n; ++i) {
+        float x[4], y[4], z[4];
+        v[i].Value(x[0], x[1], x[2], x[3]);
+        w[i].Value(y[0], y[1], y[2], y[3]);
+        d[i].Value(z[0], z[1], z[2], z[3]);
+        for (int32_t j = 0; j < 4; ++j) {
+          reference[i * 4 + j] =
+              (x[j] * y[j] + 0.5f * x[j] - y[j]) / z[j] / 3.0f;
+        }
+      }
+    }, n);
+    double simd_ns = TimeNs([&]() {
+      for (size_t i = 0; i < n; ++i) {
+        Vec4 r = (v[i] * w[i] + 0.5f * v[i] - w[i]) / d[i] / 3.0f;
+        r.Value(value[i * 4], value[i * 4 + 1], value[i * 4 + 2],
+                value[i * 4 + 3]);
+      }
+    }, n);
+    Comparison result = Comparison();
+    for (size_t i = 0; i < n; ++i) {
+      float x[4], y[4], z[4];
+      v[i].Value(x[0], x[1], x[2], x[3]);
+      w[i].Value(y[0], y[1], y[2], y[3]);
+      d[i].Value(z[0], z[1], z[2], z[3]);
+      for (int32_t j = 0; j < 4; ++j) {
+        scale[i * 4 + j] = (fabsf(x[j] * y[j]) + fabsf(0.5f * x[j]) +
+                            fabsf(y[j])) / fabsf(z[j]) / 3.0f;
+      }
+    }
+    Compare(&value[0], &reference[0], &scale[0], n * 4, kUlps, &result);
+    used = Report(report, report_size, used, "vec4 arithmetic", scalar_ns,
+                  simd_ns, result);
+    ok = ok && !result.failed;
+  }
+  return ok;
+}
+
+}  // namespace ndk_helper
+
+int main() {
+  char report[2048];
+  bool ok = ndk_helper::VecmathBenchmark(report, sizeof(report));
+  fputs(report, stdout);
+  return ok ? 0 : 1;
+}
+#endif
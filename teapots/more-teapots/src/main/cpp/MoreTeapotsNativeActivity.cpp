@@ -102,6 +102,7 @@ class Engine {
 Engine::Engine()
     : initialized_resources_(false),
       has_focus_(false),
+      monitor_("more-teapots"),
       app_(NULL),
       sensor_manager_(NULL),
       accelerometer_sensor_(NULL),
@@ -180,15 +181,22 @@ void Engine::DrawFrame() {
   if (monitor_.Update(fps)) {
     UpdateFPS(fps);
   }
-  double dTime = monitor_.GetCurrentTime();
-  renderer_.Update(dTime);
+  {
+    FramePhaseScope update(monitor_.Timer(), FRAME_PHASE_UPDATE);
+    double dTime = monitor_.GetCurrentTime();
+    renderer_.Update(dTime);
+  }
 
-  // Just fill the screen with a color.
-  glClearColor(0.5f, 0.5f, 0.5f, 1.f);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  renderer_.Render();
+  {
+    FramePhaseScope render(monitor_.Timer(), FRAME_PHASE_RENDER);
+    // Just fill the screen with a color.
+    glClearColor(0.5f, 0.5f, 0.5f, 1.f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    renderer_.Render();
+  }
 
   // Swap
+  FramePhaseScope swap(monitor_.Timer(), FRAME_PHASE_SWAP);
   if (EGL_SUCCESS != gl_context_->Swap()) {
     UnloadResources();
     LoadResources();
@@ -198,7 +206,10 @@ void Engine::DrawFrame() {
 /**
  * Tear down the EGL context currently associated with the display.
  */
-void Engine::TermDisplay() { gl_context_->Suspend(); }
+void Engine::TermDisplay() {
+  gl_context_->Suspend();
+  monitor_.Pause();
+}
 
 void Engine::TrimMemory() {
   LOGI("Trimming memory");
@@ -293,6 +304,7 @@ void Engine::HandleCmd(struct android_app* app, int32_t cmd) {
       // Also stop animating.
       eng->has_focus_ = false;
       eng->DrawFrame();
+      eng->monitor_.Pause();
       break;
     case APP_CMD_LOW_MEMORY:
       // Free up GL resources
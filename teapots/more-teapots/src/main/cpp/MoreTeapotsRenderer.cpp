@@ -25,6 +25,8 @@
 
 #include <string.h>
 
+#include <algorithm>
+
 //--------------------------------------------------------------------------------
 // Teapot model data
 //--------------------------------------------------------------------------------
@@ -34,12 +36,15 @@
 // Ctor
 //--------------------------------------------------------------------------------
 MoreTeapotsRenderer::MoreTeapotsRenderer()
-    : geometry_instancing_support_(false) {}
+    : jobs_(NULL), geometry_instancing_support_(false) {}
 
 //--------------------------------------------------------------------------------
 // Dtor
 //--------------------------------------------------------------------------------
-MoreTeapotsRenderer::~MoreTeapotsRenderer() { Unload(); }
+MoreTeapotsRenderer::~MoreTeapotsRenderer() {
+  Unload();
+  delete jobs_;
+}
 
 //--------------------------------------------------------------------------------
 // Init
@@ -73,11 +78,15 @@ void MoreTeapotsRenderer::Init(const int32_t numX, const int32_t numY,
   num_vertices_ = sizeof(teapotPositions) / sizeof(teapotPositions[0]) / 3;
   int32_t stride = sizeof(TEAPOT_VERTEX);
   int32_t index = 0;
+  float radius_sq = 0.f;
   TEAPOT_VERTEX* p = new TEAPOT_VERTEX[num_vertices_];
   for (int32_t i = 0; i < num_vertices_; ++i) {
     p[i].pos[0] = teapotPositions[index];
     p[i].pos[1] = teapotPositions[index + 1];
     p[i].pos[2] = teapotPositions[index + 2];
+    radius_sq = std::max(radius_sq, p[i].pos[0] * p[i].pos[0] +
+                                        p[i].pos[1] * p[i].pos[1] +
+                                        p[i].pos[2] * p[i].pos[2]);
 
     p[i].normal[0] = teapotNormals[index];
     p[i].normal[1] = teapotNormals[index + 1];
@@ -94,34 +103,19 @@ void MoreTeapotsRenderer::Init(const int32_t numX, const int32_t numY,
   teapot_x_ = numX;
   teapot_y_ = numY;
   teapot_z_ = numZ;
-  vec_mat_models_.reserve(teapot_x_ * teapot_y_ * teapot_z_);
 
   UpdateViewport();
 
-  const float total_width = 500.f;
-  float gap_x = total_width / (teapot_x_ - 1);
-  float gap_y = total_width / (teapot_y_ - 1);
-  float gap_z = total_width / (teapot_z_ - 1);
-  float offset_x = -total_width / 2.f;
-  float offset_y = -total_width / 2.f;
-  float offset_z = -total_width / 2.f;
-
-  for (int32_t x = 0; x < teapot_x_; ++x)
-    for (int32_t y = 0; y < teapot_y_; ++y)
-      for (int32_t z = 0; z < teapot_z_; ++z) {
-        vec_mat_models_.push_back(ndk_helper::Mat4::Translation(
-            x * gap_x + offset_x, y * gap_y + offset_y,
-            z * gap_z + offset_z));
-        vec_colors_.push_back(ndk_helper::Vec3(
-            random() / float(RAND_MAX * 1.1), random() / float(RAND_MAX * 1.1),
-            random() / float(RAND_MAX * 1.1)));
-
-        float rotation_x = random() / float(RAND_MAX) - 0.5f;
-        float rotation_y = random() / float(RAND_MAX) - 0.5f;
-        vec_rotations_.push_back(ndk_helper::Vec2(rotation_x * 0.05f, rotation_y * 0.05f));
-        vec_current_rotations_.push_back(
-            ndk_helper::Vec2(rotation_x * M_PI, rotation_y * M_PI));
-      }
+  instances_.Init(teapot_x_, teapot_y_, teapot_z_, sqrtf(radius_sq));
+  if (jobs_ == NULL) jobs_ = new ndk_helper::JobSystem();
+
+  // GLES2 pass: packed arrays in memory
+  size_t count = instances_.Count();
+  instance_layout_.mvp_offset = 0;
+  instance_layout_.mv_offset = count * sizeof(ndk_helper::Mat4);
+  instance_layout_.color_offset = count * sizeof(ndk_helper::Mat4) * 2;
+  instance_layout_.matrix_stride = sizeof(ndk_helper::Mat4);
+  instance_layout_.vector_stride = 4 * sizeof(float);
 
   if (geometry_instancing_support_) {
     //
@@ -159,29 +153,19 @@ void MoreTeapotsRenderer::Init(const int32_t numX, const int32_t numY,
       glGetActiveUniformsiv(shader_param_.program_, num_indices, (GLuint*)i,
                             GL_UNIFORM_ARRAY_STRIDE, stride);
 
-      ubo_matrix_stride_ = stride[0] / sizeof(float);
-      ubo_vector_stride_ = stride[2] / sizeof(float);
+      // The arrays follow each other: Mat4 + Mat4 + Vec3 + 1 stride
+      instance_layout_.matrix_stride = stride[0];
+      instance_layout_.vector_stride = stride[2];
+      instance_layout_.mvp_offset = 0;
+      instance_layout_.mv_offset = count * stride[0];
+      instance_layout_.color_offset = count * stride[0] * 2;
+      ubo_size_ = count * (stride[0] * 2 + stride[2]);
 
+      // Written every frame: the colors too, as the instances drawn change
       glGenBuffers(1, &ubo_);
       glBindBuffer(GL_UNIFORM_BUFFER, ubo_);
       glBindBufferBase(GL_UNIFORM_BUFFER, bindingPoint, ubo_);
-
-      // Store color value which wouldn't be updated every frame
-      int32_t size = teapot_x_ * teapot_y_ * teapot_z_ *
-                      (ubo_matrix_stride_ + ubo_matrix_stride_ +
-                       ubo_vector_stride_);  // Mat4 + Mat4 + Vec3 + 1 stride
-      float* pBuffer = new float[size];
-      float* pColor =
-          pBuffer + teapot_x_ * teapot_y_ * teapot_z_ * ubo_matrix_stride_ * 2;
-      for (int32_t i = 0; i < teapot_x_ * teapot_y_ * teapot_z_; ++i) {
-        memcpy(pColor, &vec_colors_[i], 3 * sizeof(float));
-        pColor += ubo_vector_stride_;  // Assuming std140 layout which is 4
-                                       // DWORD stride for vectors
-      }
-
-      glBufferData(GL_UNIFORM_BUFFER, size * sizeof(float), pBuffer,
-                   GL_DYNAMIC_DRAW);
-      delete[] pBuffer;
+      glBufferData(GL_UNIFORM_BUFFER, ubo_size_, NULL, GL_DYNAMIC_DRAW);
     } else {
       LOGI("Shader compilation failed!! Falls back to ES2.0 pass");
       // This happens some devices.
@@ -195,6 +179,10 @@ void MoreTeapotsRenderer::Init(const int32_t numX, const int32_t numY,
     LoadShaders(&shader_param_, "Shaders/VS_ShaderPlain.vsh",
                 "Shaders/ShaderPlain.fsh");
   }
+  if (!geometry_instancing_support_) {
+    instance_data_.resize(instance_layout_.color_offset +
+                          count * instance_layout_.vector_stride);
+  }
 }
 
 void MoreTeapotsRenderer::UpdateViewport() {
@@ -298,59 +286,46 @@ void MoreTeapotsRenderer::Render() {
     // Geometry instancing, new feature in GLES3.0
     //
 
-    // Update UBO
+    // Update UBO: matrices and colors of the visible teapots, written by
+    // the jobs straight into the mapped buffer
     glBindBuffer(GL_UNIFORM_BUFFER, ubo_);
-    float* p = (float*)glMapBufferRange(
-        GL_UNIFORM_BUFFER, 0, teapot_x_ * teapot_y_ * teapot_z_ *
-                                  (ubo_matrix_stride_ * 2) * sizeof(float),
-        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
-    float* mat_mvp = p;
-    float* mat_mv = p + teapot_x_ * teapot_y_ * teapot_z_ * ubo_matrix_stride_;
-    for (int32_t i = 0; i < teapot_x_ * teapot_y_ * teapot_z_; ++i) {
-      // Rotation
-      float x, y;
-      vec_current_rotations_[i] += vec_rotations_[i];
-      vec_current_rotations_[i].Value(x, y);
-      ndk_helper::Mat4 mat_rotation =
-          ndk_helper::Mat4::RotationX(x) * ndk_helper::Mat4::RotationY(y);
-
-      // Feed Projection and Model View matrices to the shaders
-      ndk_helper::Mat4 mat_v = mat_view_ * vec_mat_models_[i] * mat_rotation;
-      ndk_helper::Mat4 mat_vp = mat_projection_ * mat_v;
-
-      memcpy(mat_mvp, mat_vp.Ptr(), sizeof(mat_v));
-      mat_mvp += ubo_matrix_stride_;
-
-      memcpy(mat_mv, mat_v.Ptr(), sizeof(mat_v));
-      mat_mv += ubo_matrix_stride_;
+    void* p = glMapBufferRange(
+        GL_UNIFORM_BUFFER, 0, ubo_size_,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    int32_t visible = 0;
+    if (p) {
+      visible = instances_.Update(jobs_, mat_view_, mat_projection_,
+                                  instance_layout_, p);
     }
     glUnmapBuffer(GL_UNIFORM_BUFFER);
 
     // Instanced rendering
-    glDrawElementsInstanced(GL_TRIANGLES, num_indices_, GL_UNSIGNED_SHORT,
-                            BUFFER_OFFSET(0),
-                            teapot_x_ * teapot_y_ * teapot_z_);
+    if (visible > 0) {
+      glDrawElementsInstanced(GL_TRIANGLES, num_indices_, GL_UNSIGNED_SHORT,
+                              BUFFER_OFFSET(0), visible);
+    }
 
   } else {
     // Regular rendering pass
-    for (int32_t i = 0; i < teapot_x_ * teapot_y_ * teapot_z_; ++i) {
+    int32_t visible = instances_.Update(jobs_, mat_view_, mat_projection_,
+                                        instance_layout_, &instance_data_[0]);
+    const uint8_t* mat_mvp = &instance_data_[instance_layout_.mvp_offset];
+    const uint8_t* mat_mv = &instance_data_[instance_layout_.mv_offset];
+    const uint8_t* color = &instance_data_[instance_layout_.color_offset];
+    for (int32_t i = 0; i < visible; ++i) {
       // Set diffuse
-      float x, y, z;
-      vec_colors_[i].Value(x, y, z);
-      glUniform4f(shader_param_.material_diffuse_, x, y, z, 1.f);
-
-      // Rotation
-      vec_current_rotations_[i] += vec_rotations_[i];
-      vec_current_rotations_[i].Value(x, y);
-      ndk_helper::Mat4 mat_rotation =
-          ndk_helper::Mat4::RotationX(x) * ndk_helper::Mat4::RotationY(y);
+      const float* diffuse = reinterpret_cast<const float*>(color);
+      glUniform4f(shader_param_.material_diffuse_, diffuse[0], diffuse[1],
+                  diffuse[2], 1.f);
+      color += instance_layout_.vector_stride;
 
       // Feed Projection and Model View matrices to the shaders
-      ndk_helper::Mat4 mat_v = mat_view_ * vec_mat_models_[i] * mat_rotation;
-      ndk_helper::Mat4 mat_vp = mat_projection_ * mat_v;
       glUniformMatrix4fv(shader_param_.matrix_projection_, 1, GL_FALSE,
-                         mat_vp.Ptr());
-      glUniformMatrix4fv(shader_param_.matrix_view_, 1, GL_FALSE, mat_v.Ptr());
+                         reinterpret_cast<const GLfloat*>(mat_mvp));
+      mat_mvp += instance_layout_.matrix_stride;
+      glUniformMatrix4fv(shader_param_.matrix_view_, 1, GL_FALSE,
+                         reinterpret_cast<const GLfloat*>(mat_mv));
+      mat_mv += instance_layout_.matrix_stride;
 
       glDrawElements(GL_TRIANGLES, num_indices_, GL_UNSIGNED_SHORT,
                      BUFFER_OFFSET(0));
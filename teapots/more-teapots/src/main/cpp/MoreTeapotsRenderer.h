@@ -42,6 +42,7 @@
 #define APPLICATION_CLASS_NAME "com/sample/moreteapots/MoreTeapotsApplication"
 
 #include "NDKHelper.h"
+#include "TeapotInstances.h"
 
 #define BUFFER_OFFSET(i) ((char*)NULL + (i))
 
@@ -89,18 +90,19 @@ class MoreTeapotsRenderer {
 
   ndk_helper::Mat4 mat_projection_;
   ndk_helper::Mat4 mat_view_;
-  std::vector<ndk_helper::Mat4> vec_mat_models_;
-  std::vector<ndk_helper::Vec3> vec_colors_;
-  std::vector<ndk_helper::Vec2> vec_rotations_;
-  std::vector<ndk_helper::Vec2> vec_current_rotations_;
+  TeapotInstances instances_;
+  ndk_helper::JobSystem* jobs_;
+  // where the instances are written: the uniform buffer, or instance_data_
+  // for the GLES2 pass
+  TEAPOT_INSTANCE_LAYOUT instance_layout_;
+  std::vector<uint8_t> instance_data_;
 
   ndk_helper::TapCamera* camera_;
 
   int32_t teapot_x_;
   int32_t teapot_y_;
   int32_t teapot_z_;
-  int32_t ubo_matrix_stride_;
-  int32_t ubo_vector_stride_;
+  int32_t ubo_size_;
   bool geometry_instancing_support_;
   bool arb_support_;
 
@@ -0,0 +1,197 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// TeapotInstances.cpp
+// Update, cull and pack the teapot instances
+//--------------------------------------------------------------------------------
+#include "TeapotInstances.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+//--------------------------------------------------------------------------------
+// Ctor
+//--------------------------------------------------------------------------------
+TeapotInstances::TeapotInstances()
+    : radius_(0.f), view_scale_(1.f), cull_(true) {
+  memset(planes_, 0, sizeof(planes_));
+}
+
+//--------------------------------------------------------------------------------
+// Init
+//--------------------------------------------------------------------------------
+void TeapotInstances::Init(int32_t num_x, int32_t num_y, int32_t num_z,
+                           float radius) {
+  models_.clear();
+  colors_.clear();
+  rotations_.clear();
+  current_rotations_.clear();
+  radius_ = radius;
+
+  const float total_width = 500.f;
+  float gap_x = total_width / (num_x - 1);
+  float gap_y = total_width / (num_y - 1);
+  float gap_z = total_width / (num_z - 1);
+  float offset_x = -total_width / 2.f;
+  float offset_y = -total_width / 2.f;
+  float offset_z = -total_width / 2.f;
+
+  for (int32_t x = 0; x < num_x; ++x)
+    for (int32_t y = 0; y < num_y; ++y)
+      for (int32_t z = 0; z < num_z; ++z) {
+        models_.push_back(ndk_helper::Mat4::Translation(
+            x * gap_x + offset_x, y * gap_y + offset_y,
+            z * gap_z + offset_z));
+        colors_.push_back(ndk_helper::Vec3(
+            random() / float(RAND_MAX * 1.1), random() / float(RAND_MAX * 1.1),
+            random() / float(RAND_MAX * 1.1)));
+
+        float rotation_x = random() / float(RAND_MAX) - 0.5f;
+        float rotation_y = random() / float(RAND_MAX) - 0.5f;
+        rotations_.push_back(
+            ndk_helper::Vec2(rotation_x * 0.05f, rotation_y * 0.05f));
+        current_rotations_.push_back(
+            ndk_helper::Vec2(rotation_x * M_PI, rotation_y * M_PI));
+      }
+
+  size_t count = models_.size();
+  model_views_.resize(count);
+  visible_.resize(count);
+  chunk_counts_.resize((count + kChunkSize - 1) / kChunkSize);
+  chunk_offsets_.resize(chunk_counts_.size());
+}
+
+//--------------------------------------------------------------------------------
+// Update
+//--------------------------------------------------------------------------------
+int32_t TeapotInstances::Update(ndk_helper::JobSystem* jobs,
+                                const ndk_helper::Mat4& view,
+                                const ndk_helper::Mat4& projection,
+                                const TEAPOT_INSTANCE_LAYOUT& layout,
+                                void* buffer) {
+  // Planes of the frustum from the rows of the projection: w + x, w - x,
+  // w + y, w - y, w + z and w - z, normalized so that the distance to a
+  // plane compares with a radius
+  const float* p = projection.Ptr();
+  for (int32_t i = 0; i < 3; ++i) {
+    for (int32_t j = 0; j < 4; ++j) {
+      planes_[i * 2][j] = p[j * 4 + 3] + p[j * 4 + i];
+      planes_[i * 2 + 1][j] = p[j * 4 + 3] - p[j * 4 + i];
+    }
+  }
+  for (int32_t i = 0; i < 6; ++i) {
+    float* plane = planes_[i];
+    float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] +
+                         plane[2] * plane[2]);
+    for (int32_t j = 0; j < 4; ++j) plane[j] /= length;
+  }
+
+  // Models translate and rotate, the view may scale too: the camera pinch
+  const float* v = view.Ptr();
+  view_scale_ = 0.f;
+  for (int32_t i = 0; i < 3; ++i) {
+    float scale = sqrtf(v[i * 4] * v[i * 4] + v[i * 4 + 1] * v[i * 4 + 1] +
+                        v[i * 4 + 2] * v[i * 4 + 2]);
+    if (scale > view_scale_) view_scale_ = scale;
+  }
+
+  size_t count = models_.size();
+  jobs->ParallelFor(count, kChunkSize, [&](size_t begin, size_t end) {
+    Cull(begin, end, view);
+  });
+
+  uint32_t visible = 0;
+  for (size_t i = 0; i < chunk_counts_.size(); ++i) {
+    chunk_offsets_[i] = visible;
+    visible += chunk_counts_[i];
+  }
+
+  uint8_t* dst = static_cast<uint8_t*>(buffer);
+  jobs->ParallelFor(count, kChunkSize, [&](size_t begin, size_t end) {
+    Write(begin, end, projection, layout, dst);
+  });
+  return static_cast<int32_t>(visible);
+}
+
+//--------------------------------------------------------------------------------
+// First pass: rotations, culling, and model views of the visible instances
+//--------------------------------------------------------------------------------
+void TeapotInstances::Cull(size_t begin, size_t end,
+                           const ndk_helper::Mat4& view) {
+  const float radius = radius_ * view_scale_;
+  uint32_t visible = 0;
+  ndk_helper::Mat4 view_model;
+
+  for (size_t i = begin; i < end; ++i) {
+    // Rotation, whether the teapot is drawn or not
+    float x, y;
+    current_rotations_[i] += rotations_[i];
+    current_rotations_[i].Value(x, y);
+
+    // The model origin is the center of the bounding sphere: in view space,
+    // the translation of view * model
+    ndk_helper::Mat4::Multiply(view, models_[i], view_model);
+    if (cull_) {
+      const float* center = view_model.Ptr() + 12;
+      bool inside = true;
+      for (int32_t j = 0; j < 6 && inside; ++j) {
+        const float* plane = planes_[j];
+        inside = plane[0] * center[0] + plane[1] * center[1] +
+                     plane[2] * center[2] + plane[3] >=
+                 -radius;
+      }
+      if (!inside) continue;
+    }
+
+    ndk_helper::Mat4 rotation =
+        ndk_helper::Mat4::RotationX(x) * ndk_helper::Mat4::RotationY(y);
+    ndk_helper::Mat4::Multiply(view_model, rotation,
+                               model_views_[begin + visible]);
+    visible_[begin + visible] = static_cast<uint32_t>(i);
+    visible++;
+  }
+  chunk_counts_[begin / kChunkSize] = visible;
+}
+
+//--------------------------------------------------------------------------------
+// Second pass: the visible instances of a chunk, at the offset of the chunk
+//--------------------------------------------------------------------------------
+void TeapotInstances::Write(size_t begin, size_t end,
+                            const ndk_helper::Mat4& projection,
+                            const TEAPOT_INSTANCE_LAYOUT& layout,
+                            uint8_t* buffer) {
+  size_t chunk = begin / kChunkSize;
+  uint32_t count = chunk_counts_[chunk];
+  if (count == 0) return;
+
+  size_t first = chunk_offsets_[chunk];
+  ndk_helper::Mat4::MultiplyBatch(
+      projection, &model_views_[begin], count,
+      reinterpret_cast<float*>(buffer + layout.mvp_offset +
+                               first * layout.matrix_stride),
+      layout.matrix_stride);
+
+  uint8_t* mv = buffer + layout.mv_offset + first * layout.matrix_stride;
+  uint8_t* color = buffer + layout.color_offset + first * layout.vector_stride;
+  for (uint32_t i = 0; i < count; ++i) {
+    memcpy(mv, model_views_[begin + i].Ptr(), sizeof(ndk_helper::Mat4));
+    mv += layout.matrix_stride;
+    memcpy(color, &colors_[visible_[begin + i]], 3 * sizeof(float));
+    color += layout.vector_stride;
+  }
+}
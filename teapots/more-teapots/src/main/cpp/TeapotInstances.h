@@ -0,0 +1,103 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// TeapotInstances.h
+// Per instance state of the teapots, and the CPU side of drawing them
+//--------------------------------------------------------------------------------
+#ifndef _TeapotInstances_H
+#define _TeapotInstances_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "jobSystem.h"
+#include "vecmath.h"
+
+/*
+ * Where Update() writes the instance data: three arrays, as laid out in the
+ * ParamBlock uniform block of VS_ShaderPlainES3.vsh. Offsets and strides are
+ * in bytes.
+ */
+struct TEAPOT_INSTANCE_LAYOUT {
+  size_t mvp_offset;    // projection * model view, mat4
+  size_t mv_offset;     // model view, mat4
+  size_t color_offset;  // diffuse color, vec3
+  size_t matrix_stride;
+  size_t vector_stride;
+};
+
+class TeapotInstances {
+ public:
+  TeapotInstances();
+
+  // A grid of num_x * num_y * num_z teapots, radius: bounding sphere of the
+  // teapot model around its origin
+  void Init(int32_t num_x, int32_t num_y, int32_t num_z, float radius);
+
+  int32_t Count() const { return static_cast<int32_t>(models_.size()); }
+
+  // Culling is on by default; off, every instance is drawn
+  void SetCulling(bool cull) { cull_ = cull; }
+
+  /*
+   * Advances the rotations, culls the instances against the view frustum of
+   * projection, and writes the matrices and color of the visible ones,
+   * compacted and in instance order, into buffer. Returns how many there
+   * are: instance i of the draw call is the i-th of them.
+   *
+   * The instances are processed in chunks on jobs: a first pass transforms
+   * and culls every chunk, a second one writes the visible instances of
+   * every chunk at its offset in buffer, a prefix sum of the visible counts.
+   */
+  int32_t Update(ndk_helper::JobSystem* jobs, const ndk_helper::Mat4& view,
+                 const ndk_helper::Mat4& projection,
+                 const TEAPOT_INSTANCE_LAYOUT& layout, void* buffer);
+
+ private:
+  // instances per job, the second pass has one job per chunk of the first
+  static const size_t kChunkSize = 256;
+
+  void Cull(size_t begin, size_t end, const ndk_helper::Mat4& view);
+  void Write(size_t begin, size_t end, const ndk_helper::Mat4& projection,
+             const TEAPOT_INSTANCE_LAYOUT& layout, uint8_t* buffer);
+
+  typedef std::vector<ndk_helper::Mat4,
+                      ndk_helper::AlignedAllocator<ndk_helper::Mat4> >
+      Mat4Array;
+
+  Mat4Array models_;
+  std::vector<ndk_helper::Vec3> colors_;
+  std::vector<ndk_helper::Vec2> rotations_;
+  std::vector<ndk_helper::Vec2> current_rotations_;
+  float radius_;
+
+  // planes of the frustum in view space, a x + b y + c z + d >= 0 inside
+  float planes_[6][4];
+  float view_scale_;
+  bool cull_;
+
+  // per frame: the model views of the visible instances of a chunk, packed
+  // at the start of its range, their instance indexes, and the counts and
+  // output offsets of the chunks
+  Mat4Array model_views_;
+  std::vector<uint32_t> visible_;
+  std::vector<uint32_t> chunk_counts_;
+  std::vector<uint32_t> chunk_offsets_;
+};
+
+#endif
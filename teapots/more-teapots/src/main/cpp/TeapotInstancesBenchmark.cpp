@@ -0,0 +1,170 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// TeapotInstancesBenchmark.cpp
+// Check and time TeapotInstances::Update() on the host
+//--------------------------------------------------------------------------------
+/*
+ * Not part of the app builds, from this directory:
+ *   c++ -O2 -std=gnu++11 -DMORE_TEAPOTS_HOST_BENCHMARK \
+ *       -I../../../../common/ndk_helper TeapotInstances.cpp \
+ *       TeapotInstancesBenchmark.cpp \
+ *       ../../../../common/ndk_helper/vecmath.cpp \
+ *       ../../../../common/ndk_helper/jobSystem.cpp -lpthread
+ *   ./a.out [teapots] [threads]
+ */
+#ifdef MORE_TEAPOTS_HOST_BENCHMARK
+#include "TeapotInstances.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+namespace {
+
+double NowMs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+// whether the clip space position of a teapot center is inside the frustum
+bool IsInClipVolume(const float* clip) {
+  return fabsf(clip[0]) <= clip[3] && fabsf(clip[1]) <= clip[3] &&
+         fabsf(clip[2]) <= clip[3];
+}
+
+// 16 floats of the matrix at index of a packed matrix array
+const float* MatrixAt(const std::vector<uint8_t>& buffer, size_t offset,
+                      size_t index) {
+  return reinterpret_cast<const float*>(&buffer[offset + index * 64]);
+}
+
+/*
+ * Checks the parallel and culled updates against a serial, unculled one,
+ * on count instances, and times them. Writes the results into report;
+ * returns false on a mismatch.
+ */
+bool Benchmark(char* report, size_t report_size, int32_t count,
+               int32_t thread_count) {
+  const int32_t kFrames = 60;
+  int32_t side = static_cast<int32_t>(cbrt(static_cast<double>(count)) + 0.5);
+  if (side < 2) side = 2;
+
+  ndk_helper::JobSystem serial_jobs(1);
+  ndk_helper::JobSystem parallel_jobs(thread_count);
+
+  // the same teapots three times: the random colors and rotations from the
+  // same seed
+  TeapotInstances all, serial, parallel;
+  TeapotInstances* instances[] = {&all, &serial, &parallel};
+  for (int32_t i = 0; i < 3; ++i) {
+    srandom(1);
+    instances[i]->Init(side, side, side, 45.f);
+  }
+  all.SetCulling(false);
+  size_t n = all.Count();
+
+  // packed arrays, as std140 would lay them out
+  TEAPOT_INSTANCE_LAYOUT layout = {0, n * 64, n * 128, 64, 16};
+  std::vector<uint8_t> all_buffer(n * 144), serial_buffer(n * 144),
+      parallel_buffer(n * 144);
+
+  ndk_helper::Mat4 projection =
+      ndk_helper::Mat4::Perspective(1.0f, 0.5625f, 5.f, 10000.f);
+  double all_ms = 0, serial_ms = 0, parallel_ms = 0;
+  size_t visible_total = 0, mismatches = 0, wrongly_culled = 0;
+
+  for (int32_t frame = 0; frame < kFrames; ++frame) {
+    // orbit around the grid, half of it in front of the camera
+    float angle = frame * (6.2832f / kFrames);
+    ndk_helper::Mat4 view = ndk_helper::Mat4::LookAt(
+        ndk_helper::Vec3(600.f * sinf(angle), 100.f, 600.f * cosf(angle)),
+        ndk_helper::Vec3(0.f, 0.f, 0.f), ndk_helper::Vec3(0.f, 1.f, 0.f));
+
+    double start = NowMs();
+    all.Update(&serial_jobs, view, projection, layout, &all_buffer[0]);
+    double all_end = NowMs();
+    int32_t serial_count = serial.Update(&serial_jobs, view, projection,
+                                         layout, &serial_buffer[0]);
+    double serial_end = NowMs();
+    int32_t parallel_count = parallel.Update(&parallel_jobs, view, projection,
+                                             layout, &parallel_buffer[0]);
+    double parallel_end = NowMs();
+    all_ms += all_end - start;
+    serial_ms += serial_end - all_end;
+    parallel_ms += parallel_end - serial_end;
+    visible_total += parallel_count;
+
+    // the parallel update writes what the serial one does
+    if (parallel_count != serial_count ||
+        memcmp(&parallel_buffer[0], &serial_buffer[0],
+               parallel_count * 64) != 0 ||
+        memcmp(&parallel_buffer[layout.mv_offset],
+               &serial_buffer[layout.mv_offset], parallel_count * 64) != 0 ||
+        memcmp(&parallel_buffer[layout.color_offset],
+               &serial_buffer[layout.color_offset], parallel_count * 16) != 0) {
+      mismatches++;
+    }
+
+    // the visible instances are the unculled ones, in order; the culled ones
+    // have their center out of the clip volume
+    size_t i = 0;
+    for (int32_t k = 0; k < serial_count; ++k, ++i) {
+      while (i < n &&
+             (memcmp(MatrixAt(serial_buffer, 0, k), MatrixAt(all_buffer, 0, i),
+                     64) != 0 ||
+              memcmp(MatrixAt(serial_buffer, layout.mv_offset, k),
+                     MatrixAt(all_buffer, layout.mv_offset, i), 64) != 0)) {
+        if (IsInClipVolume(MatrixAt(all_buffer, 0, i) + 12)) wrongly_culled++;
+        ++i;
+      }
+      if (i == n) {
+        mismatches++;
+        break;
+      }
+    }
+    for (; i < n; ++i) {
+      if (IsInClipVolume(MatrixAt(all_buffer, 0, i) + 12)) wrongly_culled++;
+    }
+  }
+
+  snprintf(report, report_size,
+           "%zu teapots, %.1f%% visible\n"
+           "serial, all drawn   %8.3f ms\n"
+           "serial, culled      %8.3f ms\n"
+           "%2d threads, culled  %8.3f ms\n"
+           "%s%s",
+           n, 100.0 * visible_total / (static_cast<double>(n) * kFrames),
+           all_ms / kFrames, serial_ms / kFrames, parallel_jobs.ThreadCount(),
+           parallel_ms / kFrames, mismatches ? "MISMATCH\n" : "",
+           wrongly_culled ? "VISIBLE TEAPOT CULLED\n" : "");
+  return mismatches == 0 && wrongly_culled == 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  char report[1024];
+  bool ok = Benchmark(report, sizeof(report), argc > 1 ? atoi(argv[1]) : 32768,
+                      argc > 2 ? atoi(argv[2]) : 0);
+  fputs(report, stdout);
+  return ok ? 0 : 1;
+}
+#endif  // MORE_TEAPOTS_HOST_BENCHMARK
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cstdio>
+#include <cstring>
+#include "frame_cache.h"
+
+FrameCache::FrameCache(size_t budgetBytes, bool keepRgb565)
+    : budget_(budgetBytes), keepRgb565_(keepRgb565),
+      hits_(0), misses_(0), evictions_(0), entries_(0), bytes_(0) {
+}
+
+std::string FrameCache::Key(const char* file,
+                            const DecodeSurfaceDescriptor& surface) {
+    char geometry[64];
+    snprintf(geometry, sizeof(geometry), "|%dx%d/%d|%u", surface.width_,
+             surface.height_, surface.stride_,
+             static_cast<unsigned int>(surface.format_));
+    return std::string(file) + geometry;
+}
+
+/*
+ * Find():
+ *    Look the picture up, and make it the most recently used one
+ */
+std::shared_ptr<const uint8_t> FrameCache::Find(
+        const char* file, const DecodeSurfaceDescriptor& surface,
+        bool* rgb565) {
+    auto it = index_.find(Key(file, surface));
+    if (it == index_.end()) {
+        misses_++;
+        return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    hits_++;
+    *rgb565 = it->second->rgb565_;
+    return it->second->pixels_;
+}
+
+/*
+ * Insert():
+ *    Copy the picture in, packed to RGB565 if asked to, after evicting
+ *    enough least recently used pictures to stay in the budget. Pictures
+ *    bigger than the whole budget are not kept.
+ */
+void FrameCache::Insert(const char* file,
+                        const DecodeSurfaceDescriptor& surface,
+                        const uint8_t* pixels) {
+    std::string key = Key(file, surface);
+    if (index_.find(key) != index_.end()) {
+        return;
+    }
+    size_t count = static_cast<size_t>(surface.stride_) * surface.height_;
+    bool pack = keepRgb565_ &&
+        surface.format_ != SurfaceFormat::SURFACE_FORMAT_RGB_565;
+    size_t bytes = count *
+        ((surface.format_ == SurfaceFormat::SURFACE_FORMAT_RGB_565 || pack) ? 2 : 4);
+    if (bytes > budget_) {
+        return;
+    }
+    Evict(bytes);
+
+    Entry entry;
+    entry.key_ = key;
+    entry.pixels_.reset(new uint8_t[bytes], std::default_delete<uint8_t[]>());
+    entry.bytes_ = bytes;
+    entry.rgb565_ = pack;
+    if (pack) {
+        PackRgb565(pixels, reinterpret_cast<uint16_t*>(entry.pixels_.get()),
+                   count);
+    } else {
+        memcpy(entry.pixels_.get(), pixels, bytes);
+    }
+    lru_.push_front(entry);
+    index_[key] = lru_.begin();
+    entries_++;
+    bytes_ += bytes;
+}
+
+/*
+ * Evict():
+ *    Drop least recently used pictures until bytes more fit in the budget
+ */
+void FrameCache::Evict(size_t bytes) {
+    while (!lru_.empty() && bytes_.load() + bytes > budget_) {
+        Entry& victim = lru_.back();
+        bytes_ -= victim.bytes_;
+        entries_--;
+        evictions_++;
+        index_.erase(victim.key_);
+        lru_.pop_back();
+    }
+}
+
+void FrameCache::GetStats(FrameCacheStats* stats) const {
+    stats->hits_ = hits_.load();
+    stats->misses_ = misses_.load();
+    stats->evictions_ = evictions_.load();
+    stats->entries_ = entries_.load();
+    stats->bytes_ = bytes_.load();
+    stats->budget_ = budget_;
+}
+
+void FrameCache::PackRgb565(const uint8_t* src, uint16_t* dst, size_t count) {
+    for (size_t i = 0; i < count; i++, src += 4) {
+        dst[i] = static_cast<uint16_t>(((src[0] & 0xF8) << 8) |
+                                       ((src[1] & 0xFC) << 3) |
+                                       (src[2] >> 3));
+    }
+}
+
+void FrameCache::ExpandRgb565(const uint16_t* src, uint8_t* dst, size_t count) {
+    for (size_t i = 0; i < count; i++, dst += 4) {
+        uint32_t r = (src[i] >> 11) & 0x1F;
+        uint32_t g = (src[i] >> 5) & 0x3F;
+        uint32_t b = src[i] & 0x1F;
+        dst[0] = static_cast<uint8_t>((r << 3) | (r >> 2));
+        dst[1] = static_cast<uint8_t>((g << 2) | (g >> 4));
+        dst[2] = static_cast<uint8_t>((b << 3) | (b >> 2));
+        dst[3] = 0xFF;
+    }
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __FRAME_CACHE_H__
+#define __FRAME_CACHE_H__
+#include <atomic>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "webp_decode.h"
+
+/*
+ * Cache counters
+ */
+struct FrameCacheStats {
+    uint32_t hits_;
+    uint32_t misses_;
+    uint32_t evictions_;
+    uint32_t entries_;
+    size_t   bytes_;
+    size_t   budget_;
+};
+
+/*
+ * Decoded picture cache:
+ *     Keeps decoded surfaces keyed by file name and surface geometry and
+ *     format, dropping the least recently used ones to stay within a byte
+ *     budget. Surfaces of 32 bit formats may be kept as RGB565 instead to
+ *     fit twice as many, at the cost of expanding them back on every hit.
+ *     Cached pixels are handed out shared, so a picture evicted while it is
+ *     on display stays valid until it is released.
+ *     Not thread safe, except for GetStats().
+ */
+class FrameCache {
+  public:
+    explicit FrameCache(size_t budgetBytes, bool keepRgb565);
+
+    // pixels of the file decoded for the surface, nullptr if not cached.
+    // *rgb565 is set when they were kept as RGB565 for a 32 bit surface
+    // and need ExpandRgb565() before use.
+    std::shared_ptr<const uint8_t> Find(const char* file,
+                                        const DecodeSurfaceDescriptor& surface,
+                                        bool* rgb565);
+
+    // copy the pixels of the file decoded for the surface into the cache
+    void Insert(const char* file, const DecodeSurfaceDescriptor& surface,
+                const uint8_t* pixels);
+
+    void GetStats(FrameCacheStats* stats) const;
+
+    // RGBA_8888 <-> RGB565 of the cache, count pixels
+    static void PackRgb565(const uint8_t* src, uint16_t* dst, size_t count);
+    static void ExpandRgb565(const uint16_t* src, uint8_t* dst, size_t count);
+
+  private:
+    struct Entry {
+        std::string key_;
+        std::shared_ptr<uint8_t> pixels_;
+        size_t bytes_;
+        bool   rgb565_;
+    };
+    std::string Key(const char* file, const DecodeSurfaceDescriptor& surface);
+    void        Evict(size_t bytes);
+
+    size_t budget_;
+    bool   keepRgb565_;
+    std::list<Entry> lru_;      // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+
+    std::atomic<uint32_t> hits_;
+    std::atomic<uint32_t> misses_;
+    std::atomic<uint32_t> evictions_;
+    std::atomic<uint32_t> entries_;
+    std::atomic<size_t>   bytes_;
+};
+#endif // __FRAME_CACHE_H__
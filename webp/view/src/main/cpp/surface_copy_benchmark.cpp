@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Bandwidth of showing a decoded picture two ways:
+ *   - copy: the decoder writes its own surface, which is then copied row by
+ *     row into the window buffer (Engine::UpdateFrameBuffer())
+ *   - direct: the decoder writes the window buffer itself
+ * The decoder output is stood in for by a fill of every pixel, so the
+ * difference is the full-frame copy that decoding into the window saves.
+ * Not part of the app build; on a host or with adb:
+ *   g++ -O2 -std=c++11 -DSURFACE_COPY_HOST_BENCHMARK surface_copy_benchmark.cpp
+ */
+#ifdef SURFACE_COPY_HOST_BENCHMARK
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const int kFrames = 60;
+
+struct Geometry {
+    const char* name_;
+    int32_t width_, height_, stride_;   // window, in pixels
+    int32_t bytePerPix_;
+};
+
+// stands in for the decoder writing a picture, stride in bytes
+void Produce(uint8_t* dst, int32_t rowBytes, int32_t height,
+             int32_t stride, uint8_t value) {
+    for (int32_t y = 0; y < height; y++) {
+        memset(dst + y * stride, value + y, rowBytes);
+    }
+}
+
+double Run(const Geometry& g, bool direct, std::vector<uint8_t>* window,
+           std::vector<uint8_t>* surface) {
+    int32_t rowBytes = g.width_ * g.bytePerPix_;
+    int32_t winStride = g.stride_ * g.bytePerPix_;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kFrames; i++) {
+        if (direct) {
+            Produce(window->data(), rowBytes, g.height_, winStride,
+                    static_cast<uint8_t>(i));
+            continue;
+        }
+        // the decoder surface has the window geometry, as in PrepareDrawing()
+        Produce(surface->data(), rowBytes, g.height_, winStride,
+                static_cast<uint8_t>(i));
+        for (int32_t y = 0; y < g.height_; y++) {
+            memcpy(window->data() + y * winStride,
+                   surface->data() + y * winStride, rowBytes);
+        }
+    }
+    std::chrono::duration<double, std::milli> ms =
+        std::chrono::steady_clock::now() - start;
+    return ms.count() / kFrames;
+}
+
+}  // namespace
+
+int main() {
+    const Geometry geometries[] = {
+        {"1080x1920 RGBA_8888", 1080, 1920, 1088, 4},
+        {"1080x1920 RGB_565", 1080, 1920, 1088, 2},
+        {"1440x2560 RGBA_8888", 1440, 2560, 1472, 4},
+    };
+    for (const Geometry& g : geometries) {
+        size_t size = static_cast<size_t>(g.stride_) * g.height_ * g.bytePerPix_;
+        std::vector<uint8_t> window(size), surface(size);
+        // warm up both, so page faults don't count
+        Run(g, false, &window, &surface);
+        double copyMs = Run(g, false, &window, &surface);
+        double directMs = Run(g, true, &window, &surface);
+
+        double frameBytes = static_cast<double>(g.width_) * g.height_ *
+                            g.bytePerPix_;
+        // the copy reads the surface and writes the window once more
+        double savedBytes = 2 * frameBytes;
+        printf("%s stride %d: copy %.2f ms/frame, direct %.2f ms/frame; "
+               "%.1f MB less memory traffic per frame, copy at %.2f GB/s\n",
+               g.name_, g.stride_, copyMs, directMs, savedBytes / 1e6,
+               copyMs > directMs ?
+                   savedBytes / ((copyMs - directMs) * 1e6) : 0.0);
+        if (window[0] != static_cast<uint8_t>(kFrames - 1)) {
+            printf("window not written\n");
+            return 1;
+        }
+    }
+    return 0;
+}
+#endif  // SURFACE_COPY_HOST_BENCHMARK
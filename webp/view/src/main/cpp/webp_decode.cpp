@@ -13,17 +13,39 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
 #include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include <webp/decode.h>
 #include "webp_decode.h"
+#include "frame_cache.h"
+
+static uint64_t NowUs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
 
 WebpDecoder::WebpDecoder(const char** files, uint32_t count,
                          DecodeSurfaceDescriptor* frameBuf,
-                         AAssetManager* assetMgr)
+                         AAssetManager* assetMgr,
+                         uint32_t aheadCount,
+                         size_t cacheBytes,
+                         bool cacheRgb565)
     : assetMgr_(assetMgr),
-      buf_(nullptr), stopPending_(false),
-      state_(state_idle), worker_(nullptr) {
+      fileBuf_(nullptr), fileBufSize_(0), decodeStartUs_(0), cache_(nullptr),
+      ring_(nullptr), ringSize_(0), writeIdx_(0), readIdx_(0),
+      stopPending_(false), started_(false), external_(aheadCount == 0),
+      waitingFrame_(false),
+      framesDecoded_(0), framesDisplayed_(0), displayMisses_(0),
+      lastDecodeUs_(0), maxDecodeUs_(0), totalDecodeUs_(0),
+      totalFirstRowsUs_(0), mappedFrames_(0), incrementalFrames_(0),
+      readySamples_(0) {
     for (auto i = 0; i < count; i++) {
         files_.push(files[i]);
     }
@@ -41,55 +63,335 @@ WebpDecoder::WebpDecoder(const char** files, uint32_t count,
                 assert(0);
                 return;
         }
-        // allocate a private decode buffer
+        // allocate the ring of private decode buffers, or a single slot
+        // for the buffers given to DecodeInto()
+        ringSize_ = std::max(aheadCount, 1u);
         uint32_t size = bufInfo_.height_ * bufInfo_.stride_ * bytePerPix_;
-        buf_ = new uint8_t [size];
-        assert(buf_);
+        ring_ = new FrameSlot[ringSize_];
+        for (uint32_t i = 0; i < ringSize_; i++) {
+            ring_[i].buf_ = external_ ? nullptr : new uint8_t [size];
+            ring_[i].stride_ = bufInfo_.stride_;
+            ring_[i].frame_ = ring_[i].buf_;
+            ring_[i].state_.store(slot_free, std::memory_order_relaxed);
+            ring_[i].rowsReady_.store(0, std::memory_order_relaxed);
+        }
+        if (cacheBytes) {
+            cache_ = new FrameCache(cacheBytes, cacheRgb565);
+        }
     }
+    // external slots are free to decode into once given a buffer
+    sem_init(&freeSlots_, 0, external_ ? 0 : ringSize_);
 }
 
 /*
- * GetDecodedFrame():  return decoded frame if available,
+ * GetDecodedFrame():  return the oldest decoded frame if available,
  *                     return nullptr otherwise
  */
-uint8_t* WebpDecoder::GetDecodedFrame(void) {
-    return (state_ == state_ready ? buf_ : nullptr);
+const uint8_t* WebpDecoder::GetDecodedFrame(void) {
+    if (!ring_) {
+        return nullptr;
+    }
+    FrameSlot& slot = ring_[readIdx_];
+    // pairs with the release store of the decoding thread: the pixels
+    // written before it are visible once ready is seen
+    if (slot.state_.load(std::memory_order_acquire) != slot_ready) {
+        if (!waitingFrame_ && started_) {
+            displayMisses_++;
+            waitingFrame_ = true;
+        }
+        return nullptr;
+    }
+    return slot.frame_;
+}
+
+/*
+ * GetPartialFrame():  return the frame GetDecodedFrame() returns next with
+ *                     the number of its top rows already decoded, or nullptr
+ *                     if none is
+ */
+const uint8_t* WebpDecoder::GetPartialFrame(int32_t* rows) {
+    if (!ring_) {
+        return nullptr;
+    }
+    FrameSlot& slot = ring_[readIdx_];
+    // pairs with the release store in PublishRows()
+    int32_t ready = slot.rowsReady_.load(std::memory_order_acquire);
+    if (ready <= 0) {
+        return nullptr;
+    }
+    *rows = ready;
+    return slot.frame_;
+}
+
+/*
+ * ReleaseFrame():  hand the frame returned by GetDecodedFrame() back to the
+ *                  decoding thread
+ */
+void WebpDecoder::ReleaseFrame(void) {
+    FrameSlot& slot = ring_[readIdx_];
+    if (slot.state_.load(std::memory_order_relaxed) != slot_ready) {
+        assert(false);
+        return;
+    }
+    // pairs with the acquire load of the decoding thread: we are done
+    // reading the pixels before it writes the next picture in
+    slot.rowsReady_.store(0, std::memory_order_relaxed);
+    slot.state_.store(slot_free, std::memory_order_release);
+    readIdx_ = (readIdx_ + 1) % ringSize_;
+    readySamples_ += framesDecoded_.load() - framesDisplayed_.load();
+    framesDisplayed_++;
+    waitingFrame_ = false;
+    if (!external_) {
+        sem_post(&freeSlots_);
+    }
 }
 
 /*
- * DecodeFrame():
- *    thread function to decode a picture
- *    directly pass through to internal decoding function
+ * DecodeInto():  give the decoding thread the buffer to decode the next
+ *                picture into
  */
-void* DecodeFrame(void * decoder) {
-    reinterpret_cast<WebpDecoder*>(decoder)->DecodeFrameInternal();
+bool WebpDecoder::DecodeInto(uint8_t* dst, int32_t stride) {
+    if (!external_ || !ring_ || !dst || stride < bufInfo_.width_) {
+        assert(false);
+        return false;
+    }
+    FrameSlot& slot = ring_[readIdx_];
+    if (slot.state_.load(std::memory_order_acquire) != slot_free) {
+        assert(false);
+        return false;
+    }
+    slot.buf_ = dst;
+    slot.stride_ = stride;
+    // the decoding thread sees the buffer once it is woken up
+    sem_post(&freeSlots_);
+    return true;
+}
+
+void WebpDecoder::GetStats(DecodeStats* stats) const {
+    uint32_t decoded = framesDecoded_.load();
+    uint32_t displayed = framesDisplayed_.load();
+    stats->framesDecoded_ = decoded;
+    stats->framesDisplayed_ = displayed;
+    stats->displayMisses_ = displayMisses_.load();
+    stats->lastDecodeUs_ = lastDecodeUs_.load();
+    stats->avgDecodeUs_ = decoded ?
+        static_cast<uint32_t>(totalDecodeUs_.load() / decoded) : 0;
+    stats->maxDecodeUs_ = maxDecodeUs_.load();
+    stats->avgFirstRowsUs_ = decoded ?
+        static_cast<uint32_t>(totalFirstRowsUs_.load() / decoded) : 0;
+    stats->mappedFrames_ = mappedFrames_.load();
+    stats->incrementalFrames_ = incrementalFrames_.load();
+    FrameCacheStats cache;
+    memset(&cache, 0, sizeof(cache));
+    if (cache_) {
+        cache_->GetStats(&cache);
+    }
+    stats->cacheHits_ = cache.hits_;
+    stats->cacheMisses_ = cache.misses_;
+    stats->cacheEvictions_ = cache.evictions_;
+    stats->cacheEntries_ = cache.entries_;
+    stats->cacheBytes_ = cache.bytes_;
+    stats->ringSize_ = ringSize_;
+    stats->readyFrames_ = decoded - displayed;
+    stats->avgReadyFrames_ = displayed ?
+        static_cast<float>(readySamples_.load()) / displayed : 0.0f;
+}
+
+/*
+ * DecodeLoop():
+ *    thread function to decode pictures
+ *    directly pass through to internal decoding loop
+ */
+static void* DecodeLoop(void * decoder) {
+    reinterpret_cast<WebpDecoder*>(decoder)->DecodeLoop();
     return nullptr;
 }
 
+/*
+ * DecodeLoop():
+ *    Decoding thread: decode the next picture into every free slot of the
+ *    ring, in order, and sleep while they are all ready
+ */
+void WebpDecoder::DecodeLoop(void) {
+    while (true) {
+        while (sem_wait(&freeSlots_) != 0 && errno == EINTR) {}
+        if (stopPending_.load(std::memory_order_acquire)) {
+            break;
+        }
+        FrameSlot& slot = ring_[writeIdx_];
+        if (slot.state_.load(std::memory_order_acquire) != slot_free) {
+            assert(false);
+            break;
+        }
+
+        // drop the cached picture shown from the slot last time
+        slot.cached_.reset();
+        slot.frame_ = slot.buf_;
+        decodeStartUs_ = NowUs();
+        bool decoded = DecodeFrameInternal(slot);
+        if (stopPending_.load(std::memory_order_acquire)) {
+            break;
+        }
+        if (!decoded) {
+            // keep the slot for the next picture
+            slot.rowsReady_.store(0, std::memory_order_relaxed);
+            sem_post(&freeSlots_);
+            continue;
+        }
+        uint32_t decodeUs = static_cast<uint32_t>(NowUs() - decodeStartUs_);
+        lastDecodeUs_ = decodeUs;
+        totalDecodeUs_ += decodeUs;
+        if (decodeUs > maxDecodeUs_.load()) {
+            maxDecodeUs_ = decodeUs;
+        }
+        framesDecoded_++;
+
+        slot.state_.store(slot_ready, std::memory_order_release);
+        writeIdx_ = (writeIdx_ + 1) % ringSize_;
+    }
+
+    // if we were asked to release while we are running (at this point,
+    // this is dangling pointer for the app), we perform the release here
+    // to complete the request. DestroyDecoder() waits for the thread and
+    // releases external decoders itself.
+    if (!external_) {
+        delete this;
+    }
+}
+
+/*
+ * OpenAsset():
+ *    Get the compressed bytes of an asset file without copying them when
+ *    possible:
+ *      - stored uncompressed in the apk: map its range of the apk
+ *      - compressed: point into the buffer the asset manager inflates it to
+ *      - otherwise read it into our own buffer, kept from file to file
+ */
+bool WebpDecoder::OpenAsset(const char* file, AssetData* asset) {
+    memset(asset, 0, sizeof(*asset));
+    AAsset* frameFile = AAssetManager_open(assetMgr_, file, AASSET_MODE_BUFFER);
+    if (frameFile == NULL) {
+        return false;
+    }
+
+    off_t start, length;
+    int fd = AAsset_openFileDescriptor(frameFile, &start, &length);
+    if (fd >= 0) {
+        // mmap() wants a page aligned offset
+        off_t pageStart = start & ~static_cast<off_t>(sysconf(_SC_PAGESIZE) - 1);
+        size_t mapSize = static_cast<size_t>(length + (start - pageStart));
+        void* map = mmap(nullptr, mapSize, PROT_READ, MAP_PRIVATE, fd, pageStart);
+        close(fd);
+        if (map != MAP_FAILED) {
+            madvise(map, mapSize, MADV_SEQUENTIAL);
+            AAsset_close(frameFile);
+            asset->map_ = map;
+            asset->mapSize_ = mapSize;
+            asset->data_ = reinterpret_cast<const uint8_t*>(map) + (start - pageStart);
+            asset->size_ = static_cast<size_t>(length);
+            mappedFrames_++;
+            return true;
+        }
+    }
+
+    size_t len = static_cast<size_t>(AAsset_getLength(frameFile));
+    const void* buf = AAsset_getBuffer(frameFile);
+    if (buf) {
+        asset->asset_ = frameFile;
+        asset->data_ = reinterpret_cast<const uint8_t*>(buf);
+        asset->size_ = len;
+        return true;
+    }
+
+    if (len > fileBufSize_) {
+        delete [] fileBuf_;
+        fileBuf_ = new uint8_t[len];
+        fileBufSize_ = len;
+    }
+    int32_t bytes = AAsset_read(frameFile, fileBuf_, len);
+    AAsset_close(frameFile);
+    if (bytes <= 0) {
+        return false;
+    }
+    asset->data_ = fileBuf_;
+    asset->size_ = static_cast<size_t>(bytes);
+    return true;
+}
+
+void WebpDecoder::CloseAsset(AssetData* asset) {
+    if (asset->map_) {
+        munmap(asset->map_, asset->mapSize_);
+    }
+    if (asset->asset_) {
+        AAsset_close(asset->asset_);
+    }
+    memset(asset, 0, sizeof(*asset));
+}
+
+/*
+ * PublishRows():
+ *    Let the display see the top rows of the slot decoded so far
+ */
+void WebpDecoder::PublishRows(FrameSlot& slot, int32_t rows) {
+    if (slot.rowsReady_.load(std::memory_order_relaxed) == 0) {
+        totalFirstRowsUs_ += NowUs() - decodeStartUs_;
+    }
+    // pairs with the acquire load in GetPartialFrame(): the rows written
+    // before are visible once the count is seen
+    slot.rowsReady_.store(rows, std::memory_order_release);
+}
+
 /*
  * DecodeFrameInternal():
- *    Main decoding function from app side, and executing inside its own thread
+ *    Decode the next picture of the file list into the slot, executing inside
+ *    the decoding thread. Large files are fed to an incremental decoder a
+ *    chunk at a time, and the rows it completes are published as they come.
+ *    Pictures in the cache are not decoded: the slot points to the cached
+ *    pixels, or they are expanded into it if the cache keeps them packed.
  */
-void WebpDecoder::DecodeFrameInternal() {
+bool WebpDecoder::DecodeFrameInternal(FrameSlot& slot) {
     const char * webpFile = files_.front();
     files_.pop();
     files_.push(webpFile);
 
-    AAsset* frameFile = AAssetManager_open(assetMgr_, webpFile, AASSET_MODE_BUFFER);
-    assert(frameFile != NULL);
-    int32_t len = AAsset_getLength(frameFile);
-    uint8_t *buf = new uint8_t[len];
-    assert(buf);
-    len = AAsset_read(frameFile, buf, len);
-    assert(len > 0);
-    AAsset_close(frameFile);
+    // the geometry of the slot, window buffers may have their own stride
+    DecodeSurfaceDescriptor surface = bufInfo_;
+    surface.stride_ = slot.stride_;
+    size_t pixelCount = static_cast<size_t>(surface.stride_) * surface.height_;
+
+    if (cache_) {
+        bool rgb565 = false;
+        std::shared_ptr<const uint8_t> pixels =
+            cache_->Find(webpFile, surface, &rgb565);
+        if (pixels) {
+            if (rgb565) {
+                FrameCache::ExpandRgb565(
+                    reinterpret_cast<const uint16_t*>(pixels.get()), slot.buf_,
+                    pixelCount);
+            } else if (external_) {
+                memcpy(slot.buf_, pixels.get(), pixelCount * bytePerPix_);
+            } else {
+                slot.cached_ = pixels;
+                slot.frame_ = pixels.get();
+            }
+            PublishRows(slot, bufInfo_.height_);
+            return true;
+        }
+    }
+
+    AssetData asset;
+    if (!OpenAsset(webpFile, &asset)) {
+        assert(0);
+        return false;
+    }
 
     WebPDecoderConfig config;
     if (!WebPInitDecoderConfig(&config)) {
         assert(0);
     }
 
-    VP8StatusCode  status = WebPGetFeatures(buf, len, &config.input);
+    VP8StatusCode  status = WebPGetFeatures(asset.data_, asset.size_,
+                                            &config.input);
     assert(status == VP8_STATUS_OK);
 
     // let's decode it into a buffer ...
@@ -112,62 +414,79 @@ void WebpDecoder::DecodeFrameInternal() {
             break;
         default:
             assert( 0 );
-            delete  [] buf;
-            return;
+            CloseAsset(&asset);
+            return false;
     }
     config.output.width = bufInfo_.width_;
     config.output.height = bufInfo_.height_;
     config.output.is_external_memory = 1;
-    config.output.private_memory = reinterpret_cast<uint8_t*>(buf_);
-    config.output.u.RGBA.stride = bufInfo_.stride_ * bytePerPix_;
+    config.output.private_memory = slot.buf_;
+    config.output.u.RGBA.stride = slot.stride_ * bytePerPix_;
     config.output.u.RGBA.rgba  = config.output.private_memory;
     config.output.u.RGBA.size  = config.output.height *
                                  config.output.u.RGBA.stride;
 
-    status = WebPDecode(buf, len, &config);
+    if (asset.size_ < kIncrementalMinBytes) {
+        status = WebPDecode(asset.data_, asset.size_, &config);
+    } else {
+        WebPIDecoder* idec = WebPIDecode(nullptr, 0, &config);
+        assert(idec);
+        status = VP8_STATUS_SUSPENDED;
+        size_t fed = 0;
+        while (idec && status == VP8_STATUS_SUSPENDED && fed < asset.size_ &&
+               !stopPending_.load(std::memory_order_relaxed)) {
+            // the data stays in place, so the decoder does not copy it
+            fed = std::min(asset.size_, fed + kIncrementalChunkBytes);
+            status = WebPIUpdate(idec, asset.data_, fed);
+            int lastY = 0;
+            if ((status == VP8_STATUS_OK || status == VP8_STATUS_SUSPENDED) &&
+                WebPIDecGetRGB(idec, &lastY, nullptr, nullptr, nullptr) &&
+                lastY > slot.rowsReady_.load(std::memory_order_relaxed)) {
+                PublishRows(slot, lastY);
+            }
+        }
+        if (idec) {
+            WebPIDelete(idec);
+        }
+        incrementalFrames_++;
+    }
     WebPFreeDecBuffer(&config.output);
-    delete [] buf;
+    CloseAsset(&asset);
 
-    // only change state when it is decoded OK. Our small decoder engine will be
-    // in decoding state when error happens
-    assert(status == VP8_STATUS_OK);
-    if (status == VP8_STATUS_OK) {
-        state_ = state_ready;
+    // only publish the picture when it is decoded OK.
+    assert(status == VP8_STATUS_OK || stopPending_.load());
+    if (status != VP8_STATUS_OK) {
+        return false;
     }
-
-    delete worker_;
-    worker_ = nullptr;
-
-    // if we were asked to release while we are busy decoding (at this point,
-    // this is dangling pointer), we perform the release here to complete the
-    // request.
-    if (stopPending_) {
-        stopPending_ = false;
-        delete  this;
+    PublishRows(slot, bufInfo_.height_);
+    if (cache_) {
+        cache_->Insert(webpFile, surface, slot.buf_);
     }
+    return true;
 }
 
 /*
  * DecodeFrame(void):
- *     Start to decode a picture into internal frame memory
- *     The internal memory layout and size are the same as andriod native
- *     window to save copying when possible.
+ *     Start the decoding thread, which decodes pictures into the internal
+ *     frame memory ring until it is full, then one more each time a frame
+ *     is released. The internal memory layout and size are the same as
+ *     andriod native window to save copying when possible.
  *
  *     The decoded frames are scaled up/down by webp decoder to fix the display
  *     window size.
  */
 bool WebpDecoder::DecodeFrame(void) {
-    if (state_ == state_decoding)
+    if (started_ || !ring_)
         return false;
-    pthread_t       worker_;
     pthread_attr_t  attrib;
     pthread_attr_init( &attrib);
-    pthread_attr_setdetachstate(&attrib, PTHREAD_CREATE_DETACHED);
-    int status = pthread_create(&worker_, &attrib, ::DecodeFrame, this);
+    pthread_attr_setdetachstate(&attrib, external_ ? PTHREAD_CREATE_JOINABLE :
+                                                     PTHREAD_CREATE_DETACHED);
+    int status = pthread_create(&worker_, &attrib, ::DecodeLoop, this);
     pthread_attr_destroy(&attrib);
 
     if (status == 0) {
-        state_ = state_decoding;
+        started_ = true;
         return true;
     }
 
@@ -178,15 +497,23 @@ bool WebpDecoder::DecodeFrame(void) {
 
 /*
  * DestroyDecoder(void):
- *     Self-delete if decoder is idle
+ *     Self-delete if the decoding thread was never started, or once it is
+ *     stopped for external buffers: the caller may free them on return.
  *     Otherwise set up a flag to let decoding thread perform self-delete when
- *     it finishes. Upon returning from the function, the class pointer is invalid
+ *     it finishes the picture at hand. Upon returning from the function, the class pointer is invalid
  *     and should not be used
  */
 bool WebpDecoder::DestroyDecoder(void) {
-    if (state_ == state_decoding) {
-        stopPending_ = true;
-        return false;
+    if (started_) {
+        // the decoding thread may delete this as soon as it is woken up
+        bool external = external_;
+        // wake up the decoding thread if it waits for a free slot
+        stopPending_.store(true, std::memory_order_release);
+        sem_post(&freeSlots_);
+        if (!external) {
+            return false;
+        }
+        pthread_join(worker_, nullptr);
     }
 
     delete this;
@@ -197,7 +524,15 @@ bool WebpDecoder::DestroyDecoder(void) {
  * private destructor prevent object directly call delete
  */
 WebpDecoder::~WebpDecoder() {
-    if (buf_)  delete [] buf_;
-    buf_ = nullptr;
+    for (uint32_t i = 0; ring_ && !external_ && i < ringSize_; i++) {
+        delete [] ring_[i].buf_;
+    }
+    delete [] ring_;
+    ring_ = nullptr;
+    delete [] fileBuf_;
+    fileBuf_ = nullptr;
+    delete cache_;
+    cache_ = nullptr;
+    sem_destroy(&freeSlots_);
 }
 
@@ -15,10 +15,13 @@
  */
 #ifndef __WEBP_DECODE_H__
 #define __WEBP_DECODE_H__
+#include <atomic>
+#include <memory>
 #include <queue>
+#include <pthread.h>
+#include <semaphore.h>
 #include <android/asset_manager.h>
 
-enum DecodeState { state_idle, state_decoding, state_ready};
 enum class SurfaceFormat : unsigned int {
     SURFACE_FORMAT_RGBA_8888,
     SURFACE_FORMAT_RGBX_8888,
@@ -31,13 +34,52 @@ struct DecodeSurfaceDescriptor {
     SurfaceFormat format_;
 };
 
+class FrameCache;
+
+/*
+ * Decoder counters, times are in micro-seconds
+ */
+struct DecodeStats {
+    uint32_t framesDecoded_;
+    uint32_t framesDisplayed_;
+    uint32_t displayMisses_;   // display was due and no frame was ready
+    uint32_t lastDecodeUs_;
+    uint32_t avgDecodeUs_;
+    uint32_t maxDecodeUs_;
+    uint32_t avgFirstRowsUs_;  // from decode start to the first rows out
+    uint32_t mappedFrames_;    // compressed bytes mapped, not copied
+    uint32_t incrementalFrames_;
+    uint32_t cacheHits_;       // pictures taken from the decoded cache
+    uint32_t cacheMisses_;
+    uint32_t cacheEvictions_;
+    uint32_t cacheEntries_;
+    size_t   cacheBytes_;
+    uint32_t ringSize_;
+    uint32_t readyFrames_;     // decoded frames waiting in the ring now
+    float    avgReadyFrames_;  // ring occupancy seen by the display
+};
+
 /*
  * Webp decoder wrapper:
- *     Select a picture to decode in its own thread. The thread is deleted
- *     once a picture is decoded into its internal memory. The next picture
- *     will be decoded when:
- *       - the decoded frame is retrieved
- *       - Another DecodeFrame() is called [this is trigger]
+ *     A decoding thread decodes pictures ahead of the display into a ring of
+ *     surfaces, going round the file list. Each ring slot is either free or
+ *     ready; the decoding thread publishes a slot ready with a release store
+ *     and the display thread hands it back free the same way, so neither
+ *     side takes a lock. The decoding thread only sleeps when every slot is
+ *     ready.
+ *     Asset files stored uncompressed in the apk are mapped rather than read;
+ *     large ones are decoded incrementally, publishing rows as they come out
+ *     so the first picture can be shown before it is complete.
+ *     Decoded pictures are kept in a FrameCache within a byte budget, so the
+ *     next rounds of the file list are not decoded again: a cached picture
+ *     is displayed straight from the cache, or expanded from RGB565 when
+ *     the cache keeps it packed.
+ *     Created with no surfaces ahead, the decoder owns no surface at all: it
+ *     decodes each picture into the buffer given to DecodeInto(), normally a
+ *     locked window buffer, so nothing is copied on the way to the screen.
+ *       - DecodeFrame() starts the decoding thread
+ *       - GetDecodedFrame() returns the oldest ready frame
+ *       - ReleaseFrame() hands that frame back once it is displayed
  *    when display format changes, call DestroyDecoder() to release this decoder
  *    and allocate a new deocder object.
  */
@@ -45,32 +87,102 @@ class WebpDecoder {
   public:
     explicit WebpDecoder(const char** files, uint32_t count,
                          DecodeSurfaceDescriptor* surfDesc,
-                         AAssetManager* assetMgr);
-    // Start decode a picture
+                         AAssetManager* assetMgr,
+                         uint32_t aheadCount = kDefaultAheadCount,
+                         size_t cacheBytes = kDefaultCacheBytes,
+                         bool cacheRgb565 = false);
+    // Start decoding pictures ahead
     bool     DecodeFrame(void);
 
+    // Decoders created with no surfaces ahead only: decode the next picture
+    // into dst, stride in pixels, which must stay valid until the picture is
+    // released or the decoder destroyed. GetDecodedFrame() returns dst once
+    // the picture is in.
+    bool     DecodeInto(uint8_t* dst, int32_t stride);
+
     // Poll to see if a picture is decoded and ready to be used/displayed
-    uint8_t *GetDecodedFrame(void);
+    const uint8_t *GetDecodedFrame(void);
+
+    // Poll the picture GetDecodedFrame() returns next while it is decoded:
+    // the rows at its top already decoded. nullptr if there are none yet.
+    const uint8_t *GetPartialFrame(int32_t* rows);
 
-    // WebpDecoder internal decoding function, no called from user
-    void     DecodeFrameInternal(void);
+    // Done with the picture from GetDecodedFrame(), decode the next one into it
+    void     ReleaseFrame(void);
 
-    // Release this decoder after usage
+    void     GetStats(DecodeStats* stats) const;
+
+    // WebpDecoder internal decoding thread function, no called from user
+    void     DecodeLoop(void);
+
+    // Release this decoder after usage. A decoder with no surfaces ahead is
+    // released right away, once it stops writing into the DecodeInto() buffer
     bool     DestroyDecoder(void);
 
+    static const uint32_t kDefaultAheadCount = 3;
+    // decode files from that size on incrementally, that many bytes at a time
+    static const size_t kIncrementalMinBytes = 64 * 1024;
+    static const size_t kIncrementalChunkBytes = 16 * 1024;
+    // decoded pictures cache budget, 0 for no cache
+    static const size_t kDefaultCacheBytes = 32 * 1024 * 1024;
+
   private:
+    enum SlotState : uint32_t { slot_free, slot_ready };
+    struct FrameSlot {
+        uint8_t* buf_;
+        int32_t  stride_;                 // of buf_, in pixels
+        const uint8_t* frame_;            // buf_, or pixels in the cache
+        std::shared_ptr<const uint8_t> cached_;
+        std::atomic<uint32_t> state_;
+        std::atomic<int32_t>  rowsReady_;  // rows of buf_ already decoded
+    };
+    // compressed bytes of an asset file
+    struct AssetData {
+        const uint8_t* data_;
+        size_t         size_;
+        void*          map_;      // mmap() of the apk range, if mapped
+        size_t         mapSize_;
+        AAsset*        asset_;    // open while data_ points into its buffer
+    };
+    bool     OpenAsset(const char* file, AssetData* asset);
+    void     CloseAsset(AssetData* asset);
+    bool     DecodeFrameInternal(FrameSlot& slot);
+    void     PublishRows(FrameSlot& slot, int32_t rows);
+
     DecodeSurfaceDescriptor bufInfo_;
     AAssetManager*          assetMgr_;
-    std::queue<const char*> files_;
-    uint8_t*  buf_;
-    bool      stopPending_;
-    DecodeState state_;
+    std::queue<const char*> files_;   // decoding thread only
+    uint8_t*   fileBuf_;              // decoding thread only: assets read
+    size_t     fileBufSize_;          // when they can't be mapped
+    uint64_t   decodeStartUs_;        // decoding thread only
+    FrameCache* cache_;               // decoding thread only, but stats
+
+    FrameSlot* ring_;
+    uint32_t   ringSize_;
+    uint32_t   writeIdx_;             // decoding thread only
+    uint32_t   readIdx_;              // display thread only
+    sem_t      freeSlots_;
+    std::atomic<bool> stopPending_;
+    bool       started_;
+    bool       external_;             // slots are DecodeInto() buffers
+    bool       waitingFrame_;         // display thread only
 
     uint32_t   bytePerPix_;
-    pthread_t* worker_;
+    pthread_t  worker_;
+
+    std::atomic<uint32_t> framesDecoded_;
+    std::atomic<uint32_t> framesDisplayed_;
+    std::atomic<uint32_t> displayMisses_;
+    std::atomic<uint32_t> lastDecodeUs_;
+    std::atomic<uint32_t> maxDecodeUs_;
+    std::atomic<uint64_t> totalDecodeUs_;
+    std::atomic<uint64_t> totalFirstRowsUs_;
+    std::atomic<uint32_t> mappedFrames_;
+    std::atomic<uint32_t> incrementalFrames_;
+    std::atomic<uint64_t> readySamples_;
     /*
      * private destructor prevent object directly call delete
      */
     ~WebpDecoder();
 };
-#endif // __WEBP_DECODE_H__
\ No newline at end of file
+#endif // __WEBP_DECODE_H__
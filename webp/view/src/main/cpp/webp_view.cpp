@@ -39,6 +39,14 @@ const char * frames[] = {
 const int kFRAME_COUNT = sizeof(frames) / sizeof(frames[0]);
 const int kFRAME_DISPLAY_TIME = 2;
 
+/*
+ * Decode pictures straight into the window buffers: the next window buffer
+ * stays locked while the current one is shown, and the decoder writes into
+ * it. Otherwise pictures are decoded ahead into decoder surfaces and copied
+ * into the window when shown.
+ */
+const bool kDECODE_TO_WINDOW = true;
+
 /*
  * main object handles Android window frame update, and use webp to decode
  * pictures
@@ -48,16 +56,26 @@ class Engine {
     explicit Engine(android_app* app) :
                 app_(app),
                 decoder_(nullptr),
-                animating_(false) {
+                animating_(false),
+                firstFrame_(true),
+                partialRows_(0),
+                decodeToWindow_(false),
+                copyToWindow_(false),
+                targetLocked_(false) {
         memset(&frameStartTime_, 0, sizeof(frameStartTime_));
+        memset(&surface_, 0, sizeof(surface_));
     }
 
-    ~Engine() {}
+    ~Engine() {
+        DestroyDecoder();
+        ReleaseTarget();
+    }
 
     struct android_app* AndroidApp(void) const { return app_; }
     void StartAnimation(bool start) { animating_ = start; }
     bool IsAnimating(void) const { return animating_; }
-    void TerminateDisplay(void) { StartAnimation(false); }
+    // stop animating; give back the window buffer decoded into, if any
+    void TerminateDisplay(void);
 
      // PrepareDrawing(): Initialize the Engine with current native window geometry
      //   and blank current screen to avoid garbbage displaying on device
@@ -68,10 +86,21 @@ class Engine {
     bool UpdateDisplay(void);
 
   private:
-    void UpdateFrameBuffer(ANativeWindow_Buffer* buf, uint8_t* src);
+    void UpdateFrameBuffer(ANativeWindow_Buffer* buf, const uint8_t* src,
+                           int32_t rows = -1);
+    bool UpdatePartialDisplay(void);
+    bool LockTarget(void);
+    void ReleaseTarget(void);
+    void DestroyDecoder(void);
     struct android_app* app_;
     WebpDecoder* decoder_;
     bool animating_;
+    bool firstFrame_;       // nothing but a blank screen shown yet
+    int32_t partialRows_;   // rows of the first picture on screen
+    bool decodeToWindow_;   // the decoder writes into window buffers
+    bool copyToWindow_;     // decoding into this window failed, copy instead
+    bool targetLocked_;     // a window buffer is locked for the decoder
+    DecodeSurfaceDescriptor surface_;
     struct timespec frameStartTime_;
 };
 
@@ -167,11 +196,80 @@ extern "C" void android_main(struct android_app* state) {
 }
 
 // Engine class implementations
+void Engine::DestroyDecoder(void) {
+    if (!decoder_) {
+        return;
+    }
+    DecodeStats stats;
+    decoder_->GetStats(&stats);
+    LOGI("Decoded %u frames in %u us avg, %u us max, first rows after "
+         "%u us avg; %u mapped, %u incremental; cache %u hits %u misses "
+         "%u evictions, %u frames in %zu bytes; %u displayed, %u late, "
+         "%.2f of %u frames ready on average",
+         stats.framesDecoded_, stats.avgDecodeUs_, stats.maxDecodeUs_,
+         stats.avgFirstRowsUs_, stats.mappedFrames_,
+         stats.incrementalFrames_, stats.cacheHits_, stats.cacheMisses_,
+         stats.cacheEvictions_, stats.cacheEntries_, stats.cacheBytes_,
+         stats.framesDisplayed_,
+         stats.displayMisses_, stats.avgReadyFrames_, stats.ringSize_);
+    // when decoding into the window, this waits until the decoder stops
+    // writing into the locked buffer
+    decoder_->DestroyDecoder();
+    decoder_ = nullptr;
+}
+
+void Engine::TerminateDisplay(void) {
+    StartAnimation(false);
+    if (targetLocked_) {
+        DestroyDecoder();
+        ReleaseTarget();
+    }
+    // the next window gets another try at decoding into its buffers
+    copyToWindow_ = false;
+}
+
+/*
+ * LockTarget():
+ *     Lock the next window buffer and have the decoder decode the next
+ *     picture into it, while the buffer posted last is on screen
+ */
+bool Engine::LockTarget(void) {
+    ANativeWindow_Buffer buffer;
+    // no dirty rectangle: the whole buffer is rewritten, so nothing of the
+    // previous buffer is copied back into it
+    if (ANativeWindow_lock(app_->window, &buffer, nullptr) < 0) {
+        LOGW("Unable to lock window buffer to decode into");
+        return false;
+    }
+    if (buffer.width != surface_.width_ || buffer.height != surface_.height_ ||
+        buffer.stride < buffer.width ||
+        !decoder_->DecodeInto(reinterpret_cast<uint8_t*>(buffer.bits),
+                              buffer.stride)) {
+        // nothing will be decoded into this buffer: post it blank, and go
+        // back to decoding into surfaces of our own rather than failing
+        // again on every frame
+        LOGW("Unable to decode into window buffer, copying pictures instead");
+        UpdateFrameBuffer(&buffer, nullptr);
+        ANativeWindow_unlockAndPost(app_->window);
+        copyToWindow_ = true;
+        PrepareDrawing();
+        return false;
+    }
+    targetLocked_ = true;
+    return true;
+}
+
+void Engine::ReleaseTarget(void) {
+    if (targetLocked_ && app_->window) {
+        ANativeWindow_unlockAndPost(app_->window);
+    }
+    targetLocked_ = false;
+}
+
 bool Engine::PrepareDrawing(void) {
     // create decoder
-    if (decoder_) {
-        decoder_->DestroyDecoder();
-    }
+    DestroyDecoder();
+    ReleaseTarget();
     ANativeWindow_Buffer buf;
     if (ANativeWindow_lock(app_->window, &buf, NULL) < 0) {
         LOGW("Unable to lock window buffer to create decoder");
@@ -179,6 +277,8 @@ bool Engine::PrepareDrawing(void) {
     }
     UpdateFrameBuffer(&buf, nullptr);
     ANativeWindow_unlockAndPost(app_->window);
+    firstFrame_ = true;
+    partialRows_ = 0;
     DecodeSurfaceDescriptor descriptor;
     switch (buf.format) {
         case  WINDOW_FORMAT_RGB_565:
@@ -195,14 +295,22 @@ bool Engine::PrepareDrawing(void) {
     descriptor.width_  = buf.width;
     descriptor.height_ = buf.height;
     descriptor.stride_ = buf.stride;
+    surface_ = descriptor;
 
+    // decoding into the window, the decoder needs no surface of its own
+    decodeToWindow_ = kDECODE_TO_WINDOW && !copyToWindow_;
     decoder_ = new WebpDecoder(frames, kFRAME_COUNT, &descriptor,
-                               app_->activity->assetManager);
+                               app_->activity->assetManager,
+                               decodeToWindow_ ? 0 :
+                                   WebpDecoder::kDefaultAheadCount);
     assert(decoder_);
     if (!decoder_) {
         return false;
     }
     decoder_->DecodeFrame();
+    if (decodeToWindow_) {
+        LockTarget();
+    }
 
     return true;
 }
@@ -211,11 +319,16 @@ bool Engine::PrepareDrawing(void) {
  * Only copy decoded webp picture when:
  *  - current frame has been on for kFrame_DISPLAY_TIME seconds
  *  - a new picture is decoded
- * After copying, start decoding the next frame
+ * After copying, hand the frame back to the decoder to decode ahead into.
+ * When decoding into the window, the picture is in the locked window buffer
+ * already: post it, and lock the next buffer for the next picture.
  */
 bool Engine::UpdateDisplay(void) {
     if (!app_->window || !decoder_) {
-        assert(0);
+        // no decoder between TerminateDisplay() and PrepareDrawing()
+        return false;
+    }
+    if (decodeToWindow_ && !targetLocked_ && !LockTarget()) {
         return false;
     }
     struct timespec curTime;
@@ -225,9 +338,19 @@ bool Engine::UpdateDisplay(void) {
         // current frame is displayed less than required duration
         return false;
     }
-    uint8_t *frame = decoder_->GetDecodedFrame();
+    const uint8_t *frame = decoder_->GetDecodedFrame();
     if (!frame)
-        return false;
+        return UpdatePartialDisplay();
+
+    if (decodeToWindow_) {
+        ANativeWindow_unlockAndPost(app_->window);
+        targetLocked_ = false;
+        clock_gettime(CLOCK_MONOTONIC, &frameStartTime_);
+        firstFrame_ = false;
+        decoder_->ReleaseFrame();
+        LockTarget();
+        return true;
+    }
 
     ANativeWindow_Buffer buffer;
     if (ANativeWindow_lock(app_->window, &buffer, nullptr) < 0) {
@@ -237,9 +360,36 @@ bool Engine::UpdateDisplay(void) {
     UpdateFrameBuffer(&buffer, frame);
     ANativeWindow_unlockAndPost(app_->window);
     clock_gettime(CLOCK_MONOTONIC, &frameStartTime_);
+    firstFrame_ = false;
 
-    // start decoding next frame
-    decoder_->DecodeFrame();
+    // the picture is on screen, let the decoder reuse its surface
+    decoder_->ReleaseFrame();
+    return true;
+}
+
+/*
+ * While the screen is still blank, show the top of the first picture as
+ * its rows are decoded instead of waiting for all of it
+ */
+bool Engine::UpdatePartialDisplay(void) {
+    // decoding into the window, the window buffer can't be posted until the
+    // picture is all in
+    if (!firstFrame_ || decodeToWindow_) {
+        return false;
+    }
+    int32_t rows = 0;
+    const uint8_t *frame = decoder_->GetPartialFrame(&rows);
+    if (!frame || rows <= partialRows_) {
+        return false;
+    }
+    ANativeWindow_Buffer buffer;
+    if (ANativeWindow_lock(app_->window, &buffer, nullptr) < 0) {
+        LOGW("Unable to lock window buffer");
+        return false;
+    }
+    UpdateFrameBuffer(&buffer, frame, rows);
+    ANativeWindow_unlockAndPost(app_->window);
+    partialRows_ = rows;
     return true;
 }
 
@@ -249,10 +399,13 @@ bool Engine::UpdateDisplay(void) {
  *     src:
  *        - if nullptr, blank it
  *        - otherwise,  copy to given buf
+ *     rows: if not negative, only copy that many rows of src and blank
+ *           the rest
  *     assumption:
  *         src and bug MUST be in the same geometry format & layout
  */
-void Engine::UpdateFrameBuffer(ANativeWindow_Buffer* buf, uint8_t* src) {
+void Engine::UpdateFrameBuffer(ANativeWindow_Buffer* buf, const uint8_t* src,
+                               int32_t rows) {
     // src is either null: to blank the screen
     //     or holding exact pixels with the same fmt [stride is the SAME]
     uint8_t *dst = reinterpret_cast<uint8_t*> (buf->bits);
@@ -272,15 +425,17 @@ void Engine::UpdateFrameBuffer(ANativeWindow_Buffer* buf, uint8_t* src) {
     uint32_t stride, width;
     stride = buf->stride * bpp;
     width = buf->width * bpp;
+    int32_t copyRows = 0;
     if (src) {
-        for (auto height =0; height < buf->height; ++height) {
-            memcpy(dst, src, width);
-            dst += stride, src += stride;
-        }
-    } else {
-        for (auto height =0; height < buf->height; ++height) {
-            memset(dst, 0, width);
-            dst += stride;
-        }
+        copyRows = (rows < 0 || rows > buf->height) ? buf->height : rows;
+    }
+    auto height = 0;
+    for (; height < copyRows; ++height) {
+        memcpy(dst, src, width);
+        dst += stride, src += stride;
+    }
+    for (; height < buf->height; ++height) {
+        memset(dst, 0, width);
+        dst += stride;
     }
 }